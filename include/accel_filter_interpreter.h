@@ -4,7 +4,10 @@
 
 #include <math.h>
 
+#include <map>
 #include <memory>
+#include <mutex>
+#include <vector>
 #include <gtest/gtest.h>  // for FRIEND_TEST
 
 #include "gestures/include/filter_interpreter.h"
@@ -20,8 +23,12 @@ namespace gestures {
 // This interpreter provides pointer and scroll acceleration based on
 // an acceleration curve and the user's sensitivity setting.
 
-class AccelFilterInterpreter : public FilterInterpreter {
+class AccelFilterInterpreter : public FilterInterpreter,
+                               public PropertyDelegate {
+  FRIEND_TEST(AccelFilterInterpreterTest, BakedCurvesTest);
+  FRIEND_TEST(AccelFilterInterpreterTest, BakedCustomCurveTest);
   FRIEND_TEST(AccelFilterInterpreterTest, CustomAccelTest);
+  FRIEND_TEST(AccelFilterInterpreterTest, SharedCurveTableTest);
   FRIEND_TEST(AccelFilterInterpreterTest, SimpleTest);
   FRIEND_TEST(AccelFilterInterpreterTest, TimingTest);
   FRIEND_TEST(AccelFilterInterpreterTest, TinyMoveTest);
@@ -35,6 +42,14 @@ class AccelFilterInterpreter : public FilterInterpreter {
 
   virtual void ConsumeGesture(const Gesture& gs);
 
+  virtual void BoolWasWritten(BoolProperty* prop);
+  virtual void DoubleArrayWasWritten(DoubleArrayProperty* prop);
+  virtual void IntWasWritten(IntProperty* prop);
+
+ protected:
+  virtual void SaveOwnState(StateWriter* writer) const;
+  virtual void RestoreOwnState(StateReader* reader);
+
  private:
   struct CurveSegment {
     CurveSegment() : x_(INFINITY), sqr_(0.0), mul_(1.0), int_(0.0) {}
@@ -50,6 +65,64 @@ class AccelFilterInterpreter : public FilterInterpreter {
     double int_;  // Intercept of line
   };
 
+  // A curve's ratio of output to input speed, sampled densely at evenly
+  // spaced speeds, so that it's found with an index and a lerp rather than by
+  // walking the segments and dividing. Interpreters whose curves are the same
+  // share a table.
+  class CurveTable {
+   public:
+    // Returns the table for the first |count| segments of |segs|, baking it
+    // unless it's in use already.
+    static std::shared_ptr<const CurveTable> Get(const CurveSegment* segs,
+                                                 size_t count);
+
+    // Sets |*ratio| for speed |mag| and returns true, or returns false if
+    // |mag| is outside the table: slower than its first sample, where the
+    // ratio may be singular, or past its last.
+    bool Lookup(float mag, float* ratio) const {
+      float pos = mag * inv_step_;
+      if (!(pos >= 1.0f && pos < max_pos_))
+        return false;
+      size_t i = static_cast<size_t>(pos);
+      float frac = pos - i;
+      *ratio = ratios_[i] + (ratios_[i + 1] - ratios_[i]) * frac;
+      return true;
+    }
+
+    size_t size() const { return ratios_.size(); }
+
+   private:
+    CurveTable(const CurveSegment* segs, size_t count);
+
+    // The key a table is shared under: its segments' members.
+    typedef std::vector<double> Key;
+    static std::mutex tables_lock_;
+    static std::map<Key, std::weak_ptr<const CurveTable> > tables_;
+
+    std::vector<float> ratios_;
+    float inv_step_;
+    // The last sample's position, as Lookup() computes it.
+    float max_pos_;
+
+    DISALLOW_COPY_AND_ASSIGN(CurveTable);
+  };
+
+  // The curves in use, per the properties, and how many segments they have.
+  CurveSegment* PointCurve(size_t* max_segs);
+  CurveSegment* ScrollCurve(size_t* max_segs);
+
+  // Sets |*ratio| to that of the segment of |segs| that |mag| falls in.
+  // Returns false if it falls in none.
+  static bool CurveRatio(const CurveSegment* segs, size_t max_segs, float mag,
+                         float* ratio);
+
+  // Bakes the curves in use into tables, or drops the tables if baking is
+  // off.
+  void BakeCurves();
+  // Calls BakeCurves() if a property that picks or shapes the curves has
+  // been written since they were last baked.
+  void BakeCurvesIfWritten();
+
   static const size_t kMaxCurveSegs = 3;
   static const size_t kMaxCustomCurveSegs = 20;
   static const size_t kMaxAccelCurves = 5;
@@ -117,6 +190,21 @@ class AccelFilterInterpreter : public FilterInterpreter {
   stime_t last_end_time_;
   float last_mags_[2];
   size_t last_mags_size_;
+
+  // If set, the curves in use are baked into lookup tables.
+  BoolProperty use_baked_curves_;
+  // Bumped whenever a property that picks or shapes the curves is written,
+  // custom curves' segments included, and the generation they were last
+  // baked at.
+  unsigned curves_generation_;
+  unsigned baked_generation_;
+  // The baked tables, and where the curves they were baked from are. A curve
+  // picked by a property changed without being written isn't the baked one,
+  // so it's evaluated segment by segment.
+  std::shared_ptr<const CurveTable> point_table_;
+  std::shared_ptr<const CurveTable> scroll_table_;
+  const CurveSegment* baked_point_curve_;
+  const CurveSegment* baked_scroll_curve_;
 };
 
 }  // namespace gestures
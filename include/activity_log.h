@@ -7,6 +7,9 @@
 
 #include "gestures/include/gestures.h"
 
+#include <stdint.h>
+
+#include <memory>
 #include <string>
 
 #include <gtest/gtest.h>  // For FRIEND_TEST
@@ -49,6 +52,10 @@ class ActivityLog {
       // No string because string values can't change
     } value;
   };
+  // A decoded view of one logged entry. Only the member for |type| is set.
+  // For kHardwareState, hwstate.fingers points into the log's buffer and is
+  // only valid until the next call that logs or clears, as logging may grow
+  // the buffer and move every record.
   struct Entry {
     EntryType type;
     struct details {
@@ -59,7 +66,60 @@ class ActivityLog {
     } details;
   };
 
+  // Binary log format, as written by EncodeBinary(). Values are in native
+  // byte order. A log is a BinaryHeader, then the HardwareProperties, the
+  // property values as JSON text and the gestures version string, each
+  // padded to kRecordAlign bytes. Then there's a record per entry: a
+  // RecordHeader followed by the payload for its type, padded likewise.
+  //   kHardwareState: BinaryHardwareState then finger_cnt FingerStates
+  //   kTimerCallback, kCallbackRequest: stime_t
+  //   kGesture: Gesture
+  //   kPropChange: BinaryPropChange then the NUL-terminated property name
+  struct BinaryHeader {
+    char magic[8];  // kBinaryMagic
+    uint32_t version;  // kBinaryVersion
+    // Sizes of structs stored as is, which a reader must match.
+    uint32_t hwprops_size;
+    uint32_t finger_state_size;
+    uint32_t gesture_size;
+    // Lengths of the properties JSON and version string, without padding.
+    uint32_t properties_size;
+    uint32_t gestures_version_size;
+  };
+  struct RecordHeader {
+    uint32_t size;  // Including the header. A multiple of kRecordAlign.
+    uint32_t type;  // EntryType
+  };
+  // HardwareState without the fingers pointer, for a stable layout.
+  struct BinaryHardwareState {
+    stime_t timestamp;
+    int32_t buttons_down;
+    uint16_t finger_cnt;
+    uint16_t touch_cnt;
+    float rel_x;
+    float rel_y;
+    float rel_wheel;
+    float rel_wheel_hi_res;
+    float rel_hwheel;
+    uint32_t reserved;
+    stime_t msc_timestamp;
+  };
+  struct BinaryPropChange {
+    uint32_t type;  // PropChangeEntry's type
+    uint32_t reserved;
+    union {
+      int32_t bool_val;
+      double double_val;
+      int32_t int_val;
+      int16_t short_val;
+    } value;
+  };
+  static const char kBinaryMagic[8];
+  static const uint32_t kBinaryVersion = 1;
+  static const size_t kRecordAlign = 8;
+
   explicit ActivityLog(PropRegistry* prop_reg);
+  ~ActivityLog();
   void SetHardwareProperties(const HardwareProperties& hwprops);
 
   // Log*() functions record an argument into the buffer
@@ -71,20 +131,47 @@ class ActivityLog {
 
   // Dump allocates, and thus must not be called on a signal handler.
   void Dump(const char* filename);
-  void Clear() { head_idx_ = size_ = 0; }
+  void Clear();
+  // Replaces the contents of this log with a copy of |that|'s entries,
+  // hardware properties, and current property values, so it can be encoded
+  // independently of |that|. Only the occupied part of the buffer is copied.
+  void CopyFrom(const ActivityLog& that);
 
   // Returns a JSON string representing all the state in the buffer
   std::string Encode();
+  // Returns the same state in the binary format described above, which is
+  // much faster to produce and to parse.
+  std::string EncodeBinary();
   void AddEncodeInfo(Json::Value* root);
   Json::Value EncodeCommonInfo();
+  // Stream the same members that EncodeCommonInfo() and AddEncodeInfo()
+  // produce into the object currently open in |writer|, one entry at a time,
+  // so that no Json::Value is built for the log itself. Only defined for
+  // JsonStreamWriter; the Json encoders use these with a JsonValueWriter.
+  template<typename Writer> void WriteCommonInfo(Writer* writer);
+  template<typename Writer> void WriteEncodeInfo(Writer* writer);
   size_t size() const { return size_; }
-  size_t MaxSize() const { return kBufferSize; }
-  Entry* GetEntry(size_t idx) {
-    return &buffer_[(head_idx_ + idx) % kBufferSize];
-  }
+  // Bytes of the buffer occupied by entries, currently allocated, and at
+  // most allocated. The buffer starts out empty and grows as entries are
+  // logged; Clear() releases it.
+  size_t BytesUsed() const;
+  size_t BytesAllocated() const { return capacity_; }
+  size_t MaxBytes() const { return kBufferSize; }
+  // Fast when called with increasing |idx|, as when walking the log.
+  Entry GetEntry(size_t idx);
 
   static const char kKeyInterpreterName[];
   static const char kKeyNext[];
+  static const char kKeyLatencyStats[];
+  static const char kKeyLatencySync[];
+  static const char kKeyLatencyTimer[];
+  static const char kKeyGestureTypeMemo[];
+  static const char kKeyMemoHits[];
+  static const char kKeyMemoMisses[];
+  static const char kKeyInputQueueDelay[];
+  static const char kKeyQueueDelay[];
+  static const char kKeyReportInterval[];
+  static const char kKeyDownstreamTime[];
   static const char kKeyRoot[];
   static const char kKeyType[];
   static const char kKeyHardwareState[];
@@ -191,41 +278,76 @@ class ActivityLog {
   static const char kKeyProperties[];
 
  private:
-  // Extends the tail of the buffer by one element and returns that new element.
-  // This may cause an older element to be overwritten if the buffer is full.
-  Entry* PushBack();
+  // Entries are stored back to back in a ring of bytes, each as a
+  // RecordHeader followed by the payload for its type. A HardwareState is
+  // followed by only the fingers it has. Records never straddle the end of
+  // the ring; if one doesn't fit there, a wrap record is left behind and it
+  // goes at the front.
+  static const uint32_t kWrapRecord = 0xffffffff;
 
-  size_t TailIdx() const { return (head_idx_ + size_ - 1) % kBufferSize; }
+  // Makes room for a record with |payload_size| bytes at the tail of the
+  // buffer, dropping the oldest records as needed, and returns its payload.
+  char* PushBack(EntryType type, size_t payload_size);
+  // Drops the oldest record.
+  void PopFront();
+  // Doubles the size of the buffer, up to kBufferSize.
+  void Grow();
+  RecordHeader* HeaderAt(size_t offset) const {
+    return reinterpret_cast<RecordHeader*>(&buffer_[offset]);
+  }
+  // Returns the offset of the record after the one at |offset|.
+  size_t NextRecord(size_t offset) const;
+  void DecodeRecord(size_t offset, Entry* out) const;
 
-  // JSON-encoders for various types
-  Json::Value EncodeHardwareProperties() const;
-  Json::Value EncodeHardwareState(const HardwareState& hwstate);
-  Json::Value EncodeTimerCallback(stime_t timestamp);
-  Json::Value EncodeCallbackRequest(stime_t timestamp);
-  Json::Value EncodeGesture(const Gesture& gesture);
-  Json::Value EncodePropChange(const PropChangeEntry& prop_change);
+  // JSON-encoders for various types. |writer| is a JsonStreamWriter, or a
+  // JsonValueWriter to build a Json::Value.
+  template<typename Writer>
+  void WriteHardwareProperties(Writer* writer) const;
+  template<typename Writer>
+  void WriteHardwareState(Writer* writer, const HardwareState& hwstate);
+  template<typename Writer>
+  void WriteTimerCallback(Writer* writer, stime_t timestamp);
+  template<typename Writer>
+  void WriteCallbackRequest(Writer* writer, stime_t timestamp);
+  template<typename Writer>
+  void WriteGesture(Writer* writer, const Gesture& gesture);
+  template<typename Writer>
+  void WritePropChange(Writer* writer, const PropChangeEntry& prop_change);
 
   // Encode user-configurable properties
-  Json::Value EncodePropRegistry();
+  Json::Value EncodePropRegistry() const;
 
+  // Maximum size of the ring in bytes. A one finger HardwareState takes
+  // about 100 bytes and a timer callback 16.
 #ifdef GESTURES_LARGE_LOGGING_BUFFER
-  static const size_t kBufferSize = 65536;
+  static const size_t kBufferSize = 8 * 1024 * 1024;
 #else
-  static const size_t kBufferSize = 8192;
+  static const size_t kBufferSize = 1024 * 1024;
 #endif
+  // Size of the ring when first allocated. Fits a record with kMaxFingers.
+  static const size_t kInitialBufferSize = 16 * 1024;
+
+  // More fingers than this in a HardwareState is surely bogus, so such
+  // states are logged without their fingers.
+  static const size_t kMaxFingers = 255;
 
-  Entry buffer_[kBufferSize];
-  size_t head_idx_;
-  size_t size_;
+  std::unique_ptr<char[]> buffer_;
+  size_t capacity_;  // Size of buffer_
+  size_t head_;  // Offset of the oldest record
+  size_t tail_;  // Offset just past the newest record
+  size_t size_;  // Number of records, not counting wrap records
 
-  // We allocate this to be number of entries * max fingers/entry, and
-  // if buffer_[i] is a kHardwareState type, then the fingers for it are
-  // at finger_states_[i * (max fingers/entry)].
-  std::unique_ptr<FingerState[]> finger_states_;
-  size_t max_fingers_;
+  // Where GetEntry() last found a record, so that walking the log in order
+  // doesn't rescan it from the head each time. |dropped_| counts records
+  // popped off the front, so that indices stay comparable across pops.
+  size_t dropped_;
+  size_t cursor_idx_;  // dropped_ + idx, as of the lookup
+  size_t cursor_offset_;
 
   HardwareProperties hwprops_;
   PropRegistry* prop_reg_;
+  // Property values copied by CopyFrom(), used when there's no registry
+  Json::Value properties_;
 };
 
 }  // namespace gestures
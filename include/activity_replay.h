@@ -5,10 +5,10 @@
 #ifndef GESTURES_ACTIVITY_REPLAY_H_
 #define GESTURES_ACTIVITY_REPLAY_H_
 
-#include <deque>
 #include <string>
 #include <memory>
 #include <set>
+#include <vector>
 
 #include <json/value.h>
 
@@ -16,11 +16,12 @@
 #include "gestures/include/gestures.h"
 #include "gestures/include/interpreter.h"
 
-// This class can parse a JSON log, as generated by ActivityLog and replay
-// it on an interpreter.
+// This class can parse a JSON or binary log, as generated by ActivityLog and
+// replay it on an interpreter.
 
 namespace gestures {
 
+class BinaryLogReader;
 class PropRegistry;
 
 class ActivityReplay : public GestureConsumer {
@@ -30,13 +31,60 @@ class ActivityReplay : public GestureConsumer {
   bool Parse(const std::string& data);
   // An empty set means honor all properties
   bool Parse(const std::string& data, const std::set<std::string>& honor_props);
+  // Parses a log in ActivityLog's binary format. Parse() calls this if
+  // |data| starts with the binary magic.
+  bool ParseBinary(const std::string& data,
+                   const std::set<std::string>& honor_props);
+  // Takes the hardware properties, property values and version from the
+  // binary log read by |reader|, without reading its entries. Use with
+  // ReplayBinary() to replay logs too long to load into log().
+  bool ParseBinaryInfo(const BinaryLogReader& reader,
+                       const std::set<std::string>& honor_props);
+
+  // Mismatches between the gestures produced during the last replay and
+  // those in the log.
+  struct GestureDiff {
+    GestureDiff() : matched(0), missing(0), unexpected(0) {}
+    size_t matched;
+    size_t missing;  // Logged, but not produced
+    size_t unexpected;  // Produced, but not logged
+    // A line per mismatch, in log order: "- " and the missing gesture, or
+    // "+ " and the unexpected one.
+    std::vector<std::string> lines;
+  };
 
   // If there is any unexpected behavior, replay continues, but EXPECT_*
-  // reports failure, otherwise no failure is reported.
+  // reports failure (see set_report_failures()), otherwise no failure is
+  // reported.
   void Replay(Interpreter* interpreter, MetricsProperties* mprops);
+  // Like Replay(), but reads entries from |reader|, starting at its first
+  // record, rather than log(). Returns false if the log is malformed.
+  bool ReplayBinary(BinaryLogReader* reader, Interpreter* interpreter,
+                    MetricsProperties* mprops);
 
   virtual void ConsumeGesture(const Gesture& gesture);
 
+  const GestureDiff& gesture_diff() const { return gesture_diff_; }
+  // If false, mismatched gestures are only recorded in gesture_diff(), not
+  // reported as gtest failures. Defaults to true.
+  void set_report_failures(bool report) { report_failures_ = report; }
+
+  // Applies a logged property change to the registry. Returns true on success.
+  bool ReplayPropChange(const ActivityLog::PropChangeEntry& entry);
+
+  // The parsed log and hardware properties, for callers that want to drive
+  // an interpreter themselves (e.g., benchmarks) rather than use Replay().
+  ActivityLog* log() { return &log_; }
+  const HardwareProperties& hwprops() const { return hwprops_; }
+
+  // The property values and gestures version recorded in the parsed log.
+  const Json::Value& properties() const { return properties_; }
+  const std::string& gestures_version() const { return gestures_version_; }
+
+  // Returns the parsed log encoded as JSON, as ActivityLog::Encode() would
+  // have when the log was recorded.
+  std::string EncodeJson();
+
  private:
   // These return true on success
   bool ParseProperties(const Json::Value& dict,
@@ -59,12 +107,25 @@ class ActivityReplay : public GestureConsumer {
   bool ParseGestureMetrics(const Json::Value& entry, Gesture* out_gs);
   bool ParsePropChange(const Json::Value& entry);
 
-  bool ReplayPropChange(const ActivityLog::PropChangeEntry& entry);
+  // |idx| is only used in messages.
+  void ReplayEntry(Interpreter* interpreter, const ActivityLog::Entry& entry,
+                   size_t idx, stime_t* last_timeout_req);
+  // Reports gestures produced after the last logged one.
+  void FinishReplay();
+  void AddMissingGesture(const Gesture& gesture);
+  void AddUnexpectedGesture(const Gesture& gesture);
 
   ActivityLog log_;
   HardwareProperties hwprops_;
+  Json::Value properties_;
+  std::string gestures_version_;
   PropRegistry* prop_reg_;
-  std::deque<Gesture> consumed_gestures_;
+  // Gestures the interpreter produced that aren't matched yet, from
+  // |consumed_head_| on. Cleared once drained so its storage is reused.
+  std::vector<Gesture> consumed_gestures_;
+  size_t consumed_head_;
+  GestureDiff gesture_diff_;
+  bool report_failures_;
   std::vector<std::shared_ptr<const std::string> > names_;
 };
 
@@ -0,0 +1,42 @@
+// Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef GESTURES_ALLOCATION_COUNTER_H_
+#define GESTURES_ALLOCATION_COUNTER_H_
+
+#include <stddef.h>
+
+// Once initialized, the interpreter chains shouldn't touch the heap: calls
+// into them come from the input thread, where an allocation can stall for
+// as long as the allocator's locks are held. Tests and benchmarks check this
+// by linking allocation_counter.o, which replaces malloc(), calloc() and
+// realloc() with versions that count calls per thread before calling glibc's.
+// It's not part of libgestures.
+
+namespace gestures {
+
+class ActivityLog;
+
+// Returns how many blocks this thread has allocated so far.
+size_t ThreadAllocationCount();
+
+// Counts the allocations this thread makes during this object's lifetime.
+class ScopedAllocationCounter {
+ public:
+  // If |log| is given, the allocation it makes whenever it grows its ring
+  // isn't counted: that happens a bounded number of times, after which the
+  // ring stays at its full size until cleared.
+  explicit ScopedAllocationCounter(const ActivityLog* log = NULL);
+
+  size_t count() const;
+
+ private:
+  const ActivityLog* log_;
+  size_t log_bytes_;
+  size_t start_;
+};
+
+}  // namespace gestures
+
+#endif  // GESTURES_ALLOCATION_COUNTER_H_
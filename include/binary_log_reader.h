@@ -0,0 +1,79 @@
+// Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef GESTURES_BINARY_LOG_READER_H_
+#define GESTURES_BINARY_LOG_READER_H_
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include "gestures/include/activity_log.h"
+#include "gestures/include/gestures.h"
+#include "gestures/include/macros.h"
+
+namespace gestures {
+
+// Reads a log in ActivityLog's binary format one record at a time, straight
+// from the log's bytes. Open() maps a file rather than reading it, so logs
+// of any length can be replayed in constant memory, and unlike loading a
+// log into an ActivityLog, nothing is dropped from the head of long logs.
+class BinaryLogReader {
+ public:
+  BinaryLogReader();
+  ~BinaryLogReader();
+
+  // Maps the file at |path|. Returns false if it can't be mapped or isn't a
+  // valid binary log; the latter is only reported if the file has the
+  // binary magic, so callers can fall back to other formats quietly.
+  bool Open(const char* path);
+  // Reads from |size| bytes at |data|, which must outlive this reader.
+  // Returns false if they aren't a valid binary log.
+  bool Init(const char* data, size_t size);
+  void Close();
+
+  const HardwareProperties& hwprops() const { return hwprops_; }
+  // The property values, as JSON text, and gestures version of the log.
+  const std::string& properties() const { return properties_; }
+  const std::string& gestures_version() const { return gestures_version_; }
+
+  // Decodes the next record into |out| and returns true, or returns false at
+  // the end of the log or on a malformed record (see error()). A
+  // HardwareState's fingers are copied to a buffer that may be modified and
+  // stays valid until the next call. A prop change's name points into the
+  // log.
+  bool Next(ActivityLog::Entry* out);
+  // Goes back to the first record.
+  void Rewind() { pos_ = records_start_; }
+  // Offset of the next record, e.g. for error messages.
+  size_t pos() const { return pos_; }
+  bool error() const { return error_; }
+
+ private:
+  bool ReadHeader();
+  // Reads |size| bytes at pos_ into |out| and advances pos_ past them and
+  // their padding. Returns false if the log is too short.
+  bool Read(void* out, size_t size);
+  // Like Read(), but into a string. The size comes from the log, so it's
+  // checked before anything is allocated.
+  bool ReadString(size_t size, std::string* out);
+
+  const char* data_;
+  size_t size_;
+  void* mapping_;  // Set if data_ was mapped by Open()
+  size_t pos_;
+  size_t records_start_;
+  bool error_;
+  HardwareProperties hwprops_;
+  std::string properties_;
+  std::string gestures_version_;
+  std::vector<FingerState> fingers_;
+
+  DISALLOW_COPY_AND_ASSIGN(BinaryLogReader);
+};
+
+}  // namespace gestures
+
+#endif  // GESTURES_BINARY_LOG_READER_H_
@@ -44,6 +44,9 @@ class BoxFilterInterpreter : public FilterInterpreter, public PropertyDelegate {
  protected:
   virtual void SyncInterpretImpl(HardwareState* hwstate, stime_t* timeout);
 
+  virtual void SaveOwnState(StateWriter* writer) const;
+  virtual void RestoreOwnState(StateReader* reader);
+
  private:
   DoubleProperty box_width_;
   DoubleProperty box_height_;
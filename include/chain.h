@@ -0,0 +1,320 @@
+// Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef GESTURES_CHAIN_H__
+#define GESTURES_CHAIN_H__
+
+#include <type_traits>
+
+#include "gestures/include/filter_interpreter.h"
+#include "gestures/include/gestures.h"
+#include "gestures/include/interpreter.h"
+#include "gestures/include/prop_registry.h"
+#include "gestures/include/tracer.h"
+
+namespace gestures {
+
+// Chain<Outer, ..., Inner> is an interpreter chain declared at compile time:
+// each filter layer in the list wraps the next one, and the last one is the
+// base interpreter. E.g.:
+//
+//   typedef Chain<LoggingFilterInterpreter,
+//                 TimestampFilterInterpreter,
+//                 ImmediateInterpreter> MyChain;
+//   Interpreter* interpreter = new MyChain(prop_reg, tracer, devclass);
+//
+// builds the same layers as
+//
+//   Interpreter* temp = new ImmediateInterpreter(prop_reg, tracer);
+//   temp = new TimestampFilterInterpreter(prop_reg, temp, tracer);
+//   temp = new LoggingFilterInterpreter(prop_reg, temp, tracer);
+//
+// except that each layer is a Chain<> deriving from the given class, which
+// knows the static type of the layer below it. Where a layer doesn't
+// override SyncInterpretImpl(), HandleTimerImpl() or ConsumeGesture(), the
+// Chain<> calls straight into the next layer, which the compiler can inline,
+// rather than through FilterInterpreter's virtual forwarding. While a layer
+// has nothing to log, trace, time or update metrics for (see
+// Interpreter::IsPlainHop()), its Impl function is called directly too,
+// skipping the Interpreter::SyncInterpret() and HandleTimer() wrappers.
+// Layers that do override those functions call into the next layer through
+// next_ as usual, so every filter works unchanged in both kinds of chain.
+//
+// Chain<>::NewDynamic() builds the same layers as ordinary filters.
+template<typename... Layers>
+class Chain;
+
+enum ChainHopKind {
+  kChainHopForwards,  // Inherits FilterInterpreter's forwarding
+  kChainHopOverrides,  // Overrides it with an accessible function
+  kChainHopInaccessible  // Overrides it privately, or doesn't have it
+};
+
+typedef void (FilterInterpreter::*ChainSyncImplFn)(HardwareState*, stime_t*);
+typedef void (FilterInterpreter::*ChainTimerImplFn)(stime_t, stime_t*);
+typedef void (FilterInterpreter::*ChainConsumeFn)(const Gesture&);
+typedef void (Interpreter::*ChainProduceFn)(const Gesture&);
+
+template<typename Fn, typename Forwarding>
+struct ChainHopKindOf
+    : std::integral_constant<ChainHopKind,
+                             std::is_same<Fn, Forwarding>::value ?
+                             kChainHopForwards : kChainHopOverrides> {};
+
+// Derives from |L| only to be able to name its protected members. Access is
+// checked during substitution, so private overrides select the fallback.
+template<typename L>
+class ChainProbe : public L {
+ public:
+  template<typename P>
+  static ChainHopKindOf<decltype(&P::SyncInterpretImpl), ChainSyncImplFn>
+  SyncKind(int);
+  template<typename P>
+  static std::integral_constant<ChainHopKind, kChainHopInaccessible>
+  SyncKind(...);
+
+  template<typename P>
+  static ChainHopKindOf<decltype(&P::HandleTimerImpl), ChainTimerImplFn>
+  TimerKind(int);
+  template<typename P>
+  static std::integral_constant<ChainHopKind, kChainHopInaccessible>
+  TimerKind(...);
+
+  template<typename P>
+  static ChainHopKindOf<decltype(&P::ConsumeGesture), ChainConsumeFn>
+  ConsumeKind(int);
+  template<typename P>
+  static std::integral_constant<ChainHopKind, kChainHopInaccessible>
+  ConsumeKind(...);
+
+  template<typename P>
+  static ChainHopKindOf<decltype(&P::ProduceGesture), ChainProduceFn>
+  ProduceKind(int);
+  template<typename P>
+  static std::integral_constant<ChainHopKind, kChainHopInaccessible>
+  ProduceKind(...);
+};
+
+template<typename L>
+struct ChainHopKinds {
+  typedef ChainProbe<L> Probe;
+  static const ChainHopKind kSync =
+      decltype(Probe::template SyncKind<Probe>(0))::value;
+  static const ChainHopKind kTimer =
+      decltype(Probe::template TimerKind<Probe>(0))::value;
+  // Gestures can only be passed on directly if ProduceGesture() isn't
+  // overridden either.
+  static const ChainHopKind kConsume =
+      decltype(Probe::template ConsumeKind<Probe>(0))::value ==
+      kChainHopForwards &&
+      decltype(Probe::template ProduceKind<Probe>(0))::value ==
+      kChainHopForwards ? kChainHopForwards : kChainHopInaccessible;
+};
+
+// The constructor signatures layers may have, most specific first.
+struct ChainDevClassCtor {};  // (prop_reg, next, tracer, devclass)
+struct ChainFilterCtor {};  // (prop_reg, next, tracer)
+struct ChainNoPropsCtor {};  // (next, tracer)
+struct ChainBaseCtor {};  // (prop_reg, tracer)
+
+template<typename L>
+struct ChainCtorFor {
+  typedef typename std::conditional<
+    std::is_constructible<L, PropRegistry*, Interpreter*, Tracer*,
+                          GestureInterpreterDeviceClass>::value,
+    ChainDevClassCtor,
+    typename std::conditional<
+      std::is_constructible<L, PropRegistry*, Interpreter*, Tracer*>::value,
+      ChainFilterCtor,
+      typename std::conditional<
+        std::is_constructible<L, Interpreter*, Tracer*>::value,
+        ChainNoPropsCtor,
+        ChainBaseCtor>::type>::type>::type type;
+};
+
+// Overrides SyncInterpretImpl() to call Next directly, if |kForwards|.
+template<typename Base, typename Next, bool kForwards>
+class ChainSyncHop : public Base {
+ public:
+  using Base::Base;
+};
+
+template<typename Base, typename Next>
+class ChainSyncHop<Base, Next, true> : public Base {
+ public:
+  using Base::Base;
+
+ protected:
+  virtual void SyncInterpretImpl(HardwareState* hwstate, stime_t* timeout) {
+    static_cast<Next*>(this->next_.get())->ChainSyncInterpret(hwstate,
+                                                              timeout);
+  }
+};
+
+// Overrides HandleTimerImpl() to call Next directly, if |kForwards|.
+template<typename Base, typename Next, bool kForwards>
+class ChainTimerHop : public Base {
+ public:
+  using Base::Base;
+};
+
+template<typename Base, typename Next>
+class ChainTimerHop<Base, Next, true> : public Base {
+ public:
+  using Base::Base;
+
+ protected:
+  virtual void HandleTimerImpl(stime_t now, stime_t* timeout) {
+    static_cast<Next*>(this->next_.get())->ChainHandleTimer(now, timeout);
+  }
+};
+
+// Overrides ConsumeGesture() to skip ProduceGesture() on plain hops, if
+// |kForwards|. The consumer above isn't known statically, so this hop stays
+// virtual.
+template<typename Base, bool kForwards>
+class ChainConsumeHop : public Base {
+ public:
+  using Base::Base;
+};
+
+template<typename Base>
+class ChainConsumeHop<Base, true> : public Base {
+ public:
+  using Base::Base;
+
+  virtual void ConsumeGesture(const Gesture& gesture) {
+    if (this->IsPlainHop())
+      this->consumer_->ConsumeGesture(gesture);
+    else
+      this->ProduceGesture(gesture);
+  }
+};
+
+template<typename... Rest>
+struct ChainNext {
+  typedef Chain<Rest...> type;
+};
+
+template<>
+struct ChainNext<> {
+  typedef void type;
+};
+
+template<typename L, typename... Rest>
+struct ChainBase {
+  typedef typename ChainNext<Rest...>::type Next;
+  typedef ChainHopKinds<L> Kinds;
+  typedef ChainConsumeHop<
+    ChainTimerHop<
+      ChainSyncHop<L, Next, Kinds::kSync == kChainHopForwards>,
+      Next, Kinds::kTimer == kChainHopForwards>,
+    Kinds::kConsume == kChainHopForwards> type;
+};
+
+template<typename L, typename... Rest>
+class Chain<L, Rest...> final : public ChainBase<L, Rest...>::type {
+  typedef typename ChainBase<L, Rest...>::type Base;
+  typedef typename ChainBase<L, Rest...>::Next Next;
+  typedef ChainHopKinds<L> Kinds;
+  typedef std::integral_constant<ChainHopKind, Kinds::kSync> SyncKind;
+  typedef std::integral_constant<ChainHopKind, Kinds::kTimer> TimerKind;
+  typedef std::integral_constant<ChainHopKind, kChainHopForwards> Forwards;
+  typedef std::integral_constant<ChainHopKind, kChainHopOverrides> Overrides;
+  typedef std::integral_constant<ChainHopKind, kChainHopInaccessible>
+      Inaccessible;
+
+ public:
+  // |devclass| is passed to the layers that take one.
+  Chain(PropRegistry* prop_reg, Tracer* tracer,
+        GestureInterpreterDeviceClass devclass)
+      : Chain(prop_reg, tracer, devclass, typename ChainCtorFor<L>::type()) {}
+
+  // Builds the same layers as ordinary, dynamically chained interpreters.
+  static L* NewDynamic(PropRegistry* prop_reg, Tracer* tracer,
+                       GestureInterpreterDeviceClass devclass) {
+    return NewLayer(prop_reg, tracer, devclass,
+                    typename ChainCtorFor<L>::type());
+  }
+
+  // Same as SyncInterpret() and HandleTimer(), but called by the layer
+  // above without a virtual call.
+  void ChainSyncInterpret(HardwareState* hwstate, stime_t* timeout) {
+    if (this->IsPlainHop())
+      PlainSyncInterpret(hwstate, timeout, SyncKind());
+    else
+      this->Interpreter::SyncInterpret(hwstate, timeout);
+  }
+  void ChainHandleTimer(stime_t now, stime_t* timeout) {
+    if (this->IsPlainHop())
+      PlainHandleTimer(now, timeout, TimerKind());
+    else
+      this->Interpreter::HandleTimer(now, timeout);
+  }
+
+ private:
+  Chain(PropRegistry* prop_reg, Tracer* tracer,
+        GestureInterpreterDeviceClass devclass, ChainDevClassCtor)
+      : Base(prop_reg, new Next(prop_reg, tracer, devclass), tracer,
+             devclass) {}
+  Chain(PropRegistry* prop_reg, Tracer* tracer,
+        GestureInterpreterDeviceClass devclass, ChainFilterCtor)
+      : Base(prop_reg, new Next(prop_reg, tracer, devclass), tracer) {}
+  Chain(PropRegistry* prop_reg, Tracer* tracer,
+        GestureInterpreterDeviceClass devclass, ChainNoPropsCtor)
+      : Base(new Next(prop_reg, tracer, devclass), tracer) {}
+  Chain(PropRegistry* prop_reg, Tracer* tracer,
+        GestureInterpreterDeviceClass devclass, ChainBaseCtor)
+      : Base(prop_reg, tracer) {}
+
+  static L* NewLayer(PropRegistry* prop_reg, Tracer* tracer,
+                     GestureInterpreterDeviceClass devclass,
+                     ChainDevClassCtor) {
+    return new L(prop_reg, Next::NewDynamic(prop_reg, tracer, devclass),
+                 tracer, devclass);
+  }
+  static L* NewLayer(PropRegistry* prop_reg, Tracer* tracer,
+                     GestureInterpreterDeviceClass devclass,
+                     ChainFilterCtor) {
+    return new L(prop_reg, Next::NewDynamic(prop_reg, tracer, devclass),
+                 tracer);
+  }
+  static L* NewLayer(PropRegistry* prop_reg, Tracer* tracer,
+                     GestureInterpreterDeviceClass devclass,
+                     ChainNoPropsCtor) {
+    return new L(Next::NewDynamic(prop_reg, tracer, devclass), tracer);
+  }
+  static L* NewLayer(PropRegistry* prop_reg, Tracer* tracer,
+                     GestureInterpreterDeviceClass devclass, ChainBaseCtor) {
+    return new L(prop_reg, tracer);
+  }
+
+  void PlainSyncInterpret(HardwareState* hwstate, stime_t* timeout,
+                          Forwards) {
+    static_cast<Next*>(this->next_.get())->ChainSyncInterpret(hwstate,
+                                                              timeout);
+  }
+  void PlainSyncInterpret(HardwareState* hwstate, stime_t* timeout,
+                          Overrides) {
+    this->L::SyncInterpretImpl(hwstate, timeout);
+  }
+  void PlainSyncInterpret(HardwareState* hwstate, stime_t* timeout,
+                          Inaccessible) {
+    this->Interpreter::SyncInterpret(hwstate, timeout);
+  }
+
+  void PlainHandleTimer(stime_t now, stime_t* timeout, Forwards) {
+    static_cast<Next*>(this->next_.get())->ChainHandleTimer(now, timeout);
+  }
+  void PlainHandleTimer(stime_t now, stime_t* timeout, Overrides) {
+    this->L::HandleTimerImpl(now, timeout);
+  }
+  void PlainHandleTimer(stime_t now, stime_t* timeout, Inaccessible) {
+    this->Interpreter::HandleTimer(now, timeout);
+  }
+};
+
+}  // namespace gestures
+
+#endif  // GESTURES_CHAIN_H__
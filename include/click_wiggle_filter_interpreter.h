@@ -48,6 +48,9 @@ class ClickWiggleFilterInterpreter : public FilterInterpreter {
  protected:
   virtual void SyncInterpretImpl(HardwareState* hwstate, stime_t* timeout);
 
+  virtual void SaveOwnState(StateWriter* writer) const;
+  virtual void RestoreOwnState(StateReader* reader);
+
  private:
   void UpdateClickWiggle(const HardwareState& hwstate);
   void SetWarpFlags(HardwareState* hwstate) const;
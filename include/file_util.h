@@ -21,6 +21,10 @@ bool ReadFileToString(const char* path, std::string* contents);
 // previously there.  Returns the number of bytes written, or -1 on error.
 int WriteFile(const char* filename, const char* data, int size);
 
+// Writes all of |data| to |fd|, retrying partial writes. Returns the number
+// of bytes written, or -1 on error.
+int WriteFileDescriptor(const int fd, const char* data, int size);
+
 }  // namespace gestures
 
 #endif  // GESTURES_UTIL_H_
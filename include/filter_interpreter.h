@@ -30,6 +30,13 @@ class FilterInterpreter : public Interpreter, public GestureConsumer {
   Json::Value EncodeCommonInfo();
   void Clear();
 
+  virtual void SetLatencyStatsEnabled(bool enabled);
+  virtual void ClearLatencyStats();
+  virtual void EncodeLatencyStats(Json::Value* out);
+
+  virtual void SaveState(StateWriter* writer);
+  virtual bool RestoreState(StateReader* reader);
+
   virtual void Initialize(const HardwareProperties* hwprops,
                           Metrics* metrics, MetricsProperties* mprops,
                           GestureConsumer* consumer);
@@ -39,6 +46,7 @@ class FilterInterpreter : public Interpreter, public GestureConsumer {
  protected:
   virtual void SyncInterpretImpl(HardwareState* hwstate, stime_t* timeout);
   virtual void HandleTimerImpl(stime_t now, stime_t* timeout);
+  virtual void WriteNextCommonInfo(JsonStreamWriter* writer);
 
   std::unique_ptr<Interpreter> next_;
 
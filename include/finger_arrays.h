@@ -0,0 +1,83 @@
+// Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef GESTURES_FINGER_ARRAYS_H__
+#define GESTURES_FINGER_ARRAYS_H__
+
+#include <stdint.h>
+
+#include "gestures/include/gestures.h"
+
+// FingerState is an array-of-structs layout, which is fixed at the C API.
+// Filters that apply the same math to a field of every finger can instead
+// load the fingers into a FingerArrays, with one aligned array per field,
+// run kernels such as FingerArraysIir() over the columns, and store the
+// fingers back.
+//
+// Kernels process several fingers per instruction where they can, and run
+// over padded_size() fingers; Load() zeroes the padding.
+//
+// Load() and Store() cost more than a pass or two of cheap math over a
+// handful of fingers saves (see "microbench finger_scaling"), so this pays
+// off only for kernels that do a fair amount of work per finger.
+
+namespace gestures {
+
+// Fingers processed per SIMD instruction.
+const size_t kFingerLanes = 4;
+
+struct FingerArrays {
+  // Larger states are processed in chunks of this many fingers.
+  static const size_t kCapacity = 16;
+
+  // Copies |count| fingers, at most kCapacity, in.
+  void Load(const FingerState* fingers, size_t count);
+  // Copies the fingers back out to |fingers|.
+  void Store(FingerState* fingers) const;
+
+  // size rounded up to a multiple of kFingerLanes.
+  size_t padded_size() const {
+    return (size + kFingerLanes - 1) / kFingerLanes * kFingerLanes;
+  }
+
+  size_t size;
+  alignas(16) float touch_major[kCapacity];
+  alignas(16) float touch_minor[kCapacity];
+  alignas(16) float width_major[kCapacity];
+  alignas(16) float width_minor[kCapacity];
+  alignas(16) float pressure[kCapacity];
+  alignas(16) float orientation[kCapacity];
+  alignas(16) float position_x[kCapacity];
+  alignas(16) float position_y[kCapacity];
+  short tracking_id[kCapacity];
+  unsigned flags[kCapacity];
+};
+
+// The last three inputs and two outputs of a second order IIR filter on a
+// field of each finger, newest first.
+struct FingerIirHistory {
+  alignas(16) float in[3][FingerArrays::kCapacity];
+  alignas(16) float out[2][FingerArrays::kCapacity];
+};
+
+// y = b0*x + b1*in[0] + b2*in[1] + b3*in[2] - a1*out[0] - a2*out[1]
+struct FingerIirCoefficients {
+  double b0, b1, b2, b3, a1, a2;
+};
+
+// Runs values[i] through the filter where iir[i] is all ones, or averages it
+// with out[0][i] where it's 0, or leaves it alone where pass[i] is all ones,
+// and shifts values[i] and what it became into |history|. |count| must be a
+// multiple of kFingerLanes. The filter is
+// computed in double, as it is in the comment above in scalar code, two
+// fingers per instruction with SSE2. Elsewhere it's computed one finger at a
+// time: the scalar code's multiply-adds may be fused on targets that have
+// them, which a vector version couldn't match bit for bit.
+void FingerArraysIir(float* values, FingerIirHistory* history,
+                     const FingerIirCoefficients& coeffs,
+                     const uint32_t* iir, const uint32_t* pass, size_t count);
+
+}  // namespace gestures
+
+#endif  // GESTURES_FINGER_ARRAYS_H__
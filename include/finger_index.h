@@ -0,0 +1,90 @@
+// Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef GESTURES_FINGER_INDEX_H__
+#define GESTURES_FINGER_INDEX_H__
+
+#include "gestures/include/gestures.h"
+#include "gestures/include/macros.h"
+
+// HardwareState::GetFingerState() scans the fingers of the state, and
+// filters call it in loops over other fingers. While a ScopedFingerIndex
+// exists for a state on the current thread, GetFingerState() on that state
+// looks the tracking id up in a small hash table instead.
+//
+// Interpreter::SyncInterpret() creates one for every hardware state that
+// isn't indexed yet. So a frame is indexed once at the top of the chain,
+// and again below filters that pass on hardware states of their own.
+//
+// Code that changes the tracking ids or the order of a state's fingers must
+// call HardwareState::FingersChanged(), which rebuilds the index. If the
+// finger count or the |fingers| pointer changes without that call, it's
+// caught, and lookups scan until the index is rebuilt.
+
+namespace gestures {
+
+class ScopedFingerIndex {
+ public:
+  // Indexes |hwstate|, unless it's NULL or already indexed.
+  explicit ScopedFingerIndex(const HardwareState* hwstate);
+  ~ScopedFingerIndex();
+
+  // Looks |tracking_id| up in the index of |hwstate|, and sets |*out| to the
+  // finger or NULL. Returns false if |hwstate| isn't indexed, in which case
+  // the caller has to scan.
+  static bool Find(const HardwareState& hwstate, short tracking_id,
+                   const FingerState** out) {
+    const ScopedFingerIndex* index = current_;
+    if (!index || index->hwstate_ != &hwstate || !index->indexed_ ||
+        !index->UpToDate())
+      return false;
+    for (size_t i = Hash(tracking_id); index->table_[i];
+         i = (i + 1) & kTableMask) {
+      const FingerState* fs = &hwstate.fingers[index->table_[i] - 1];
+      if (fs->tracking_id == tracking_id) {
+        *out = fs;
+        return true;
+      }
+    }
+    *out = NULL;
+    return true;
+  }
+
+  // Rebuilds the index of |hwstate|, if it has one.
+  static void Rebuild(const HardwareState& hwstate);
+
+ private:
+  static const size_t kTableSize = 64;
+  static const size_t kTableMask = kTableSize - 1;
+  // Larger states aren't indexed, so that the table stays at most half full.
+  static const size_t kMaxFingers = kTableSize / 2;
+
+  static size_t Hash(short id) {
+    return static_cast<unsigned short>(id) & kTableMask;
+  }
+
+  bool UpToDate() const {
+    return fingers_ == hwstate_->fingers &&
+        finger_cnt_ == hwstate_->finger_cnt;
+  }
+  void Build();
+
+  // The innermost index on this thread.
+  static thread_local ScopedFingerIndex* current_;
+
+  const HardwareState* hwstate_;  // NULL if this scope didn't index anything
+  ScopedFingerIndex* outer_;
+  // What was indexed, to catch changes that FingersChanged() wasn't told of.
+  const FingerState* fingers_;
+  unsigned short finger_cnt_;
+  bool indexed_;  // False if there were no or too many fingers
+  // Index + 1 into |fingers_| of the finger hashed to each entry, or 0.
+  unsigned char table_[kTableSize];
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedFingerIndex);
+};
+
+}  // namespace gestures
+
+#endif  // GESTURES_FINGER_INDEX_H__
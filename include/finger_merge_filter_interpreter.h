@@ -32,6 +32,9 @@ class FingerMergeFilterInterpreter : public FilterInterpreter {
  protected:
   virtual void SyncInterpretImpl(HardwareState* hwstate, stime_t* timeout);
 
+  virtual void SaveOwnState(StateWriter* writer) const;
+  virtual void RestoreOwnState(StateReader* reader);
+
  private:
   // Detects finger merge and appends GESTURE_FINGER_MERGE flag for a merged
   // finger or close fingers
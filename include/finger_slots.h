@@ -0,0 +1,337 @@
+// Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef GESTURES_FINGER_SLOTS_H__
+#define GESTURES_FINGER_SLOTS_H__
+
+#include <stdint.h>
+
+#include "gestures/include/gestures.h"
+#include "gestures/include/interpreter_state.h"
+#include "gestures/include/logging.h"
+#include "gestures/include/macros.h"
+#include "gestures/include/vector.h"
+
+// Containers keyed by tracking id that don't scan. set<short, N> and
+// map<short, T, N> look ids up linearly, which adds up when an interpreter
+// queries a handful of them for every finger of every frame. Here, a
+// TrackingIdSlots table maps each tracking id the interpreter currently
+// knows about to a small slot number, 0 to 63, and TrackingIdSet and
+// TrackingIdMap are indexed by slot: membership is a bit test, and set
+// algebra between sets of the same table is a bitwise op.
+//
+// The owner calls TrackingIdSlots::Update() with each hardware state. Ids
+// that have left are removed from all sets and maps of the table at that
+// point, so their slots can be reused without aliasing.
+// RemoveMissingIdsFromSet() and RemoveMissingIdsFromMap() work on them too.
+//
+// Unlike set and map, iteration is in slot order, not insertion order, and
+// the containers can't be copied.
+
+namespace gestures {
+
+// A set of slots, as a bitmask.
+class FingerSlotSet {
+ public:
+  static const size_t kMaxSlots = 64;
+
+  FingerSlotSet() : bits_(0) {}
+  explicit FingerSlotSet(uint64_t bits) : bits_(bits) {}
+
+  class const_iterator {
+   public:
+    explicit const_iterator(uint64_t bits) : bits_(bits) {}
+    size_t operator*() const { return __builtin_ctzll(bits_); }
+    const_iterator& operator++() {
+      bits_ &= bits_ - 1;  // Clears the lowest set bit
+      return *this;
+    }
+    bool operator==(const const_iterator& that) const {
+      return bits_ == that.bits_;
+    }
+    bool operator!=(const const_iterator& that) const {
+      return bits_ != that.bits_;
+    }
+   private:
+    uint64_t bits_;
+  };
+
+  const_iterator begin() const { return const_iterator(bits_); }
+  const_iterator end() const { return const_iterator(0); }
+
+  bool contains(size_t slot) const { return (bits_ >> slot) & 1; }
+  void insert(size_t slot) { bits_ |= Bit(slot); }
+  void erase(size_t slot) { bits_ &= ~Bit(slot); }
+  void clear() { bits_ = 0; }
+  size_t size() const { return __builtin_popcountll(bits_); }
+  bool empty() const { return !bits_; }
+  uint64_t bits() const { return bits_; }
+
+  FingerSlotSet& operator|=(const FingerSlotSet& that) {
+    bits_ |= that.bits_;
+    return *this;
+  }
+  FingerSlotSet& operator&=(const FingerSlotSet& that) {
+    bits_ &= that.bits_;
+    return *this;
+  }
+  FingerSlotSet& operator-=(const FingerSlotSet& that) {
+    bits_ &= ~that.bits_;
+    return *this;
+  }
+
+  static uint64_t Bit(size_t slot) { return static_cast<uint64_t>(1) << slot; }
+
+ private:
+  uint64_t bits_;
+};
+
+inline FingerSlotSet operator|(FingerSlotSet left, const FingerSlotSet& right) {
+  return left |= right;
+}
+inline FingerSlotSet operator&(FingerSlotSet left, const FingerSlotSet& right) {
+  return left &= right;
+}
+inline FingerSlotSet operator-(FingerSlotSet left, const FingerSlotSet& right) {
+  return left -= right;
+}
+inline bool operator==(const FingerSlotSet& left, const FingerSlotSet& right) {
+  return left.bits() == right.bits();
+}
+inline bool operator!=(const FingerSlotSet& left, const FingerSlotSet& right) {
+  return left.bits() != right.bits();
+}
+
+// Maps tracking ids to slots, with a small open-addressed hash table.
+// Tracking ids tend to be handed out sequentially, so they rarely collide.
+class TrackingIdSlots {
+ public:
+  static const size_t kMaxSlots = FingerSlotSet::kMaxSlots;
+  static const size_t kMaxUsers = 32;
+
+  TrackingIdSlots();
+
+  // Gives each finger in |hwstate| a slot, and frees the slots of all other
+  // ids, removing them from the registered sets.
+  void Update(const HardwareState& hwstate);
+
+  // Frees all slots, removing all ids from the registered sets.
+  void Clear();
+
+  // Returns the slot of |id|, or -1 if it doesn't have one.
+  int Slot(short id) const {
+    for (size_t i = Hash(id); table_[i]; i = (i + 1) & kTableMask)
+      if (ids_[table_[i] - 1] == id)
+        return table_[i] - 1;
+    return -1;
+  }
+
+  // Same as Slot(), but gives |id| a slot if it doesn't have one, until the
+  // next Update(). Returns -1 if all slots are taken.
+  int Assign(short id) {
+    int slot = Slot(id);
+    return slot >= 0 ? slot : AssignNew(id);
+  }
+
+  short Id(size_t slot) const { return ids_[slot]; }
+  const FingerSlotSet& assigned() const { return assigned_; }
+
+  // Sets of slots that ids are removed from when their slots are freed.
+  // Done by TrackingIdSet.
+  void Register(FingerSlotSet* user);
+  void Unregister(FingerSlotSet* user);
+
+  // Saves or restores the ids that have slots. Restoring empties the
+  // registered sets, so they're restored afterwards.
+  void SaveState(StateWriter* writer) const;
+  void RestoreState(StateReader* reader);
+
+ private:
+  // At most half full, so that probe sequences stay short.
+  static const size_t kTableSize = 2 * kMaxSlots;
+  static const size_t kTableMask = kTableSize - 1;
+
+  static size_t Hash(short id) {
+    return static_cast<unsigned short>(id) & kTableMask;
+  }
+
+  int AssignNew(short id);
+  void AssignSlot(short id, int slot);
+  void Free(const FingerSlotSet& slots);
+
+  // Slot + 1 of the id hashed to each entry, or 0 if the entry is empty.
+  unsigned char table_[kTableSize];
+  short ids_[kMaxSlots];
+  FingerSlotSet assigned_;
+  vector<FingerSlotSet*, kMaxUsers> users_;
+
+  DISALLOW_COPY_AND_ASSIGN(TrackingIdSlots);
+};
+
+// A set of tracking ids, stored as a set of their slots in |slots|.
+class TrackingIdSet {
+ public:
+  class const_iterator {
+   public:
+    const_iterator(const TrackingIdSlots* slots,
+                   FingerSlotSet::const_iterator it)
+        : slots_(slots), it_(it) {}
+    short operator*() const { return slots_->Id(*it_); }
+    const_iterator& operator++() {
+      ++it_;
+      return *this;
+    }
+    bool operator==(const const_iterator& that) const {
+      return it_ == that.it_;
+    }
+    bool operator!=(const const_iterator& that) const {
+      return it_ != that.it_;
+    }
+   private:
+    const TrackingIdSlots* slots_;
+    FingerSlotSet::const_iterator it_;
+  };
+
+  TrackingIdSet(TrackingIdSlots* slots) : slots_(slots) {
+    slots_->Register(&slot_set_);
+  }
+  ~TrackingIdSet() { slots_->Unregister(&slot_set_); }
+
+  const_iterator begin() const {
+    return const_iterator(slots_, slot_set_.begin());
+  }
+  const_iterator end() const { return const_iterator(slots_, slot_set_.end()); }
+
+  bool contains(short id) const { return Find(id) >= 0; }
+  // Returns the slot of |id| if it's in the set, or -1.
+  int Find(short id) const {
+    int slot = slots_->Slot(id);
+    return slot >= 0 && slot_set_.contains(slot) ? slot : -1;
+  }
+  // Returns the slot of |id|, or -1 if it couldn't be given one.
+  int insert(short id) {
+    int slot = slots_->Assign(id);
+    if (slot < 0) {
+      Err("No slot for tracking id %d", id);
+      return -1;
+    }
+    slot_set_.insert(slot);
+    return slot;
+  }
+  // Returns the number of ids removed (0 or 1).
+  size_t erase(short id) {
+    int slot = slots_->Slot(id);
+    if (slot < 0 || !slot_set_.contains(slot))
+      return 0;
+    slot_set_.erase(slot);
+    return 1;
+  }
+  void clear() { slot_set_.clear(); }
+  size_t size() const { return slot_set_.size(); }
+  bool empty() const { return slot_set_.empty(); }
+
+  // Set algebra with sets of the same TrackingIdSlots.
+  const FingerSlotSet& slot_set() const { return slot_set_; }
+  void set_slot_set(const FingerSlotSet& slot_set) { slot_set_ = slot_set; }
+  TrackingIdSlots* slots() const { return slots_; }
+
+  // Restored after |slots|.
+  void SaveState(StateWriter* writer) const { writer->Write(slot_set_); }
+  void RestoreState(StateReader* reader) {
+    if (reader->Read(&slot_set_))
+      slot_set_ &= slots_->assigned();
+  }
+
+ private:
+  TrackingIdSlots* slots_;
+  FingerSlotSet slot_set_;
+
+  DISALLOW_COPY_AND_ASSIGN(TrackingIdSet);
+};
+
+// A map from tracking ids to |Data|, stored in an array indexed by slot.
+template<typename Data>
+class TrackingIdMap {
+ public:
+  TrackingIdMap(TrackingIdSlots* slots) : keys_(slots) {}
+
+  // Default-constructs the value if |id| wasn't in the map.
+  Data& operator[](short id) {
+    int slot = keys_.Find(id);
+    if (slot >= 0)
+      return values_[slot];
+    slot = keys_.insert(id);
+    if (slot < 0)
+      slot = FingerSlotSet::kMaxSlots;  // Scratch entry
+    values_[slot] = Data();
+    return values_[slot];
+  }
+  bool contains(short id) const { return keys_.contains(id); }
+  size_t erase(short id) { return keys_.erase(id); }
+  void clear() { keys_.clear(); }
+  size_t size() const { return keys_.size(); }
+  bool empty() const { return keys_.empty(); }
+  const TrackingIdSet& keys() const { return keys_; }
+  TrackingIdSet* mutable_keys() { return &keys_; }
+
+  // Restored after the keys' TrackingIdSlots.
+  void SaveState(StateWriter* writer) const {
+    keys_.SaveState(writer);
+    for (size_t slot : keys_.slot_set())
+      writer->Write(values_[slot]);
+  }
+  void RestoreState(StateReader* reader) {
+    keys_.RestoreState(reader);
+    for (size_t slot : keys_.slot_set())
+      reader->Read(&values_[slot]);
+  }
+
+ private:
+  TrackingIdSet keys_;
+  Data values_[FingerSlotSet::kMaxSlots + 1];
+
+  DISALLOW_COPY_AND_ASSIGN(TrackingIdMap);
+};
+
+// Overloads of the set.h and map.h helpers.
+
+template<typename Elt>
+inline bool SetContainsValue(const TrackingIdSet& the_set, const Elt& elt) {
+  return the_set.contains(elt);
+}
+
+template<typename Data, typename Elt>
+inline bool SetContainsValue(const TrackingIdMap<Data>& the_map,
+                             const Elt& elt) {
+  return the_map.contains(elt);
+}
+
+template<typename Data, typename Key>
+inline bool MapContainsKey(const TrackingIdMap<Data>& the_map,
+                           const Key& key) {
+  return the_map.contains(key);
+}
+
+// Ids that have left are removed by TrackingIdSlots::Update() already, but
+// the owner may not have called it with |hs|.
+inline void RemoveMissingIdsFromSet(TrackingIdSet* the_set,
+                                    const HardwareState& hs) {
+  FingerSlotSet present;
+  for (size_t i = 0; i < hs.finger_cnt; i++) {
+    int slot = the_set->slots()->Slot(hs.fingers[i].tracking_id);
+    if (slot >= 0)
+      present.insert(slot);
+  }
+  the_set->set_slot_set(the_set->slot_set() & present);
+}
+
+template<typename Data>
+inline void RemoveMissingIdsFromMap(TrackingIdMap<Data>* the_map,
+                                    const HardwareState& hs) {
+  RemoveMissingIdsFromSet(the_map->mutable_keys(), hs);
+}
+
+}  // namespace gestures
+
+#endif  // GESTURES_FINGER_SLOTS_H__
@@ -37,6 +37,9 @@ class FlingStopFilterInterpreter : public FilterInterpreter {
 
   virtual void ConsumeGesture(const Gesture& gesture);
 
+  virtual void SaveOwnState(StateWriter* writer) const;
+  virtual void RestoreOwnState(StateReader* reader);
+
  private:
   // May override an outgoing gesture with a fling stop gesture.
   bool NeedsExtraTime(const HardwareState& hwstate) const;
@@ -166,6 +166,9 @@ struct HardwareState {
 #ifdef __cplusplus
   FingerState* GetFingerState(short tracking_id);
   const FingerState* GetFingerState(short tracking_id) const;
+  // Must be called after changing the tracking ids or the order of
+  // |fingers| while the state is being interpreted; see finger_index.h.
+  void FingersChanged() const;
   bool SameFingersAs(const HardwareState& that) const;
   std::string String() const;
   void DeepCopy(const HardwareState& that, unsigned short max_finger_cnt);
@@ -504,6 +507,7 @@ namespace gestures {
 
 class Interpreter;
 class PropRegistry;
+class BoolProperty;
 class LoggingFilterInterpreter;
 class Tracer;
 class GestureInterpreterConsumer;
@@ -516,6 +520,12 @@ struct GestureInterpreter {
   explicit GestureInterpreter(int version);
   ~GestureInterpreter();
   void PushHardwareState(HardwareState* hwstate);
+  // Interprets |count| states that arrived at once, oldest first, and sets
+  // the timer once for the last of them. Where a state requested a timer
+  // that would have fired before the next one, the callback is run for its
+  // due time in between, so the gestures are the same as pushing the states
+  // one at a time as they were timestamped.
+  void PushHardwareStates(HardwareState* hwstates, size_t count);
 
   void SetHardwareProperties(const HardwareProperties& hwprops);
 
@@ -535,16 +545,46 @@ struct GestureInterpreter {
   PropRegistry* prop_reg() const { return prop_reg_.get(); }
 
   std::string EncodeActivityLog();
+
+  // Per-interpreter latency stats of the chain, which are also included in
+  // the activity log while enabled. Stats are off by default; they may also
+  // be toggled with the "Latency Stats Enable" property.
+  void SetLatencyStatsEnabled(bool enabled);
+  void ClearLatencyStats();
+  std::string EncodeLatencyStats();
+
+  // Snapshots the state of the chain, e.g. to replay from a point in a log
+  // or carry a session across a process restart. See
+  // Interpreter::SaveState() for what is and isn't saved. The timeout the
+  // timer was last set for is saved too. Returns an empty string if the
+  // filters are not composed yet.
+  std::string SaveState();
+  // Restores a snapshot taken by SaveState() of a chain initialized with the
+  // same device class and hardware properties, and sets the timer for the
+  // timeout that was pending, or cancels it if none was. Returns false,
+  // leaving the chain and timer as they were, if |state| doesn't fit this
+  // chain.
+  bool RestoreState(const std::string& state);
  private:
   void InitializeTouchpad(void);
   void InitializeTouchpad2(void);
   void InitializeMouse(void);
   void InitializeMultitouchMouse(void);
 
+  // Sets the timer to call back in |timeout| s, or cancels it if |timeout|
+  // is not positive.
+  void SetTimer(stime_t timeout);
+  // Restores |state| into the chain, and sets |*timeout| to the timeout
+  // that was pending. Returns false if |state| doesn't fit the chain.
+  bool RestoreChainState(const std::string& state, stime_t* timeout);
+
   GestureReadyFunction callback_;
   void* callback_data_;
 
   std::unique_ptr<PropRegistry> prop_reg_;
+  // If set, Initialize() builds the chain as a Chain<> rather than from
+  // ordinary filters.
+  std::unique_ptr<BoolProperty> static_chain_;
   std::unique_ptr<Tracer> tracer_;
   std::unique_ptr<Interpreter> interpreter_;
   std::unique_ptr<MetricsProperties> mprops_;
@@ -552,6 +592,9 @@ struct GestureInterpreter {
   GesturesTimerProvider* timer_provider_;
   void* timer_provider_data_;
   GesturesTimer* interpret_timer_;
+  // The timeout the chain last asked for, which isn't positive if none is
+  // pending.
+  stime_t timer_timeout_;
 
   LoggingFilterInterpreter* loggingFilter_;
   std::unique_ptr<GestureInterpreterConsumer> consumer_;
@@ -590,6 +633,13 @@ void GestureInterpreterSetHardwareProperties(GestureInterpreter*,
 void GestureInterpreterPushHardwareState(GestureInterpreter*,
                                          struct HardwareState*);
 
+// Pushes an array of states that arrived together, e.g. a whole evdev
+// buffer read after the input thread was descheduled. Cheaper than pushing
+// them one at a time, as the timer is set only once.
+void GestureInterpreterPushHardwareStates(GestureInterpreter*,
+                                          struct HardwareState*,
+                                          size_t);
+
 void GestureInterpreterSetCallback(GestureInterpreter*,
                                    GestureReadyFunction,
                                    void*);
@@ -5,9 +5,8 @@
 #include <gtest/gtest.h>  // for FRIEND_TEST
 
 #include "gestures/include/filter_interpreter.h"
-#include "gestures/include/finger_metrics.h"
+#include "gestures/include/finger_arrays.h"
 #include "gestures/include/gestures.h"
-#include "gestures/include/map.h"
 #include "gestures/include/prop_registry.h"
 #include "gestures/include/tracer.h"
 
@@ -24,48 +23,8 @@ namespace gestures {
 
 class IirFilterInterpreter : public FilterInterpreter, public PropertyDelegate {
   FRIEND_TEST(IirFilterInterpreterTest, DisableIIRTest);
+  FRIEND_TEST(IirFilterInterpreterTest, ManyFingersTest);
  public:
-  // We'll maintain one IOHistory record per active finger
-  class IoHistory {
-   public:
-    IoHistory() : in_head(0), out_head(0) {}
-    explicit IoHistory(const FingerState& fs) : in_head(0), out_head(0) {
-      for (size_t i = 0; i < kInSize; i++)
-        in[i] = fs;
-      for (size_t i = 0; i < kOutSize; i++)
-        out[i] = fs;
-    }
-    // Note: NextOut() and the oldest PrevOut() point to the same object.
-    FingerState* NextOut() { return &out[NextOutHead()]; }
-    FingerState* PrevOut(size_t idx) {
-      return &out[(out_head + idx) % kOutSize];
-    }
-    // Note: NextIn() and the oldest PrevIn() point to the same object.
-    FingerState* NextIn() { return &in[NextInHead()]; }
-    FingerState* PrevIn(size_t idx) { return &in[(in_head + idx) % kInSize]; }
-    void Increment();
-
-    bool operator==(const IoHistory& that) const;
-    bool operator!=(const IoHistory& that) const { return !(*this == that); }
-
-    void WarpBy(float dx, float dy);
-
-   private:
-    size_t NextOutHead() const {
-      return (out_head + kOutSize - 1) % kOutSize;
-    }
-    size_t NextInHead() const {
-      return (in_head + kInSize - 1) % kInSize;
-    }
-
-    static const size_t kInSize = 3;
-    static const size_t kOutSize = 2;
-    FingerState in[kInSize];  // previous input values
-    size_t in_head;
-    FingerState out[kOutSize];  // previous output values
-    size_t out_head;
-  };
-
   // Takes ownership of |next|:
   IirFilterInterpreter(PropRegistry* prop_reg, Interpreter* next,
                        Tracer* tracer);
@@ -74,10 +33,33 @@ class IirFilterInterpreter : public FilterInterpreter, public PropertyDelegate {
  protected:
   virtual void SyncInterpretImpl(HardwareState* hwstate, stime_t* timeout);
 
+  virtual void SaveOwnState(StateWriter* writer) const;
+  virtual void RestoreOwnState(StateReader* reader);
+
  public:
   virtual void DoubleWasWritten(DoubleProperty* prop);
 
  private:
+  // The fields that are filtered, in the order their histories are kept.
+  enum Field { kFieldX, kFieldY, kFieldPressure, kNumFields };
+
+  // The filter's history for each finger of a hardware state, a column per
+  // finger in the order they came, so that the filter runs on several
+  // fingers at once. Fingers past the first FingerArrays::kCapacity aren't
+  // filtered.
+  struct Histories {
+    // The column of |tracking_id|, or size if there's none.
+    size_t Find(short tracking_id) const;
+    // Copies column |from| of |that| to column |to|.
+    void CopyColumn(const Histories& that, size_t from, size_t to);
+    // Sets all of column |to|'s history of |field| to |value|.
+    void FillColumn(size_t to, Field field, float value);
+
+    size_t size;
+    short tracking_id[FingerArrays::kCapacity];
+    FingerIirHistory fields[kNumFields];
+  };
+
   // y[0] = b[0]*x[0] + b[1]*x[1] + b[2]*x[2] + b[3]*x[3]
   //        - (a[1]*y[1] + a[2]*y[2])
   DoubleProperty b0_, b1_, b2_, b3_, a1_, a2_;
@@ -90,7 +72,10 @@ class IirFilterInterpreter : public FilterInterpreter, public PropertyDelegate {
   // Whether IIR filter should be used. Put as a member varible for
   // unittest purpose.
   bool using_iir_;
-  map<short, IoHistory, kMaxFingers> histories_;
+  // The histories after the last hardware state, and a buffer that those
+  // after the next one are arranged in. They swap each frame.
+  Histories histories_[2];
+  size_t last_;
 };
 
 }  // namespace gestures
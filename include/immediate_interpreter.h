@@ -5,6 +5,7 @@
 #include <gtest/gtest.h>  // for FRIEND_TEST
 
 #include "gestures/include/finger_metrics.h"
+#include "gestures/include/finger_slots.h"
 #include "gestures/include/gestures.h"
 #include "gestures/include/interpreter.h"
 #include "gestures/include/macros.h"
@@ -41,6 +42,8 @@ class TapRecord {
               const set<short, kMaxTapFingers>& removed,
               const set<short, kMaxFingers>& dead);
   void Clear();
+  void SaveState(StateWriter* writer) const;
+  void RestoreState(StateReader* reader);
 
   // if any gesturing fingers are moving
   bool Moving(const HardwareState& hwstate, const float dist_max) const;
@@ -94,6 +97,8 @@ class ScrollEventBuffer {
       : buf_(new ScrollEvent[size]), max_size_(size), size_(0), head_(0) {}
   void Insert(float dx, float dy, float dt);
   void Clear();
+  void SaveState(StateWriter* writer) const;
+  void RestoreState(StateReader* reader);
   size_t Size() const { return size_; }
   // 0 is newest, 1 is next newest, ..., size_ - 1 is oldest.
   const ScrollEvent& Get(size_t offset) const;
@@ -125,6 +130,10 @@ class HardwareStateBuffer {
   // Pops most recently pushed state
   void PopState();
 
+  // The buffer must have been Reset() with the same max_finger_cnt.
+  void SaveState(StateWriter* writer) const;
+  void RestoreState(StateReader* reader);
+
   const HardwareState* Get(size_t idx) const {
     return &states_[(idx + newest_index_) % size_];
   }
@@ -197,6 +206,9 @@ class ScrollManager {
     stationary_start_positions_.clear();
   }
 
+  void SaveState(StateWriter* writer) const;
+  void RestoreState(StateReader* reader);
+
   // Set to true when a scroll or move is blocked b/c of high pressure
   // change or small movement. Cleared when a normal scroll or move
   // goes through.
@@ -339,6 +351,7 @@ class ImmediateInterpreter : public Interpreter, public PropertyDelegate {
   FRIEND_TEST(ImmediateInterpreterTest, ChangeTimeoutTest);
   FRIEND_TEST(ImmediateInterpreterTest, ClickTest);
   FRIEND_TEST(ImmediateInterpreterTest, FlingDepthTest);
+  FRIEND_TEST(ImmediateInterpreterTest, GestureTypeMemoTest);
   FRIEND_TEST(ImmediateInterpreterTest, GetGesturingFingersTest);
   FRIEND_TEST(ImmediateInterpreterTest, PalmAtEdgeTest);
   FRIEND_TEST(ImmediateInterpreterTest, PalmReevaluateTest);
@@ -372,9 +385,77 @@ class ImmediateInterpreter : public Interpreter, public PropertyDelegate {
     kTtcDragRetouch
   };
 
+  // The tap-to-click state machine is a table of transitions. For each frame
+  // or timer callback, UpdateTapState() updates the TapRecord as the current
+  // state calls for, evaluates the predicates that the state's transitions
+  // test, and takes the first transition whose predicates hold.
+  enum TapPredicate {
+    kTapHwState = 1 << 0,  // Called with a hardware state, not a timer
+    kTapTimeout = 1 << 1,  // TimeoutForTtcState() passed since entering
+    kTapFingersAdded = 1 << 2,  // Fingers that may tap arrived
+    kTapMotionAllowed = 1 << 3,  // Motion Tap Prevent Timeout passed
+    kTapBegan = 1 << 4,  // TapRecord::TapBegan()
+    kTapComplete = 1 << 5,  // TapRecord::TapComplete()
+    kTapMoving = 1 << 6,  // TapRecord::Moving() past Tap Move Distance
+    kTapLeft = 1 << 7,  // TapRecord::TapType() is the left button
+    kTapPressureMet = 1 << 8,  // TapRecord::MinTapPressureMet()
+    kTapFingersYoung = 1 << 9,  // TapRecord::FingersBelowMaxAge()
+    kTapDragEnabled = 1 << 10,  // Tap Drag Enable
+    kTapDragLockEnabled = 1 << 11,  // Tap Drag Lock Enable
+    kTapDragDelayMet = 1 << 12,  // Tap Drag Delay passed since entering
+    kTapDragStationary = 1 << 13,  // Finger stayed still before dragging
+    kTapDragEvaluating = 1 << 14,  // Within Evaluation Timeout of entering
+  };
+
+  // What a transition does besides setting the state.
+  enum TapEffect {
+    kTapPressLeft = 1 << 0,  // Sends a left button down
+    kTapReleaseLeft = 1 << 1,  // Sends a left button up
+    kTapClickLeft = kTapPressLeft | kTapReleaseLeft,
+    kTapClick = 1 << 2,  // Clicks the button of TapRecord::TapType()
+    kTapClearRecord = 1 << 3,  // Clears the TapRecord afterwards
+    kTapResetDragMotion = 1 << 4,  // Starts watching for a stationary finger
+  };
+
+  struct TapTransition {
+    TapToClickState state;
+    unsigned required;  // TapPredicates that must hold
+    unsigned forbidden;  // TapPredicates that must not hold
+    unsigned effects;  // TapEffects
+    TapToClickState next;
+    const char* name;
+  };
+
+  // How the TapRecord is updated in each state, before the transitions'
+  // predicates are evaluated.
+  struct TapRecordUpdate {
+    // The frame is added to the record if these predicates hold...
+    unsigned required;
+    // ...and these don't.
+    unsigned forbidden;
+    bool clear;  // Clears the record before adding the frame
+    bool track_drag_motion;  // Updates tap_drag_finger_was_stationary_
+  };
+
+  // Returns the first transition out of |state| whose predicates hold. Each
+  // state's last transition is unconditional, so there always is one.
+  static const TapTransition& FindTapTransition(TapToClickState state,
+                                                unsigned predicates);
+
+  // The predicates that the transitions out of |state| test.
+  static unsigned TapPredicatesUsed(TapToClickState state);
+
   ImmediateInterpreter(PropRegistry* prop_reg, Tracer* tracer);
   virtual ~ImmediateInterpreter() {}
 
+  // Besides latency, counts how often UpdateCurrentGestureType() kept the
+  // multi-finger gesture type (a hit) rather than running the classifier
+  // (a miss).
+  virtual void ClearLatencyStats();
+  virtual void EncodeLatencyStats(Json::Value* out);
+  size_t gesture_type_hits() const { return gesture_type_hits_; }
+  size_t gesture_type_misses() const { return gesture_type_misses_; }
+
  protected:
   virtual void SyncInterpretImpl(HardwareState* hwstate, stime_t* timeout);
 
@@ -384,6 +465,9 @@ class ImmediateInterpreter : public Interpreter, public PropertyDelegate {
                           Metrics* metrics, MetricsProperties* mprops,
                           GestureConsumer* consumer);
 
+  virtual void SaveOwnState(StateWriter* writer) const;
+  virtual void RestoreOwnState(StateReader* reader);
+
  public:
   TapToClickState tap_to_click_state() const { return tap_to_click_state_; }
 
@@ -561,6 +645,18 @@ class ImmediateInterpreter : public Interpreter, public PropertyDelegate {
                       unsigned* buttons_up,
                       stime_t* timeout);
 
+  // Evaluates the TapPredicates in |used| that depend on the TapRecord and
+  // on how long the current state has lasted.
+  unsigned EvaluateTapPredicates(const HardwareState* hwstate,
+                                 stime_t now,
+                                 unsigned used) const;
+
+  // The transitions of the tap-to-click state machine, grouped by state in
+  // the order of TapToClickState.
+  static const TapTransition kTapTransitions[];
+  // Indexed by TapToClickState.
+  static const TapRecordUpdate kTapRecordUpdates[];
+
   // Returns true iff the given finger is too close to any other finger to
   // realistically be doing a tap gesture.
   bool FingerTooCloseToTap(const HardwareState& hwstate, const FingerState& fs);
@@ -603,8 +699,11 @@ class ImmediateInterpreter : public Interpreter, public PropertyDelegate {
 
   virtual void IntWasWritten(IntProperty* prop);
 
+  // Slots of the present fingers, for tap_dead_fingers_ and moving_.
+  TrackingIdSlots finger_slots_;
+
   // Fingers which are prohibited from ever tapping.
-  set<short, kMaxFingers> tap_dead_fingers_;
+  TrackingIdSet tap_dead_fingers_;
 
   // Active gs fingers are the subset of gs_fingers that are actually performing
   // a gesture
@@ -644,7 +743,7 @@ class ImmediateInterpreter : public Interpreter, public PropertyDelegate {
   // When gesturing fingers move after change, we record the time.
   stime_t started_moving_time_;
   // Record which fingers have started moving already.
-  set<short, kMaxFingers> moving_;
+  TrackingIdSet moving_;
 
   // When different fingers are gesturing, we record the time
   stime_t gs_changed_time_;
@@ -707,6 +806,10 @@ class ImmediateInterpreter : public Interpreter, public PropertyDelegate {
   GestureType current_gesture_type_;
   // Previous value of current_gesture_type_
   GestureType prev_gesture_type_;
+  // Times the multi-finger gesture type was kept or reclassified; see
+  // gesture_type_hits().
+  size_t gesture_type_hits_;
+  size_t gesture_type_misses_;
 
   // Cache for distance between fingers at previous pinch gesture event, or
   // start of pinch detection
@@ -27,6 +27,9 @@ class IntegralGestureFilterInterpreter : public FilterInterpreter {
   virtual void SyncInterpretImpl(HardwareState* hwstate, stime_t* timeout);
   virtual void ConsumeGesture(const Gesture& gesture);
 
+  virtual void SaveOwnState(StateWriter* writer) const;
+  virtual void RestoreOwnState(StateReader* reader);
+
  private:
   Gesture* HandleGesture(Gesture* gs);
 
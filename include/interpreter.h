@@ -8,6 +8,7 @@
 
 #include "gestures/include/activity_log.h"
 #include "gestures/include/gestures.h"
+#include "gestures/include/latency_histogram.h"
 #include "gestures/include/prop_registry.h"
 #include "gestures/include/tracer.h"
 
@@ -27,8 +28,11 @@ class GestureConsumer {
   virtual void ConsumeGesture(const Gesture& gesture) = 0;
 };
 
+class JsonStreamWriter;
 class Metrics;
 class MetricsProperties;
+class StateReader;
+class StateWriter;
 
 // Interface for all interpreters. Interpreters currently are synchronous.
 // A synchronous interpreter will return  0 or 1 Gestures for each passed in
@@ -63,12 +67,50 @@ class Interpreter {
 
   virtual Json::Value EncodeCommonInfo();
   std::string Encode();
+  // Streams the members of EncodeCommonInfo() into the object open in
+  // |writer|.
+  void WriteCommonInfo(JsonStreamWriter* writer) {
+    WriteCommonInfo(writer, log_.get());
+  }
+  // Writes the same JSON as Encode() to |fd| without building it in memory
+  // first. Returns false on a write error.
+  bool WriteEncoded(int fd);
 
   virtual void Clear() {
     if (log_.get())
       log_->Clear();
   }
 
+  // Latency stats record the self time of each SyncInterpret() and
+  // HandleTimer() call, i.e., excluding time spent in nested interpreters.
+  // Time spent by upstream interpreters consuming a gesture produced during
+  // the call is included. Filters apply these to the whole chain below them.
+  virtual void SetLatencyStatsEnabled(bool enabled) {
+    latency_stats_enabled_ = enabled;
+  }
+  virtual void ClearLatencyStats() {
+    sync_latency_.Clear();
+    timer_latency_.Clear();
+  }
+  // Appends an entry per interpreter to |out|, which must be an array.
+  virtual void EncodeLatencyStats(Json::Value* out);
+  bool latency_stats_enabled() const { return latency_stats_enabled_; }
+  const LatencyHistogram& sync_latency() const { return sync_latency_; }
+  const LatencyHistogram& timer_latency() const { return timer_latency_; }
+
+  // Saves the state gesture recognition depends on, such as the fingers and
+  // their histories, queued input and gestures in progress, to |writer|.
+  // Properties, logs and stats aren't saved. Filters save the interpreters
+  // below them too.
+  virtual void SaveState(StateWriter* writer);
+  // Restores state saved by the same chain into this one, which must have
+  // been initialized with the same hardware properties. Returns false if
+  // |reader| doesn't hold such state, in which case this chain's state is
+  // undefined until Clear() or more input. Timer requests aren't saved: if
+  // one was pending, call HandleTimer() once it's due.
+  // GestureInterpreter::SaveState() saves its pending timeout alongside.
+  virtual bool RestoreState(StateReader* reader);
+
   virtual void ProduceGesture(const Gesture& gesture);
   const char* name() const { return name_; }
 
@@ -84,13 +126,39 @@ class Interpreter {
   void InitName();
   void Trace(const char* message, const char* name);
 
+  // These match the public versions, but with |log|, which may be NULL, in
+  // place of this interpreter's log, and |latency_stats| in place of its
+  // latency stats, which are left out if null.
+  void WriteCommonInfo(JsonStreamWriter* writer, ActivityLog* log);
+  bool WriteEncoded(int fd, ActivityLog* log,
+                    const Json::Value& latency_stats);
+  // Streams the common info of the interpreters below this one, which deep
+  // logs include.
+  virtual void WriteNextCommonInfo(JsonStreamWriter* writer) {}
+
+  // True if SyncInterpret(), HandleTimer() and ProduceGesture() have nothing
+  // to do besides calling through: no logging, tracing, latency stats or
+  // own metrics.
+  bool IsPlainHop() const {
+    return initialized_ && !log_.get() && !own_metrics_.get() &&
+        !latency_stats_enabled_ && !(tracer_ && tracer_->enabled());
+  }
+
   virtual void SyncInterpretImpl(HardwareState* hwstate,
                                  stime_t* timeout) {}
   virtual void HandleTimerImpl(stime_t now, stime_t* timeout) {}
 
+  // Save and restore this interpreter's own members. Interpreters whose
+  // behavior depends only on their properties needn't override these.
+  virtual void SaveOwnState(StateWriter* writer) const {}
+  virtual void RestoreOwnState(StateReader* reader) {}
+
  private:
   const char* name_;
   Tracer* tracer_;
+  bool latency_stats_enabled_;
+  LatencyHistogram sync_latency_;
+  LatencyHistogram timer_latency_;
   void LogOutputs(const Gesture* result, stime_t* timeout, const char* action);
 };
 }  // namespace gestures
@@ -0,0 +1,184 @@
+// Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef GESTURES_INTERPRETER_STATE_H_
+#define GESTURES_INTERPRETER_STATE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "gestures/include/finger_metrics.h"
+#include "gestures/include/gestures.h"
+#include "gestures/include/macros.h"
+#include "gestures/include/map.h"
+#include "gestures/include/set.h"
+#include "gestures/include/vector.h"
+
+namespace gestures {
+
+// Snapshots of an interpreter chain's state (see Interpreter::SaveState())
+// are compact binary blobs: a header, then a section per interpreter, outer
+// first, holding the interpreter's members in the order it writes them.
+// Each section starts with the interpreter's name and length, so a snapshot
+// is only restored into the same chain. Values are stored in host byte order
+// and layout: a snapshot is for the build that wrote it.
+class StateWriter {
+ public:
+  StateWriter();
+
+  // Sections nest; each is ended by the matching EndSection().
+  void BeginSection(const char* name);
+  void EndSection();
+
+  void WriteBytes(const void* data, size_t size);
+
+  template<typename T>
+  void Write(const T& value) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Write the members of T instead");
+    WriteBytes(&value, sizeof(value));
+  }
+
+  template<typename T, size_t kMaxSize>
+  void Write(const vector<T, kMaxSize>& values) {
+    Write(static_cast<uint32_t>(values.size()));
+    for (const T& value : values)
+      Write(value);
+  }
+
+  template<typename T, size_t kMaxSize>
+  void Write(const set<T, kMaxSize>& values) {
+    Write(static_cast<uint32_t>(values.size()));
+    for (const T& value : values)
+      Write(value);
+  }
+
+  // Keys and values are written in the map's order, which restoring keeps.
+  template<typename Key, typename Data, size_t kMaxSize>
+  void Write(const map<Key, Data, kMaxSize>& values) {
+    Write(static_cast<uint32_t>(values.size()));
+    for (const auto& value : values) {
+      Write(value.first);
+      Write(value.second);
+    }
+  }
+
+  void Write(const Vector2& value);
+  void Write(const FingerState& finger);
+  // Writes the fields and fingers of |hwstate|.
+  void Write(const HardwareState& hwstate);
+
+  const std::string& blob() const { return blob_; }
+
+ private:
+  std::string blob_;
+  // Offsets of the lengths of the open sections.
+  std::vector<size_t> sections_;
+
+  DISALLOW_COPY_AND_ASSIGN(StateWriter);
+};
+
+// Reads a blob written by StateWriter. Read() calls must match the Write()
+// calls that wrote it. Once a read fails, because the blob is too short or a
+// value is out of range, ok() is false and all later reads fail too.
+class StateReader {
+ public:
+  // Reads from |size| bytes at |data|, which must outlive this reader.
+  StateReader(const char* data, size_t size);
+
+  // Fails if the next section isn't |name|'s.
+  bool BeginSection(const char* name);
+  // Fails if the section wasn't read up to its end.
+  bool EndSection();
+
+  bool ReadBytes(void* data, size_t size);
+
+  template<typename T>
+  bool Read(T* value) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Read the members of T instead");
+    return ReadBytes(value, sizeof(*value));
+  }
+
+  template<typename T, size_t kMaxSize>
+  bool Read(vector<T, kMaxSize>* values) {
+    uint32_t size = 0;
+    if (!ReadSize(&size, kMaxSize))
+      return false;
+    values->clear();
+    for (uint32_t i = 0; i < size; i++) {
+      T value;
+      if (!Read(&value))
+        return false;
+      values->push_back(value);
+    }
+    return true;
+  }
+
+  template<typename T, size_t kMaxSize>
+  bool Read(set<T, kMaxSize>* values) {
+    uint32_t size = 0;
+    if (!ReadSize(&size, kMaxSize))
+      return false;
+    values->clear();
+    for (uint32_t i = 0; i < size; i++) {
+      T value;
+      if (!Read(&value))
+        return false;
+      values->insert(value);
+    }
+    return true;
+  }
+
+  template<typename Key, typename Data, size_t kMaxSize>
+  bool Read(map<Key, Data, kMaxSize>* values) {
+    uint32_t size = 0;
+    if (!ReadSize(&size, kMaxSize))
+      return false;
+    values->clear();
+    for (uint32_t i = 0; i < size; i++) {
+      Key key;
+      Data data;
+      if (!Read(&key) || !Read(&data))
+        return false;
+      (*values)[key] = data;
+    }
+    return true;
+  }
+
+  bool Read(Vector2* value);
+  bool Read(FingerState* finger);
+  // Reads the fields of a HardwareState into |hwstate|, and its fingers into
+  // hwstate->fingers, which must have room for |max_finger_cnt| of them.
+  bool Read(HardwareState* hwstate, size_t max_finger_cnt);
+
+  // Makes this and later reads fail, e.g. because a value read is out of
+  // range. Returns false.
+  bool Fail(const char* what);
+
+  bool ok() const { return ok_; }
+  // True once the whole blob has been read.
+  bool done() const { return ok_ && pos_ == size_; }
+
+ private:
+  // Reads a size, failing if it's over |max_size|.
+  bool ReadSize(uint32_t* size, size_t max_size);
+
+  const char* data_;
+  size_t size_;
+  size_t pos_;
+  bool ok_;
+  // Offsets of the ends of the open sections.
+  std::vector<size_t> section_ends_;
+
+  DISALLOW_COPY_AND_ASSIGN(StateReader);
+};
+
+}  // namespace gestures
+
+#endif  // GESTURES_INTERPRETER_STATE_H_
@@ -0,0 +1,99 @@
+// Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef GESTURES_JSON_STREAM_WRITER_H_
+#define GESTURES_JSON_STREAM_WRITER_H_
+
+#include <stddef.h>
+
+#include <vector>
+
+#include <json/value.h>
+
+#include "gestures/include/macros.h"
+
+namespace gestures {
+
+// Writes JSON to a file descriptor as it's produced, through a small fixed
+// buffer, so that large documents can be written without building them in
+// memory first. The caller is responsible for producing well-formed nesting:
+// within an object, each value must be preceded by Key().
+class JsonStreamWriter {
+ public:
+  explicit JsonStreamWriter(int fd);
+  ~JsonStreamWriter() { Flush(); }
+
+  void BeginObject();
+  void EndObject();
+  void BeginArray();
+  void EndArray();
+  void Key(const char* key);
+
+  void Bool(bool value);
+  void Int(int value);
+  void Double(double value);
+  void String(const char* value);
+  // Writes a whole Json::Value, for small parts of a document that are
+  // already in that form.
+  void Value(const Json::Value& value);
+
+  // Writes out anything buffered. Returns false if any write so far failed.
+  bool Flush();
+
+  static const size_t kBufferSize = 4096;
+
+ private:
+  // Starts a new value, adding a separator from the previous one if needed.
+  void StartValue();
+  void Write(const char* data, size_t size);
+  void WriteChar(char c) {
+    if (used_ == kBufferSize)
+      Flush();
+    buffer_[used_++] = c;
+  }
+  void WriteString(const char* value, size_t size);
+
+  int fd_;
+  char buffer_[kBufferSize];
+  size_t used_;
+  size_t depth_;
+  bool first_;  // No value yet in the current object or array
+  bool after_key_;  // The next value belongs to the key just written
+  bool ok_;
+
+  DISALLOW_COPY_AND_ASSIGN(JsonStreamWriter);
+};
+
+// Builds a Json::Value through the same calls as JsonStreamWriter, so that
+// code templated on the writer can produce either.
+class JsonValueWriter {
+ public:
+  // Values are added as members of |root|, which must be an object.
+  explicit JsonValueWriter(Json::Value* root);
+
+  void BeginObject();
+  void EndObject();
+  void BeginArray();
+  void EndArray();
+  void Key(const char* key) { key_ = key; }
+
+  void Bool(bool value) { Add(Json::Value(value)); }
+  void Int(int value) { Add(Json::Value(value)); }
+  void Double(double value) { Add(Json::Value(value)); }
+  void String(const char* value) { Add(Json::Value(value)); }
+  void Value(const Json::Value& value) { Add(value); }
+
+ private:
+  // Adds |value| to the innermost open object or array and returns it.
+  Json::Value* Add(const Json::Value& value);
+
+  std::vector<Json::Value*> open_;
+  const char* key_;
+
+  DISALLOW_COPY_AND_ASSIGN(JsonValueWriter);
+};
+
+}  // namespace gestures
+
+#endif  // GESTURES_JSON_STREAM_WRITER_H_
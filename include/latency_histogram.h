@@ -0,0 +1,56 @@
+// Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef GESTURES_LATENCY_HISTOGRAM_H_
+#define GESTURES_LATENCY_HISTOGRAM_H_
+
+#include <json/value.h>
+
+#include "gestures/include/gestures.h"
+
+namespace gestures {
+
+// Returns the current time of a monotonic clock, for measuring durations.
+stime_t MonotonicNow();
+
+// A fixed-size histogram of durations. Adding a sample never allocates, so
+// it's safe to use on every event.
+//
+// Bucket 0 counts samples under 1 us. Bucket i > 0 counts samples in
+// [2^(i-1), 2^i) us, except for the last bucket, which also counts all
+// longer samples.
+class LatencyHistogram {
+ public:
+  static const size_t kNumBuckets = 20;
+
+  LatencyHistogram() { Clear(); }
+
+  void Add(stime_t duration);
+  void Clear();
+
+  size_t count() const { return count_; }
+  stime_t total() const { return total_; }
+  stime_t max() const { return max_; }
+  size_t bucket(size_t idx) const { return buckets_[idx]; }
+
+  // Returns the bucket a sample of |duration| is counted in.
+  static size_t BucketForDuration(stime_t duration);
+
+  Json::Value Encode() const;
+
+  static const char kKeyCount[];
+  static const char kKeyTotal[];
+  static const char kKeyMax[];
+  static const char kKeyBuckets[];
+
+ private:
+  size_t buckets_[kNumBuckets];
+  size_t count_;
+  stime_t total_;
+  stime_t max_;
+};
+
+}  // namespace gestures
+
+#endif  // GESTURES_LATENCY_HISTOGRAM_H_
@@ -3,6 +3,10 @@
 // found in the LICENSE file.
 
 #include <gtest/gtest.h>
+#include <json/value.h>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <string>
 
 #include "gestures/include/activity_log.h"
@@ -21,29 +25,70 @@ namespace gestures {
 class LoggingFilterInterpreter : public FilterInterpreter,
                                  public PropertyDelegate {
   FRIEND_TEST(ActivityReplayTest, DISABLED_SimpleTest);
+  FRIEND_TEST(LoggingFilterInterpreterTest, AsyncDumpTest);
+  FRIEND_TEST(LoggingFilterInterpreterTest, BinaryDumpTest);
+  FRIEND_TEST(LoggingFilterInterpreterTest, CoalescedDumpTest);
+  FRIEND_TEST(LoggingFilterInterpreterTest, StreamedDumpTest);
   FRIEND_TEST(LoggingFilterInterpreterTest, LogResetHandlerTest);
  public:
   // Takes ownership of |next|:
   LoggingFilterInterpreter(PropRegistry* prop_reg, Interpreter* next,
                            Tracer* tracer);
-  virtual ~LoggingFilterInterpreter() {}
+  virtual ~LoggingFilterInterpreter();
 
+  virtual void BoolWasWritten(BoolProperty* prop);
   virtual void IntWasWritten(IntProperty* prop);
 
   std::string EncodeActivityLog();
 
  private:
+  // Everything an asynchronous dump writes, copied on the input thread.
+  struct DumpSnapshot {
+    DumpSnapshot() : binary(false), log(NULL) {}
+    std::string filename;
+    bool binary;
+    ActivityLog log;
+    Json::Value latency_stats;  // Null if latency stats are disabled
+  };
+
   void Dump(const char* filename);
+  // Snapshots the log and starts a thread to encode and write it. If a dump
+  // is already being written, the snapshot is written after it instead,
+  // replacing any other still waiting.
+  void DumpAsync(const char* filename);
+  // Writes queued snapshots until there are none left.
+  void WriteDumps();
+  static void* DumpThreadMain(void* interpreter);
+  void WriteSnapshot(DumpSnapshot* snapshot);
+  // Waits for any asynchronous dumps in progress to finish.
+  void WaitForDump();
 
   IntProperty logging_notify_;
   // Reset the log by setting the property value.
   IntProperty logging_reset_;
   StringProperty log_location_;
+  // If true, Dump() writes ActivityLog's binary format rather than JSON.
+  // Use log_to_json to convert such logs.
+  BoolProperty log_binary_;
+  // If true, Dump() only copies the log, and a worker thread encodes and
+  // writes it, so that dumping doesn't stall input processing.
+  BoolProperty log_dump_async_;
+  // If true, record per-interpreter latency stats for the whole chain. They
+  // are included in the activity log and reset along with it.
+  BoolProperty latency_stats_enable_;
 
   // This property is unused by this library, but we need a place to stick it.
   // If true, this device is an integrated touchpad, as opposed to an external
   // device.
   BoolProperty integrated_touchpad_;
+
+  // Guard the members below, which the dump thread shares.
+  std::mutex dump_lock_;
+  std::condition_variable dump_done_;
+  // True while a thread is writing dumps.
+  bool dump_running_;
+  // The next snapshot to write, if any.
+  std::unique_ptr<DumpSnapshot> pending_dump_;
 };
 }  // namespace gestures
 
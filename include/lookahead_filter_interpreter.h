@@ -3,14 +3,13 @@
 // found in the LICENSE file.
 
 #include <algorithm>
-#include <memory>
+#include <vector>
 
 #include <gtest/gtest.h>  // For FRIEND_TEST
 
 #include "gestures/include/filter_interpreter.h"
 #include "gestures/include/finger_metrics.h"
 #include "gestures/include/gestures.h"
-#include "gestures/include/list.h"
 #include "gestures/include/map.h"
 #include "gestures/include/prop_registry.h"
 #include "gestures/include/tracer.h"
@@ -21,12 +20,16 @@
 namespace gestures {
 
 class LookaheadFilterInterpreter : public FilterInterpreter {
+  FRIEND_TEST(LookaheadFilterInterpreterTest, AdaptiveDelayTest);
   FRIEND_TEST(LookaheadFilterInterpreterTest, CyapaQuickTwoFingerMoveTest);
   FRIEND_TEST(LookaheadFilterInterpreterTest, DrumrollTest);
   FRIEND_TEST(LookaheadFilterInterpreterTest, InterpolateHwStateTest);
   FRIEND_TEST(LookaheadFilterInterpreterTest, InterpolateTest);
   FRIEND_TEST(LookaheadFilterInterpreterTest, InterpolationOverdueTest);
   FRIEND_TEST(LookaheadFilterInterpreterTest, NoTapSetTest);
+  FRIEND_TEST(LookaheadFilterInterpreterTest, OverflowCoalesceTest);
+  FRIEND_TEST(LookaheadFilterInterpreterTest, OverflowFlushTest);
+  FRIEND_TEST(LookaheadFilterInterpreterTest, OverflowGrowTest);
   FRIEND_TEST(LookaheadFilterInterpreterTest, QuickMoveTest);
   FRIEND_TEST(LookaheadFilterInterpreterTest, QuickSwipeTest);
   FRIEND_TEST(LookaheadFilterInterpreterTest, SemiMtNoTrackingIdAssignmentTest);
@@ -34,10 +37,25 @@ class LookaheadFilterInterpreter : public FilterInterpreter {
   FRIEND_TEST(LookaheadFilterInterpreterTest, SpuriousCallbackTest);
   FRIEND_TEST(LookaheadFilterInterpreterTest, VariableDelayTest);
  public:
+  // What to do with a new hardware state when the queue is full.
+  enum OverflowPolicy {
+    // Send the oldest queued state on to next_ early.
+    kOverflowFlush = 0,
+    // Fold the new state into the newest queued one, if it has the same
+    // fingers and buttons. Otherwise, flush.
+    kOverflowCoalesce = 1,
+    // Double the size of the queue.
+    kOverflowGrow = 2,
+  };
+
   LookaheadFilterInterpreter(PropRegistry* prop_reg, Interpreter* next,
                              Tracer* tracer);
   virtual ~LookaheadFilterInterpreter() {}
 
+  // Besides latency, reports the queue delay last applied and, with
+  // adaptive delay, the estimates it was chosen from.
+  virtual void EncodeLatencyStats(Json::Value* out);
+
  protected:
   virtual void SyncInterpretImpl(HardwareState* hwstate,
                                  stime_t* timeout);
@@ -48,24 +66,68 @@ class LookaheadFilterInterpreter : public FilterInterpreter {
                           Metrics* metrics, MetricsProperties* mprops,
                           GestureConsumer* consumer);
 
+  virtual void SaveOwnState(StateWriter* writer) const;
+  virtual void RestoreOwnState(StateReader* reader);
+
  private:
   struct QState {
     QState();
-    explicit QState(unsigned short max_fingers);
 
     // Deep copy of new_state to state_
     void set_state(const HardwareState& new_state);
 
+    // state_.fingers points to room for max_fingers_ fingers, owned by the
+    // queue.
     HardwareState state_;
     unsigned short max_fingers_;
-    std::unique_ptr<FingerState[]> fs_;
     map<short, short, kMaxFingers> output_ids_;  // input tracking ids -> output
 
     stime_t due_;
     bool completed_;
+  };
 
-    QState* next_;
-    QState* prev_;
+  // A fixed-capacity ring of QStates, oldest first. The fingers of all the
+  // nodes live in one slab, so nothing is allocated once the ring is sized.
+  // Nodes don't move while they're queued, except by InsertBeforeTail().
+  class QStateRing {
+   public:
+    QStateRing() : head_(0), size_(0), max_fingers_(0) {}
+
+    // Empties the ring and makes room for |capacity| nodes of |max_fingers|
+    // fingers each.
+    void Reset(size_t capacity, unsigned short max_fingers);
+    // Doubles the capacity, keeping the queued nodes.
+    void Grow();
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return nodes_.size(); }
+    bool Empty() const { return size_ == 0; }
+    bool Full() const { return size_ == nodes_.size(); }
+
+    // The |i|th oldest node.
+    QState* At(size_t i) {
+      return &nodes_[(head_ + i) % nodes_.size()];
+    }
+    const QState* At(size_t i) const {
+      return &nodes_[(head_ + i) % nodes_.size()];
+    }
+    QState* Head() { return At(0); }
+    QState* Tail() { return At(size_ - 1); }
+
+    // Appends a node and returns it, or returns NULL if the ring is full.
+    QState* PushBack();
+    // Inserts a node before the tail and returns it, or returns NULL if the
+    // ring is full or empty.
+    QState* InsertBeforeTail();
+    void PopFront();
+    void Clear() { head_ = size_ = 0; }
+
+   private:
+    std::vector<QState> nodes_;
+    std::vector<FingerState> fingers_;
+    size_t head_;
+    size_t size_;
+    unsigned short max_fingers_;
   };
 
   void LogVectors();
@@ -106,10 +168,23 @@ class LookaheadFilterInterpreter : public FilterInterpreter {
                             stime_t* timeout);
   void ConsumeGesture(const Gesture& gesture);
 
+  // Sends |node|'s state on to next_ and marks it completed.
+  void InterpretNode(QState* node, stime_t* next_timeout);
+
+  // Makes room in the full queue for |hwstate| as overflow_policy_ says.
+  // Returns true if |hwstate| was coalesced into the queue's tail instead.
+  bool HandleOverflow(const HardwareState& hwstate, stime_t* timeout);
+
+  // Folds |hwstate| into the tail of the queue, if it has the same fingers
+  // and buttons and the tail hasn't been sent on yet. Returns true if so.
+  bool CoalesceIntoTail(const HardwareState& hwstate);
+
+  // Sets delay_ for a hardware state arriving at |now|.
+  void UpdateDelay(stime_t now);
+
   stime_t ExtraVariableDelay() const;
 
-  List<QState> queue_;
-  List<QState> free_list_;
+  QStateRing queue_;
 
   // The last id assigned to a contact (part of drumroll suppression)
   short last_id_;
@@ -124,6 +199,18 @@ class LookaheadFilterInterpreter : public FilterInterpreter {
 
   Gesture result_;
 
+  // The delay applied to the hardware states being queued: min_delay_, or
+  // less with adaptive_delay_.
+  stime_t delay_;
+  // With adaptive_delay_, smoothed estimates of the time between hardware
+  // states and of how long next_ takes to handle one, and the time of the
+  // last hardware state.
+  stime_t report_interval_;
+  stime_t downstream_time_;
+  stime_t last_hwstate_time_;
+  // Times next_ for downstream_time_. Tests replace it to get steady times.
+  stime_t (*clock_)();
+
   DoubleProperty min_nonsuppress_speed_;
   DoubleProperty min_delay_;
   // On some platforms, min_delay_ is very small, and sometimes we would like
@@ -159,6 +246,17 @@ class LookaheadFilterInterpreter : public FilterInterpreter {
   // If looking for a possible liftoff-move, the speed a finger is moving
   // relative to the previous speed, such that it's a possible leave.
   DoubleProperty liftoff_speed_increase_threshold_;
+  // An OverflowPolicy: what to do when hardware states come in faster than
+  // the queue drains.
+  IntProperty overflow_policy_;
+  // If set, the queue delay shrinks below min_delay_ to what drumroll and
+  // quick move correction need: a state must still be queued when the next
+  // one has arrived and been handled. That's adaptive_delay_factor_ times the
+  // measured report interval, plus the time next_ takes. Possibly ambiguous
+  // states are still held for max_delay_ in all.
+  BoolProperty adaptive_delay_;
+  // Allows for jitter in the report interval. Should be over 1.
+  DoubleProperty adaptive_delay_factor_;
 };
 
 }  // namespace gestures
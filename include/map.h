@@ -161,9 +161,18 @@ void RemoveMissingIdsFromMap(map<short, Data, kSetSize>* the_map,
                              const HardwareState& hs,
                              map<short, Data, kSetSize>* removed) {
   removed->clear();
+  if (the_map->empty())
+    return;
+  if (!hs.finger_cnt) {
+    *removed = *the_map;
+    the_map->clear();
+    return;
+  }
+  short ids[hs.finger_cnt];
+  size_t ids_len = GetTrackingIds(hs, ids);
   for (typename map<short, Data, kSetSize>::const_iterator it =
       the_map->begin(); it != the_map->end(); ++it)
-    if (!hs.GetFingerState((*it).first))
+    if (FindValueIndex(ids, ids_len, it->first) == ids_len)
       (*removed)[it->first] = it->second;
   for (typename map<short, Data, kSetSize>::const_iterator it =
       removed->begin(); it != removed->end(); ++it)
@@ -38,6 +38,10 @@ class MouseInterpreter : public Interpreter, public PropertyDelegate {
   void InterpretScrollWheelEvent(const HardwareState& hwstate,
                                  bool is_vertical);
   bool EmulateScrollWheel(const HardwareState& hwstate);
+
+  virtual void SaveOwnState(StateWriter* writer) const;
+  virtual void RestoreOwnState(StateReader* reader);
+
  private:
   struct WheelRecord {
     WheelRecord(float v, stime_t t): value(v), timestamp(t) {}
@@ -43,6 +43,9 @@ class MultitouchMouseInterpreter : public MouseInterpreter {
                           GestureConsumer* consumer);
   virtual void ProduceGesture(const Gesture& gesture);
 
+  virtual void SaveOwnState(StateWriter* writer) const;
+  virtual void RestoreOwnState(StateReader* reader);
+
  private:
   void InterpretMultitouchEvent();
 
@@ -2,10 +2,14 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <memory>
+#include <string>
+
 #include <gtest/gtest.h>  // for FRIEND_TEST
 
 #include "gestures/include/filter_interpreter.h"
 #include "gestures/include/gestures.h"
+#include "gestures/include/macros.h"
 #include "gestures/include/prop_registry.h"
 #include "gestures/include/tracer.h"
 
@@ -47,15 +51,74 @@ namespace gestures {
 //          8 bytes: Double x error
 //          8 bytes: Double y error
 //
+// All values are little-endian, and packed: the doubles aren't aligned.
+//
 // Currently, this only handles the situation where exactly 1 finger is on the
 // touchpad at a time.  There may be interactions between multiple contacts
 // that this doesn't take into consideration, so it simply skips hwstates with
 // more than 1 finger.
 
+// A table of errors in the format above, read from its file. Interpreters
+// that load the same file share one copy.
+class NonLinearityTable {
+ public:
+  struct Error {
+    double x_error;
+    double y_error;
+  };
+
+  // Returns the table at |path|, reading it unless it's loaded already, or
+  // NULL if it can't be read or is malformed.
+  static std::shared_ptr<const NonLinearityTable> Open(const char* path);
+
+  // Given a point (x, y, p), calculates the non-linearity error that needs to
+  // be compensated for at that point, by interpolating between the eight
+  // samples around it. Outside the sampled range, the error is zero.
+  Error GetError(float x, float y, float p) const;
+
+ private:
+  // A range array: the points along one axis where the error was sampled.
+  struct Axis {
+    double Value(size_t i) const;
+    // Finds the samples on either side of |value|: the last at or below it,
+    // |*lo|, and the one after it, and how far |value| is from |*lo| to the
+    // next, |*frac|. Returns false if there aren't samples on both sides.
+    bool FindCell(float value, size_t* lo, float* frac) const;
+
+    const char* values;
+    size_t len;
+    // If the samples are evenly spaced, cells are found from the first and
+    // the spacing, rather than by a binary search.
+    bool uniform;
+    double first;
+    double inv_step;
+  };
+
+  NonLinearityTable() : x_(), y_(), p_(), errors_(NULL) {}
+
+  // Sets up the axes and errors_ from data_. Returns false if the file is
+  // malformed.
+  bool Parse();
+  bool ParseAxis(size_t* pos, Axis* axis);
+  // Where the error for the sample (x_index, y_index, p_index) is stored.
+  const char* ErrorAt(size_t x_index, size_t y_index, size_t p_index) const;
+  // Interpolates the errors of the cell whose lowest corner is (x_lo, y_lo,
+  // p_lo), one scalar at a time.
+  Error Blend(size_t x_lo, size_t y_lo, size_t p_lo,
+              float x_hi_perc, float y_hi_perc, float p_hi_perc) const;
+
+  std::string data_;
+  Axis x_, y_, p_;
+  const char* errors_;
+
+  DISALLOW_COPY_AND_ASSIGN(NonLinearityTable);
+};
+
 class NonLinearityFilterInterpreter : public FilterInterpreter {
   FRIEND_TEST(NonLinearityFilterInterpreterTest, DisablingTest);
   FRIEND_TEST(NonLinearityFilterInterpreterTest, HWstateModificationTest);
   FRIEND_TEST(NonLinearityFilterInterpreterTest, HWstateNoChangesNeededTest);
+  FRIEND_TEST(NonLinearityFilterInterpreterTest, SharedTableTest);
  public:
   NonLinearityFilterInterpreter(PropRegistry* prop_reg, Interpreter* next,
                            Tracer* tracer);
@@ -64,42 +127,12 @@ class NonLinearityFilterInterpreter : public FilterInterpreter {
   virtual void SyncInterpretImpl(HardwareState* hwstate, stime_t* timeout);
 
  private:
-  struct Error {
-    double x_error;
-    double y_error;
-  };
-  struct Bounds {
-    ssize_t lo;
-    ssize_t hi;
-  };
-
-  // The error readings are stored in a flattened matrix, this finds the 1d
-  // index corresponding to the point (x_index, y_index, p_index)
-  unsigned int ErrorIndex(size_t x_index, size_t y_index, size_t p_index) const;
-  // Find the two values in the range on either side of "value" to interpolate
-  Bounds FindBounds(float value, const std::unique_ptr<double[]>& range,
-                           size_t len) const;
-  // Given a point (x, y, p) calculate the non-linearity error that needs to be
-  // compensated for at that point.
-  Error GetError(float finger_x, float finger_y, float finger_p) const;
-  // Interpolate linearly between p1 and p2, according to percent_p1
-  Error LinearInterpolate(const Error& p1, const Error& p2,
-                          float percent_p1) const;
-  // Load nonlinearity data from disk and parse it
+  // Load nonlinearity data from disk
   void LoadData();
-  // Parse only a range array from the binary data
-  bool LoadRange(std::unique_ptr<double[]>& arr, size_t& len, FILE* fd);
-  int ReadObject(void* buf, size_t object_size, FILE* fd);
 
   BoolProperty enabled_;
   StringProperty data_location_;
-  // These three arrays define the points where the error was sampled.
-  // There is a reading in err_ for each point formed by the cross product
-  // of these arrays.
-  std::unique_ptr<double[]> x_range_, y_range_, p_range_;
-  size_t x_range_len_, y_range_len_, p_range_len_;
-  // A flattened 3-d array holding the actual sampled error values
-  std::unique_ptr<Error[]> err_;
+  std::shared_ptr<const NonLinearityTable> table_;
 };
 
 }  // namespace gestures
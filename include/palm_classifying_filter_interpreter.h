@@ -6,6 +6,7 @@
 
 #include "gestures/include/filter_interpreter.h"
 #include "gestures/include/finger_metrics.h"
+#include "gestures/include/finger_slots.h"
 #include "gestures/include/gestures.h"
 #include "gestures/include/macros.h"
 #include "gestures/include/map.h"
@@ -37,6 +38,9 @@ class PalmClassifyingFilterInterpreter : public FilterInterpreter {
  protected:
   virtual void SyncInterpretImpl(HardwareState* hwstate, stime_t* timeout);
 
+  virtual void SaveOwnState(StateWriter* writer) const;
+  virtual void RestoreOwnState(StateReader* reader);
+
  private:
   void FillOriginInfo(const HardwareState& hwstate);
   void FillPrevInfo(const HardwareState& hwstate);
@@ -79,40 +83,44 @@ class PalmClassifyingFilterInterpreter : public FilterInterpreter {
   // FingerStates from the previous HardwareState.
   map<short, FingerState, kMaxFingers> prev_fingerstates_;
 
+  // Slots of the present fingers, for the containers below. They only ever
+  // hold present fingers.
+  TrackingIdSlots finger_slots_;
+
   // Max reported pressure for present fingers.
-  map<short, float, kMaxFingers> max_pressure_;
+  TrackingIdMap<float> max_pressure_;
 
   // Max reported width for present fingers.
-  map<short, float, kMaxFingers> max_width_;
+  TrackingIdMap<float> max_width_;
 
   // Accumulated distance travelled by each finger.
   // _positive[0]  -->  positive direction along x axis
   // _positive[1]  -->  positive direction along y axis
   // _negative[0]  -->  negative direction along x axis
   // _negative[1]  -->  negative direction along y axis
-  map<short, float, kMaxFingers> distance_positive_[2];
-  map<short, float, kMaxFingers> distance_negative_[2];
+  TrackingIdMap<float> distance_positive_[2];
+  TrackingIdMap<float> distance_negative_[2];
 
   // Same fingers state. This state is accumulated as fingers remain the same
   // and it's reset when fingers change.
-  set<short, kMaxFingers> palm_;  // tracking ids of known palms
+  TrackingIdSet palm_;  // tracking ids of known palms
   // These contacts have moved significantly and shouldn't be considered
   // stationary palms:
-  set<short, kMaxFingers> non_stationary_palm_;
+  TrackingIdSet non_stationary_palm_;
 
   static const unsigned kPointCloseToFinger = 1;
   static const unsigned kPointNotInEdge = 2;
   static const unsigned kPointMoving = 4;
   // tracking ids of known fingers that are not palms, along with the reason(s)
-  map<short, unsigned, kMaxFingers> pointing_;
+  TrackingIdMap<unsigned> pointing_;
 
 
   // tracking ids that were ever close to other fingers.
-  set<short, kMaxFingers> was_near_other_fingers_;
+  TrackingIdSet was_near_other_fingers_;
 
   // tracking ids that have ever travelled out of the palm envelope or bottom
   // area.
-  set<short, kMaxFingers> fingers_not_in_edge_;
+  TrackingIdSet fingers_not_in_edge_;
 
   // Previously input timestamp
   stime_t prev_time_;
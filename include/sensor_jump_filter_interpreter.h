@@ -36,6 +36,9 @@ class SensorJumpFilterInterpreter : public FilterInterpreter,
  protected:
   virtual void SyncInterpretImpl(HardwareState* hwstate, stime_t* timeout);
 
+  virtual void SaveOwnState(StateWriter* writer) const;
+  virtual void RestoreOwnState(StateReader* reader);
+
  private:
   // Whether or not this filter is enabled. If disabled, it behaves as a
   // simple passthrough.
@@ -130,15 +130,32 @@ inline void SetRemoveMissing(ReducedSet* reduced, const RequiredSet& required) {
   }
 }
 
+// Copies the tracking ids of the fingers in hs to ids, so that they can be
+// searched with FindValueIndex(). ids must have room for hs.finger_cnt
+// values; returns hs.finger_cnt.
+inline size_t GetTrackingIds(const HardwareState& hs, short* ids) {
+  for (size_t i = 0; i < hs.finger_cnt; i++)
+    ids[i] = hs.fingers[i].tracking_id;
+  return hs.finger_cnt;
+}
+
 // Removes any ids from the set that are not finger ids in hs.
 template<size_t kSetSize>
 void RemoveMissingIdsFromSet(set<short, kSetSize>* the_set,
                              const HardwareState& hs) {
+  if (the_set->empty())
+    return;
+  if (!hs.finger_cnt) {
+    the_set->clear();
+    return;
+  }
+  short ids[hs.finger_cnt];
+  size_t ids_len = GetTrackingIds(hs, ids);
   short old_ids[the_set->size()];
   size_t old_ids_len = 0;
   for (typename set<short, kSetSize>::const_iterator it = the_set->begin();
        it != the_set->end(); ++it)
-    if (!hs.GetFingerState(*it))
+    if (FindValueIndex(ids, ids_len, *it) == ids_len)
       old_ids[old_ids_len++] = *it;
   for (size_t i = 0; i < old_ids_len; i++)
     the_set->erase(old_ids[i]);
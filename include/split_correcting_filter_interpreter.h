@@ -57,6 +57,9 @@ class SplitCorrectingFilterInterpreter : public FilterInterpreter {
  protected:
   virtual void SyncInterpretImpl(HardwareState* hwstate, stime_t* timeout);
 
+  virtual void SaveOwnState(StateWriter* writer) const;
+  virtual void RestoreOwnState(StateReader* reader);
+
  private:
   void RemoveMissingUnmergedContacts(const HardwareState& hwstate);
   void MergeFingers(const HardwareState& hwstate);
@@ -131,6 +131,9 @@ class StationaryWiggleFilterInterpreter : public FilterInterpreter {
  protected:
   virtual void SyncInterpretImpl(HardwareState* hwstate, stime_t* timeout);
 
+  virtual void SaveOwnState(StateWriter* writer) const;
+  virtual void RestoreOwnState(StateReader* reader);
+
  private:
   // Calculate signal energy from input data and update finger flag if
   // a finger is stationary
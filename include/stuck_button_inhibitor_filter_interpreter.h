@@ -33,6 +33,9 @@ class StuckButtonInhibitorFilterInterpreter : public FilterInterpreter {
 
   virtual void HandleTimerImpl(stime_t now, stime_t* timeout);
 
+  virtual void SaveOwnState(StateWriter* writer) const;
+  virtual void RestoreOwnState(StateReader* reader);
+
  private:
   void HandleHardwareState(const HardwareState& hwstate);
   void HandleTimeouts(stime_t next_timeout, stime_t* timeout);
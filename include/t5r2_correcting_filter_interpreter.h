@@ -31,6 +31,9 @@ class T5R2CorrectingFilterInterpreter : public FilterInterpreter {
  protected:
   virtual void SyncInterpretImpl(HardwareState* hwstate, stime_t* timeout);
 
+  virtual void SaveOwnState(StateWriter* writer) const;
+  virtual void RestoreOwnState(StateReader* reader);
+
  private:
   unsigned short last_finger_cnt_;
   unsigned short last_touch_cnt_;
@@ -26,6 +26,8 @@ class Tracer {
   Tracer(PropRegistry* prop_reg, WriteFn write_fn);
   ~Tracer() {};
   void Trace(const char* message, const char* name);
+  // True if Trace() writes anything.
+  bool enabled() const { return tracing_enabled_.val_ && write_fn_; }
 
  private:
   WriteFn write_fn_;
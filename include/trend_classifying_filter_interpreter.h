@@ -291,6 +291,9 @@ private:
   // 0.10    |   1.6448536269514722
   // 0.20    |   1.2815515655446004
   DoubleProperty z_threshold_;
+
+  virtual void SaveOwnState(StateWriter* writer) const;
+  virtual void RestoreOwnState(StateReader* reader);
 };
 
 }
@@ -7,10 +7,63 @@
 
 #include <algorithm>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #include "gestures/include/logging.h"
 
 namespace gestures {
 
+// Returns the index of the first of the |count| values at |values| that
+// equals |value|, or |count| if there is none.
+template<typename ValueType>
+inline size_t FindValueIndex(const ValueType* values, size_t count,
+                             const ValueType& value) {
+  for (size_t i = 0; i < count; ++i)
+    if (values[i] == value)
+      return i;
+  return count;
+}
+
+// Tracking ids are shorts, and sets of them are searched for every finger of
+// every frame, so compare 8 of them at a time where SSE2 or NEON is there.
+// Only whole chunks of the |count| values are loaded; the rest are compared
+// one at a time.
+const size_t kFindShortChunk = 8;
+
+inline size_t FindValueIndex(const short* values, size_t count,
+                             const short& value) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  __m128i needle = _mm_set1_epi16(value);
+  for (; i + kFindShortChunk <= count; i += kFindShortChunk) {
+    __m128i chunk =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(&values[i]));
+    // Two mask bits per lane.
+    unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi16(chunk, needle));
+    if (mask)
+      return i + __builtin_ctz(mask) / 2;
+  }
+#elif defined(__ARM_NEON)
+  int16x8_t needle = vdupq_n_s16(value);
+  for (; i + kFindShortChunk <= count; i += kFindShortChunk) {
+    uint16x8_t eq = vceqq_s16(vld1q_s16(&values[i]), needle);
+    // Narrowed to four mask bits per lane.
+    uint64_t mask =
+        vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(eq, 4)), 0);
+    if (mask)
+      return i + __builtin_ctzll(mask) / 4;
+  }
+#endif
+  for (; i < count; ++i)
+    if (values[i] == value)
+      return i;
+  return count;
+}
+
 // This class allows range-based for loops to iterate over a subset of
 // array elements, by only yielding those elements for which the
 // AcceptMethod returns true.
@@ -135,10 +188,8 @@ class vector {
     return const_reverse_iterator(begin());
   }
   const_iterator find(const ValueType& value) const {
-    for (size_t i = 0; i < size_; ++i)
-      if (buffer_[i] == value)
-        return const_iterator(&buffer_[i]);
-    return end();
+    return const_iterator(
+        &buffer_[FindValueIndex(buffer_, size_, value)]);
   }
   const ValueType& at(size_t idx) const {
     if (idx >= size()) {
@@ -9,12 +9,90 @@
 
 #include "gestures/include/gestures.h"
 #include "gestures/include/interpreter.h"
+#include "gestures/include/interpreter_state.h"
 #include "gestures/include/logging.h"
 #include "gestures/include/macros.h"
 #include "gestures/include/tracer.h"
 
 namespace gestures {
 
+namespace {
+
+// How many speeds a curve is sampled at when it's baked.
+const size_t kCurveTableSize = 512;
+// The least range of speeds, in mm/s, that a curve whose last segment is
+// unbounded is baked over.
+const double kMinCurveTableRange = 100.0;
+
+}  // namespace
+
+std::mutex AccelFilterInterpreter::CurveTable::tables_lock_;
+std::map<AccelFilterInterpreter::CurveTable::Key,
+         std::weak_ptr<const AccelFilterInterpreter::CurveTable> >
+    AccelFilterInterpreter::CurveTable::tables_;
+
+std::shared_ptr<const AccelFilterInterpreter::CurveTable>
+AccelFilterInterpreter::CurveTable::Get(const CurveSegment* segs,
+                                        size_t count) {
+  Key key;
+  for (size_t i = 0; i < count; i++) {
+    key.push_back(segs[i].x_);
+    key.push_back(segs[i].sqr_);
+    key.push_back(segs[i].mul_);
+    key.push_back(segs[i].int_);
+  }
+  std::shared_ptr<const CurveTable> shared;
+  for (size_t i = 0; i < key.size(); i++)
+    if (isnan(key[i]))
+      return shared;  // Can't be ordered as a key, nor sampled.
+  std::lock_guard<std::mutex> lock(tables_lock_);
+  shared = tables_[key].lock();
+  if (!shared) {
+    shared.reset(new CurveTable(segs, count));
+    tables_[key] = shared;
+  }
+  // Forget the tables no interpreter uses anymore.
+  for (auto it = tables_.begin(); it != tables_.end();) {
+    if (it->second.expired())
+      it = tables_.erase(it);
+    else
+      ++it;
+  }
+  return shared;
+}
+
+AccelFilterInterpreter::CurveTable::CurveTable(const CurveSegment* segs,
+                                               size_t count)
+    : inv_step_(0.0), max_pos_(0.0) {
+  // Past the last bounded segment, the curve's shape is set, so sampling up
+  // to twice its bound covers the speeds where a table pays. A curve that
+  // ends at a bound is sampled up to it.
+  double range = 0.0;
+  bool unbounded = false;
+  for (size_t i = 0; i < count && !unbounded; i++) {
+    if (isinf(segs[i].x_))
+      unbounded = true;
+    else
+      range = std::max(range, segs[i].x_);
+  }
+  if (unbounded)
+    range = std::max(2.0 * range, kMinCurveTableRange);
+  if (range <= 0.0)
+    return;
+  double step = range / (kCurveTableSize - 1);
+  ratios_.reserve(kCurveTableSize);
+  // The first sample, at speed 0, is never read.
+  ratios_.push_back(0.0);
+  for (size_t i = 1; i < kCurveTableSize; i++) {
+    float ratio = 0.0;
+    if (!CurveRatio(segs, count, i * step, &ratio))
+      break;
+    ratios_.push_back(ratio);
+  }
+  inv_step_ = 1.0 / step;
+  max_pos_ = ratios_.size() - 1;
+}
+
 // Takes ownership of |next|:
 AccelFilterInterpreter::AccelFilterInterpreter(PropRegistry* prop_reg,
                                                Interpreter* next,
@@ -26,36 +104,44 @@ AccelFilterInterpreter::AccelFilterInterpreter(PropRegistry* prop_reg,
       // to float arrays.
       tp_custom_point_prop_(prop_reg, "Pointer Accel Curve",
                             reinterpret_cast<double*>(&tp_custom_point_),
-                            sizeof(tp_custom_point_) / sizeof(double)),
+                            sizeof(tp_custom_point_) / sizeof(double),
+                            this),
       tp_custom_scroll_prop_(prop_reg, "Scroll Accel Curve",
                              reinterpret_cast<double*>(&tp_custom_scroll_),
-                             sizeof(tp_custom_scroll_) / sizeof(double)),
+                             sizeof(tp_custom_scroll_) / sizeof(double),
+                             this),
       mouse_custom_point_prop_(prop_reg, "Mouse Pointer Accel Curve",
                                reinterpret_cast<double*>(&mouse_custom_point_),
-                               sizeof(mouse_custom_point_) / sizeof(double)),
+                               sizeof(mouse_custom_point_) / sizeof(double),
+                               this),
 #pragma GCC diagnostic pop
       use_custom_tp_point_curve_(
-          prop_reg, "Use Custom Touchpad Pointer Accel Curve", 0),
+          prop_reg, "Use Custom Touchpad Pointer Accel Curve", 0, this),
       use_custom_tp_scroll_curve_(
-          prop_reg, "Use Custom Touchpad Scroll Accel Curve", 0),
+          prop_reg, "Use Custom Touchpad Scroll Accel Curve", 0, this),
       use_custom_mouse_curve_(
-          prop_reg, "Use Custom Mouse Pointer Accel Curve", 0),
-      pointer_sensitivity_(prop_reg, "Pointer Sensitivity", 3),
-      scroll_sensitivity_(prop_reg, "Scroll Sensitivity", 3),
+          prop_reg, "Use Custom Mouse Pointer Accel Curve", 0, this),
+      pointer_sensitivity_(prop_reg, "Pointer Sensitivity", 3, this),
+      scroll_sensitivity_(prop_reg, "Scroll Sensitivity", 3, this),
       point_x_out_scale_(prop_reg, "Point X Out Scale", 1.0),
       point_y_out_scale_(prop_reg, "Point Y Out Scale", 1.0),
       scroll_x_out_scale_(prop_reg, "Scroll X Out Scale", 2.5),
       scroll_y_out_scale_(prop_reg, "Scroll Y Out Scale", 2.5),
-      use_mouse_point_curves_(prop_reg, "Mouse Accel Curves", 0),
+      use_mouse_point_curves_(prop_reg, "Mouse Accel Curves", 0, this),
       use_mouse_scroll_curves_(prop_reg, "Mouse Scroll Curves", 0),
-      use_old_mouse_point_curves_(prop_reg, "Old Mouse Accel Curves", 0),
-      pointer_acceleration_(prop_reg, "Pointer Acceleration", 1),
+      use_old_mouse_point_curves_(prop_reg, "Old Mouse Accel Curves", 0, this),
+      pointer_acceleration_(prop_reg, "Pointer Acceleration", 1, this),
       min_reasonable_dt_(prop_reg, "Accel Min dt", 0.003),
       max_reasonable_dt_(prop_reg, "Accel Max dt", 0.050),
       last_reasonable_dt_(0.05),
       smooth_accel_(prop_reg, "Smooth Accel", 0),
       last_end_time_(-1.0),
-      last_mags_size_(0) {
+      last_mags_size_(0),
+      use_baked_curves_(prop_reg, "Baked Accel Curves", 0, this),
+      curves_generation_(0),
+      baked_generation_(0),
+      baked_point_curve_(NULL),
+      baked_scroll_curve_(NULL) {
   InitName();
   // Set up default curves.
 
@@ -160,11 +246,95 @@ AccelFilterInterpreter::AccelFilterInterpreter(PropRegistry* prop_reg,
     const float icept = y_at_border - slope * x_border;
     scroll_curves_[i][2] = CurveSegment(INFINITY, 0, slope, icept);
   }
+  BakeCurves();
+}
+
+AccelFilterInterpreter::CurveSegment* AccelFilterInterpreter::PointCurve(
+    size_t* max_segs) {
+  *max_segs = kMaxCurveSegs;
+  if (use_mouse_point_curves_.val_ && use_custom_mouse_curve_.val_) {
+    *max_segs = kMaxCustomCurveSegs;
+    return mouse_custom_point_;
+  }
+  if (!use_mouse_point_curves_.val_ && use_custom_tp_point_curve_.val_) {
+    *max_segs = kMaxCustomCurveSegs;
+    return tp_custom_point_;
+  }
+  if (use_mouse_point_curves_.val_) {
+    if (!pointer_acceleration_.val_) {
+      *max_segs = 1;
+      return &unaccel_mouse_curves_[pointer_sensitivity_.val_ - 1];
+    }
+    if (use_old_mouse_point_curves_.val_)
+      return old_mouse_point_curves_[pointer_sensitivity_.val_ - 1];
+    return mouse_point_curves_[pointer_sensitivity_.val_ - 1];
+  }
+  if (!pointer_acceleration_.val_) {
+    *max_segs = 1;
+    return &unaccel_point_curves_[pointer_sensitivity_.val_ - 1];
+  }
+  return point_curves_[pointer_sensitivity_.val_ - 1];
+}
+
+AccelFilterInterpreter::CurveSegment* AccelFilterInterpreter::ScrollCurve(
+    size_t* max_segs) {
+  if (use_custom_tp_scroll_curve_.val_) {
+    *max_segs = kMaxCustomCurveSegs;
+    return tp_custom_scroll_;
+  }
+  *max_segs = kMaxCurveSegs;
+  return scroll_curves_[scroll_sensitivity_.val_ - 1];
+}
+
+bool AccelFilterInterpreter::CurveRatio(const CurveSegment* segs,
+                                        size_t max_segs, float mag,
+                                        float* ratio) {
+  for (size_t i = 0; i < max_segs; ++i) {
+    if (mag > segs[i].x_)
+      continue;
+    *ratio = segs[i].sqr_ * mag + segs[i].mul_ + segs[i].int_ / mag;
+    return true;
+  }
+  return false;
+}
+
+void AccelFilterInterpreter::BakeCurves() {
+  baked_generation_ = curves_generation_;
+  if (!use_baked_curves_.val_) {
+    point_table_.reset();
+    scroll_table_.reset();
+    baked_point_curve_ = baked_scroll_curve_ = NULL;
+    return;
+  }
+  size_t max_segs = 0;
+  baked_point_curve_ = PointCurve(&max_segs);
+  point_table_ = CurveTable::Get(baked_point_curve_, max_segs);
+  baked_scroll_curve_ = ScrollCurve(&max_segs);
+  scroll_table_ = CurveTable::Get(baked_scroll_curve_, max_segs);
+}
+
+void AccelFilterInterpreter::BakeCurvesIfWritten() {
+  if (baked_generation_ != curves_generation_)
+    BakeCurves();
+}
+
+void AccelFilterInterpreter::BoolWasWritten(BoolProperty* prop) {
+  curves_generation_++;
+}
+
+void AccelFilterInterpreter::DoubleArrayWasWritten(DoubleArrayProperty* prop) {
+  curves_generation_++;
+}
+
+void AccelFilterInterpreter::IntWasWritten(IntProperty* prop) {
+  curves_generation_++;
 }
 
 void AccelFilterInterpreter::ConsumeGesture(const Gesture& gs) {
+  BakeCurvesIfWritten();
   Gesture copy = gs;
   CurveSegment* segs = NULL;
+  const CurveTable* table = NULL;
   float* dx = NULL;
   float* dy = NULL;
 
@@ -179,7 +349,7 @@ void AccelFilterInterpreter::ConsumeGesture(const Gesture& gs) {
   else
     last_reasonable_dt_ = dt;
 
-  size_t max_segs = kMaxCurveSegs;
+  size_t max_segs = 0;
   float x_scale = 1.0;
   float y_scale = 1.0;
   float mag = 0.0;
@@ -217,32 +387,9 @@ void AccelFilterInterpreter::ConsumeGesture(const Gesture& gs) {
         scale_out_x = dx = &copy.details.four_finger_swipe.dx;
         scale_out_y = dy = &copy.details.four_finger_swipe.dy;
       }
-      if (use_mouse_point_curves_.val_ && use_custom_mouse_curve_.val_) {
-        segs = mouse_custom_point_;
-        max_segs = kMaxCustomCurveSegs;
-      } else if (!use_mouse_point_curves_.val_ &&
-                 use_custom_tp_point_curve_.val_) {
-        segs = tp_custom_point_;
-        max_segs = kMaxCustomCurveSegs;
-      } else {
-        if (use_mouse_point_curves_.val_) {
-          if (!pointer_acceleration_.val_) {
-            segs = &unaccel_mouse_curves_[pointer_sensitivity_.val_ - 1];
-            max_segs = 1;
-          } else if (use_old_mouse_point_curves_.val_) {
-            segs = old_mouse_point_curves_[pointer_sensitivity_.val_ - 1];
-          } else {
-            segs = mouse_point_curves_[pointer_sensitivity_.val_ - 1];
-          }
-        } else {
-          if (!pointer_acceleration_.val_) {
-            segs = &unaccel_point_curves_[pointer_sensitivity_.val_ - 1];
-            max_segs = 1;
-          } else {
-            segs = point_curves_[pointer_sensitivity_.val_ - 1];
-          }
-        }
-      }
+      segs = PointCurve(&max_segs);
+      if (segs == baked_point_curve_)
+        table = point_table_.get();
       x_scale = point_x_out_scale_.val_;
       y_scale = point_y_out_scale_.val_;
       break;
@@ -268,12 +415,9 @@ void AccelFilterInterpreter::ConsumeGesture(const Gesture& gs) {
         ProduceGesture(gs);
         return;
       }
-      if (!use_custom_tp_scroll_curve_.val_) {
-        segs = scroll_curves_[scroll_sensitivity_.val_ - 1];
-      } else {
-        segs = tp_custom_scroll_;
-        max_segs = kMaxCustomCurveSegs;
-      }
+      segs = ScrollCurve(&max_segs);
+      if (segs == baked_scroll_curve_)
+        table = scroll_table_.get();
       x_scale = scroll_x_out_scale_.val_;
       y_scale = scroll_y_out_scale_.val_;
       break;
@@ -318,21 +462,37 @@ void AccelFilterInterpreter::ConsumeGesture(const Gesture& gs) {
     return;  // Avoid division by 0
   }
 
-  for (size_t i = 0; i < max_segs; ++i) {
-    if (mag > segs[i].x_)
-      continue;
-    float ratio = segs[i].sqr_ * mag + segs[i].mul_ + segs[i].int_ / mag;
-    *scale_out_x *= ratio * x_scale;
-    *scale_out_y *= ratio * y_scale;
-    if (copy.type == kGestureTypeFling ||
-        copy.type == kGestureTypeScroll) {
-      // We don't accelerate the ordinal values as we do for normal ones
-      // because this is how the Chrome needs it.
-      *scale_out_x_ordinal *= x_scale;
-      *scale_out_y_ordinal *= y_scale;
-    }
-    ProduceGesture(copy);
+  float ratio = 0.0;
+  if (!(table && table->Lookup(mag, &ratio)) &&
+      !CurveRatio(segs, max_segs, mag, &ratio))
     return;
+  *scale_out_x *= ratio * x_scale;
+  *scale_out_y *= ratio * y_scale;
+  if (copy.type == kGestureTypeFling ||
+      copy.type == kGestureTypeScroll) {
+    // We don't accelerate the ordinal values as we do for normal ones
+    // because this is how the Chrome needs it.
+    *scale_out_x_ordinal *= x_scale;
+    *scale_out_y_ordinal *= y_scale;
+  }
+  ProduceGesture(copy);
+}
+
+void AccelFilterInterpreter::SaveOwnState(StateWriter* writer) const {
+  writer->Write(last_reasonable_dt_);
+  writer->Write(last_end_time_);
+  writer->Write(last_mags_);
+  writer->Write(last_mags_size_);
+}
+
+void AccelFilterInterpreter::RestoreOwnState(StateReader* reader) {
+  reader->Read(&last_reasonable_dt_);
+  reader->Read(&last_end_time_);
+  reader->Read(&last_mags_);
+  if (reader->Read(&last_mags_size_) &&
+      last_mags_size_ > arraysize(last_mags_)) {
+    last_mags_size_ = 0;
+    reader->Fail("too many magnitudes");
   }
 }
 
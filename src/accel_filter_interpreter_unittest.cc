@@ -4,6 +4,7 @@
 
 #include <deque>
 #include <math.h>
+#include <string.h>
 #include <utility>
 #include <vector>
 
@@ -12,6 +13,7 @@
 #include "gestures/include/accel_filter_interpreter.h"
 #include "gestures/include/gestures.h"
 #include "gestures/include/macros.h"
+#include "gestures/include/prop_registry.h"
 #include "gestures/include/unittest_util.h"
 #include "gestures/include/util.h"
 
@@ -444,4 +446,226 @@ TEST(AccelFilterInterpreterTest, UnacceleratedTouchpadTest) {
   }
 }
 
+namespace {
+
+// An interpreter that accelerates with baked curves, next to one that
+// doesn't, to check the baked curves against.
+struct BakedPair {
+  BakedPair()
+      : exact_base(new AccelFilterInterpreterTestInterpreter),
+        baked_base(new AccelFilterInterpreterTestInterpreter),
+        exact(&exact_reg, exact_base, NULL),
+        baked(&baked_reg, baked_base, NULL),
+        exact_wrapper(&exact),
+        baked_wrapper(&baked) {
+    WriteProp(&baked_reg, "Baked Accel Curves", Json::Value(true));
+  }
+
+  // Writes the property |name| in |reg|, as the property system would.
+  static void WriteProp(PropRegistry* reg, const char* name,
+                        const Json::Value& value) {
+    for (Property* prop : reg->props()) {
+      if (strcmp(prop->name(), name))
+        continue;
+      EXPECT_TRUE(prop->SetValue(value)) << name;
+      prop->HandleGesturesPropWritten();
+      return;
+    }
+    ADD_FAILURE() << "No property " << name;
+  }
+
+  // Writes the property |name| of both interpreters.
+  void Set(const char* name, const Json::Value& value) {
+    WriteProp(&exact_reg, name, value);
+    WriteProp(&baked_reg, name, value);
+  }
+
+  // Checks that both accelerate moves and scrolls at speeds from a crawl to
+  // well past the tables' ends within |tolerance| of each other, relatively.
+  void ExpectSameAcceleration(float tolerance) {
+    const stime_t kDt = 0.01;
+    for (float speed = 0.25; speed < 5000.0; speed *= 1.01) {
+      float dist = speed * kDt;
+      const Gesture gestures[] = {
+        Gesture(kGestureMove, 1, 1 + kDt, dist * 0.6, -dist * 0.8),
+        Gesture(kGestureScroll, 1, 1 + kDt, 0, dist),
+      };
+      for (size_t i = 0; i < arraysize(gestures); i++) {
+        exact_base->return_values_.push_back(gestures[i]);
+        baked_base->return_values_.push_back(gestures[i]);
+        Gesture* expected = exact_wrapper.SyncInterpret(NULL, NULL);
+        ASSERT_NE(reinterpret_cast<Gesture*>(NULL), expected);
+        Gesture expected_copy = *expected;
+        Gesture* actual = baked_wrapper.SyncInterpret(NULL, NULL);
+        ASSERT_NE(reinterpret_cast<Gesture*>(NULL), actual);
+        ASSERT_EQ(expected_copy.type, actual->type);
+        float expected_y = expected_copy.type == kGestureTypeMove ?
+            expected_copy.details.move.dy : expected_copy.details.scroll.dy;
+        float actual_y = actual->type == kGestureTypeMove ?
+            actual->details.move.dy : actual->details.scroll.dy;
+        EXPECT_NEAR(expected_y, actual_y, fabsf(expected_y) * tolerance)
+            << "speed " << speed << ", " << expected_copy.String();
+      }
+    }
+  }
+
+  PropRegistry exact_reg;
+  PropRegistry baked_reg;
+  AccelFilterInterpreterTestInterpreter* exact_base;
+  AccelFilterInterpreterTestInterpreter* baked_base;
+  AccelFilterInterpreter exact;
+  AccelFilterInterpreter baked;
+  TestInterpreterWrapper exact_wrapper;
+  TestInterpreterWrapper baked_wrapper;
+};
+
+}  // namespace
+
+TEST(AccelFilterInterpreterTest, BakedCurvesTest) {
+  BakedPair pair;
+  pair.baked.BakeCurvesIfWritten();
+  ASSERT_TRUE(pair.baked.point_table_);
+  ASSERT_TRUE(pair.baked.scroll_table_);
+  for (int mouse = 0; mouse <= 1; mouse++) {
+    for (int old_mouse = 0; old_mouse <= mouse; old_mouse++) {
+      for (int accel = 0; accel <= 1; accel++) {
+        pair.Set("Mouse Accel Curves", Json::Value(mouse != 0));
+        pair.Set("Old Mouse Accel Curves", Json::Value(old_mouse != 0));
+        pair.Set("Pointer Acceleration", Json::Value(accel != 0));
+        for (int i = 1; i <= 5; ++i) {
+          SCOPED_TRACE(testing::Message() << "mouse " << mouse << ", old "
+                       << old_mouse << ", accel " << accel << ", i " << i);
+          pair.Set("Pointer Sensitivity", Json::Value(i));
+          pair.Set("Scroll Sensitivity", Json::Value(i));
+          pair.ExpectSameAcceleration(0.01);
+        }
+      }
+    }
+  }
+
+  // Sensitivities changed without being written are still honored, without
+  // the tables.
+  pair.exact.pointer_sensitivity_.val_ = pair.baked.pointer_sensitivity_.val_ =
+      2;
+  pair.exact.scroll_sensitivity_.val_ = pair.baked.scroll_sensitivity_.val_ =
+      2;
+  pair.ExpectSameAcceleration(0.0);
+
+  BakedPair::WriteProp(&pair.baked_reg, "Baked Accel Curves",
+                       Json::Value(false));
+  pair.ExpectSameAcceleration(0.0);
+  EXPECT_FALSE(pair.baked.point_table_);
+  EXPECT_FALSE(pair.baked.scroll_table_);
+}
+
+TEST(AccelFilterInterpreterTest, BakedCustomCurveTest) {
+  BakedPair pair;
+  pair.Set("Use Custom Touchpad Pointer Accel Curve", Json::Value(true));
+  pair.Set("Use Custom Touchpad Scroll Accel Curve", Json::Value(true));
+  typedef AccelFilterInterpreter::CurveSegment CurveSegment;
+  const CurveSegment point_curve[] = {
+    CurveSegment(20.0, 0.0, 0.5, 0.0),
+    CurveSegment(30.0, 0.0, 2.0, -30.0),
+    CurveSegment(INFINITY, 0.0, 0.0, 30.0),
+  };
+  // Bounded, so faster scrolls are dropped.
+  const CurveSegment scroll_curve[] = {
+    CurveSegment(50.0, 0.02, 1.0, 0.0),
+    CurveSegment(400.0, 0.0, 2.0, 0.0),
+  };
+  Json::Value point_vals(Json::arrayValue);
+  Json::Value scroll_vals(Json::arrayValue);
+  for (size_t i = 0; i < AccelFilterInterpreter::kMaxCustomCurveSegs; i++) {
+    CurveSegment point =
+        i < arraysize(point_curve) ? point_curve[i] : CurveSegment();
+    CurveSegment scroll = i < arraysize(scroll_curve) ? scroll_curve[i] :
+        CurveSegment(400.0, 0.0, 1.0, 0.0);
+    point_vals.append(point.x_);
+    point_vals.append(point.sqr_);
+    point_vals.append(point.mul_);
+    point_vals.append(point.int_);
+    scroll_vals.append(scroll.x_);
+    scroll_vals.append(scroll.sqr_);
+    scroll_vals.append(scroll.mul_);
+    scroll_vals.append(scroll.int_);
+  }
+  const AccelFilterInterpreter::CurveTable* old_table =
+      pair.baked.point_table_.get();
+  // The segments are written in place, and rebaked once they're used.
+  pair.Set("Pointer Accel Curve", point_vals);
+  pair.Set("Scroll Accel Curve", scroll_vals);
+  EXPECT_EQ(old_table, pair.baked.point_table_.get());
+  pair.baked.BakeCurvesIfWritten();
+  EXPECT_NE(old_table, pair.baked.point_table_.get());
+  ASSERT_TRUE(pair.baked.scroll_table_);
+  float ratio = 0.0;
+  EXPECT_TRUE(pair.baked.scroll_table_->Lookup(399.0, &ratio));
+  EXPECT_FLOAT_EQ(2.0, ratio);
+  EXPECT_FALSE(pair.baked.scroll_table_->Lookup(401.0, &ratio));
+
+  const stime_t kDt = 0.01;
+  for (float speed = 0.25; speed < 5000.0; speed *= 1.01) {
+    float dist = speed * kDt;
+    pair.exact_base->return_values_.push_back(
+        Gesture(kGestureMove, 1, 1 + kDt, dist, 0));
+    pair.baked_base->return_values_.push_back(
+        Gesture(kGestureMove, 1, 1 + kDt, dist, 0));
+    pair.exact_base->return_values_.push_back(
+        Gesture(kGestureScroll, 1, 1 + kDt, 0, dist));
+    pair.baked_base->return_values_.push_back(
+        Gesture(kGestureScroll, 1, 1 + kDt, 0, dist));
+    for (int i = 0; i < 2; i++) {
+      Gesture* expected = pair.exact_wrapper.SyncInterpret(NULL, NULL);
+      Gesture* actual = pair.baked_wrapper.SyncInterpret(NULL, NULL);
+      if (i == 1 && speed > 400.0) {
+        EXPECT_EQ(reinterpret_cast<Gesture*>(NULL), expected);
+        EXPECT_EQ(reinterpret_cast<Gesture*>(NULL), actual);
+        continue;
+      }
+      ASSERT_NE(reinterpret_cast<Gesture*>(NULL), expected);
+      ASSERT_NE(reinterpret_cast<Gesture*>(NULL), actual);
+      float expected_out = i == 0 ?
+          expected->details.move.dx : expected->details.scroll.dy;
+      float actual_out = i == 0 ?
+          actual->details.move.dx : actual->details.scroll.dy;
+      EXPECT_NEAR(expected_out, actual_out, fabsf(expected_out) * 0.01)
+          << "speed " << speed;
+    }
+  }
+}
+
+TEST(AccelFilterInterpreterTest, SharedCurveTableTest) {
+  AccelFilterInterpreter first(NULL, NULL, NULL);
+  AccelFilterInterpreter second(NULL, NULL, NULL);
+  EXPECT_FALSE(first.point_table_);
+  first.use_baked_curves_.val_ = second.use_baked_curves_.val_ = 1;
+  first.BoolWasWritten(&first.use_baked_curves_);
+  second.BoolWasWritten(&second.use_baked_curves_);
+  first.BakeCurvesIfWritten();
+  second.BakeCurvesIfWritten();
+  ASSERT_TRUE(first.point_table_);
+  EXPECT_EQ(first.point_table_.get(), second.point_table_.get());
+  EXPECT_EQ(first.scroll_table_.get(), second.scroll_table_.get());
+  EXPECT_NE(first.point_table_.get(), first.scroll_table_.get());
+
+  second.pointer_sensitivity_.val_ = 5;
+  second.IntWasWritten(&second.pointer_sensitivity_);
+  second.BakeCurvesIfWritten();
+  EXPECT_NE(first.point_table_.get(), second.point_table_.get());
+  EXPECT_EQ(first.scroll_table_.get(), second.scroll_table_.get());
+
+  // Mice with the same settings share the tables too.
+  first.use_mouse_point_curves_.val_ = second.use_mouse_point_curves_.val_ = 1;
+  second.pointer_sensitivity_.val_ = 3;
+  first.BoolWasWritten(&first.use_mouse_point_curves_);
+  second.BoolWasWritten(&second.use_mouse_point_curves_);
+  first.BakeCurvesIfWritten();
+  second.BakeCurvesIfWritten();
+  EXPECT_EQ(first.point_table_.get(), second.point_table_.get());
+  EXPECT_EQ(AccelFilterInterpreter::CurveTable::Get(
+                first.mouse_point_curves_[2],
+                AccelFilterInterpreter::kMaxCurveSegs).get(),
+            first.point_table_.get());
+}
+
 }  // namespace gestures
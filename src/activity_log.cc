@@ -6,6 +6,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <string.h>
 #include <set>
 #include <string>
 #include <sys/stat.h>
@@ -15,6 +16,7 @@
 #include <json/writer.h>
 
 #include "gestures/include/file_util.h"
+#include "gestures/include/json_stream_writer.h"
 #include "gestures/include/logging.h"
 #include "gestures/include/prop_registry.h"
 #include "gestures/include/string_util.h"
@@ -24,77 +26,82 @@
 #define VCSID "Unknown"
 #endif  // VCSID
 
-#define QUINTTAP_COUNT 5  /* BTN_TOOL_QUINTTAP - Five fingers on trackpad */
-
 using std::set;
 using std::string;
 
 namespace gestures {
 
+namespace {
+
+size_t AlignRecordSize(size_t size) {
+  return (size + ActivityLog::kRecordAlign - 1) &
+      ~(ActivityLog::kRecordAlign - 1);
+}
+
+void AppendPadding(string* out) {
+  out->append(AlignRecordSize(out->size()) - out->size(), '\0');
+}
+
+void AppendBytes(string* out, const void* data, size_t size) {
+  out->append(static_cast<const char*>(data), size);
+}
+
+void AppendRecordHeader(string* out, ActivityLog::EntryType type,
+                        size_t payload_size) {
+  ActivityLog::RecordHeader header;
+  header.size = AlignRecordSize(sizeof(header) + payload_size);
+  header.type = type;
+  AppendBytes(out, &header, sizeof(header));
+}
+
+}  // namespace {}
+
 ActivityLog::ActivityLog(PropRegistry* prop_reg)
-    : head_idx_(0), size_(0), max_fingers_(0), hwprops_(),
-      prop_reg_(prop_reg) {}
+    : capacity_(0), head_(0), tail_(0), size_(0),
+      dropped_(0), cursor_idx_(0), cursor_offset_(0), hwprops_(),
+      prop_reg_(prop_reg), properties_(Json::objectValue) {}
+
+ActivityLog::~ActivityLog() {}
 
 void ActivityLog::SetHardwareProperties(const HardwareProperties& hwprops) {
   hwprops_ = hwprops;
-
-  // For old devices(such as mario, alex, zgb..), the reporting touch count
-  // or 'max_touch_cnt' will be less than number of slots or 'max_finger_cnt'
-  // they support. As kernel evdev drivers do not have a bitset to report
-  // touch count greater than five (bitset for five-fingers gesture is
-  // BTN_TOOL_QUINTAP), we respect 'max_finger_cnt' than 'max_touch_cnt'
-  // reported from kernel driver as the 'max_fingers_' instead.
-  if (hwprops.max_touch_cnt < QUINTTAP_COUNT) {
-    max_fingers_ = std::min<size_t>(hwprops.max_finger_cnt,
-                                    hwprops.max_touch_cnt);
-  } else {
-    max_fingers_ = std::max<size_t>(hwprops.max_finger_cnt,
-                                    hwprops.max_touch_cnt);
-  }
-
-  finger_states_.reset(new FingerState[kBufferSize * max_fingers_]);
 }
 
 void ActivityLog::LogHardwareState(const HardwareState& hwstate) {
-  Entry* entry = PushBack();
-  entry->type = kHardwareState;
-  entry->details.hwstate = hwstate;
-  if (hwstate.finger_cnt > max_fingers_) {
-    Err("Too many fingers! Max is %zu, but I got %d",
-        max_fingers_, hwstate.finger_cnt);
-    entry->details.hwstate.fingers = NULL;
-    entry->details.hwstate.finger_cnt = 0;
-    return;
+  size_t finger_cnt = hwstate.fingers ? hwstate.finger_cnt : 0;
+  if (hwstate.finger_cnt && !hwstate.fingers)
+    Err("Have finger_cnt %d but fingers is NULL!", hwstate.finger_cnt);
+  if (finger_cnt > kMaxFingers) {
+    Err("Too many fingers! Max is %zu, but I got %zu",
+        kMaxFingers, finger_cnt);
+    finger_cnt = 0;
   }
-  if (!finger_states_.get())
-    return;
-  entry->details.hwstate.fingers = &finger_states_[TailIdx() * max_fingers_];
-  std::copy(&hwstate.fingers[0], &hwstate.fingers[hwstate.finger_cnt],
-            entry->details.hwstate.fingers);
+  char* payload = PushBack(kHardwareState, sizeof(HardwareState) +
+                           finger_cnt * sizeof(FingerState));
+  HardwareState copy = hwstate;
+  copy.finger_cnt = finger_cnt;
+  copy.fingers = NULL;
+  memcpy(payload, &copy, sizeof(copy));
+  if (finger_cnt)
+    memcpy(payload + sizeof(copy), hwstate.fingers,
+           finger_cnt * sizeof(FingerState));
 }
 
 void ActivityLog::LogTimerCallback(stime_t now) {
-  Entry* entry = PushBack();
-  entry->type = kTimerCallback;
-  entry->details.timestamp = now;
+  memcpy(PushBack(kTimerCallback, sizeof(now)), &now, sizeof(now));
 }
 
 void ActivityLog::LogCallbackRequest(stime_t when) {
-  Entry* entry = PushBack();
-  entry->type = kCallbackRequest;
-  entry->details.timestamp = when;
+  memcpy(PushBack(kCallbackRequest, sizeof(when)), &when, sizeof(when));
 }
 
 void ActivityLog::LogGesture(const Gesture& gesture) {
-  Entry* entry = PushBack();
-  entry->type = kGesture;
-  entry->details.gesture = gesture;
+  memcpy(PushBack(kGesture, sizeof(gesture)), &gesture, sizeof(gesture));
 }
 
 void ActivityLog::LogPropChange(const PropChangeEntry& prop_change) {
-  Entry* entry = PushBack();
-  entry->type = kPropChange;
-  entry->details.prop_change = prop_change;
+  memcpy(PushBack(kPropChange, sizeof(prop_change)), &prop_change,
+         sizeof(prop_change));
 }
 
 void ActivityLog::Dump(const char* filename) {
@@ -102,330 +109,494 @@ void ActivityLog::Dump(const char* filename) {
   WriteFile(filename, data.c_str(), data.size());
 }
 
-ActivityLog::Entry* ActivityLog::PushBack() {
-  if (size_ == kBufferSize) {
-    Entry* ret = &buffer_[head_idx_];
-    head_idx_ = (head_idx_ + 1) % kBufferSize;
-    return ret;
+void ActivityLog::Clear() {
+  buffer_.reset();
+  capacity_ = 0;
+  head_ = tail_ = size_ = 0;
+  dropped_ = cursor_idx_ = cursor_offset_ = 0;
+}
+
+void ActivityLog::CopyFrom(const ActivityLog& that) {
+  Clear();
+  hwprops_ = that.hwprops_;
+  properties_ = that.EncodePropRegistry();
+  if (!that.size_)
+    return;
+  // Keep the same offsets so the ring's layout, including any wrap record,
+  // stays valid.
+  buffer_.reset(new char[that.capacity_]);
+  capacity_ = that.capacity_;
+  if (that.tail_ > that.head_) {
+    memcpy(&buffer_[that.head_], &that.buffer_[that.head_],
+           that.tail_ - that.head_);
+  } else {
+    memcpy(&buffer_[that.head_], &that.buffer_[that.head_],
+           that.capacity_ - that.head_);
+    memcpy(&buffer_[0], &that.buffer_[0], that.tail_);
   }
-  ++size_;
-  return &buffer_[TailIdx()];
+  head_ = that.head_;
+  tail_ = that.tail_;
+  size_ = that.size_;
+  cursor_offset_ = head_;
 }
 
-Json::Value ActivityLog::EncodeHardwareProperties() const {
-  Json::Value ret(Json::objectValue);
-  ret[kKeyHardwarePropLeft] = Json::Value(hwprops_.left);
-  ret[kKeyHardwarePropTop] = Json::Value(hwprops_.top);
-  ret[kKeyHardwarePropRight] = Json::Value(hwprops_.right);
-  ret[kKeyHardwarePropBottom] = Json::Value(hwprops_.bottom);
-  ret[kKeyHardwarePropXResolution] = Json::Value(hwprops_.res_x);
-  ret[kKeyHardwarePropYResolution] = Json::Value(hwprops_.res_y);
-  ret[kKeyHardwarePropXDpi] = Json::Value(hwprops_.screen_x_dpi);
-  ret[kKeyHardwarePropYDpi] = Json::Value(hwprops_.screen_y_dpi);
-  ret[kKeyHardwarePropOrientationMinimum] =
-      Json::Value(hwprops_.orientation_minimum);
-  ret[kKeyHardwarePropOrientationMaximum] =
-      Json::Value(hwprops_.orientation_maximum);
-  ret[kKeyHardwarePropMaxFingerCount] =
-      Json::Value(hwprops_.max_finger_cnt);
-  ret[kKeyHardwarePropMaxTouchCount] =
-      Json::Value(hwprops_.max_touch_cnt);
-
-  ret[kKeyHardwarePropSupportsT5R2] =
-      Json::Value(hwprops_.supports_t5r2 != 0);
-  ret[kKeyHardwarePropSemiMt] =
-      Json::Value(hwprops_.support_semi_mt != 0);
-  ret[kKeyHardwarePropIsButtonPad] =
-      Json::Value(hwprops_.is_button_pad != 0);
-  ret[kKeyHardwarePropHasWheel] =
-      Json::Value(hwprops_.has_wheel != 0);
+size_t ActivityLog::BytesUsed() const {
+  if (!size_)
+    return 0;
+  if (tail_ > head_)
+    return tail_ - head_;
+  return capacity_ - head_ + tail_;
+}
+
+char* ActivityLog::PushBack(EntryType type, size_t payload_size) {
+  size_t size = AlignRecordSize(sizeof(RecordHeader) + payload_size);
+  for (;;) {
+    if (!size_) {
+      head_ = tail_ = 0;
+      if (capacity_ < size)
+        Grow();
+    }
+    if (!size_ || tail_ > head_) {
+      // Records are in [head_, tail_), so free space is after tail_ and then
+      // before head_.
+      if (capacity_ - tail_ >= size)
+        break;
+      if (capacity_ - tail_ >= sizeof(RecordHeader))
+        HeaderAt(tail_)->type = kWrapRecord;
+      tail_ = 0;
+      continue;
+    }
+    // Records are in [head_, end) and [0, tail_). Free space is between.
+    if (head_ - tail_ >= size)
+      break;
+    // Out of room. Only drop old records once the buffer can't grow.
+    if (capacity_ < kBufferSize)
+      Grow();
+    else
+      PopFront();
+  }
+  RecordHeader* header = HeaderAt(tail_);
+  header->size = size;
+  header->type = type;
+  tail_ += size;
+  size_++;
+  return reinterpret_cast<char*>(header + 1);
+}
+
+void ActivityLog::PopFront() {
+  dropped_++;
+  if (!--size_) {
+    head_ = tail_ = 0;
+    return;
+  }
+  head_ = NextRecord(head_);
+}
+
+void ActivityLog::Grow() {
+  size_t capacity = capacity_ ? capacity_ * 2 : kInitialBufferSize;
+  if (capacity > kBufferSize)
+    capacity = kBufferSize;
+  std::unique_ptr<char[]> buffer(new char[capacity]);
+  // Copy the records in order to the front of the new buffer.
+  size_t used = 0;
+  size_t offset = head_;
+  for (size_t i = 0; i < size_; i++) {
+    if (i)
+      offset = NextRecord(offset);
+    size_t record_size = HeaderAt(offset)->size;
+    memcpy(&buffer[used], &buffer_[offset], record_size);
+    used += record_size;
+  }
+  buffer_ = std::move(buffer);
+  capacity_ = capacity;
+  head_ = 0;
+  tail_ = used;
+  cursor_idx_ = dropped_;
+  cursor_offset_ = 0;
+}
+
+size_t ActivityLog::NextRecord(size_t offset) const {
+  offset += HeaderAt(offset)->size;
+  if (capacity_ - offset < sizeof(RecordHeader) ||
+      HeaderAt(offset)->type == kWrapRecord)
+    return 0;
+  return offset;
+}
+
+ActivityLog::Entry ActivityLog::GetEntry(size_t idx) {
+  size_t target = dropped_ + idx;
+  if (cursor_idx_ < dropped_ || cursor_idx_ > target) {
+    cursor_idx_ = dropped_;
+    cursor_offset_ = head_;
+  }
+  for (; cursor_idx_ < target; cursor_idx_++)
+    cursor_offset_ = NextRecord(cursor_offset_);
+  Entry ret;
+  DecodeRecord(cursor_offset_, &ret);
   return ret;
 }
 
-Json::Value ActivityLog::EncodeHardwareState(const HardwareState& hwstate) {
+void ActivityLog::DecodeRecord(size_t offset, Entry* out) const {
+  RecordHeader* header = HeaderAt(offset);
+  char* payload = reinterpret_cast<char*>(header + 1);
+  out->type = static_cast<EntryType>(header->type);
+  switch (out->type) {
+    case kHardwareState:
+      memcpy(&out->details.hwstate, payload, sizeof(HardwareState));
+      out->details.hwstate.fingers = out->details.hwstate.finger_cnt ?
+          reinterpret_cast<FingerState*>(payload + sizeof(HardwareState)) :
+          NULL;
+      break;
+    case kTimerCallback:  // fall through
+    case kCallbackRequest:
+      memcpy(&out->details.timestamp, payload, sizeof(stime_t));
+      break;
+    case kGesture:
+      memcpy(&out->details.gesture, payload, sizeof(Gesture));
+      break;
+    case kPropChange:
+      memcpy(&out->details.prop_change, payload, sizeof(PropChangeEntry));
+      break;
+  }
+}
+
+Json::Value ActivityLog::EncodePropRegistry() const {
+  if (!prop_reg_)
+    return properties_;
+
   Json::Value ret(Json::objectValue);
-  ret[kKeyType] = Json::Value(kKeyHardwareState);
-  ret[kKeyHardwareStateButtonsDown] =
-      Json::Value(hwstate.buttons_down);
-  ret[kKeyHardwareStateTouchCnt] =
-      Json::Value(hwstate.touch_cnt);
-  ret[kKeyHardwareStateTimestamp] =
-      Json::Value(hwstate.timestamp);
-  Json::Value fingers(Json::arrayValue);
+  const set<Property*>& props = prop_reg_->props();
+  for (set<Property*>::const_iterator it = props.begin(), e = props.end();
+       it != e; ++it) {
+    ret[(*it)->name()] = (*it)->NewValue();
+  }
+  return ret;
+}
+
+template<typename Writer>
+void ActivityLog::WriteHardwareProperties(Writer* writer) const {
+  writer->BeginObject();
+  writer->Key(kKeyHardwarePropLeft);
+  writer->Double(hwprops_.left);
+  writer->Key(kKeyHardwarePropTop);
+  writer->Double(hwprops_.top);
+  writer->Key(kKeyHardwarePropRight);
+  writer->Double(hwprops_.right);
+  writer->Key(kKeyHardwarePropBottom);
+  writer->Double(hwprops_.bottom);
+  writer->Key(kKeyHardwarePropXResolution);
+  writer->Double(hwprops_.res_x);
+  writer->Key(kKeyHardwarePropYResolution);
+  writer->Double(hwprops_.res_y);
+  writer->Key(kKeyHardwarePropXDpi);
+  writer->Double(hwprops_.screen_x_dpi);
+  writer->Key(kKeyHardwarePropYDpi);
+  writer->Double(hwprops_.screen_y_dpi);
+  writer->Key(kKeyHardwarePropOrientationMinimum);
+  writer->Double(hwprops_.orientation_minimum);
+  writer->Key(kKeyHardwarePropOrientationMaximum);
+  writer->Double(hwprops_.orientation_maximum);
+  writer->Key(kKeyHardwarePropMaxFingerCount);
+  writer->Int(hwprops_.max_finger_cnt);
+  writer->Key(kKeyHardwarePropMaxTouchCount);
+  writer->Int(hwprops_.max_touch_cnt);
+
+  writer->Key(kKeyHardwarePropSupportsT5R2);
+  writer->Bool(hwprops_.supports_t5r2 != 0);
+  writer->Key(kKeyHardwarePropSemiMt);
+  writer->Bool(hwprops_.support_semi_mt != 0);
+  writer->Key(kKeyHardwarePropIsButtonPad);
+  writer->Bool(hwprops_.is_button_pad != 0);
+  writer->Key(kKeyHardwarePropHasWheel);
+  writer->Bool(hwprops_.has_wheel != 0);
+  writer->EndObject();
+}
+
+template<typename Writer>
+void ActivityLog::WriteHardwareState(Writer* writer,
+                                     const HardwareState& hwstate) {
+  writer->BeginObject();
+  writer->Key(kKeyType);
+  writer->String(kKeyHardwareState);
+  writer->Key(kKeyHardwareStateButtonsDown);
+  writer->Int(hwstate.buttons_down);
+  writer->Key(kKeyHardwareStateTouchCnt);
+  writer->Int(hwstate.touch_cnt);
+  writer->Key(kKeyHardwareStateTimestamp);
+  writer->Double(hwstate.timestamp);
+  writer->Key(kKeyHardwareStateFingers);
+  writer->BeginArray();
   for (size_t i = 0; i < hwstate.finger_cnt; ++i) {
     if (hwstate.fingers == NULL) {
       Err("Have finger_cnt %d but fingers is NULL!", hwstate.finger_cnt);
       break;
     }
     const FingerState& fs = hwstate.fingers[i];
-    Json::Value finger(Json::objectValue);
-    finger[kKeyFingerStateTouchMajor] =
-        Json::Value(fs.touch_major);
-    finger[kKeyFingerStateTouchMinor] =
-        Json::Value(fs.touch_minor);
-    finger[kKeyFingerStateWidthMajor] =
-        Json::Value(fs.width_major);
-    finger[kKeyFingerStateWidthMinor] =
-        Json::Value(fs.width_minor);
-    finger[kKeyFingerStatePressure] =
-        Json::Value(fs.pressure);
-    finger[kKeyFingerStateOrientation] =
-        Json::Value(fs.orientation);
-    finger[kKeyFingerStatePositionX] =
-        Json::Value(fs.position_x);
-    finger[kKeyFingerStatePositionY] =
-        Json::Value(fs.position_y);
-    finger[kKeyFingerStateTrackingId] =
-        Json::Value(fs.tracking_id);
-    finger[kKeyFingerStateFlags] =
-        Json::Value(static_cast<int>(fs.flags));
-    fingers.append(finger);
+    writer->BeginObject();
+    writer->Key(kKeyFingerStateTouchMajor);
+    writer->Double(fs.touch_major);
+    writer->Key(kKeyFingerStateTouchMinor);
+    writer->Double(fs.touch_minor);
+    writer->Key(kKeyFingerStateWidthMajor);
+    writer->Double(fs.width_major);
+    writer->Key(kKeyFingerStateWidthMinor);
+    writer->Double(fs.width_minor);
+    writer->Key(kKeyFingerStatePressure);
+    writer->Double(fs.pressure);
+    writer->Key(kKeyFingerStateOrientation);
+    writer->Double(fs.orientation);
+    writer->Key(kKeyFingerStatePositionX);
+    writer->Double(fs.position_x);
+    writer->Key(kKeyFingerStatePositionY);
+    writer->Double(fs.position_y);
+    writer->Key(kKeyFingerStateTrackingId);
+    writer->Int(fs.tracking_id);
+    writer->Key(kKeyFingerStateFlags);
+    writer->Int(static_cast<int>(fs.flags));
+    writer->EndObject();
   }
-  ret[kKeyHardwareStateFingers] = fingers;
-  ret[kKeyHardwareStateRelX] =
-      Json::Value(hwstate.rel_x);
-  ret[kKeyHardwareStateRelY] =
-      Json::Value(hwstate.rel_y);
-  ret[kKeyHardwareStateRelWheel] =
-      Json::Value(hwstate.rel_wheel);
-  ret[kKeyHardwareStateRelHWheel] =
-      Json::Value(hwstate.rel_hwheel);
-  return ret;
+  writer->EndArray();
+  writer->Key(kKeyHardwareStateRelX);
+  writer->Double(hwstate.rel_x);
+  writer->Key(kKeyHardwareStateRelY);
+  writer->Double(hwstate.rel_y);
+  writer->Key(kKeyHardwareStateRelWheel);
+  writer->Double(hwstate.rel_wheel);
+  writer->Key(kKeyHardwareStateRelHWheel);
+  writer->Double(hwstate.rel_hwheel);
+  writer->EndObject();
 }
 
-Json::Value ActivityLog::EncodeTimerCallback(stime_t timestamp) {
-  Json::Value ret(Json::objectValue);
-  ret[kKeyType] = Json::Value(kKeyTimerCallback);
-  ret[kKeyTimerCallbackNow] = Json::Value(timestamp);
-  return ret;
+template<typename Writer>
+void ActivityLog::WriteTimerCallback(Writer* writer, stime_t timestamp) {
+  writer->BeginObject();
+  writer->Key(kKeyType);
+  writer->String(kKeyTimerCallback);
+  writer->Key(kKeyTimerCallbackNow);
+  writer->Double(timestamp);
+  writer->EndObject();
 }
 
-Json::Value ActivityLog::EncodeCallbackRequest(stime_t timestamp) {
-  Json::Value ret(Json::objectValue);
-  ret[kKeyType] = Json::Value(kKeyCallbackRequest);
-  ret[kKeyCallbackRequestWhen] = Json::Value(timestamp);
-  return ret;
+template<typename Writer>
+void ActivityLog::WriteCallbackRequest(Writer* writer, stime_t timestamp) {
+  writer->BeginObject();
+  writer->Key(kKeyType);
+  writer->String(kKeyCallbackRequest);
+  writer->Key(kKeyCallbackRequestWhen);
+  writer->Double(timestamp);
+  writer->EndObject();
 }
 
-Json::Value ActivityLog::EncodeGesture(const Gesture& gesture) {
-  Json::Value ret(Json::objectValue);
-  ret[kKeyType] = Json::Value(kKeyGesture);
-  ret[kKeyGestureStartTime] = Json::Value(gesture.start_time);
-  ret[kKeyGestureEndTime] = Json::Value(gesture.end_time);
-
-  bool handled = false;
+template<typename Writer>
+void ActivityLog::WriteGesture(Writer* writer, const Gesture& gesture) {
+  writer->BeginObject();
+  writer->Key(kKeyType);
+  writer->String(kKeyGesture);
+  writer->Key(kKeyGestureStartTime);
+  writer->Double(gesture.start_time);
+  writer->Key(kKeyGestureEndTime);
+  writer->Double(gesture.end_time);
+
+  writer->Key(kKeyGestureType);
   switch (gesture.type) {
     case kGestureTypeNull:
-      handled = true;
-      ret[kKeyGestureType] = Json::Value("null");
+      writer->String("null");
       break;
     case kGestureTypeContactInitiated:
-      handled = true;
-      ret[kKeyGestureType] =
-          Json::Value(kValueGestureTypeContactInitiated);
+      writer->String(kValueGestureTypeContactInitiated);
       break;
     case kGestureTypeMove:
-      handled = true;
-      ret[kKeyGestureType] =
-          Json::Value(kValueGestureTypeMove);
-      ret[kKeyGestureMoveDX] =
-          Json::Value(gesture.details.move.dx);
-      ret[kKeyGestureMoveDY] =
-          Json::Value(gesture.details.move.dy);
-      ret[kKeyGestureMoveOrdinalDX] =
-          Json::Value(gesture.details.move.ordinal_dx);
-      ret[kKeyGestureMoveOrdinalDY] =
-          Json::Value(gesture.details.move.ordinal_dy);
+      writer->String(kValueGestureTypeMove);
+      writer->Key(kKeyGestureMoveDX);
+      writer->Double(gesture.details.move.dx);
+      writer->Key(kKeyGestureMoveDY);
+      writer->Double(gesture.details.move.dy);
+      writer->Key(kKeyGestureMoveOrdinalDX);
+      writer->Double(gesture.details.move.ordinal_dx);
+      writer->Key(kKeyGestureMoveOrdinalDY);
+      writer->Double(gesture.details.move.ordinal_dy);
       break;
     case kGestureTypeScroll:
-      handled = true;
-      ret[kKeyGestureType] =
-          Json::Value(kValueGestureTypeScroll);
-      ret[kKeyGestureScrollDX] =
-          Json::Value(gesture.details.scroll.dx);
-      ret[kKeyGestureScrollDY] =
-          Json::Value(gesture.details.scroll.dy);
-      ret[kKeyGestureScrollOrdinalDX] =
-          Json::Value(gesture.details.scroll.ordinal_dx);
-      ret[kKeyGestureScrollOrdinalDY] =
-          Json::Value(gesture.details.scroll.ordinal_dy);
+      writer->String(kValueGestureTypeScroll);
+      writer->Key(kKeyGestureScrollDX);
+      writer->Double(gesture.details.scroll.dx);
+      writer->Key(kKeyGestureScrollDY);
+      writer->Double(gesture.details.scroll.dy);
+      writer->Key(kKeyGestureScrollOrdinalDX);
+      writer->Double(gesture.details.scroll.ordinal_dx);
+      writer->Key(kKeyGestureScrollOrdinalDY);
+      writer->Double(gesture.details.scroll.ordinal_dy);
       break;
     case kGestureTypePinch:
-      handled = true;
-      ret[kKeyGestureType] =
-          Json::Value(kValueGestureTypePinch);
-      ret[kKeyGesturePinchDZ] =
-          Json::Value(gesture.details.pinch.dz);
-      ret[kKeyGesturePinchOrdinalDZ] =
-          Json::Value(gesture.details.pinch.ordinal_dz);
-      ret[kKeyGesturePinchZoomState] =
-          Json::Value(gesture.details.pinch.zoom_state);
+      writer->String(kValueGestureTypePinch);
+      writer->Key(kKeyGesturePinchDZ);
+      writer->Double(gesture.details.pinch.dz);
+      writer->Key(kKeyGesturePinchOrdinalDZ);
+      writer->Double(gesture.details.pinch.ordinal_dz);
+      writer->Key(kKeyGesturePinchZoomState);
+      writer->Int(gesture.details.pinch.zoom_state);
       break;
     case kGestureTypeButtonsChange:
-      handled = true;
-      ret[kKeyGestureType] =
-          Json::Value(kValueGestureTypeButtonsChange);
-      ret[kKeyGestureButtonsChangeDown] =
-          Json::Value(
-                   static_cast<int>(gesture.details.buttons.down));
-      ret[kKeyGestureButtonsChangeUp] =
-          Json::Value(
-                   static_cast<int>(gesture.details.buttons.up));
+      writer->String(kValueGestureTypeButtonsChange);
+      writer->Key(kKeyGestureButtonsChangeDown);
+      writer->Int(static_cast<int>(gesture.details.buttons.down));
+      writer->Key(kKeyGestureButtonsChangeUp);
+      writer->Int(static_cast<int>(gesture.details.buttons.up));
       break;
     case kGestureTypeFling:
-      handled = true;
-      ret[kKeyGestureType] =
-          Json::Value(kValueGestureTypeFling);
-      ret[kKeyGestureFlingVX] =
-          Json::Value(gesture.details.fling.vx);
-      ret[kKeyGestureFlingVY] =
-          Json::Value(gesture.details.fling.vy);
-      ret[kKeyGestureFlingOrdinalVX] =
-          Json::Value(gesture.details.fling.ordinal_vx);
-      ret[kKeyGestureFlingOrdinalVY] =
-          Json::Value(gesture.details.fling.ordinal_vy);
-      ret[kKeyGestureFlingState] =
-          Json::Value(
-                   static_cast<int>(gesture.details.fling.fling_state));
+      writer->String(kValueGestureTypeFling);
+      writer->Key(kKeyGestureFlingVX);
+      writer->Double(gesture.details.fling.vx);
+      writer->Key(kKeyGestureFlingVY);
+      writer->Double(gesture.details.fling.vy);
+      writer->Key(kKeyGestureFlingOrdinalVX);
+      writer->Double(gesture.details.fling.ordinal_vx);
+      writer->Key(kKeyGestureFlingOrdinalVY);
+      writer->Double(gesture.details.fling.ordinal_vy);
+      writer->Key(kKeyGestureFlingState);
+      writer->Int(static_cast<int>(gesture.details.fling.fling_state));
       break;
     case kGestureTypeSwipe:
-      handled = true;
-      ret[kKeyGestureType] =
-          Json::Value(kValueGestureTypeSwipe);
-      ret[kKeyGestureSwipeDX] =
-          Json::Value(gesture.details.swipe.dx);
-      ret[kKeyGestureSwipeDY] =
-          Json::Value(gesture.details.swipe.dy);
-      ret[kKeyGestureSwipeOrdinalDX] =
-          Json::Value(gesture.details.swipe.ordinal_dx);
-      ret[kKeyGestureSwipeOrdinalDY] =
-          Json::Value(gesture.details.swipe.ordinal_dy);
+      writer->String(kValueGestureTypeSwipe);
+      writer->Key(kKeyGestureSwipeDX);
+      writer->Double(gesture.details.swipe.dx);
+      writer->Key(kKeyGestureSwipeDY);
+      writer->Double(gesture.details.swipe.dy);
+      writer->Key(kKeyGestureSwipeOrdinalDX);
+      writer->Double(gesture.details.swipe.ordinal_dx);
+      writer->Key(kKeyGestureSwipeOrdinalDY);
+      writer->Double(gesture.details.swipe.ordinal_dy);
       break;
     case kGestureTypeSwipeLift:
-      handled = true;
-      ret[kKeyGestureType] =
-          Json::Value(kValueGestureTypeSwipeLift);
+      writer->String(kValueGestureTypeSwipeLift);
       break;
     case kGestureTypeFourFingerSwipe:
-      handled = true;
-      ret[kKeyGestureType] =
-          Json::Value(kValueGestureTypeFourFingerSwipe);
-      ret[kKeyGestureFourFingerSwipeDX] =
-          Json::Value(gesture.details.four_finger_swipe.dx);
-      ret[kKeyGestureFourFingerSwipeDY] =
-          Json::Value(gesture.details.four_finger_swipe.dy);
-      ret[kKeyGestureFourFingerSwipeOrdinalDX] =
-          Json::Value(gesture.details.four_finger_swipe.ordinal_dx);
-      ret[kKeyGestureFourFingerSwipeOrdinalDY] =
-          Json::Value(gesture.details.four_finger_swipe.ordinal_dy);
+      writer->String(kValueGestureTypeFourFingerSwipe);
+      writer->Key(kKeyGestureFourFingerSwipeDX);
+      writer->Double(gesture.details.four_finger_swipe.dx);
+      writer->Key(kKeyGestureFourFingerSwipeDY);
+      writer->Double(gesture.details.four_finger_swipe.dy);
+      writer->Key(kKeyGestureFourFingerSwipeOrdinalDX);
+      writer->Double(gesture.details.four_finger_swipe.ordinal_dx);
+      writer->Key(kKeyGestureFourFingerSwipeOrdinalDY);
+      writer->Double(gesture.details.four_finger_swipe.ordinal_dy);
       break;
     case kGestureTypeFourFingerSwipeLift:
-      handled = true;
-      ret[kKeyGestureType] =
-          Json::Value(kValueGestureTypeFourFingerSwipeLift);
+      writer->String(kValueGestureTypeFourFingerSwipeLift);
       break;
     case kGestureTypeMetrics:
-      handled = true;
-      ret[kKeyGestureType] =
-          Json::Value(kValueGestureTypeMetrics);
-      ret[kKeyGestureMetricsType] =
-          Json::Value(
-                   static_cast<int>(gesture.details.metrics.type));
-      ret[kKeyGestureMetricsData1] =
-          Json::Value(gesture.details.metrics.data[0]);
-      ret[kKeyGestureMetricsData2] =
-          Json::Value(gesture.details.metrics.data[1]);
+      writer->String(kValueGestureTypeMetrics);
+      writer->Key(kKeyGestureMetricsType);
+      writer->Int(static_cast<int>(gesture.details.metrics.type));
+      writer->Key(kKeyGestureMetricsData1);
+      writer->Double(gesture.details.metrics.data[0]);
+      writer->Key(kKeyGestureMetricsData2);
+      writer->Double(gesture.details.metrics.data[1]);
+      break;
+    default:
+      writer->String(StringPrintf("Unhandled %d", gesture.type).c_str());
       break;
   }
-  if (!handled)
-    ret[kKeyGestureType] =
-        Json::Value(StringPrintf("Unhandled %d", gesture.type));
-  return ret;
+  writer->EndObject();
 }
 
-Json::Value ActivityLog::EncodePropChange(const PropChangeEntry& prop_change) {
-  Json::Value ret(Json::objectValue);
-  ret[kKeyType] = Json::Value(kKeyPropChange);
-  ret[kKeyPropChangeName] = Json::Value(prop_change.name);
-  Json::Value val;
-  Json::Value type;
+template<typename Writer>
+void ActivityLog::WritePropChange(Writer* writer,
+                                  const PropChangeEntry& prop_change) {
+  writer->BeginObject();
+  writer->Key(kKeyType);
+  writer->String(kKeyPropChange);
+  writer->Key(kKeyPropChangeName);
+  writer->String(prop_change.name);
   switch (prop_change.type) {
     case PropChangeEntry::kBoolProp:
-      val = Json::Value(static_cast<bool>(prop_change.value.bool_val));
-      type = Json::Value(kValuePropChangeTypeBool);
+      writer->Key(kKeyPropChangeValue);
+      writer->Bool(prop_change.value.bool_val);
+      writer->Key(kKeyPropChangeType);
+      writer->String(kValuePropChangeTypeBool);
       break;
     case PropChangeEntry::kDoubleProp:
-      val = Json::Value(prop_change.value.double_val);
-      type = Json::Value(kValuePropChangeTypeDouble);
+      writer->Key(kKeyPropChangeValue);
+      writer->Double(prop_change.value.double_val);
+      writer->Key(kKeyPropChangeType);
+      writer->String(kValuePropChangeTypeDouble);
       break;
     case PropChangeEntry::kIntProp:
-      val = Json::Value(prop_change.value.int_val);
-      type = Json::Value(kValuePropChangeTypeInt);
+      writer->Key(kKeyPropChangeValue);
+      writer->Int(prop_change.value.int_val);
+      writer->Key(kKeyPropChangeType);
+      writer->String(kValuePropChangeTypeInt);
       break;
     case PropChangeEntry::kShortProp:
-      val = Json::Value(prop_change.value.short_val);
-      type = Json::Value(kValuePropChangeTypeShort);
+      writer->Key(kKeyPropChangeValue);
+      writer->Int(prop_change.value.short_val);
+      writer->Key(kKeyPropChangeType);
+      writer->String(kValuePropChangeTypeShort);
       break;
   }
-  if (!val.isNull())
-    ret[kKeyPropChangeValue] = val;
-  if (!type.isNull())
-    ret[kKeyPropChangeType] = type;
-  return ret;
-}
-
-Json::Value ActivityLog::EncodePropRegistry() {
-  Json::Value ret(Json::objectValue);
-  if (!prop_reg_)
-    return ret;
-
-  const set<Property*>& props = prop_reg_->props();
-  for (set<Property*>::const_iterator it = props.begin(), e = props.end();
-       it != e; ++it) {
-    ret[(*it)->name()] = (*it)->NewValue();
-  }
-  return ret;
+  writer->EndObject();
 }
 
-Json::Value ActivityLog::EncodeCommonInfo() {
-  Json::Value root(Json::objectValue);
-
-  Json::Value entries(Json::arrayValue);
+template<typename Writer>
+void ActivityLog::WriteCommonInfo(Writer* writer) {
+  writer->Key(kKeyRoot);
+  writer->BeginArray();
+  Entry entry;
+  size_t offset = head_;
   for (size_t i = 0; i < size_; ++i) {
-    const Entry& entry = buffer_[(i + head_idx_) % kBufferSize];
+    if (i)
+      offset = NextRecord(offset);
+    DecodeRecord(offset, &entry);
     switch (entry.type) {
       case kHardwareState:
-        entries.append(EncodeHardwareState(entry.details.hwstate));
+        WriteHardwareState(writer, entry.details.hwstate);
         continue;
       case kTimerCallback:
-        entries.append(EncodeTimerCallback(entry.details.timestamp));
+        WriteTimerCallback(writer, entry.details.timestamp);
         continue;
       case kCallbackRequest:
-        entries.append(EncodeCallbackRequest(entry.details.timestamp));
+        WriteCallbackRequest(writer, entry.details.timestamp);
         continue;
       case kGesture:
-        entries.append(EncodeGesture(entry.details.gesture));
+        WriteGesture(writer, entry.details.gesture);
         continue;
       case kPropChange:
-        entries.append(EncodePropChange(entry.details.prop_change));
+        WritePropChange(writer, entry.details.prop_change);
         continue;
     }
     Err("Unknown entry type %d", entry.type);
   }
-  root[kKeyRoot] = entries;
-  root[kKeyHardwarePropRoot] = EncodeHardwareProperties();
+  writer->EndArray();
+  writer->Key(kKeyHardwarePropRoot);
+  WriteHardwareProperties(writer);
+}
+
+template<typename Writer>
+void ActivityLog::WriteEncodeInfo(Writer* writer) {
+  writer->Key("version");
+  writer->Int(1);
+  string gestures_version = VCSID;
+  TrimWhitespaceASCII(gestures_version, TRIM_ALL, &gestures_version);
+  writer->Key("gesturesVersion");
+  writer->String(gestures_version.c_str());
+  // Properties are few and small, so it's fine to build them up front.
+  writer->Key(kKeyProperties);
+  writer->Value(EncodePropRegistry());
+}
 
+template void ActivityLog::WriteCommonInfo(JsonStreamWriter* writer);
+template void ActivityLog::WriteEncodeInfo(JsonStreamWriter* writer);
+
+Json::Value ActivityLog::EncodeCommonInfo() {
+  Json::Value root(Json::objectValue);
+  JsonValueWriter writer(&root);
+  WriteCommonInfo(&writer);
   return root;
 }
 
 void ActivityLog::AddEncodeInfo(Json::Value* root) {
-  (*root)["version"] = Json::Value(1);
-  string gestures_version = VCSID;
-
-  // Strip tailing whitespace.
-  TrimWhitespaceASCII(gestures_version, TRIM_ALL, &gestures_version);
-  (*root)["gesturesVersion"] = Json::Value(gestures_version);
-  (*root)[kKeyProperties] = EncodePropRegistry();
+  JsonValueWriter writer(root);
+  WriteEncodeInfo(&writer);
 }
 
 string ActivityLog::Encode() {
@@ -434,8 +605,116 @@ string ActivityLog::Encode() {
   return root.toStyledString();
 }
 
+string ActivityLog::EncodeBinary() {
+  Json::FastWriter writer;
+  string properties = writer.write(EncodePropRegistry());
+  string gestures_version = VCSID;
+  TrimWhitespaceASCII(gestures_version, TRIM_ALL, &gestures_version);
+
+  BinaryHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kBinaryMagic, sizeof(header.magic));
+  header.version = kBinaryVersion;
+  header.hwprops_size = sizeof(HardwareProperties);
+  header.finger_state_size = sizeof(FingerState);
+  header.gesture_size = sizeof(Gesture);
+  header.properties_size = properties.size();
+  header.gestures_version_size = gestures_version.size();
+
+  string out;
+  out.reserve(sizeof(header) + sizeof(hwprops_) + properties.size() +
+              gestures_version.size() + BytesUsed() + 4 * kRecordAlign);
+  AppendBytes(&out, &header, sizeof(header));
+  AppendPadding(&out);
+  AppendBytes(&out, &hwprops_, sizeof(hwprops_));
+  AppendPadding(&out);
+  out.append(properties);
+  AppendPadding(&out);
+  out.append(gestures_version);
+  AppendPadding(&out);
+
+  Entry entry;
+  size_t offset = head_;
+  for (size_t i = 0; i < size_; ++i) {
+    if (i)
+      offset = NextRecord(offset);
+    DecodeRecord(offset, &entry);
+    switch (entry.type) {
+      case kHardwareState: {
+        const HardwareState& hwstate = entry.details.hwstate;
+        BinaryHardwareState bhs;
+        memset(&bhs, 0, sizeof(bhs));
+        bhs.timestamp = hwstate.timestamp;
+        bhs.buttons_down = hwstate.buttons_down;
+        bhs.finger_cnt = hwstate.finger_cnt;
+        bhs.touch_cnt = hwstate.touch_cnt;
+        bhs.rel_x = hwstate.rel_x;
+        bhs.rel_y = hwstate.rel_y;
+        bhs.rel_wheel = hwstate.rel_wheel;
+        bhs.rel_wheel_hi_res = hwstate.rel_wheel_hi_res;
+        bhs.rel_hwheel = hwstate.rel_hwheel;
+        bhs.msc_timestamp = hwstate.msc_timestamp;
+        size_t fingers_size = hwstate.finger_cnt * sizeof(FingerState);
+        AppendRecordHeader(&out, entry.type, sizeof(bhs) + fingers_size);
+        AppendBytes(&out, &bhs, sizeof(bhs));
+        if (fingers_size)
+          AppendBytes(&out, hwstate.fingers, fingers_size);
+        break;
+      }
+      case kTimerCallback:  // fall through
+      case kCallbackRequest:
+        AppendRecordHeader(&out, entry.type, sizeof(stime_t));
+        AppendBytes(&out, &entry.details.timestamp, sizeof(stime_t));
+        break;
+      case kGesture:
+        AppendRecordHeader(&out, entry.type, sizeof(Gesture));
+        AppendBytes(&out, &entry.details.gesture, sizeof(Gesture));
+        break;
+      case kPropChange: {
+        const PropChangeEntry& prop_change = entry.details.prop_change;
+        BinaryPropChange bpc;
+        memset(&bpc, 0, sizeof(bpc));
+        bpc.type = prop_change.type;
+        switch (prop_change.type) {
+          case PropChangeEntry::kBoolProp:
+            bpc.value.bool_val = prop_change.value.bool_val;
+            break;
+          case PropChangeEntry::kDoubleProp:
+            bpc.value.double_val = prop_change.value.double_val;
+            break;
+          case PropChangeEntry::kIntProp:
+            bpc.value.int_val = prop_change.value.int_val;
+            break;
+          case PropChangeEntry::kShortProp:
+            bpc.value.short_val = prop_change.value.short_val;
+            break;
+        }
+        size_t name_size = strlen(prop_change.name) + 1;
+        AppendRecordHeader(&out, entry.type, sizeof(bpc) + name_size);
+        AppendBytes(&out, &bpc, sizeof(bpc));
+        AppendBytes(&out, prop_change.name, name_size);
+        break;
+      }
+    }
+    AppendPadding(&out);
+  }
+  return out;
+}
+
+const char ActivityLog::kBinaryMagic[8] = "GESTLOG";
+
 const char ActivityLog::kKeyInterpreterName[] = "interpreterName";
 const char ActivityLog::kKeyNext[] = "nextLayer";
+const char ActivityLog::kKeyLatencyStats[] = "latencyStats";
+const char ActivityLog::kKeyLatencySync[] = "syncInterpret";
+const char ActivityLog::kKeyLatencyTimer[] = "handleTimer";
+const char ActivityLog::kKeyGestureTypeMemo[] = "gestureTypeMemo";
+const char ActivityLog::kKeyMemoHits[] = "hits";
+const char ActivityLog::kKeyMemoMisses[] = "misses";
+const char ActivityLog::kKeyInputQueueDelay[] = "inputQueueDelay";
+const char ActivityLog::kKeyQueueDelay[] = "delay";
+const char ActivityLog::kKeyReportInterval[] = "reportInterval";
+const char ActivityLog::kKeyDownstreamTime[] = "downstreamTime";
 const char ActivityLog::kKeyRoot[] = "entries";
 const char ActivityLog::kKeyType[] = "type";
 const char ActivityLog::kKeyHardwareState[] = "hardwareState";
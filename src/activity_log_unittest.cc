@@ -2,11 +2,18 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <stdlib.h>
+#include <unistd.h>
+
 #include <string>
 
 #include <gtest/gtest.h>
+#include <json/reader.h>
+#include <json/value.h>
 
 #include "gestures/include/activity_log.h"
+#include "gestures/include/file_util.h"
+#include "gestures/include/json_stream_writer.h"
 #include "gestures/include/macros.h"
 #include "gestures/include/prop_registry.h"
 #include "gestures/include/unittest_util.h"
@@ -63,27 +70,28 @@ TEST(ActivityLogTest, SimpleTest) {
     EXPECT_TRUE(strstr(hwprops_log.c_str(), expected_strings[i]));
 
   EXPECT_EQ(0, log.size());
-  EXPECT_GT(log.MaxSize(), 10);
+  EXPECT_EQ(0, log.BytesUsed());
+  EXPECT_GT(log.MaxBytes(), 10);
 
   FingerState fs = { 0.0, 0.0, 0.0, 0.0, 9.0, 0.0, 3.0, 4.0, 22, 0 };
   HardwareState hs = make_hwstate(1.0, 0, 1, 1, &fs);
   log.LogHardwareState(hs);
   EXPECT_EQ(1, log.size());
   EXPECT_TRUE(strstr(log.Encode().c_str(), "22"));
-  ActivityLog::Entry* entry = log.GetEntry(0);
-  EXPECT_EQ(ActivityLog::kHardwareState, entry->type);
+  ActivityLog::Entry entry = log.GetEntry(0);
+  EXPECT_EQ(ActivityLog::kHardwareState, entry.type);
 
   log.LogTimerCallback(234.5);
   EXPECT_EQ(2, log.size());
   EXPECT_TRUE(strstr(log.Encode().c_str(), "234.5"));
   entry = log.GetEntry(1);
-  EXPECT_EQ(ActivityLog::kTimerCallback, entry->type);
+  EXPECT_EQ(ActivityLog::kTimerCallback, entry.type);
 
   log.LogCallbackRequest(90210);
   EXPECT_EQ(3, log.size());
   EXPECT_TRUE(strstr(log.Encode().c_str(), "90210"));
   entry = log.GetEntry(2);
-  EXPECT_EQ(ActivityLog::kCallbackRequest, entry->type);
+  EXPECT_EQ(ActivityLog::kCallbackRequest, entry.type);
 
   Gesture null;
   Gesture move(kGestureMove, 1.0, 2.0, 773, 4.0);
@@ -100,7 +108,7 @@ TEST(ActivityLogTest, SimpleTest) {
     log.LogGesture(*gs[i]);
     EXPECT_TRUE(strstr(log.Encode().c_str(), test_strs[i])) << "i=" << i;
     entry = log.GetEntry(log.size() - 1);
-    EXPECT_EQ(ActivityLog::kGesture, entry->type) << "i=" << i;
+    EXPECT_EQ(ActivityLog::kGesture, entry.type) << "i=" << i;
   }
 
   log.Clear();
@@ -109,8 +117,8 @@ TEST(ActivityLogTest, SimpleTest) {
 
 TEST(ActivityLogTest, WrapAroundTest) {
   ActivityLog log(NULL);
-  // overfill the buffer
-  const size_t fill_size = (ActivityLog::kBufferSize * 3) / 2;
+  // overfill the buffer. Each entry takes 16 bytes.
+  const size_t fill_size = (ActivityLog::kBufferSize * 3) / 2 / 16;
   for (size_t i = 0; i < fill_size; i++)
     log.LogCallbackRequest(static_cast<stime_t>(i));
   const string::size_type prefix_length = 100;
@@ -120,6 +128,191 @@ TEST(ActivityLogTest, WrapAroundTest) {
   EXPECT_NE(first_prefix, second_prefix);
 }
 
+TEST(ActivityLogTest, VariableSizeEntryTest) {
+  ActivityLog log(NULL);
+  FingerState fs[] = {
+    // TM, Tm, WM, Wm, Press, Orientation, X, Y, TrID, flags
+    { 0, 0, 0, 0, 10, 0, 1, 2, 1, 0 },
+    { 0, 0, 0, 0, 10, 0, 3, 4, 2, 0 },
+    { 0, 0, 0, 0, 10, 0, 5, 6, 3, 0 },
+  };
+  // Only the fingers present take up space.
+  log.LogTimerCallback(1.0);
+  size_t timer_bytes = log.BytesUsed();
+  log.LogHardwareState(make_hwstate(2.0, 0, 1, 1, &fs[0]));
+  size_t one_finger_bytes = log.BytesUsed() - timer_bytes;
+  log.LogHardwareState(make_hwstate(3.0, 0, 3, 3, &fs[0]));
+  EXPECT_EQ(one_finger_bytes + 2 * sizeof(FingerState),
+            log.BytesUsed() - timer_bytes - one_finger_bytes);
+  log.Clear();
+  EXPECT_EQ(0, log.BytesUsed());
+
+  // Fill with entries of varying sizes until the buffer has wrapped around a
+  // few times, then check that the newest entries read back in order.
+  const size_t kCount = 3 * log.MaxBytes() / one_finger_bytes;
+  for (size_t i = 0; i < kCount; i++) {
+    stime_t now = static_cast<stime_t>(i);
+    switch (i % 3) {
+      case 0:
+        log.LogTimerCallback(now);
+        break;
+      case 1:
+        log.LogHardwareState(make_hwstate(now, 0, 1, 1, &fs[i % 3]));
+        break;
+      case 2:
+        log.LogHardwareState(make_hwstate(now, 0, 2, 2, &fs[0]));
+        break;
+    }
+  }
+  ASSERT_GT(log.size(), 0);
+  EXPECT_LT(log.size(), kCount);
+  EXPECT_LE(log.BytesUsed(), log.MaxBytes());
+  size_t first = kCount - log.size();
+  for (size_t i = 0; i < log.size(); i++) {
+    ActivityLog::Entry entry = log.GetEntry(i);
+    size_t expected = first + i;
+    if (expected % 3 == 0) {
+      ASSERT_EQ(ActivityLog::kTimerCallback, entry.type);
+      EXPECT_DOUBLE_EQ(expected, entry.details.timestamp);
+      continue;
+    }
+    ASSERT_EQ(ActivityLog::kHardwareState, entry.type);
+    const HardwareState& hs = entry.details.hwstate;
+    EXPECT_DOUBLE_EQ(expected, hs.timestamp);
+    ASSERT_EQ(expected % 3, hs.finger_cnt);
+    EXPECT_TRUE(hs.fingers[0] == fs[expected % 3 == 1 ? 1 : 0]);
+    if (hs.finger_cnt == 2) {
+      EXPECT_TRUE(hs.fingers[1] == fs[1]);
+    }
+  }
+  // Random access still works.
+  EXPECT_EQ(ActivityLog::kTimerCallback,
+            log.GetEntry((3 - first % 3) % 3).type);
+}
+
+TEST(ActivityLogTest, GrowAndReleaseTest) {
+  ActivityLog log(NULL);
+  HardwareProperties hwprops = {
+    0, 0, 100, 100, 1, 1, 25.4, 25.4, -1, 2, 10, 10, 0, 0, 1, 0, 0
+  };
+  log.SetHardwareProperties(hwprops);
+  // Nothing is allocated until something is logged.
+  EXPECT_EQ(0, log.BytesAllocated());
+
+  log.LogTimerCallback(1.0);
+  size_t initial = log.BytesAllocated();
+  EXPECT_GT(initial, 0);
+  EXPECT_LT(initial, log.MaxBytes());
+
+  // Nothing is dropped while the buffer can still grow.
+  size_t count = 1;
+  while (log.BytesAllocated() < log.MaxBytes()) {
+    log.LogTimerCallback(static_cast<stime_t>(count));
+    count++;
+    ASSERT_EQ(count, log.size());
+  }
+  for (size_t i = 0; i < count; i += count / 10) {
+    ActivityLog::Entry entry = log.GetEntry(i);
+    ASSERT_EQ(ActivityLog::kTimerCallback, entry.type);
+    EXPECT_DOUBLE_EQ(i == 0 ? 1.0 : i, entry.details.timestamp);
+  }
+
+  log.Clear();
+  EXPECT_EQ(0, log.size());
+  EXPECT_EQ(0, log.BytesAllocated());
+  log.LogTimerCallback(1.0);
+  EXPECT_EQ(initial, log.BytesAllocated());
+}
+
+// Tests that streaming a log with every type of entry gives the same JSON as
+// building it with Encode().
+TEST(ActivityLogTest, StreamedEncodeTest) {
+  PropRegistry prop_reg;
+  BoolProperty bool_prop(&prop_reg, "bool prop", true);
+  DoubleProperty double_prop(&prop_reg, "double prop", 77.25);
+  ActivityLog log(&prop_reg);
+  HardwareProperties hwprops = {
+    0, 0, 100.5, 60, 10, 10, 133, 133, -1, 2, 2, 5, 1, 0, 1, 0, 0
+  };
+  log.SetHardwareProperties(hwprops);
+
+  FingerState fs[] = {
+    // TM, Tm, WM, Wm, Press, Orientation, X, Y, TrID, flags
+    { 1.5, 2, 3, 4, 9.25, -1, 3.125, 4, 22, GESTURES_FINGER_WARP_X },
+    { 0, 0, 0, 0, 50, 0, 40, 30.5, 23, 0 },
+  };
+  HardwareState hs = make_hwstate(1.0, GESTURES_BUTTON_LEFT, 2, 2, fs);
+  hs.rel_x = 1.5;
+  hs.rel_wheel = -2;
+  log.LogHardwareState(hs);
+  log.LogTimerCallback(234.5);
+  log.LogCallbackRequest(90210);
+
+  Gesture contact_initiated;
+  contact_initiated.type = kGestureTypeContactInitiated;
+  Gesture unhandled;
+  unhandled.type = static_cast<GestureType>(100);
+  const Gesture gestures[] = {
+    Gesture(),
+    contact_initiated,
+    Gesture(kGestureMove, 1.0, 2.0, 773, -4.5),
+    Gesture(kGestureScroll, 1.0, 2.0, 312, 4.0),
+    Gesture(kGestureButtonsChange, 1.0, 847, 3, 4),
+    Gesture(kGestureFling, 1.0, 2.0, 5.5, -6, GESTURES_FLING_TAP_DOWN),
+    Gesture(kGestureSwipe, 1.0, 2.0, 7, 8.25),
+    Gesture(kGestureSwipeLift, 1.0, 2.0),
+    Gesture(kGesturePinch, 1.0, 2.0, 1.125, GESTURES_ZOOM_UPDATE),
+    Gesture(kGestureMetrics, 1.0, 2.0, kGestureMetricsTypeNoisyGround, 9, 10),
+    Gesture(kGestureFourFingerSwipe, 1.0, 2.0, 11, 12.5),
+    Gesture(kGestureFourFingerSwipeLift, 1.0, 2.0),
+    unhandled,
+  };
+  for (size_t i = 0; i < arraysize(gestures); i++)
+    log.LogGesture(gestures[i]);
+
+  ActivityLog::PropChangeEntry prop_change;
+  prop_change.name = "bool prop";
+  prop_change.type = ActivityLog::PropChangeEntry::kBoolProp;
+  prop_change.value.bool_val = true;
+  log.LogPropChange(prop_change);
+  prop_change.name = "double prop";
+  prop_change.type = ActivityLog::PropChangeEntry::kDoubleProp;
+  prop_change.value.double_val = 77.25;
+  log.LogPropChange(prop_change);
+  prop_change.name = "int prop";
+  prop_change.type = ActivityLog::PropChangeEntry::kIntProp;
+  prop_change.value.int_val = -816;
+  log.LogPropChange(prop_change);
+  prop_change.name = "short prop";
+  prop_change.type = ActivityLog::PropChangeEntry::kShortProp;
+  prop_change.value.short_val = 12;
+  log.LogPropChange(prop_change);
+
+  char filename[] = "/tmp/gestures_log_XXXXXX";
+  int fd = mkstemp(filename);
+  ASSERT_GE(fd, 0);
+  {
+    JsonStreamWriter writer(fd);
+    writer.BeginObject();
+    log.WriteCommonInfo(&writer);
+    log.WriteEncodeInfo(&writer);
+    writer.EndObject();
+    EXPECT_TRUE(writer.Flush());
+  }
+  close(fd);
+  string contents;
+  EXPECT_TRUE(ReadFileToString(filename, &contents));
+  unlink(filename);
+
+  Json::Reader reader;
+  Json::Value streamed;
+  Json::Value encoded;
+  ASSERT_TRUE(reader.parse(contents, streamed, false));
+  ASSERT_TRUE(reader.parse(log.Encode(), encoded, false));
+  EXPECT_EQ(log.size(), streamed[ActivityLog::kKeyRoot].size());
+  EXPECT_EQ(encoded.toStyledString(), streamed.toStyledString());
+}
+
 TEST(ActivityLogTest, VersionTest) {
   ActivityLog log(NULL);
   string thelog = log.Encode();
@@ -5,12 +5,15 @@
 #include "gestures/include/activity_replay.h"
 
 #include <limits.h>
+#include <string.h>
 #include <string>
+#include <vector>
 
 #include <gtest/gtest.h>
 #include <json/reader.h>
 #include <json/writer.h>
 
+#include "gestures/include/binary_log_reader.h"
 #include "gestures/include/logging.h"
 #include "gestures/include/prop_registry.h"
 #include "gestures/include/set.h"
@@ -24,7 +27,8 @@ using std::string;
 namespace gestures {
 
 ActivityReplay::ActivityReplay(PropRegistry* prop_reg)
-    : log_(NULL), prop_reg_(prop_reg) {}
+    : log_(NULL), prop_reg_(prop_reg), consumed_head_(0),
+      report_failures_(true) {}
 
 bool ActivityReplay::Parse(const string& data) {
   std::set<string> emptyset;
@@ -33,8 +37,14 @@ bool ActivityReplay::Parse(const string& data) {
 
 bool ActivityReplay::Parse(const string& data,
                            const std::set<string>& honor_props) {
+  if (!data.compare(0, sizeof(ActivityLog::kBinaryMagic),
+                    ActivityLog::kBinaryMagic,
+                    sizeof(ActivityLog::kBinaryMagic)))
+    return ParseBinary(data, honor_props);
   log_.Clear();
   names_.clear();
+  properties_ = Json::Value(Json::objectValue);
+  gestures_version_.clear();
 
   string error_msg;
   Json::Value root;
@@ -53,6 +63,9 @@ bool ActivityReplay::Parse(const string& data,
   // Get and apply user-configurable properties
   Json::Value props_dict =
       root.get(ActivityLog::kKeyProperties, Json::Value());
+  if (props_dict.isObject())
+    properties_ = props_dict;
+  gestures_version_ = root.get("gesturesVersion", Json::Value("")).asString();
   if (root.isMember(ActivityLog::kKeyProperties) &&
       !ParseProperties(props_dict, honor_props)) {
     Err("Unable to parse properties.");
@@ -94,11 +107,81 @@ bool ActivityReplay::Parse(const string& data,
   return true;
 }
 
+bool ActivityReplay::ParseBinary(const string& data,
+                                 const std::set<string>& honor_props) {
+  log_.Clear();
+  names_.clear();
+  properties_ = Json::Value(Json::objectValue);
+  gestures_version_.clear();
+
+  BinaryLogReader reader;
+  if (!reader.Init(data.data(), data.size())) {
+    Err("Unable to read binary log");
+    return false;
+  }
+  if (!ParseBinaryInfo(reader, honor_props))
+    return false;
+  ActivityLog::Entry entry;
+  while (reader.Next(&entry)) {
+    switch (entry.type) {
+      case ActivityLog::kHardwareState:
+        log_.LogHardwareState(entry.details.hwstate);
+        break;
+      case ActivityLog::kTimerCallback:
+        log_.LogTimerCallback(entry.details.timestamp);
+        break;
+      case ActivityLog::kCallbackRequest:
+        log_.LogCallbackRequest(entry.details.timestamp);
+        break;
+      case ActivityLog::kGesture:
+        log_.LogGesture(entry.details.gesture);
+        break;
+      case ActivityLog::kPropChange: {
+        // The name points into |data|, so keep a copy.
+        const string* stored_name =
+            new string(entry.details.prop_change.name);  // alloc
+        // transfer ownership:
+        names_.push_back(std::shared_ptr<const string>(stored_name));
+        entry.details.prop_change.name = stored_name->c_str();
+        log_.LogPropChange(entry.details.prop_change);
+        break;
+      }
+    }
+  }
+  return !reader.error();
+}
+
+bool ActivityReplay::ParseBinaryInfo(const BinaryLogReader& reader,
+                                     const std::set<string>& honor_props) {
+  hwprops_ = reader.hwprops();
+  gestures_version_ = reader.gestures_version();
+  properties_ = Json::Value(Json::objectValue);
+  if (!reader.properties().empty()) {
+    Json::Reader json_reader;
+    if (!json_reader.parse(reader.properties(), properties_, false) ||
+        !properties_.isObject() ||
+        !ParseProperties(properties_, honor_props)) {
+      Err("Unable to parse properties.");
+      return false;
+    }
+  }
+  log_.SetHardwareProperties(hwprops_);
+  return true;
+}
+
+string ActivityReplay::EncodeJson() {
+  Json::Value root = log_.EncodeCommonInfo();
+  log_.AddEncodeInfo(&root);
+  root["gesturesVersion"] = Json::Value(gestures_version_);
+  root[ActivityLog::kKeyProperties] = properties_;
+  return root.toStyledString();
+}
+
 bool ActivityReplay::ParseProperties(const Json::Value& dict,
                                      const std::set<string>& honor_props) {
   if (!prop_reg_)
     return true;
-  ::set<Property*> props = prop_reg_->props();
+  const ::set<Property*>& props = prop_reg_->props();
   for (::set<Property*>::const_iterator it = props.begin(), e = props.end();
        it != e; ++it) {
     const char* key = (*it)->name();
@@ -169,8 +252,9 @@ bool ActivityReplay::ParseHardwareProperties(const Json::Value& obj,
            props.support_semi_mt, bool, true);
   PARSE_HP(obj, ActivityLog::kKeyHardwarePropIsButtonPad,isBool, asBool,
            props.is_button_pad, bool, true);
+  // Logs predating mouse support don't have this.
   PARSE_HP(obj, ActivityLog::kKeyHardwarePropHasWheel,isBool, asBool,
-           props.has_wheel, bool, true);
+           props.has_wheel, bool, false);
   *out_props = props;
   return true;
 }
@@ -402,18 +486,15 @@ bool ActivityReplay::ParseGestureMove(const Json::Value& entry,
     return false;
   }
   out_gs->details.move.dy = entry[ActivityLog::kKeyGestureMoveDY].asDouble();
-  if (!entry.isMember(ActivityLog::kKeyGestureMoveOrdinalDX)) {
-    Err("can't parse move ordinal_dx");
-    return false;
-  }
+  // Logs predating ordinal values have them equal to the raw ones.
   out_gs->details.move.ordinal_dx =
-      entry[ActivityLog::kKeyGestureMoveOrdinalDX].asDouble();
-  if (!entry.isMember(ActivityLog::kKeyGestureMoveOrdinalDY)) {
-    Err("can't parse move ordinal_dy");
-    return false;
-  }
+      entry.isMember(ActivityLog::kKeyGestureMoveOrdinalDX) ?
+      entry[ActivityLog::kKeyGestureMoveOrdinalDX].asDouble() :
+      out_gs->details.move.dx;
   out_gs->details.move.ordinal_dy =
-      entry[ActivityLog::kKeyGestureMoveOrdinalDY].asDouble();
+      entry.isMember(ActivityLog::kKeyGestureMoveOrdinalDY) ?
+      entry[ActivityLog::kKeyGestureMoveOrdinalDY].asDouble() :
+      out_gs->details.move.dy;
   return true;
 }
 
@@ -432,18 +513,15 @@ bool ActivityReplay::ParseGestureScroll(const Json::Value& entry,
   }
   out_gs->details.scroll.dy =
       entry[ActivityLog::kKeyGestureScrollDY].asDouble();
-  if (!entry.isMember(ActivityLog::kKeyGestureScrollOrdinalDX)) {
-    Err("can't parse scroll ordinal_dx");
-    return false;
-  }
+  // Logs predating ordinal values have them equal to the raw ones.
   out_gs->details.scroll.ordinal_dx =
-      entry[ActivityLog::kKeyGestureScrollOrdinalDX].asDouble();
-  if (!entry.isMember(ActivityLog::kKeyGestureScrollOrdinalDY)) {
-    Err("can't parse scroll ordinal_dy");
-    return false;
-  }
+      entry.isMember(ActivityLog::kKeyGestureScrollOrdinalDX) ?
+      entry[ActivityLog::kKeyGestureScrollOrdinalDX].asDouble() :
+      out_gs->details.scroll.dx;
   out_gs->details.scroll.ordinal_dy =
-      entry[ActivityLog::kKeyGestureScrollOrdinalDY].asDouble();
+      entry.isMember(ActivityLog::kKeyGestureScrollOrdinalDY) ?
+      entry[ActivityLog::kKeyGestureScrollOrdinalDY].asDouble() :
+      out_gs->details.scroll.dy;
   return true;
 }
 
@@ -460,18 +538,15 @@ bool ActivityReplay::ParseGestureSwipe(const Json::Value& entry,
     return false;
   }
   out_gs->details.swipe.dy = entry[ActivityLog::kKeyGestureSwipeDY].asDouble();
-  if (!entry.isMember(ActivityLog::kKeyGestureSwipeOrdinalDX)) {
-    Err("can't parse swipe ordinal_dx");
-    return false;
-  }
+  // Logs predating ordinal values have them equal to the raw ones.
   out_gs->details.swipe.ordinal_dx =
-      entry[ActivityLog::kKeyGestureSwipeOrdinalDX].asDouble();
-  if (!entry.isMember(ActivityLog::kKeyGestureSwipeOrdinalDY)) {
-    Err("can't parse swipe ordinal_dy");
-    return false;
-  }
+      entry.isMember(ActivityLog::kKeyGestureSwipeOrdinalDX) ?
+      entry[ActivityLog::kKeyGestureSwipeOrdinalDX].asDouble() :
+      out_gs->details.swipe.dx;
   out_gs->details.swipe.ordinal_dy =
-      entry[ActivityLog::kKeyGestureSwipeOrdinalDY].asDouble();
+      entry.isMember(ActivityLog::kKeyGestureSwipeOrdinalDY) ?
+      entry[ActivityLog::kKeyGestureSwipeOrdinalDY].asDouble() :
+      out_gs->details.swipe.dy;
   return true;
 }
 
@@ -489,12 +564,11 @@ bool ActivityReplay::ParseGesturePinch(const Json::Value& entry,
     return false;
   }
   out_gs->details.pinch.dz = entry[ActivityLog::kKeyGesturePinchDZ].asDouble();
-  if (!entry.isMember(ActivityLog::kKeyGesturePinchOrdinalDZ)) {
-    Err("can't parse pinch ordinal_dz");
-    return false;
-  }
+  // Logs predating ordinal values have them equal to the raw ones.
   out_gs->details.pinch.ordinal_dz =
-      entry[ActivityLog::kKeyGesturePinchOrdinalDZ].asDouble();
+      entry.isMember(ActivityLog::kKeyGesturePinchOrdinalDZ) ?
+      entry[ActivityLog::kKeyGesturePinchOrdinalDZ].asDouble() :
+      out_gs->details.pinch.dz;
   if (!entry.isMember(ActivityLog::kKeyGesturePinchZoomState)) {
     Err("can't parse pinch zoom_state");
     return false;
@@ -535,18 +609,15 @@ bool ActivityReplay::ParseGestureFling(const Json::Value& entry,
     return false;
   }
   out_gs->details.fling.vy = entry[ActivityLog::kKeyGestureFlingVY].asDouble();
-  if (!entry.isMember(ActivityLog::kKeyGestureFlingOrdinalVX)) {
-    Err("can't parse fling ordinal_vx");
-    return false;
-  }
+  // Logs predating ordinal values have them equal to the raw ones.
   out_gs->details.fling.ordinal_vx =
-      entry[ActivityLog::kKeyGestureFlingOrdinalVX].asDouble();
-  if (!entry.isMember(ActivityLog::kKeyGestureFlingOrdinalVY)) {
-    Err("can't parse fling ordinal_vy");
-    return false;
-  }
+      entry.isMember(ActivityLog::kKeyGestureFlingOrdinalVX) ?
+      entry[ActivityLog::kKeyGestureFlingOrdinalVX].asDouble() :
+      out_gs->details.fling.vx;
   out_gs->details.fling.ordinal_vy =
-      entry[ActivityLog::kKeyGestureFlingOrdinalVY].asDouble();
+      entry.isMember(ActivityLog::kKeyGestureFlingOrdinalVY) ?
+      entry[ActivityLog::kKeyGestureFlingOrdinalVY].asDouble() :
+      out_gs->details.fling.vy;
   if (!entry.isMember(ActivityLog::kKeyGestureFlingState)) {
     Err("can't parse scroll is_scroll_begin");
     return false;
@@ -645,66 +716,99 @@ bool ActivityReplay::ParsePropChange(const Json::Value& entry) {
 void ActivityReplay::Replay(Interpreter* interpreter,
                             MetricsProperties* mprops) {
   interpreter->Initialize(&hwprops_, NULL, mprops, this);
+  gesture_diff_ = GestureDiff();
 
   stime_t last_timeout_req = -1.0;
-  // Use last_gs to save a copy of last gesture.
-  Gesture last_gs;
-  for (size_t i = 0; i < log_.size(); ++i) {
-    ActivityLog::Entry* entry = log_.GetEntry(i);
-    switch (entry->type) {
-      case ActivityLog::kHardwareState: {
-        last_timeout_req = -1.0;
-        HardwareState hs = entry->details.hwstate;
-        for (size_t i = 0; i < hs.finger_cnt; i++)
-          Log("Input Finger ID: %d", hs.fingers[i].tracking_id);
-        interpreter->SyncInterpret(&hs, &last_timeout_req);
-        break;
-      }
-      case ActivityLog::kTimerCallback: {
-        last_timeout_req = -1.0;
-        interpreter->HandleTimer(entry->details.timestamp, &last_timeout_req);
-        break;
+  for (size_t i = 0; i < log_.size(); ++i)
+    ReplayEntry(interpreter, log_.GetEntry(i), i, &last_timeout_req);
+  FinishReplay();
+}
+
+bool ActivityReplay::ReplayBinary(BinaryLogReader* reader,
+                                  Interpreter* interpreter,
+                                  MetricsProperties* mprops) {
+  interpreter->Initialize(&hwprops_, NULL, mprops, this);
+  gesture_diff_ = GestureDiff();
+
+  stime_t last_timeout_req = -1.0;
+  ActivityLog::Entry entry;
+  reader->Rewind();
+  for (size_t i = 0; reader->Next(&entry); ++i)
+    ReplayEntry(interpreter, entry, i, &last_timeout_req);
+  FinishReplay();
+  return !reader->error();
+}
+
+void ActivityReplay::ReplayEntry(Interpreter* interpreter,
+                                 const ActivityLog::Entry& entry, size_t idx,
+                                 stime_t* last_timeout_req) {
+  switch (entry.type) {
+    case ActivityLog::kHardwareState: {
+      *last_timeout_req = -1.0;
+      HardwareState hs = entry.details.hwstate;
+      for (size_t i = 0; i < hs.finger_cnt; i++)
+        Log("Input Finger ID: %d", hs.fingers[i].tracking_id);
+      interpreter->SyncInterpret(&hs, last_timeout_req);
+      break;
+    }
+    case ActivityLog::kTimerCallback: {
+      *last_timeout_req = -1.0;
+      interpreter->HandleTimer(entry.details.timestamp, last_timeout_req);
+      break;
+    }
+    case ActivityLog::kCallbackRequest:
+      if (!DoubleEq(*last_timeout_req, entry.details.timestamp)) {
+        Err("Expected timeout request of %f, but log has %f (entry idx %zu)",
+            *last_timeout_req, entry.details.timestamp, idx);
       }
-      case ActivityLog::kCallbackRequest:
-        if (!DoubleEq(last_timeout_req, entry->details.timestamp)) {
-          Err("Expected timeout request of %f, but log has %f (entry idx %zu)",
-              last_timeout_req, entry->details.timestamp, i);
-        }
-        break;
-      case ActivityLog::kGesture: {
-        bool matched = false;
-        while (!consumed_gestures_.empty() && !matched) {
-          if (consumed_gestures_.front() == entry->details.gesture) {
-            Log("Gesture matched:\n  Actual gesture: %s.\n"
-                "Expected gesture: %s",
-                consumed_gestures_.front().String().c_str(),
-                entry->details.gesture.String().c_str());
-            matched = true;
-          } else {
-            Log("Unmatched actual gesture: %s\n",
-                consumed_gestures_.front().String().c_str());
-            ADD_FAILURE();
-          }
-          consumed_gestures_.pop_front();
-        }
-        if (!matched) {
-          Log("Missing logged gesture: %s",
-              entry->details.gesture.String().c_str());
-          ADD_FAILURE();
+      break;
+    case ActivityLog::kGesture: {
+      bool matched = false;
+      while (consumed_head_ < consumed_gestures_.size() && !matched) {
+        const Gesture& consumed = consumed_gestures_[consumed_head_++];
+        if (consumed == entry.details.gesture) {
+          Log("Gesture matched (entry idx %zu)", idx);
+          matched = true;
+          gesture_diff_.matched++;
+        } else {
+          AddUnexpectedGesture(consumed);
         }
-        break;
       }
-      case ActivityLog::kPropChange:
-        ReplayPropChange(entry->details.prop_change);
-        break;
+      if (consumed_head_ == consumed_gestures_.size()) {
+        consumed_gestures_.clear();
+        consumed_head_ = 0;
+      }
+      if (!matched)
+        AddMissingGesture(entry.details.gesture);
+      break;
     }
+    case ActivityLog::kPropChange:
+      ReplayPropChange(entry.details.prop_change);
+      break;
   }
-  while (!consumed_gestures_.empty()) {
-    Log("Unmatched actual gesture: %s\n",
-        consumed_gestures_.front().String().c_str());
+}
+
+void ActivityReplay::FinishReplay() {
+  for (; consumed_head_ < consumed_gestures_.size(); consumed_head_++)
+    AddUnexpectedGesture(consumed_gestures_[consumed_head_]);
+  consumed_gestures_.clear();
+  consumed_head_ = 0;
+}
+
+void ActivityReplay::AddMissingGesture(const Gesture& gesture) {
+  Log("Missing logged gesture: %s", gesture.String().c_str());
+  gesture_diff_.missing++;
+  gesture_diff_.lines.push_back("- " + gesture.String());
+  if (report_failures_)
+    ADD_FAILURE();
+}
+
+void ActivityReplay::AddUnexpectedGesture(const Gesture& gesture) {
+  Log("Unmatched actual gesture: %s\n", gesture.String().c_str());
+  gesture_diff_.unexpected++;
+  gesture_diff_.lines.push_back("+ " + gesture.String());
+  if (report_failures_)
     ADD_FAILURE();
-    consumed_gestures_.pop_front();
-  }
 }
 
 void ActivityReplay::ConsumeGesture(const Gesture& gesture) {
@@ -717,9 +821,9 @@ bool ActivityReplay::ReplayPropChange(
     Err("Missing prop registry.");
     return false;
   }
-  ::set<Property*> props = prop_reg_->props();
+  const ::set<Property*>& props = prop_reg_->props();
   Property* prop = NULL;
-  for (::set<Property*>::iterator it = props.begin(), e = props.end(); it != e;
+  for (::set<Property*>::const_iterator it = props.begin(), e = props.end(); it != e;
        ++it) {
     prop = *it;
     if (strcmp(prop->name(), entry.name) == 0)
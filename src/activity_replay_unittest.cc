@@ -14,7 +14,9 @@
 #include "gestures/include/finger_metrics.h"
 #include "gestures/include/logging_filter_interpreter.h"
 #include "gestures/include/gestures.h"
+#include "gestures/include/prop_registry.h"
 #include "gestures/include/string_util.h"
+#include "gestures/include/unittest_util.h"
 
 using std::string;
 
@@ -58,4 +60,118 @@ TEST(ActivityReplayTest, DISABLED_SimpleTest) {
   DeleteGestureInterpreter(c_interpreter);
 }
 
+// Tests that a log survives a round trip through the binary format, and that
+// converting it back to JSON gives the same JSON as the original log.
+TEST(ActivityReplayTest, BinaryRoundTripTest) {
+  PropRegistry prop_reg;
+  BoolProperty bool_prop(&prop_reg, "bool prop", true);
+  DoubleProperty double_prop(&prop_reg, "double prop", 77.25);
+  IntProperty int_prop(&prop_reg, "int prop", -816);
+  StringProperty string_prop(&prop_reg, "string prop", "foobarstr");
+
+  ActivityLog log(&prop_reg);
+  HardwareProperties hwprops = {
+    0, 0, 100, 60, 10, 12, 133, 133, -1, 2, 5, 5, 0, 0, 1, 0, 0
+  };
+  log.SetHardwareProperties(hwprops);
+  FingerState fs[] = {
+    // TM, Tm, WM, Wm, Press, Orientation, X, Y, TrID, flags
+    { 1, 2, 3, 4, 10, 0.5, 11, 12, 7, 0 },
+    { 5, 6, 7, 8, 20, -0.5, 21, 22, 8, GESTURES_FINGER_WARP_X },
+  };
+  log.LogHardwareState(make_hwstate(1.0, 0, 2, 2, &fs[0]));
+  log.LogCallbackRequest(1.5);
+  log.LogGesture(Gesture(kGestureMove, 1.0, 1.1, 3.5, -4.25));
+  log.LogHardwareState(make_hwstate(1.25, GESTURES_BUTTON_LEFT, 0, 0, NULL));
+  log.LogTimerCallback(1.5);
+  log.LogGesture(Gesture(kGestureButtonsChange, 1.25, 1.5,
+                         GESTURES_BUTTON_LEFT, 0));
+  ActivityLog::PropChangeEntry prop_change;
+  prop_change.name = "double prop";
+  prop_change.type = ActivityLog::PropChangeEntry::kDoubleProp;
+  prop_change.value.double_val = 2.5;
+  log.LogPropChange(prop_change);
+  prop_change.name = "int prop";
+  prop_change.type = ActivityLog::PropChangeEntry::kIntProp;
+  prop_change.value.int_val = 3;
+  log.LogPropChange(prop_change);
+
+  string binary = log.EncodeBinary();
+  ActivityReplay replay(NULL);
+  ASSERT_TRUE(replay.Parse(binary));
+  ActivityLog* parsed = replay.log();
+  ASSERT_EQ(log.size(), parsed->size());
+  for (size_t i = 0; i < log.size(); i++) {
+    ActivityLog::Entry expected = log.GetEntry(i);
+    ActivityLog::Entry actual = parsed->GetEntry(i);
+    ASSERT_EQ(expected.type, actual.type) << "i=" << i;
+    switch (expected.type) {
+      case ActivityLog::kHardwareState: {
+        const HardwareState& ehs = expected.details.hwstate;
+        const HardwareState& ahs = actual.details.hwstate;
+        EXPECT_DOUBLE_EQ(ehs.timestamp, ahs.timestamp);
+        EXPECT_EQ(ehs.buttons_down, ahs.buttons_down);
+        EXPECT_EQ(ehs.touch_cnt, ahs.touch_cnt);
+        ASSERT_EQ(ehs.finger_cnt, ahs.finger_cnt);
+        for (size_t j = 0; j < ehs.finger_cnt; j++)
+          EXPECT_TRUE(ehs.fingers[j] == ahs.fingers[j]);
+        break;
+      }
+      case ActivityLog::kTimerCallback:  // fall through
+      case ActivityLog::kCallbackRequest:
+        EXPECT_DOUBLE_EQ(expected.details.timestamp, actual.details.timestamp);
+        break;
+      case ActivityLog::kGesture:
+        EXPECT_TRUE(expected.details.gesture == actual.details.gesture);
+        break;
+      case ActivityLog::kPropChange:
+        EXPECT_STREQ(expected.details.prop_change.name,
+                     actual.details.prop_change.name);
+        EXPECT_EQ(expected.details.prop_change.type,
+                  actual.details.prop_change.type);
+        break;
+    }
+  }
+  EXPECT_EQ(log.Encode(), replay.EncodeJson());
+
+  // Truncated logs are rejected.
+  EXPECT_FALSE(replay.Parse(binary.substr(0, binary.size() - 4)));
+}
+
+// Produces a move by the timestamp for each hardware state.
+class ActivityReplayTestInterpreter : public Interpreter {
+ public:
+  ActivityReplayTestInterpreter() : Interpreter(NULL, NULL, false) {}
+
+ protected:
+  virtual void SyncInterpretImpl(HardwareState* hwstate, stime_t* timeout) {
+    ProduceGesture(Gesture(kGestureMove, hwstate->timestamp,
+                           hwstate->timestamp, hwstate->timestamp, 0));
+  }
+};
+
+TEST(ActivityReplayTest, GestureDiffTest) {
+  ActivityLog log(NULL);
+  log.LogHardwareState(make_hwstate(1.0, 0, 0, 0, NULL));
+  log.LogGesture(Gesture(kGestureMove, 1.0, 1.0, 1.0, 0));
+  log.LogHardwareState(make_hwstate(2.0, 0, 0, 0, NULL));
+  log.LogGesture(Gesture(kGestureMove, 2.0, 2.0, 5.0, 0));
+  log.LogHardwareState(make_hwstate(3.0, 0, 0, 0, NULL));
+  log.LogGesture(Gesture(kGestureMove, 3.0, 3.0, 3.0, 0));
+
+  ActivityReplay replay(NULL);
+  ASSERT_TRUE(replay.Parse(log.Encode()));
+  replay.set_report_failures(false);
+  ActivityReplayTestInterpreter interpreter;
+  replay.Replay(&interpreter, NULL);
+  const ActivityReplay::GestureDiff& diff = replay.gesture_diff();
+  EXPECT_EQ(2, diff.matched);
+  EXPECT_EQ(1, diff.missing);
+  EXPECT_EQ(1, diff.unexpected);
+  ASSERT_EQ(2, diff.lines.size());
+  // The move by 2 is skipped while looking for the logged move by 5.
+  EXPECT_EQ('+', diff.lines[0][0]);
+  EXPECT_EQ('-', diff.lines[1][0]);
+}
+
 }  // namespace gestures
@@ -0,0 +1,62 @@
+// Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "gestures/include/allocation_counter.h"
+
+#include "gestures/include/activity_log.h"
+
+// glibc's own entry points, which the replacements below forward to.
+// Memory from them is freed with the normal free().
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+}
+
+namespace {
+
+__thread size_t allocation_count = 0;
+
+}  // namespace
+
+namespace gestures {
+
+size_t ThreadAllocationCount() {
+  return allocation_count;
+}
+
+ScopedAllocationCounter::ScopedAllocationCounter(const ActivityLog* log)
+    : log_(log),
+      log_bytes_(log ? log->BytesAllocated() : 0),
+      start_(ThreadAllocationCount()) {}
+
+size_t ScopedAllocationCounter::count() const {
+  size_t count = ThreadAllocationCount() - start_;
+  // Each Grow() allocates once, and leaves room for more than a call logs.
+  if (count && log_ && log_->BytesAllocated() > log_bytes_)
+    count--;
+  return count;
+}
+
+}  // namespace gestures
+
+// operator new allocates through malloc(), so these count it too.
+extern "C" {
+
+void* malloc(size_t size) {
+  allocation_count++;
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+  allocation_count++;
+  return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+  allocation_count++;
+  return __libc_realloc(ptr, size);
+}
+
+}
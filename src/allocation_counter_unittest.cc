@@ -0,0 +1,175 @@
+// Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdlib.h>
+
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "gestures/include/activity_log.h"
+#include "gestures/include/allocation_counter.h"
+#include "gestures/include/gestures.h"
+#include "gestures/include/interpreter.h"
+#include "gestures/include/prop_registry.h"
+#include "gestures/include/unittest_util.h"
+
+namespace gestures {
+
+class AllocationCounterTest : public ::testing::Test {};
+
+// Keeps the compiler from eliding allocations in SimpleTest.
+void* volatile allocated;
+
+TEST(AllocationCounterTest, SimpleTest) {
+  ScopedAllocationCounter counter;
+  EXPECT_EQ(0, counter.count());
+  allocated = malloc(16);
+  allocated = realloc(allocated, 32);
+  free(allocated);
+  allocated = calloc(2, 8);
+  free(allocated);
+  EXPECT_EQ(3, counter.count());
+  allocated = new int(1);
+  delete static_cast<int*>(allocated);
+  EXPECT_EQ(4, counter.count());
+}
+
+TEST(AllocationCounterTest, ActivityLogGrowthTest) {
+  PropRegistry prop_reg;
+  ActivityLog log(&prop_reg);
+  ScopedAllocationCounter counter(&log);
+  log.LogTimerCallback(1.0);
+  EXPECT_NE(0, log.BytesAllocated());
+  EXPECT_EQ(0, counter.count());
+}
+
+namespace {
+
+const size_t kMaxFingers = 3;
+
+struct Frame {
+  HardwareState hs;
+  FingerState fs[kMaxFingers];
+};
+
+// Appends a session of scrolling, pointing, a tap, a click, a three-finger
+// swipe and wheel motion, 10 ms apart, starting at |start| and using
+// tracking ids from |first_id|.
+void AppendSession(stime_t start, short first_id, std::vector<Frame>* frames) {
+  for (int i = 0; i < 100; i++) {
+    Frame frame = {};
+    float x = 2.0f * (i % 25);
+    unsigned short finger_cnt = 0;
+    int buttons = 0;
+    FingerState* fs = frame.fs;
+    if (i < 25) {
+      fs[0] = { 0, 0, 0, 0, 50, 0, 40, 20 + x, first_id, 0 };
+      fs[1] = { 0, 0, 0, 0, 50, 0, 60, 20 + x,
+                static_cast<short>(1 + first_id), 0 };
+      finger_cnt = 2;
+    } else if (i >= 30 && i < 50) {
+      fs[0] = { 0, 0, 0, 0, 40, 0, 20 + x, 30 + x,
+                static_cast<short>(2 + first_id), 0 };
+      finger_cnt = 1;
+    } else if (i >= 55 && i < 57) {
+      fs[0] = { 0, 0, 0, 0, 50, 0, 50, 30,
+                static_cast<short>(3 + first_id), 0 };
+      finger_cnt = 1;
+    } else if (i >= 65 && i < 70) {
+      fs[0] = { 0, 0, 0, 0, 80, 0, 50, 50,
+                static_cast<short>(4 + first_id), 0 };
+      finger_cnt = 1;
+      buttons = GESTURES_BUTTON_LEFT;
+    } else if (i >= 75 && i < 90) {
+      for (short j = 0; j < 3; j++)
+        fs[j] = { 0, 0, 0, 0, 50, 0, 30.0f + 15 * j, 20 + 2 * x,
+                  static_cast<short>(5 + j + first_id), 0 };
+      finger_cnt = 3;
+    }
+    frame.hs = make_hwstate(start + 0.01 * i, buttons, finger_cnt, finger_cnt,
+                            NULL);
+    if (i >= 90) {
+      frame.hs.rel_x = i % 3;
+      frame.hs.rel_y = 1;
+      frame.hs.rel_wheel = i % 2;
+    }
+    frames->push_back(frame);
+  }
+}
+
+void IgnoreGesture(void* client_data, const Gesture* gesture) {}
+
+// Runs a session through a chain for |devclass| several times. Returns the
+// number of SyncInterpret() and HandleTimer() calls that allocated, other
+// than to grow the activity log.
+size_t CountAllocatingCalls(GestureInterpreterDeviceClass devclass) {
+  HardwareProperties hwprops = {
+    0, 0, 100, 60,  // left, top, right, bottom
+    10, 10,  // res_x, res_y
+    133, 133,  // screen dpi x, y
+    -1, 2,  // orientation minimum, maximum
+    kMaxFingers, 5,  // max fingers, max touch
+    0, 0, 1,  // t5r2, semi-mt, is button pad
+    1, 1  // has wheel, wheel is hi res
+  };
+  std::vector<Frame> frames;
+  const size_t kSessions = 4;
+  for (size_t i = 0; i < kSessions; i++)
+    AppendSession(1000.0 + 2.0 * i, 20 * i + 1, &frames);
+
+  std::unique_ptr<GestureInterpreter> gi(NewGestureInterpreter());
+  gi->Initialize(devclass);
+  gi->SetHardwareProperties(hwprops);
+  gi->set_callback(IgnoreGesture, NULL);
+  Interpreter* interpreter = gi->interpreter();
+  const ActivityLog* log = gi->prop_reg()->activity_log();
+  size_t allocating_calls = 0;
+  stime_t timeout = -1.0;
+  for (size_t i = 0; i < frames.size(); i++) {
+    Frame* frame = &frames[i];
+    if (i > 0) {
+      // Fire the timer if it's due before this frame.
+      stime_t due = frames[i - 1].hs.timestamp + timeout;
+      while (timeout > 0.0 && due <= frame->hs.timestamp) {
+        ScopedAllocationCounter counter(log);
+        timeout = -1.0;
+        interpreter->HandleTimer(due, &timeout);
+        due += timeout;
+        if (counter.count()) {
+          ADD_FAILURE() << "HandleTimer() at frame " << i << " allocated";
+          allocating_calls++;
+        }
+      }
+    }
+    frame->hs.fingers = frame->hs.finger_cnt ? frame->fs : NULL;
+    stime_t timestamp = frame->hs.timestamp;
+    ScopedAllocationCounter counter(log);
+    timeout = -1.0;
+    interpreter->SyncInterpret(&frame->hs, &timeout);
+    if (counter.count()) {
+      ADD_FAILURE() << "SyncInterpret() at frame " << i << " allocated";
+      allocating_calls++;
+    }
+    frame->hs.timestamp = timestamp;
+  }
+  return allocating_calls;
+}
+
+}  // namespace
+
+TEST(AllocationCounterTest, TouchpadChainTest) {
+  EXPECT_EQ(0, CountAllocatingCalls(GESTURES_DEVCLASS_TOUCHPAD));
+}
+
+TEST(AllocationCounterTest, MouseChainTest) {
+  EXPECT_EQ(0, CountAllocatingCalls(GESTURES_DEVCLASS_MOUSE));
+}
+
+TEST(AllocationCounterTest, MultitouchMouseChainTest) {
+  EXPECT_EQ(0, CountAllocatingCalls(GESTURES_DEVCLASS_MULTITOUCH_MOUSE));
+}
+
+}  // namespace gestures
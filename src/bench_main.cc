@@ -0,0 +1,433 @@
+// Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Replays ActivityLog files through a full interpreter chain as fast as
+// possible and reports throughput and per-call latency. Unlike
+// ActivityReplay::Replay(), nothing is logged or verified in the hot loop.
+//
+// Usage: bench [--device=touchpad|mouse|multitouch_mouse]
+//              [--stack_version=N] [--iterations=N] [--only_honor=Props]
+//              [--latency_stats] [--dynamic_chain] [--check_allocations]
+//              [--verbose] log [log ...]
+//
+// --dynamic_chain builds the chain from ordinary filters rather than as a
+// Chain<> (see chain.h), to compare the per-event cost of the two.
+//
+// --check_allocations reports the interpreter calls that allocated (see
+// allocation_counter.h), and fails if there were any.
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "gestures/include/activity_log.h"
+#include "gestures/include/activity_replay.h"
+#include "gestures/include/allocation_counter.h"
+#include "gestures/include/binary_log_reader.h"
+#include "gestures/include/command_line.h"
+#include "gestures/include/file_util.h"
+#include "gestures/include/finger_metrics.h"
+#include "gestures/include/gestures.h"
+#include "gestures/include/interpreter.h"
+#include "gestures/include/latency_histogram.h"
+#include "gestures/include/prop_registry.h"
+#include "gestures/include/string_util.h"
+
+using std::string;
+
+namespace gestures {
+
+namespace {
+
+// Set from --verbose. Otherwise errors logged by the library are only
+// counted, so that printing them doesn't skew the timings.
+bool verbose = false;
+size_t error_count = 0;
+
+// Set from --stack_version. Overrides the initial value of the
+// "Touchpad Stack Version" property so that InitializeTouchpad() can be made
+// to build either touchpad chain.
+int stack_version_override = -1;
+
+// Set from --latency_stats. Prints the chain's per-interpreter latency stats
+// after each replay.
+bool latency_stats = false;
+
+// Set from --dynamic_chain. Turns the "Static Interpreter Chain" property
+// off.
+bool dynamic_chain = false;
+
+// Set from --check_allocations.
+bool check_allocations = false;
+
+const char kStackVersionPropName[] = "Touchpad Stack Version";
+const char kStaticChainPropName[] = "Static Interpreter Chain";
+
+// A property provider that doesn't expose anything, other than applying
+// stack_version_override and dynamic_chain.
+GesturesProp* const kDummyProp = reinterpret_cast<GesturesProp*>(1);
+
+GesturesProp* BenchCreateInt(void* data, const char* name, int* loc,
+                             size_t count, const int* init) {
+  if (stack_version_override >= 0 && loc && count == 1 &&
+      !strcmp(name, kStackVersionPropName))
+    *loc = stack_version_override;
+  return kDummyProp;
+}
+
+GesturesProp* BenchCreateShort(void* data, const char* name, short* loc,
+                               size_t count, const short* init) {
+  return kDummyProp;
+}
+
+GesturesProp* BenchCreateBool(void* data, const char* name,
+                              GesturesPropBool* loc, size_t count,
+                              const GesturesPropBool* init) {
+  if (dynamic_chain && loc && count == 1 &&
+      !strcmp(name, kStaticChainPropName))
+    *loc = 0;
+  return kDummyProp;
+}
+
+GesturesProp* BenchCreateString(void* data, const char* name,
+                                const char** loc, const char* const init) {
+  return kDummyProp;
+}
+
+GesturesProp* BenchCreateReal(void* data, const char* name, double* loc,
+                              size_t count, const double* init) {
+  return kDummyProp;
+}
+
+void BenchRegisterHandlers(void* data, GesturesProp* prop, void* handler_data,
+                           GesturesPropGetHandler getter,
+                           GesturesPropSetHandler setter) {}
+
+void BenchFreeProp(void* data, GesturesProp* prop) {}
+
+GesturesPropProvider kBenchPropProvider = {
+  BenchCreateInt,
+  BenchCreateShort,
+  BenchCreateBool,
+  BenchCreateString,
+  BenchCreateReal,
+  BenchRegisterHandlers,
+  BenchFreeProp
+};
+
+class CountingConsumer : public GestureConsumer {
+ public:
+  CountingConsumer() : count_(0) {}
+  virtual void ConsumeGesture(const Gesture& gesture) { count_++; }
+  size_t count_;
+};
+
+double NowSec() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return StimeFromTimespec(&ts);
+}
+
+// Returns the value at |pct| percent in sorted |samples|.
+double Percentile(const std::vector<double>& samples, double pct) {
+  if (samples.empty())
+    return 0.0;
+  size_t idx = static_cast<size_t>(pct / 100.0 * (samples.size() - 1) + 0.5);
+  return samples[std::min(idx, samples.size() - 1)];
+}
+
+struct BenchResult {
+  BenchResult() : total_time(0.0), gestures(0), allocating_calls(0) {}
+  std::vector<double> sync_latencies;
+  std::vector<double> timer_latencies;
+  double total_time;
+  size_t gestures;
+  // Interpreter calls that allocated, other than to grow the activity log.
+  size_t allocating_calls;
+};
+
+void PrintLatencies(const char* label, std::vector<double>* samples) {
+  std::sort(samples->begin(), samples->end());
+  printf("  %-14s %8zu calls  p50 %8.2f us  p99 %8.2f us  "
+         "p99.9 %8.2f us  max %8.2f us\n",
+         label, samples->size(),
+         Percentile(*samples, 50.0) * 1e6,
+         Percentile(*samples, 99.0) * 1e6,
+         Percentile(*samples, 99.9) * 1e6,
+         samples->empty() ? 0.0 : samples->back() * 1e6);
+}
+
+// Prints mean and max self time per interpreter in the chain.
+void PrintLatencyStats(Interpreter* interpreter) {
+  Json::Value stats(Json::arrayValue);
+  interpreter->EncodeLatencyStats(&stats);
+  for (Json::Value::ArrayIndex i = 0; i < stats.size(); i++) {
+    const Json::Value& entry = stats[i];
+    const Json::Value& sync = entry[ActivityLog::kKeyLatencySync];
+    size_t count = sync[LatencyHistogram::kKeyCount].asUInt();
+    double total = sync[LatencyHistogram::kKeyTotal].asDouble();
+    printf("  %-40s mean %8.2f us  max %8.2f us\n",
+           entry[ActivityLog::kKeyInterpreterName].asCString(),
+           count ? total / count * 1e6 : 0.0,
+           sync[LatencyHistogram::kKeyMax].asDouble() * 1e6);
+    if (entry.isMember(ActivityLog::kKeyGestureTypeMemo)) {
+      const Json::Value& memo = entry[ActivityLog::kKeyGestureTypeMemo];
+      printf("  %-40s hits %8u  misses %8u\n", "  gesture type memo",
+             memo[ActivityLog::kKeyMemoHits].asUInt(),
+             memo[ActivityLog::kKeyMemoMisses].asUInt());
+    }
+    if (entry.isMember(ActivityLog::kKeyInputQueueDelay)) {
+      const Json::Value& delay = entry[ActivityLog::kKeyInputQueueDelay];
+      printf("  %-40s %8.2f ms\n", "  input queue delay",
+             delay[ActivityLog::kKeyQueueDelay].asDouble() * 1e3);
+    }
+  }
+}
+
+// Runs one logged entry through |interpreter|, timing interpreter calls.
+// Only delivers logged timer callbacks while the chain has a timer
+// outstanding, as a real timer provider would. |log| is the chain's
+// activity log, if any.
+void RunEntry(Interpreter* interpreter, const ActivityLog* log,
+              ActivityReplay* replay, const ActivityLog::Entry& entry,
+              stime_t* pending_timeout, BenchResult* result) {
+  double start;
+  switch (entry.type) {
+    case ActivityLog::kHardwareState: {
+      HardwareState hs = entry.details.hwstate;
+      *pending_timeout = -1.0;
+      ScopedAllocationCounter allocations(log);
+      start = NowSec();
+      interpreter->SyncInterpret(&hs, pending_timeout);
+      double elapsed = NowSec() - start;
+      size_t allocated = allocations.count();
+      result->sync_latencies.push_back(elapsed);
+      result->total_time += elapsed;
+      if (allocated) {
+        result->allocating_calls++;
+        if (verbose)
+          fprintf(stderr, "SyncInterpret() at %f allocated\n", hs.timestamp);
+      }
+      break;
+    }
+    case ActivityLog::kTimerCallback: {
+      if (*pending_timeout < 0.0)
+        break;
+      *pending_timeout = -1.0;
+      ScopedAllocationCounter allocations(log);
+      start = NowSec();
+      interpreter->HandleTimer(entry.details.timestamp, pending_timeout);
+      double elapsed = NowSec() - start;
+      size_t allocated = allocations.count();
+      result->timer_latencies.push_back(elapsed);
+      result->total_time += elapsed;
+      if (allocated) {
+        result->allocating_calls++;
+        if (verbose)
+          fprintf(stderr, "HandleTimer() at %f allocated\n",
+                  entry.details.timestamp);
+      }
+      break;
+    }
+    case ActivityLog::kPropChange:
+      replay->ReplayPropChange(entry.details.prop_change);
+      break;
+    case ActivityLog::kCallbackRequest:  // fall through
+    case ActivityLog::kGesture:
+      break;
+  }
+}
+
+// Replays one log through a freshly built chain, accumulating into |result|.
+// Binary logs are read through |reader|, straight from the mapped file, and
+// other logs are parsed from |contents|. Returns false if the log can't be
+// parsed.
+bool RunOnce(const string& contents, BinaryLogReader* reader,
+             GestureInterpreterDeviceClass device,
+             const std::set<string>& honor_props, BenchResult* result) {
+  GestureInterpreter* gi = NewGestureInterpreter();
+  gi->SetPropProvider(&kBenchPropProvider, NULL);
+  gi->Initialize(device);
+  Interpreter* interpreter = gi->interpreter();
+  bool ok = interpreter != NULL;
+  if (ok && latency_stats)
+    interpreter->SetLatencyStatsEnabled(true);
+  {
+    MetricsProperties mprops(gi->prop_reg());
+    ActivityReplay replay(gi->prop_reg());
+    if (reader)
+      ok = ok && replay.ParseBinaryInfo(*reader, honor_props);
+    else
+      ok = ok && replay.Parse(contents, honor_props);
+    if (ok) {
+      CountingConsumer consumer;
+      interpreter->Initialize(&replay.hwprops(), NULL, &mprops, &consumer);
+      const ActivityLog* chain_log = gi->prop_reg()->activity_log();
+      stime_t pending_timeout = -1.0;
+      if (reader) {
+        ActivityLog::Entry entry;
+        reader->Rewind();
+        while (reader->Next(&entry))
+          RunEntry(interpreter, chain_log, &replay, entry, &pending_timeout,
+                   result);
+        ok = !reader->error();
+      } else {
+        ActivityLog* log = replay.log();
+        result->sync_latencies.reserve(result->sync_latencies.size() +
+                                       log->size());
+        for (size_t i = 0; i < log->size(); ++i)
+          RunEntry(interpreter, chain_log, &replay, log->GetEntry(i),
+                   &pending_timeout, result);
+      }
+      result->gestures += consumer.count_;
+      if (latency_stats)
+        PrintLatencyStats(interpreter);
+    }
+  }
+  gi->SetPropProvider(NULL, NULL);
+  DeleteGestureInterpreter(gi);
+  return ok;
+}
+
+GestureInterpreterDeviceClass ParseDevice(const string& name) {
+  if (name.empty() || name == "touchpad")
+    return GESTURES_DEVCLASS_TOUCHPAD;
+  if (name == "mouse")
+    return GESTURES_DEVCLASS_MOUSE;
+  if (name == "multitouch_mouse")
+    return GESTURES_DEVCLASS_MULTITOUCH_MOUSE;
+  return GESTURES_DEVCLASS_UNKNOWN;
+}
+
+}  // namespace
+
+int BenchMain() {
+  CommandLine* cl = CommandLine::ForCurrentProcess();
+  GestureInterpreterDeviceClass device =
+      ParseDevice(cl->GetSwitchValueASCII("device"));
+  if (device == GESTURES_DEVCLASS_UNKNOWN) {
+    fprintf(stderr, "Unknown --device: %s\n",
+            cl->GetSwitchValueASCII("device").c_str());
+    return 1;
+  }
+  verbose = cl->HasSwitch("verbose");
+  latency_stats = cl->HasSwitch("latency_stats");
+  dynamic_chain = cl->HasSwitch("dynamic_chain");
+  check_allocations = cl->HasSwitch("check_allocations");
+  if (cl->HasSwitch("stack_version"))
+    stack_version_override =
+        atoi(cl->GetSwitchValueASCII("stack_version").c_str());
+  // Same default as tools/replay_log. Old logs may carry property values
+  // that no longer parse, so by default don't honor all of them.
+  string only_honor = "Tap Enable,Sensitivity";
+  if (cl->HasSwitch("only_honor"))
+    only_honor = cl->GetSwitchValueASCII("only_honor");
+  std::vector<string> honor_props;
+  if (!only_honor.empty())
+    SplitString(only_honor, ',', &honor_props);
+  std::set<string> honor_props_set(honor_props.begin(), honor_props.end());
+  int iterations = 1;
+  if (cl->HasSwitch("iterations"))
+    iterations = std::max(1, atoi(
+        cl->GetSwitchValueASCII("iterations").c_str()));
+
+  CommandLine::StringVector logs = cl->GetArgs();
+  if (logs.empty()) {
+    fprintf(stderr, "usage: %s [--device=touchpad|mouse|multitouch_mouse] "
+            "[--stack_version=N] [--iterations=N] [--only_honor=Props] "
+            "[--latency_stats] [--dynamic_chain] [--check_allocations] "
+            "[--verbose] log [log ...]\n",
+            cl->GetProgram().c_str());
+    return 1;
+  }
+
+  BenchResult total;
+  for (size_t i = 0; i < logs.size(); i++) {
+    // Binary logs are mapped, so they may be of any length. Others are
+    // read in full.
+    BinaryLogReader reader;
+    bool binary = reader.Open(logs[i].c_str());
+    string contents;
+    if (!binary && !ReadFileToString(logs[i].c_str(), &contents)) {
+      fprintf(stderr, "Unable to read %s\n", logs[i].c_str());
+      return 1;
+    }
+    BenchResult result;
+    for (int j = 0; j < iterations; j++) {
+      if (!RunOnce(contents, binary ? &reader : NULL, device,
+                   honor_props_set, &result)) {
+        fprintf(stderr, "Unable to replay %s\n", logs[i].c_str());
+        return 1;
+      }
+    }
+    size_t events = result.sync_latencies.size() +
+        result.timer_latencies.size();
+    printf("%s: %zu events, %zu gestures, %.0f events/sec\n",
+           logs[i].c_str(), events, result.gestures,
+           result.total_time > 0.0 ? events / result.total_time : 0.0);
+    total.sync_latencies.insert(total.sync_latencies.end(),
+                                result.sync_latencies.begin(),
+                                result.sync_latencies.end());
+    total.timer_latencies.insert(total.timer_latencies.end(),
+                                 result.timer_latencies.begin(),
+                                 result.timer_latencies.end());
+    total.total_time += result.total_time;
+    total.gestures += result.gestures;
+    total.allocating_calls += result.allocating_calls;
+    PrintLatencies("SyncInterpret", &result.sync_latencies);
+    PrintLatencies("HandleTimer", &result.timer_latencies);
+    if (check_allocations)
+      printf("  %zu of %zu calls allocated\n", result.allocating_calls,
+             events);
+  }
+  if (logs.size() > 1) {
+    size_t events = total.sync_latencies.size() +
+        total.timer_latencies.size();
+    printf("total: %zu events, %zu gestures, %.0f events/sec\n",
+           events, total.gestures,
+           total.total_time > 0.0 ? events / total.total_time : 0.0);
+    PrintLatencies("SyncInterpret", &total.sync_latencies);
+    PrintLatencies("HandleTimer", &total.timer_latencies);
+  }
+  if (error_count)
+    printf("%zu errors logged%s\n", error_count,
+           verbose ? "" : " (use --verbose to print them)");
+  if (check_allocations && total.allocating_calls) {
+    fprintf(stderr, "%zu interpreter calls allocated%s\n",
+            total.allocating_calls,
+            verbose ? "" : " (use --verbose to list them)");
+    return 1;
+  }
+  return 0;
+}
+
+}  // namespace gestures
+
+int main(int argc, char** argv) {
+  gestures::CommandLine::Init(argc, argv);
+  return gestures::BenchMain();
+}
+
+extern "C" {
+
+void gestures_log(int verb, const char* fmt, ...) {
+  if (verb != GESTURES_LOG_ERROR)
+    return;
+  gestures::error_count++;
+  if (!gestures::verbose)
+    return;
+  va_list args;
+  va_start(args, fmt);
+  vfprintf(stderr, fmt, args);
+  va_end(args);
+}
+
+}
@@ -0,0 +1,223 @@
+// Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "gestures/include/binary_log_reader.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "gestures/include/eintr_wrapper.h"
+#include "gestures/include/logging.h"
+
+namespace gestures {
+
+BinaryLogReader::BinaryLogReader()
+    : data_(NULL), size_(0), mapping_(NULL), pos_(0), records_start_(0),
+      error_(false), hwprops_() {}
+
+BinaryLogReader::~BinaryLogReader() {
+  Close();
+}
+
+bool BinaryLogReader::Open(const char* path) {
+  Close();
+  int fd = HANDLE_EINTR(open(path, O_RDONLY));
+  if (fd < 0)
+    return false;
+  struct stat st;
+  void* mapping = MAP_FAILED;
+  if (fstat(fd, &st) == 0 &&
+      st.st_size >= static_cast<off_t>(sizeof(ActivityLog::BinaryHeader)))
+    mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  IGNORE_EINTR(close(fd));
+  if (mapping == MAP_FAILED)
+    return false;
+  // Records are read front to back, once.
+  madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+  mapping_ = mapping;
+  data_ = static_cast<const char*>(mapping);
+  size_ = st.st_size;
+  if (!ReadHeader()) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+bool BinaryLogReader::Init(const char* data, size_t size) {
+  Close();
+  data_ = data;
+  size_ = size;
+  if (!ReadHeader()) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+void BinaryLogReader::Close() {
+  if (mapping_)
+    munmap(mapping_, size_);
+  mapping_ = NULL;
+  data_ = NULL;
+  size_ = pos_ = records_start_ = 0;
+  error_ = false;
+  properties_.clear();
+  gestures_version_.clear();
+}
+
+bool BinaryLogReader::Read(void* out, size_t size) {
+  if (size_ < pos_ || size_ - pos_ < size)
+    return false;
+  memcpy(out, data_ + pos_, size);
+  pos_ += (size + ActivityLog::kRecordAlign - 1) &
+      ~(ActivityLog::kRecordAlign - 1);
+  return true;
+}
+
+bool BinaryLogReader::ReadString(size_t size, std::string* out) {
+  if (size_ < pos_ || size_ - pos_ < size)
+    return false;
+  out->assign(data_ + pos_, size);
+  pos_ += (size + ActivityLog::kRecordAlign - 1) &
+      ~(ActivityLog::kRecordAlign - 1);
+  return true;
+}
+
+bool BinaryLogReader::ReadHeader() {
+  pos_ = 0;
+  ActivityLog::BinaryHeader header;
+  if (!Read(&header, sizeof(header)) ||
+      memcmp(header.magic, ActivityLog::kBinaryMagic, sizeof(header.magic)))
+    return false;
+  if (header.version != ActivityLog::kBinaryVersion) {
+    Err("Unsupported binary log version %u", header.version);
+    return false;
+  }
+  if (header.hwprops_size != sizeof(HardwareProperties) ||
+      header.finger_state_size != sizeof(FingerState) ||
+      header.gesture_size != sizeof(Gesture)) {
+    Err("Binary log was written with different struct layouts");
+    return false;
+  }
+  if (!Read(&hwprops_, sizeof(hwprops_))) {
+    Err("Unable to read hwprops");
+    return false;
+  }
+  if (!ReadString(header.properties_size, &properties_) ||
+      !ReadString(header.gestures_version_size, &gestures_version_)) {
+    Err("Unable to read properties");
+    return false;
+  }
+  records_start_ = pos_;
+  return true;
+}
+
+bool BinaryLogReader::Next(ActivityLog::Entry* out) {
+  if (error_ || pos_ >= size_)
+    return false;
+  size_t record_start = pos_;
+  ActivityLog::RecordHeader record;
+  if (!Read(&record, sizeof(record)) || record.size < sizeof(record) ||
+      record.size > size_ - record_start) {
+    Err("Truncated record at offset %zu", record_start);
+    error_ = true;
+    return false;
+  }
+  size_t payload_size = record.size - sizeof(record);
+  switch (record.type) {
+    case ActivityLog::kHardwareState: {
+      ActivityLog::BinaryHardwareState bhs;
+      if (!Read(&bhs, sizeof(bhs)) ||
+          payload_size < sizeof(bhs) + bhs.finger_cnt * sizeof(FingerState)) {
+        Err("Truncated hardware state at offset %zu", record_start);
+        error_ = true;
+        return false;
+      }
+      if (fingers_.size() < bhs.finger_cnt)
+        fingers_.resize(bhs.finger_cnt);
+      if (bhs.finger_cnt)
+        memcpy(&fingers_[0], data_ + pos_,
+               bhs.finger_cnt * sizeof(FingerState));
+      HardwareState& hs = out->details.hwstate;
+      hs.timestamp = bhs.timestamp;
+      hs.buttons_down = bhs.buttons_down;
+      hs.finger_cnt = bhs.finger_cnt;
+      hs.touch_cnt = bhs.touch_cnt;
+      hs.fingers = bhs.finger_cnt ? &fingers_[0] : NULL;
+      hs.rel_x = bhs.rel_x;
+      hs.rel_y = bhs.rel_y;
+      hs.rel_wheel = bhs.rel_wheel;
+      hs.rel_wheel_hi_res = bhs.rel_wheel_hi_res;
+      hs.rel_hwheel = bhs.rel_hwheel;
+      hs.msc_timestamp = bhs.msc_timestamp;
+      break;
+    }
+    case ActivityLog::kTimerCallback:  // fall through
+    case ActivityLog::kCallbackRequest:
+      if (payload_size < sizeof(out->details.timestamp) ||
+          !Read(&out->details.timestamp, sizeof(out->details.timestamp))) {
+        Err("Truncated record at offset %zu", record_start);
+        error_ = true;
+        return false;
+      }
+      break;
+    case ActivityLog::kGesture:
+      if (payload_size < sizeof(Gesture) ||
+          !Read(&out->details.gesture, sizeof(Gesture))) {
+        Err("Truncated gesture at offset %zu", record_start);
+        error_ = true;
+        return false;
+      }
+      break;
+    case ActivityLog::kPropChange: {
+      ActivityLog::BinaryPropChange bpc;
+      const char* name = data_ + pos_ + sizeof(bpc);
+      if (payload_size <= sizeof(bpc) ||
+          !memchr(name, '\0', payload_size - sizeof(bpc)) ||
+          !Read(&bpc, sizeof(bpc))) {
+        Err("Truncated prop change at offset %zu", record_start);
+        error_ = true;
+        return false;
+      }
+      ActivityLog::PropChangeEntry& prop_change = out->details.prop_change;
+      prop_change.name = name;
+      switch (bpc.type) {
+        case ActivityLog::PropChangeEntry::kBoolProp:
+          prop_change.type = ActivityLog::PropChangeEntry::kBoolProp;
+          prop_change.value.bool_val = bpc.value.bool_val;
+          break;
+        case ActivityLog::PropChangeEntry::kDoubleProp:
+          prop_change.type = ActivityLog::PropChangeEntry::kDoubleProp;
+          prop_change.value.double_val = bpc.value.double_val;
+          break;
+        case ActivityLog::PropChangeEntry::kIntProp:
+          prop_change.type = ActivityLog::PropChangeEntry::kIntProp;
+          prop_change.value.int_val = bpc.value.int_val;
+          break;
+        case ActivityLog::PropChangeEntry::kShortProp:
+          prop_change.type = ActivityLog::PropChangeEntry::kShortProp;
+          prop_change.value.short_val = bpc.value.short_val;
+          break;
+        default:
+          Err("Unable to parse prop change type %u", bpc.type);
+          error_ = true;
+          return false;
+      }
+      break;
+    }
+    default:
+      Err("Unknown record type %u at offset %zu", record.type, record_start);
+      error_ = true;
+      return false;
+  }
+  out->type = static_cast<ActivityLog::EntryType>(record.type);
+  pos_ = record_start + record.size;
+  return true;
+}
+
+}  // namespace gestures
@@ -0,0 +1,147 @@
+// Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "gestures/include/activity_log.h"
+#include "gestures/include/binary_log_reader.h"
+#include "gestures/include/file_util.h"
+#include "gestures/include/unittest_util.h"
+
+using std::string;
+
+namespace gestures {
+
+class BinaryLogReaderTest : public ::testing::Test {};
+
+TEST(BinaryLogReaderTest, SimpleTest) {
+  ActivityLog log(NULL);
+  HardwareProperties hwprops = {
+    0, 0, 100, 60, 10, 12, 133, 133, -1, 2, 5, 5, 0, 0, 1, 0, 0
+  };
+  log.SetHardwareProperties(hwprops);
+  FingerState fs[] = {
+    // TM, Tm, WM, Wm, Press, Orientation, X, Y, TrID, flags
+    { 1, 2, 3, 4, 10, 0.5, 11, 12, 7, 0 },
+    { 5, 6, 7, 8, 20, -0.5, 21, 22, 8, 0 },
+  };
+  log.LogHardwareState(make_hwstate(1.0, 0, 2, 2, &fs[0]));
+  log.LogTimerCallback(1.5);
+  ActivityLog::PropChangeEntry prop_change;
+  prop_change.name = "int prop";
+  prop_change.type = ActivityLog::PropChangeEntry::kIntProp;
+  prop_change.value.int_val = 3;
+  log.LogPropChange(prop_change);
+  string binary = log.EncodeBinary();
+
+  BinaryLogReader reader;
+  ASSERT_TRUE(reader.Init(binary.data(), binary.size()));
+  EXPECT_EQ(100, reader.hwprops().right);
+  for (int pass = 0; pass < 2; pass++) {
+    ActivityLog::Entry entry;
+    ASSERT_TRUE(reader.Next(&entry));
+    ASSERT_EQ(ActivityLog::kHardwareState, entry.type);
+    ASSERT_EQ(2, entry.details.hwstate.finger_cnt);
+    EXPECT_EQ(22, entry.details.hwstate.fingers[1].position_y);
+    // Fingers are a copy, so interpreters may modify them.
+    entry.details.hwstate.fingers[1].position_y = 0;
+    ASSERT_TRUE(reader.Next(&entry));
+    ASSERT_EQ(ActivityLog::kTimerCallback, entry.type);
+    EXPECT_EQ(1.5, entry.details.timestamp);
+    ASSERT_TRUE(reader.Next(&entry));
+    ASSERT_EQ(ActivityLog::kPropChange, entry.type);
+    EXPECT_STREQ("int prop", entry.details.prop_change.name);
+    EXPECT_EQ(3, entry.details.prop_change.value.int_val);
+    EXPECT_FALSE(reader.Next(&entry));
+    EXPECT_FALSE(reader.error());
+    reader.Rewind();
+  }
+
+  // Not a binary log
+  string json = log.Encode();
+  EXPECT_FALSE(reader.Init(json.data(), json.size()));
+
+  // Truncated in the middle of a record
+  ASSERT_TRUE(reader.Init(binary.data(), binary.size() - 8));
+  ActivityLog::Entry entry;
+  EXPECT_TRUE(reader.Next(&entry));
+  EXPECT_TRUE(reader.Next(&entry));
+  EXPECT_FALSE(reader.Next(&entry));
+  EXPECT_TRUE(reader.error());
+}
+
+TEST(BinaryLogReaderTest, CorruptLogTest) {
+  ActivityLog log(NULL);
+  log.LogTimerCallback(1.5);
+  const string binary = log.EncodeBinary();
+  BinaryLogReader reader;
+  ASSERT_TRUE(reader.Init(binary.data(), binary.size()));
+  const size_t records_start = reader.pos();
+
+  // Header sizes past the end of the log fail rather than allocating them.
+  string bad = binary;
+  uint32_t huge = 0xffffffff;
+  memcpy(&bad[offsetof(ActivityLog::BinaryHeader, properties_size)], &huge,
+         sizeof(huge));
+  EXPECT_FALSE(reader.Init(bad.data(), bad.size()));
+  bad = binary;
+  memcpy(&bad[offsetof(ActivityLog::BinaryHeader, gestures_version_size)],
+         &huge, sizeof(huge));
+  EXPECT_FALSE(reader.Init(bad.data(), bad.size()));
+
+  // A timer callback record without room for its timestamp
+  bad = binary;
+  uint32_t record_size = sizeof(ActivityLog::RecordHeader);
+  memcpy(&bad[records_start], &record_size, sizeof(record_size));
+  ASSERT_TRUE(reader.Init(bad.data(), bad.size()));
+  ActivityLog::Entry entry;
+  EXPECT_FALSE(reader.Next(&entry));
+  EXPECT_TRUE(reader.error());
+}
+
+TEST(BinaryLogReaderTest, LongLogTest) {
+  // Build a log with more entries than an ActivityLog holds by repeating the
+  // records of an encoded one.
+  ActivityLog log(NULL);
+  const size_t kEntries = 1000;
+  for (size_t i = 0; i < kEntries; i++)
+    log.LogTimerCallback(i);
+  string binary = log.EncodeBinary();
+  BinaryLogReader reader;
+  ASSERT_TRUE(reader.Init(binary.data(), binary.size()));
+  string records = binary.substr(reader.pos());
+  const size_t kRepeats = log.MaxBytes() / records.size() + 2;
+  for (size_t i = 1; i < kRepeats; i++)
+    binary.append(records);
+
+  char filename[] = "/tmp/gestures_binary_log_XXXXXX";
+  int fd = mkstemp(filename);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  ASSERT_EQ(static_cast<int>(binary.size()),
+            WriteFile(filename, binary.data(), binary.size()));
+  ASSERT_TRUE(reader.Open(filename));
+  unlink(filename);
+
+  size_t count = 0;
+  ActivityLog::Entry entry;
+  while (reader.Next(&entry)) {
+    ASSERT_EQ(ActivityLog::kTimerCallback, entry.type);
+    EXPECT_EQ(count % kEntries, entry.details.timestamp);
+    count++;
+  }
+  EXPECT_FALSE(reader.error());
+  EXPECT_EQ(kEntries * kRepeats, count);
+  EXPECT_GT(count * sizeof(ActivityLog::RecordHeader) * 2,
+            log.MaxBytes());
+}
+
+}  // namespace gestures
@@ -4,6 +4,7 @@
 
 #include "gestures/include/box_filter_interpreter.h"
 
+#include "gestures/include/interpreter_state.h"
 #include "gestures/include/macros.h"
 #include "gestures/include/tracer.h"
 #include "gestures/include/util.h"
@@ -66,4 +67,12 @@ void BoxFilterInterpreter::SyncInterpretImpl(HardwareState* hwstate,
   next_->SyncInterpret(hwstate, timeout);
 }
 
+void BoxFilterInterpreter::SaveOwnState(StateWriter* writer) const {
+  writer->Write(previous_output_);
+}
+
+void BoxFilterInterpreter::RestoreOwnState(StateReader* reader) {
+  reader->Read(&previous_output_);
+}
+
 }  // namespace gestures
@@ -0,0 +1,183 @@
+// Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <memory>
+
+#include <gtest/gtest.h>
+
+#include "gestures/include/chain.h"
+#include "gestures/include/filter_interpreter.h"
+#include "gestures/include/gestures.h"
+#include "gestures/include/macros.h"
+#include "gestures/include/unittest_util.h"
+
+namespace gestures {
+
+class ChainTest : public ::testing::Test {};
+
+namespace {
+
+// Passes everything on unchanged.
+class ChainTestForwardingFilter : public FilterInterpreter {
+ public:
+  ChainTestForwardingFilter(PropRegistry* prop_reg, Interpreter* next,
+                            Tracer* tracer)
+      : FilterInterpreter(NULL, next, tracer, false) {
+    InitName();
+  }
+};
+
+// Shifts the first finger right by one, and doubles the dx of gestures.
+class ChainTestShiftingFilter : public FilterInterpreter {
+ public:
+  ChainTestShiftingFilter(Interpreter* next, Tracer* tracer)
+      : FilterInterpreter(NULL, next, tracer, false) {}
+
+ protected:
+  virtual void SyncInterpretImpl(HardwareState* hwstate, stime_t* timeout) {
+    if (hwstate->finger_cnt)
+      hwstate->fingers[0].position_x += 1.0;
+    next_->SyncInterpret(hwstate, timeout);
+  }
+
+ private:
+  virtual void ConsumeGesture(const Gesture& gesture) {
+    Gesture copy = gesture;
+    if (copy.type == kGestureTypeMove)
+      copy.details.move.dx *= 2.0;
+    ProduceGesture(copy);
+  }
+};
+
+// Takes a devclass, and requests a timer a second after each hardware state.
+class ChainTestTimerFilter : public FilterInterpreter {
+ public:
+  ChainTestTimerFilter(PropRegistry* prop_reg, Interpreter* next,
+                       Tracer* tracer, GestureInterpreterDeviceClass devclass)
+      : FilterInterpreter(NULL, next, tracer, false), devclass_(devclass) {}
+
+  GestureInterpreterDeviceClass devclass_;
+
+ protected:
+  virtual void SyncInterpretImpl(HardwareState* hwstate, stime_t* timeout) {
+    next_->SyncInterpret(hwstate, timeout);
+    if (*timeout < 0.0)
+      *timeout = 1.0;
+  }
+
+  virtual void HandleTimerImpl(stime_t now, stime_t* timeout) {
+    next_->HandleTimer(now, timeout);
+  }
+};
+
+// Moves by the first finger's x position, and scrolls on timers.
+class ChainTestBaseInterpreter : public Interpreter {
+ public:
+  ChainTestBaseInterpreter(PropRegistry* prop_reg, Tracer* tracer)
+      : Interpreter(NULL, tracer, false) {}
+
+ protected:
+  virtual void SyncInterpretImpl(HardwareState* hwstate, stime_t* timeout) {
+    if (!hwstate->finger_cnt)
+      return;
+    ProduceGesture(Gesture(kGestureMove, hwstate->timestamp,
+                           hwstate->timestamp,
+                           hwstate->fingers[0].position_x, 0.0));
+  }
+
+  virtual void HandleTimerImpl(stime_t now, stime_t* timeout) {
+    ProduceGesture(Gesture(kGestureScroll, now, now, 0.0, 1.0));
+  }
+};
+
+typedef Chain<ChainTestForwardingFilter,
+              ChainTestShiftingFilter,
+              ChainTestForwardingFilter,
+              ChainTestTimerFilter,
+              ChainTestForwardingFilter,
+              ChainTestBaseInterpreter> ChainTestChain;
+
+}  // namespace {}
+
+TEST(ChainTest, HopKindsTest) {
+  EXPECT_TRUE(ChainHopKinds<ChainTestForwardingFilter>::kSync ==
+              kChainHopForwards);
+  EXPECT_TRUE(ChainHopKinds<ChainTestForwardingFilter>::kTimer ==
+              kChainHopForwards);
+  EXPECT_TRUE(ChainHopKinds<ChainTestForwardingFilter>::kConsume ==
+              kChainHopForwards);
+  EXPECT_TRUE(ChainHopKinds<ChainTestShiftingFilter>::kSync ==
+              kChainHopOverrides);
+  EXPECT_TRUE(ChainHopKinds<ChainTestShiftingFilter>::kTimer ==
+              kChainHopForwards);
+  EXPECT_TRUE(ChainHopKinds<ChainTestShiftingFilter>::kConsume ==
+              kChainHopInaccessible);
+  EXPECT_TRUE(ChainHopKinds<ChainTestTimerFilter>::kTimer ==
+              kChainHopOverrides);
+  EXPECT_TRUE(ChainHopKinds<ChainTestBaseInterpreter>::kSync ==
+              kChainHopOverrides);
+  EXPECT_TRUE(ChainHopKinds<ChainTestBaseInterpreter>::kConsume ==
+              kChainHopInaccessible);
+}
+
+// Static and dynamic chains of the same layers behave the same, whether
+// or not the hops do any bookkeeping.
+TEST(ChainTest, SameAsDynamicTest) {
+  for (size_t latency_stats = 0; latency_stats < 2; latency_stats++) {
+    std::unique_ptr<Interpreter> chains[] = {
+      std::unique_ptr<Interpreter>(
+          new ChainTestChain(NULL, NULL, GESTURES_DEVCLASS_MOUSE)),
+      std::unique_ptr<Interpreter>(
+          ChainTestChain::NewDynamic(NULL, NULL, GESTURES_DEVCLASS_MOUSE))
+    };
+    for (size_t i = 0; i < arraysize(chains); i++) {
+      Interpreter* chain = chains[i].get();
+      chain->SetLatencyStatsEnabled(latency_stats);
+      TestInterpreterWrapper wrapper(chain);
+
+      FingerState fs = { 0, 0, 0, 0, 1, 0, 5.0, 3.0, 1, 0 };
+      HardwareState hs = make_hwstate(1.0, 0, 1, 1, &fs);
+      stime_t timeout = -1.0;
+      Gesture* gs = wrapper.SyncInterpret(&hs, &timeout);
+      ASSERT_NE(static_cast<Gesture*>(NULL), gs);
+      EXPECT_EQ(kGestureTypeMove, gs->type);
+      // Shifted by one on the way down, and doubled on the way up.
+      EXPECT_DOUBLE_EQ(12.0, gs->details.move.dx);
+      EXPECT_DOUBLE_EQ(1.0, timeout);
+
+      timeout = -1.0;
+      gs = wrapper.HandleTimer(2.0, &timeout);
+      ASSERT_NE(static_cast<Gesture*>(NULL), gs);
+      EXPECT_EQ(kGestureTypeScroll, gs->type);
+      EXPECT_DOUBLE_EQ(1.0, gs->details.scroll.dy);
+      EXPECT_DOUBLE_EQ(-1.0, timeout);
+
+      // With latency stats on, every layer goes through the full
+      // SyncInterpret() and HandleTimer().
+      Json::Value stats(Json::arrayValue);
+      chain->EncodeLatencyStats(&stats);
+      ASSERT_EQ(6, stats.size());
+      for (Json::Value::ArrayIndex j = 0; j < stats.size(); j++) {
+        const Json::Value& sync = stats[j][ActivityLog::kKeyLatencySync];
+        const Json::Value& timer = stats[j][ActivityLog::kKeyLatencyTimer];
+        EXPECT_EQ(latency_stats,
+                  sync[LatencyHistogram::kKeyCount].asUInt());
+        EXPECT_EQ(latency_stats,
+                  timer[LatencyHistogram::kKeyCount].asUInt());
+      }
+    }
+  }
+}
+
+TEST(ChainTest, ConstructorTest) {
+  ChainTestChain chain(NULL, NULL, GESTURES_DEVCLASS_MULTITOUCH_MOUSE);
+  // The layers are named after the filters they're built from.
+  EXPECT_STREQ("ChainTestForwardingFilter", chain.name());
+  std::unique_ptr<ChainTestForwardingFilter> dynamic(
+      ChainTestChain::NewDynamic(NULL, NULL,
+                                 GESTURES_DEVCLASS_MULTITOUCH_MOUSE));
+  EXPECT_STREQ("ChainTestForwardingFilter", dynamic->name());
+}
+
+}  // namespace gestures
@@ -6,6 +6,7 @@
 
 #include "gestures/include/gestures.h"
 #include "gestures/include/interpreter.h"
+#include "gestures/include/interpreter_state.h"
 #include "gestures/include/logging.h"
 #include "gestures/include/tracer.h"
 
@@ -133,4 +134,20 @@ void ClickWiggleFilterInterpreter::SetWarpFlags(HardwareState* hwstate) const {
   }
 }
 
+void ClickWiggleFilterInterpreter::SaveOwnState(StateWriter* writer) const {
+  writer->Write(wiggle_recs_);
+  writer->Write(button_edge_occurred_);
+  writer->Write(button_edge_with_one_finger_);
+  writer->Write(prev_pressure_);
+  writer->Write(prev_buttons_);
+}
+
+void ClickWiggleFilterInterpreter::RestoreOwnState(StateReader* reader) {
+  reader->Read(&wiggle_recs_);
+  reader->Read(&button_edge_occurred_);
+  reader->Read(&button_edge_with_one_finger_);
+  reader->Read(&prev_pressure_);
+  reader->Read(&prev_buttons_);
+}
+
 }  // namespace gestures
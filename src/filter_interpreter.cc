@@ -6,6 +6,9 @@
 
 #include <json/value.h>
 
+#include "gestures/include/interpreter_state.h"
+#include "gestures/include/json_stream_writer.h"
+
 namespace gestures {
 
 void FilterInterpreter::SyncInterpretImpl(HardwareState* hwstate,
@@ -38,9 +41,48 @@ Json::Value FilterInterpreter::EncodeCommonInfo() {
   return root;
 }
 
+void FilterInterpreter::WriteNextCommonInfo(JsonStreamWriter* writer) {
+#ifdef DEEP_LOGS
+  writer->Key(ActivityLog::kKeyNext);
+  writer->BeginObject();
+  next_->WriteCommonInfo(writer);
+  writer->EndObject();
+#endif
+}
+
 void FilterInterpreter::Clear() {
   if (log_.get())
     log_->Clear();
   next_->Clear();
 }
+
+void FilterInterpreter::SetLatencyStatsEnabled(bool enabled) {
+  Interpreter::SetLatencyStatsEnabled(enabled);
+  if (next_)
+    next_->SetLatencyStatsEnabled(enabled);
+}
+
+void FilterInterpreter::ClearLatencyStats() {
+  Interpreter::ClearLatencyStats();
+  if (next_)
+    next_->ClearLatencyStats();
+}
+
+void FilterInterpreter::EncodeLatencyStats(Json::Value* out) {
+  Interpreter::EncodeLatencyStats(out);
+  if (next_)
+    next_->EncodeLatencyStats(out);
+}
+
+void FilterInterpreter::SaveState(StateWriter* writer) {
+  Interpreter::SaveState(writer);
+  if (next_)
+    next_->SaveState(writer);
+}
+
+bool FilterInterpreter::RestoreState(StateReader* reader) {
+  if (!Interpreter::RestoreState(reader))
+    return false;
+  return !next_ || next_->RestoreState(reader);
+}
 }  // namespace gestures
@@ -0,0 +1,206 @@
+// Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "gestures/include/finger_arrays.h"
+
+#include <stddef.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "gestures/include/logging.h"
+
+namespace gestures {
+
+const size_t FingerArrays::kCapacity;
+
+namespace {
+
+#if defined(__SSE2__)
+// The eight floats of FingerState, in order, are two vectors' worth.
+static_assert(offsetof(FingerState, position_y) -
+              offsetof(FingerState, touch_major) == 7 * sizeof(float),
+              "FingerState floats must be contiguous");
+#endif
+
+#if defined(__SSE2__)
+// The coefficients of a FingerIirCoefficients, in both lanes.
+struct IirCoefficients {
+  explicit IirCoefficients(const FingerIirCoefficients& coeffs)
+      : b0(_mm_set1_pd(coeffs.b0)), b1(_mm_set1_pd(coeffs.b1)),
+        b2(_mm_set1_pd(coeffs.b2)), b3(_mm_set1_pd(coeffs.b3)),
+        a1(_mm_set1_pd(coeffs.a1)), a2(_mm_set1_pd(coeffs.a2)) {}
+  __m128d b0, b1, b2, b3, a1, a2;
+};
+
+// The filter for two fingers, summed in the scalar code's order.
+__m128d Iir(const IirCoefficients& c, __m128d x, __m128d in0, __m128d in1,
+            __m128d in2, __m128d out0, __m128d out1) {
+  __m128d y = _mm_mul_pd(c.b3, in2);
+  y = _mm_add_pd(y, _mm_mul_pd(c.b2, in1));
+  y = _mm_add_pd(y, _mm_mul_pd(c.b1, in0));
+  y = _mm_add_pd(y, _mm_mul_pd(c.b0, x));
+  y = _mm_sub_pd(y, _mm_mul_pd(c.a2, out1));
+  return _mm_sub_pd(y, _mm_mul_pd(c.a1, out0));
+}
+
+// The low and high halves of |v|, in double.
+__m128d LowPd(__m128 v) { return _mm_cvtps_pd(v); }
+__m128d HighPd(__m128 v) { return _mm_cvtps_pd(_mm_movehl_ps(v, v)); }
+
+// Where |mask| is all ones, |a|, else |b|.
+__m128 Select(__m128 mask, __m128 a, __m128 b) {
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+__m128 LoadMask(const uint32_t* mask) {
+  return _mm_castsi128_ps(
+      _mm_load_si128(reinterpret_cast<const __m128i*>(mask)));
+}
+#endif
+
+}  // namespace {}
+
+void FingerArrays::Load(const FingerState* fingers, size_t count) {
+  if (count > kCapacity) {
+    Err("Too many fingers: %zu", count);
+    count = kCapacity;
+  }
+  size = count;
+  size_t i = 0;
+#if defined(__SSE2__)
+  // Transposes blocks of kFingerLanes fingers with vector loads and stores,
+  // so that the kernels' vector loads don't wait on scalar stores.
+  for (; i + kFingerLanes <= count; i += kFingerLanes) {
+    const FingerState* fs = &fingers[i];
+    for (size_t half = 0; half < 2; half++) {
+      __m128 f0 = _mm_loadu_ps(&fs[0].touch_major + 4 * half);
+      __m128 f1 = _mm_loadu_ps(&fs[1].touch_major + 4 * half);
+      __m128 f2 = _mm_loadu_ps(&fs[2].touch_major + 4 * half);
+      __m128 f3 = _mm_loadu_ps(&fs[3].touch_major + 4 * half);
+      _MM_TRANSPOSE4_PS(f0, f1, f2, f3);
+      _mm_store_ps(&(half ? pressure : touch_major)[i], f0);
+      _mm_store_ps(&(half ? orientation : touch_minor)[i], f1);
+      _mm_store_ps(&(half ? position_x : width_major)[i], f2);
+      _mm_store_ps(&(half ? position_y : width_minor)[i], f3);
+    }
+    for (size_t j = i; j < i + kFingerLanes; j++) {
+      tracking_id[j] = fingers[j].tracking_id;
+      flags[j] = fingers[j].flags;
+    }
+  }
+#endif
+  for (; i < count; i++) {
+    const FingerState& fs = fingers[i];
+    touch_major[i] = fs.touch_major;
+    touch_minor[i] = fs.touch_minor;
+    width_major[i] = fs.width_major;
+    width_minor[i] = fs.width_minor;
+    pressure[i] = fs.pressure;
+    orientation[i] = fs.orientation;
+    position_x[i] = fs.position_x;
+    position_y[i] = fs.position_y;
+    tracking_id[i] = fs.tracking_id;
+    flags[i] = fs.flags;
+  }
+  for (size_t e = padded_size(); i < e; i++) {
+    touch_major[i] = touch_minor[i] = width_major[i] = width_minor[i] = 0.0;
+    pressure[i] = orientation[i] = position_x[i] = position_y[i] = 0.0;
+  }
+}
+
+void FingerArrays::Store(FingerState* fingers) const {
+  size_t i = 0;
+#if defined(__SSE2__)
+  for (; i + kFingerLanes <= size; i += kFingerLanes) {
+    FingerState* fs = &fingers[i];
+    for (size_t half = 0; half < 2; half++) {
+      __m128 f0 = _mm_load_ps(&(half ? pressure : touch_major)[i]);
+      __m128 f1 = _mm_load_ps(&(half ? orientation : touch_minor)[i]);
+      __m128 f2 = _mm_load_ps(&(half ? position_x : width_major)[i]);
+      __m128 f3 = _mm_load_ps(&(half ? position_y : width_minor)[i]);
+      _MM_TRANSPOSE4_PS(f0, f1, f2, f3);
+      _mm_storeu_ps(&fs[0].touch_major + 4 * half, f0);
+      _mm_storeu_ps(&fs[1].touch_major + 4 * half, f1);
+      _mm_storeu_ps(&fs[2].touch_major + 4 * half, f2);
+      _mm_storeu_ps(&fs[3].touch_major + 4 * half, f3);
+    }
+    for (size_t j = i; j < i + kFingerLanes; j++) {
+      fingers[j].tracking_id = tracking_id[j];
+      fingers[j].flags = flags[j];
+    }
+  }
+#endif
+  for (; i < size; i++) {
+    FingerState* fs = &fingers[i];
+    fs->touch_major = touch_major[i];
+    fs->touch_minor = touch_minor[i];
+    fs->width_major = width_major[i];
+    fs->width_minor = width_minor[i];
+    fs->pressure = pressure[i];
+    fs->orientation = orientation[i];
+    fs->position_x = position_x[i];
+    fs->position_y = position_y[i];
+    fs->tracking_id = tracking_id[i];
+    fs->flags = flags[i];
+  }
+}
+
+void FingerArraysIir(float* values, FingerIirHistory* history,
+                     const FingerIirCoefficients& coeffs,
+                     const uint32_t* iir, const uint32_t* pass,
+                     size_t count) {
+  float* in0 = history->in[0];
+  float* in1 = history->in[1];
+  float* in2 = history->in[2];
+  float* out0 = history->out[0];
+  float* out1 = history->out[1];
+#if defined(__SSE2__)
+  IirCoefficients c(coeffs);
+  __m128 half = _mm_set1_ps(0.5f);
+  for (size_t i = 0; i < count; i += kFingerLanes) {
+    __m128 x = _mm_load_ps(&values[i]);
+    __m128 x0 = _mm_load_ps(&in0[i]);
+    __m128 x1 = _mm_load_ps(&in1[i]);
+    __m128 x2 = _mm_load_ps(&in2[i]);
+    __m128 y0 = _mm_load_ps(&out0[i]);
+    __m128 y1 = _mm_load_ps(&out1[i]);
+    __m128d low = Iir(c, LowPd(x), LowPd(x0), LowPd(x1), LowPd(x2),
+                      LowPd(y0), LowPd(y1));
+    __m128d high = Iir(c, HighPd(x), HighPd(x0), HighPd(x1), HighPd(x2),
+                       HighPd(y0), HighPd(y1));
+    __m128 filtered = _mm_movelh_ps(_mm_cvtpd_ps(low), _mm_cvtpd_ps(high));
+    __m128 averaged = _mm_mul_ps(_mm_add_ps(x, y0), half);
+    __m128 y = Select(LoadMask(&pass[i]), x,
+                      Select(LoadMask(&iir[i]), filtered, averaged));
+    _mm_store_ps(&in2[i], x1);
+    _mm_store_ps(&in1[i], x0);
+    _mm_store_ps(&in0[i], x);
+    _mm_store_ps(&out1[i], y0);
+    _mm_store_ps(&out0[i], y);
+    _mm_store_ps(&values[i], y);
+  }
+#else
+  for (size_t i = 0; i < count; i++) {
+    float x = values[i];
+    float y;
+    if (pass[i])
+      y = x;
+    else if (iir[i])
+      y = coeffs.b3 * in2[i] + coeffs.b2 * in1[i] + coeffs.b1 * in0[i] +
+          coeffs.b0 * x - coeffs.a2 * out1[i] - coeffs.a1 * out0[i];
+    else
+      y = 0.5 * (x + out0[i]);
+    in2[i] = in1[i];
+    in1[i] = in0[i];
+    in0[i] = x;
+    out1[i] = out0[i];
+    out0[i] = y;
+    values[i] = y;
+  }
+#endif
+}
+
+}  // namespace gestures
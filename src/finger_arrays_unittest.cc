@@ -0,0 +1,102 @@
+// Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <gtest/gtest.h>
+
+#include "gestures/include/finger_arrays.h"
+#include "gestures/include/macros.h"
+
+namespace gestures {
+
+class FingerArraysTest : public ::testing::Test {};
+
+TEST(FingerArraysTest, LoadStoreTest) {
+  FingerState fs[5];
+  for (size_t i = 0; i < arraysize(fs); i++) {
+    FingerState finger = { 1.0f + i, 2.0f + i, 3.0f + i, 4.0f + i,
+                           5.0f + i, 6.0f + i, 7.0f + i, 8.0f + i,
+                           static_cast<short>(10 + i),
+                           static_cast<unsigned>(i) };
+    fs[i] = finger;
+  }
+  FingerArrays arrays;
+  arrays.Load(fs, arraysize(fs));
+  EXPECT_EQ(arraysize(fs), arrays.size);
+  EXPECT_EQ(2 * kFingerLanes, arrays.padded_size());
+  EXPECT_FLOAT_EQ(5.0, arrays.pressure[0]);
+  EXPECT_FLOAT_EQ(12.0, arrays.position_y[4]);
+  EXPECT_EQ(14, arrays.tracking_id[4]);
+  for (size_t i = arrays.size; i < arrays.padded_size(); i++)
+    EXPECT_EQ(0.0, arrays.position_x[i]);
+
+  for (size_t i = 0; i < arrays.size; i++)
+    arrays.position_x[i] = arrays.position_x[i] * 2.0f + 1.0f;
+  FingerState out[arraysize(fs) + 1];
+  memset(out, 0, sizeof(out));
+  arrays.Store(out);
+  for (size_t i = 0; i < arraysize(fs); i++) {
+    FingerState expected = fs[i];
+    expected.position_x = expected.position_x * 2.0f + 1.0f;
+    EXPECT_TRUE(expected == out[i]) << i;
+  }
+  EXPECT_EQ(0, out[arraysize(fs)].tracking_id);  // Past the end is untouched
+}
+
+// The IIR kernel must match the scalar double math it replaced, bit for bit,
+// over several steps of its history.
+TEST(FingerArraysTest, IirTest) {
+  const size_t kCount = 3 * kFingerLanes;
+  const FingerIirCoefficients kCoeffs = {
+    0.0674552738890719, 0.134910547778144, 0.0674552738890719, 0.013,
+    -1.1429805025399, 0.412801598096189
+  };
+  FingerIirHistory history;
+  float in[3][kCount];
+  float out[2][kCount];
+  alignas(16) uint32_t iir[kCount];
+  alignas(16) uint32_t pass[kCount];
+  for (size_t i = 0; i < kCount; i++) {
+    for (size_t j = 0; j < 3; j++)
+      history.in[j][i] = in[j][i] = 0.37f * i - 1.1f * j;
+    for (size_t j = 0; j < 2; j++)
+      history.out[j][i] = out[j][i] = 0.41f * i + 0.7f * j;
+    iir[i] = i % 3 ? ~0u : 0;
+    pass[i] = i % 5 == 4 ? ~0u : 0;
+  }
+  for (size_t step = 0; step < 10; step++) {
+    alignas(16) float values[kCount];
+    float expected[kCount];
+    for (size_t i = 0; i < kCount; i++) {
+      float x = values[i] = 0.5f * i + 0.3f * step * step - 7.25f;
+      if (pass[i])
+        expected[i] = x;
+      else if (iir[i])
+        expected[i] = kCoeffs.b3 * in[2][i] + kCoeffs.b2 * in[1][i] +
+            kCoeffs.b1 * in[0][i] + kCoeffs.b0 * x -
+            kCoeffs.a2 * out[1][i] - kCoeffs.a1 * out[0][i];
+      else
+        expected[i] = 0.5 * (x + out[0][i]);
+      in[2][i] = in[1][i];
+      in[1][i] = in[0][i];
+      in[0][i] = x;
+      out[1][i] = out[0][i];
+      out[0][i] = expected[i];
+    }
+    FingerArraysIir(values, &history, kCoeffs, iir, pass, kCount);
+    for (size_t i = 0; i < kCount; i++) {
+      EXPECT_EQ(expected[i], values[i]) << "step " << step << ", " << i;
+      for (size_t j = 0; j < 3; j++)
+        EXPECT_EQ(in[j][i], history.in[j][i]) << "step " << step << ", " << i;
+      for (size_t j = 0; j < 2; j++)
+        EXPECT_EQ(out[j][i], history.out[j][i])
+            << "step " << step << ", " << i;
+    }
+    // Switch fingers between filtering and averaging as the interpreter
+    // does.
+    for (size_t i = 0; i < kCount; i++)
+      iir[i] = (i + step) % 3 ? ~0u : 0;
+  }
+}
+
+}  // namespace gestures
@@ -0,0 +1,61 @@
+// Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "gestures/include/finger_index.h"
+
+#include <string.h>
+
+namespace gestures {
+
+const size_t ScopedFingerIndex::kTableSize;
+const size_t ScopedFingerIndex::kTableMask;
+const size_t ScopedFingerIndex::kMaxFingers;
+
+thread_local ScopedFingerIndex* ScopedFingerIndex::current_ = NULL;
+
+ScopedFingerIndex::ScopedFingerIndex(const HardwareState* hwstate)
+    : hwstate_(NULL), outer_(NULL) {
+  if (!hwstate)
+    return;
+  if (current_ && current_->hwstate_ == hwstate) {
+    if (!current_->UpToDate())
+      current_->Build();
+    return;
+  }
+  hwstate_ = hwstate;
+  outer_ = current_;
+  current_ = this;
+  Build();
+}
+
+ScopedFingerIndex::~ScopedFingerIndex() {
+  if (hwstate_)
+    current_ = outer_;
+}
+
+// static
+void ScopedFingerIndex::Rebuild(const HardwareState& hwstate) {
+  for (ScopedFingerIndex* index = current_; index; index = index->outer_)
+    if (index->hwstate_ == &hwstate)
+      index->Build();
+}
+
+void ScopedFingerIndex::Build() {
+  fingers_ = hwstate_->fingers;
+  finger_cnt_ = hwstate_->finger_cnt;
+  indexed_ = fingers_ && finger_cnt_ <= kMaxFingers;
+  if (!indexed_)
+    return;
+  memset(table_, 0, sizeof(table_));
+  // Fingers are added in order, so the first of several fingers with the same
+  // id comes first in the probe sequence, like with a scan.
+  for (size_t i = 0; i < finger_cnt_; i++) {
+    size_t entry = Hash(fingers_[i].tracking_id);
+    while (table_[entry])
+      entry = (entry + 1) & kTableMask;
+    table_[entry] = i + 1;
+  }
+}
+
+}  // namespace gestures
@@ -0,0 +1,111 @@
+// Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <gtest/gtest.h>
+
+#include "gestures/include/finger_index.h"
+#include "gestures/include/gestures.h"
+#include "gestures/include/interpreter.h"
+#include "gestures/include/unittest_util.h"
+
+namespace gestures {
+
+class FingerIndexTest : public ::testing::Test {};
+
+namespace {
+
+// Records whether the hardware states it gets are indexed.
+class FingerIndexTestInterpreter : public Interpreter {
+ public:
+  FingerIndexTestInterpreter()
+      : Interpreter(NULL, NULL, false), indexed_(false) {}
+
+  bool indexed_;
+
+ protected:
+  virtual void SyncInterpretImpl(HardwareState* hwstate, stime_t* timeout) {
+    const FingerState* fs;
+    indexed_ = ScopedFingerIndex::Find(*hwstate, 1, &fs);
+  }
+};
+
+}  // namespace {}
+
+TEST(FingerIndexTest, LookupTest) {
+  // 1, 65 and -63 hash to the same entry, and 2 is right after it.
+  FingerState fs[] = {
+    { 0, 0, 0, 0, 1, 0, 0, 0, 1, 0 },
+    { 0, 0, 0, 0, 1, 0, 0, 0, 65, 0 },
+    { 0, 0, 0, 0, 1, 0, 0, 0, 2, 0 },
+    { 0, 0, 0, 0, 1, 0, 0, 0, -63, 0 },
+    { 0, 0, 0, 0, 1, 0, 0, 0, 65, 0 },
+  };
+  HardwareState hs = make_hwstate(0.0, 0, arraysize(fs), arraysize(fs), fs);
+  const FingerState* found = NULL;
+  EXPECT_FALSE(ScopedFingerIndex::Find(hs, 1, &found));
+  EXPECT_EQ(&fs[3], hs.GetFingerState(-63));
+
+  ScopedFingerIndex index(&hs);
+  EXPECT_TRUE(ScopedFingerIndex::Find(hs, 1, &found));
+  EXPECT_EQ(&fs[0], found);
+  EXPECT_EQ(&fs[1], hs.GetFingerState(65));  // The first of the two
+  EXPECT_EQ(&fs[2], hs.GetFingerState(2));
+  EXPECT_EQ(&fs[3], hs.GetFingerState(-63));
+  EXPECT_EQ(NULL, hs.GetFingerState(129));
+  EXPECT_EQ(NULL, hs.GetFingerState(3));
+
+  // Dropping the last finger is caught even without FingersChanged().
+  hs.finger_cnt = 4;
+  EXPECT_FALSE(ScopedFingerIndex::Find(hs, 1, &found));
+  EXPECT_EQ(&fs[1], hs.GetFingerState(65));
+
+  // Changing ids in place needs FingersChanged().
+  fs[0].tracking_id = 3;
+  hs.finger_cnt = 5;
+  hs.FingersChanged();
+  EXPECT_EQ(NULL, hs.GetFingerState(1));
+  EXPECT_EQ(&fs[0], hs.GetFingerState(3));
+}
+
+TEST(FingerIndexTest, NestingTest) {
+  FingerState fs_a[] = { { 0, 0, 0, 0, 1, 0, 0, 0, 1, 0 } };
+  FingerState fs_b[] = { { 0, 0, 0, 0, 1, 0, 0, 0, 2, 0 } };
+  HardwareState hs_a = make_hwstate(0.0, 0, 1, 1, fs_a);
+  HardwareState hs_b = make_hwstate(0.0, 0, 1, 1, fs_b);
+  const FingerState* found = NULL;
+
+  ScopedFingerIndex index_a(&hs_a);
+  {
+    ScopedFingerIndex index_b(&hs_b);
+    EXPECT_TRUE(ScopedFingerIndex::Find(hs_b, 2, &found));
+    // Only the innermost state is looked up by index, but the outer one is
+    // still rebuilt.
+    EXPECT_FALSE(ScopedFingerIndex::Find(hs_a, 1, &found));
+    fs_a[0].tracking_id = 3;
+    hs_a.FingersChanged();
+    {
+      // Indexing the same state again is a no-op.
+      ScopedFingerIndex index_b_again(&hs_b);
+      EXPECT_TRUE(ScopedFingerIndex::Find(hs_b, 2, &found));
+    }
+    EXPECT_TRUE(ScopedFingerIndex::Find(hs_b, 2, &found));
+    EXPECT_EQ(&fs_b[0], found);
+  }
+  EXPECT_TRUE(ScopedFingerIndex::Find(hs_a, 3, &found));
+  EXPECT_EQ(&fs_a[0], found);
+}
+
+TEST(FingerIndexTest, SyncInterpretTest) {
+  FingerIndexTestInterpreter interpreter;
+  TestInterpreterWrapper wrapper(&interpreter);
+  FingerState fs = { 0, 0, 0, 0, 1, 0, 0, 0, 1, 0 };
+  HardwareState hs = make_hwstate(0.0, 0, 1, 1, &fs);
+  stime_t timeout = -1.0;
+  wrapper.SyncInterpret(&hs, &timeout);
+  EXPECT_TRUE(interpreter.indexed_);
+  const FingerState* found = NULL;
+  EXPECT_FALSE(ScopedFingerIndex::Find(hs, 1, &found));
+}
+
+}  // namespace gestures
@@ -8,6 +8,7 @@
 
 #include "gestures/include/filter_interpreter.h"
 #include "gestures/include/gestures.h"
+#include "gestures/include/interpreter_state.h"
 #include "gestures/include/logging.h"
 #include "gestures/include/prop_registry.h"
 #include "gestures/include/tracer.h"
@@ -174,4 +175,20 @@ void FingerMergeFilterInterpreter::UpdateFingerMergeState(
   }
 }
 
+void FingerMergeFilterInterpreter::SaveOwnState(StateWriter* writer) const {
+  writer->Write(start_info_);
+  writer->Write(merge_tracking_ids_);
+  writer->Write(never_merge_ids_);
+  writer->Write(prev_x_displacement_);
+  writer->Write(prev2_x_displacement_);
+}
+
+void FingerMergeFilterInterpreter::RestoreOwnState(StateReader* reader) {
+  reader->Read(&start_info_);
+  reader->Read(&merge_tracking_ids_);
+  reader->Read(&never_merge_ids_);
+  reader->Read(&prev_x_displacement_);
+  reader->Read(&prev2_x_displacement_);
+}
+
 }
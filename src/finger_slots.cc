@@ -0,0 +1,122 @@
+// Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "gestures/include/finger_slots.h"
+
+#include <string.h>
+
+namespace gestures {
+
+const size_t FingerSlotSet::kMaxSlots;
+const size_t TrackingIdSlots::kMaxSlots;
+const size_t TrackingIdSlots::kMaxUsers;
+const size_t TrackingIdSlots::kTableSize;
+const size_t TrackingIdSlots::kTableMask;
+
+TrackingIdSlots::TrackingIdSlots() {
+  memset(table_, 0, sizeof(table_));
+  memset(ids_, 0, sizeof(ids_));
+}
+
+void TrackingIdSlots::Update(const HardwareState& hwstate) {
+  // Free the slots of departed ids first, so that new ids can take them.
+  FingerSlotSet present;
+  for (size_t i = 0; i < hwstate.finger_cnt; i++) {
+    int slot = Slot(hwstate.fingers[i].tracking_id);
+    if (slot >= 0)
+      present.insert(slot);
+  }
+  Free(assigned_ - present);
+  for (size_t i = 0; i < hwstate.finger_cnt; i++)
+    if (Assign(hwstate.fingers[i].tracking_id) < 0)
+      Err("No slot for tracking id %d", hwstate.fingers[i].tracking_id);
+}
+
+void TrackingIdSlots::Clear() {
+  Free(assigned_);
+}
+
+void TrackingIdSlots::Register(FingerSlotSet* user) {
+  if (users_.size() == kMaxUsers) {
+    Err("Too many users of TrackingIdSlots");
+    return;
+  }
+  users_.push_back(user);
+}
+
+void TrackingIdSlots::Unregister(FingerSlotSet* user) {
+  vector<FingerSlotSet*, kMaxUsers>::iterator it = users_.find(user);
+  if (it != users_.end())
+    users_.erase(it);
+}
+
+void TrackingIdSlots::SaveState(StateWriter* writer) const {
+  writer->Write(assigned_);
+  for (size_t slot : assigned_)
+    writer->Write(ids_[slot]);
+}
+
+void TrackingIdSlots::RestoreState(StateReader* reader) {
+  Clear();
+  FingerSlotSet assigned;
+  if (!reader->Read(&assigned))
+    return;
+  for (size_t slot : assigned) {
+    short id = 0;
+    if (!reader->Read(&id))
+      return;
+    if (Slot(id) >= 0) {
+      reader->Fail("duplicate tracking id");
+      return;
+    }
+    AssignSlot(id, slot);
+  }
+}
+
+int TrackingIdSlots::AssignNew(short id) {
+  uint64_t free_bits = ~assigned_.bits();
+  if (!free_bits)
+    return -1;
+  int slot = __builtin_ctzll(free_bits);
+  AssignSlot(id, slot);
+  return slot;
+}
+
+void TrackingIdSlots::AssignSlot(short id, int slot) {
+  size_t i = Hash(id);
+  while (table_[i])
+    i = (i + 1) & kTableMask;
+  table_[i] = slot + 1;
+  ids_[slot] = id;
+  assigned_.insert(slot);
+}
+
+void TrackingIdSlots::Free(const FingerSlotSet& slots) {
+  if (slots.empty())
+    return;
+  for (size_t i = 0; i < users_.size(); i++)
+    *users_[i] -= slots;
+  assigned_ -= slots;
+  for (FingerSlotSet::const_iterator it = slots.begin(), e = slots.end();
+       it != e; ++it) {
+    // Remove the entry, then shift later entries of the probe sequence back
+    // into the hole so that lookups don't stop short of them.
+    size_t hole = Hash(ids_[*it]);
+    while (table_[hole] != *it + 1)
+      hole = (hole + 1) & kTableMask;
+    table_[hole] = 0;
+    for (size_t i = (hole + 1) & kTableMask; table_[i];
+         i = (i + 1) & kTableMask) {
+      size_t home = Hash(ids_[table_[i] - 1]);
+      // Move the entry if its home isn't cyclically within (hole, i].
+      if (((i - home) & kTableMask) >= ((i - hole) & kTableMask)) {
+        table_[hole] = table_[i];
+        table_[i] = 0;
+        hole = i;
+      }
+    }
+  }
+}
+
+}  // namespace gestures
@@ -0,0 +1,177 @@
+// Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <gtest/gtest.h>
+
+#include "gestures/include/finger_slots.h"
+#include "gestures/include/unittest_util.h"
+
+namespace gestures {
+
+class FingerSlotsTest : public ::testing::Test {};
+
+namespace {
+
+HardwareState MakeState(FingerState* fs, const short* ids, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    FingerState blank = { 0, 0, 0, 0, 1, 0, 0, 0, ids[i], 0 };
+    fs[i] = blank;
+  }
+  return make_hwstate(0.0, 0, count, count, fs);
+}
+
+}  // namespace {}
+
+TEST(FingerSlotsTest, SlotSetTest) {
+  FingerSlotSet a;
+  EXPECT_TRUE(a.empty());
+  a.insert(0);
+  a.insert(5);
+  a.insert(63);
+  EXPECT_EQ(3, a.size());
+  EXPECT_TRUE(a.contains(63));
+  EXPECT_FALSE(a.contains(62));
+
+  FingerSlotSet b;
+  b.insert(5);
+  b.insert(7);
+  EXPECT_EQ(1, (a & b).size());
+  EXPECT_TRUE((a & b).contains(5));
+  EXPECT_EQ(4, (a | b).size());
+  EXPECT_EQ(2, (a - b).size());
+  EXPECT_FALSE((a - b).contains(5));
+  EXPECT_TRUE(a != b);
+  b.erase(7);
+  b.insert(0);
+  b.insert(63);
+  EXPECT_TRUE(a == b);
+
+  size_t expected[] = { 0, 5, 63 };
+  size_t i = 0;
+  for (FingerSlotSet::const_iterator it = a.begin(), e = a.end(); it != e;
+       ++it, ++i) {
+    ASSERT_LT(i, arraysize(expected));
+    EXPECT_EQ(expected[i], *it);
+  }
+  EXPECT_EQ(arraysize(expected), i);
+}
+
+TEST(FingerSlotsTest, SetTest) {
+  TrackingIdSlots slots;
+  TrackingIdSet a(&slots);
+  TrackingIdSet b(&slots);
+  FingerState fs[3];
+  short ids[] = { 10, 138, 266 };  // All hash to the same table entry
+  HardwareState hs = MakeState(fs, ids, arraysize(ids));
+  slots.Update(hs);
+
+  EXPECT_TRUE(a.empty());
+  EXPECT_GE(a.insert(10), 0);
+  EXPECT_GE(a.insert(266), 0);
+  EXPECT_GE(b.insert(138), 0);
+  EXPECT_EQ(2, a.size());
+  EXPECT_TRUE(SetContainsValue(a, 10));
+  EXPECT_FALSE(SetContainsValue(a, 138));
+  EXPECT_TRUE(SetContainsValue(a, 266));
+  EXPECT_TRUE(SetContainsValue(b, 138));
+  EXPECT_FALSE(SetContainsValue(b, 11));
+  EXPECT_EQ(3, (a.slot_set() | b.slot_set()).size());
+
+  // 138 leaves. The others must still be found past its table entry.
+  hs = MakeState(fs, ids, 1);
+  fs[1].tracking_id = 266;
+  hs.finger_cnt = hs.touch_cnt = 2;
+  slots.Update(hs);
+  EXPECT_TRUE(b.empty());
+  EXPECT_EQ(2, a.size());
+  EXPECT_TRUE(SetContainsValue(a, 10));
+  EXPECT_TRUE(SetContainsValue(a, 266));
+  EXPECT_EQ(-1, slots.Slot(138));
+
+  // A new id doesn't pick up membership from the id that left.
+  short new_ids[] = { 10, 266, 394 };
+  hs = MakeState(fs, new_ids, arraysize(new_ids));
+  slots.Update(hs);
+  EXPECT_FALSE(SetContainsValue(b, 394));
+  EXPECT_FALSE(SetContainsValue(a, 394));
+  EXPECT_EQ(1, a.erase(10));
+  EXPECT_EQ(0, a.erase(10));
+  EXPECT_EQ(1, a.size());
+
+  short ids_seen[2];
+  size_t ids_seen_len = 0;
+  b.insert(394);
+  b.insert(266);
+  for (TrackingIdSet::const_iterator it = b.begin(), e = b.end(); it != e;
+       ++it)
+    ids_seen[ids_seen_len++] = *it;
+  ASSERT_EQ(2, ids_seen_len);
+  EXPECT_TRUE(ids_seen[0] == 394 || ids_seen[1] == 394);
+  EXPECT_TRUE(ids_seen[0] == 266 || ids_seen[1] == 266);
+
+  // RemoveMissingIdsFromSet() works without an Update().
+  hs.finger_cnt = hs.touch_cnt = 1;
+  RemoveMissingIdsFromSet(&b, hs);
+  EXPECT_TRUE(b.empty());
+
+  slots.Clear();
+  EXPECT_TRUE(a.empty());
+  EXPECT_TRUE(slots.assigned().empty());
+}
+
+TEST(FingerSlotsTest, MapTest) {
+  TrackingIdSlots slots;
+  TrackingIdMap<float> map(&slots);
+  FingerState fs[2];
+  short ids[] = { 1, 2 };
+  HardwareState hs = MakeState(fs, ids, arraysize(ids));
+  slots.Update(hs);
+
+  EXPECT_FALSE(MapContainsKey(map, 1));
+  map[1] += 3.0;
+  EXPECT_TRUE(MapContainsKey(map, 1));
+  EXPECT_FLOAT_EQ(3.0, map[1]);
+  map[2] = 4.0;
+  EXPECT_EQ(2, map.size());
+
+  hs.finger_cnt = hs.touch_cnt = 1;
+  slots.Update(hs);
+  EXPECT_EQ(1, map.size());
+  EXPECT_FALSE(MapContainsKey(map, 2));
+
+  // Reusing the slot of 2 starts from a default value.
+  fs[1].tracking_id = 3;
+  hs.finger_cnt = hs.touch_cnt = 2;
+  slots.Update(hs);
+  EXPECT_FLOAT_EQ(0.0, map[3]);
+  EXPECT_FLOAT_EQ(3.0, map[1]);
+  EXPECT_EQ(1, map.erase(1));
+  EXPECT_FALSE(MapContainsKey(map, 1));
+}
+
+TEST(FingerSlotsTest, ManyIdsTest) {
+  TrackingIdSlots slots;
+  TrackingIdSet set(&slots);
+  // Ids that don't arrive in a hardware state get slots on demand, until
+  // all are taken.
+  for (short id = 0; id < static_cast<short>(TrackingIdSlots::kMaxSlots);
+       id++)
+    EXPECT_GE(set.insert(id * 3), 0);
+  EXPECT_EQ(TrackingIdSlots::kMaxSlots, set.size());
+  EXPECT_EQ(-1, set.insert(1000));
+  for (short id = 0; id < static_cast<short>(TrackingIdSlots::kMaxSlots);
+       id++)
+    EXPECT_TRUE(SetContainsValue(set, id * 3)) << id;
+
+  // They're dropped at the next Update().
+  FingerState fs[1];
+  short ids[] = { 1000 };
+  HardwareState hs = MakeState(fs, ids, arraysize(ids));
+  slots.Update(hs);
+  EXPECT_TRUE(set.empty());
+  EXPECT_EQ(1, slots.assigned().size());
+  EXPECT_GE(slots.Slot(1000), 0);
+}
+
+}  // namespace gestures
@@ -4,6 +4,7 @@
 
 #include "gestures/include/fling_stop_filter_interpreter.h"
 
+#include "gestures/include/interpreter_state.h"
 #include "gestures/include/util.h"
 
 namespace gestures {
@@ -165,4 +166,28 @@ void FlingStopFilterInterpreter::HandleTimerImpl(stime_t now,
   *timeout = SetNextDeadlineAndReturnTimeoutVal(now, next_timeout);
 }
 
+void FlingStopFilterInterpreter::SaveOwnState(StateWriter* writer) const {
+  writer->Write(already_extended_);
+  writer->Write(fingers_present_for_last_fling_);
+  writer->Write(fingers_of_last_hwstate_);
+  writer->Write(prev_touch_cnt_);
+  writer->Write(prev_timestamp_);
+  writer->Write(prev_gesture_type_);
+  writer->Write(fling_stop_already_sent_);
+  writer->Write(fling_stop_deadline_);
+  writer->Write(next_timer_deadline_);
+}
+
+void FlingStopFilterInterpreter::RestoreOwnState(StateReader* reader) {
+  reader->Read(&already_extended_);
+  reader->Read(&fingers_present_for_last_fling_);
+  reader->Read(&fingers_of_last_hwstate_);
+  reader->Read(&prev_touch_cnt_);
+  reader->Read(&prev_timestamp_);
+  reader->Read(&prev_gesture_type_);
+  reader->Read(&fling_stop_already_sent_);
+  reader->Read(&fling_stop_deadline_);
+  reader->Read(&next_timer_deadline_);
+}
+
 }  // namespace gestures
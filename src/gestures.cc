@@ -9,13 +9,16 @@
 
 #include "gestures/include/accel_filter_interpreter.h"
 #include "gestures/include/box_filter_interpreter.h"
+#include "gestures/include/chain.h"
 #include "gestures/include/click_wiggle_filter_interpreter.h"
+#include "gestures/include/finger_index.h"
 #include "gestures/include/finger_merge_filter_interpreter.h"
 #include "gestures/include/finger_metrics.h"
 #include "gestures/include/fling_stop_filter_interpreter.h"
 #include "gestures/include/iir_filter_interpreter.h"
 #include "gestures/include/immediate_interpreter.h"
 #include "gestures/include/integral_gesture_filter_interpreter.h"
+#include "gestures/include/interpreter_state.h"
 #include "gestures/include/logging.h"
 #include "gestures/include/logging_filter_interpreter.h"
 #include "gestures/include/lookahead_filter_interpreter.h"
@@ -161,6 +164,9 @@ FingerState* HardwareState::GetFingerState(short tracking_id) {
 }
 
 const FingerState* HardwareState::GetFingerState(short tracking_id) const {
+  const FingerState* fs;
+  if (gestures::ScopedFingerIndex::Find(*this, tracking_id, &fs))
+    return fs;
   for (short i = 0; i < finger_cnt; i++) {
     if (fingers[i].tracking_id == tracking_id)
       return &fingers[i];
@@ -168,6 +174,10 @@ const FingerState* HardwareState::GetFingerState(short tracking_id) const {
   return NULL;
 }
 
+void HardwareState::FingersChanged() const {
+  gestures::ScopedFingerIndex::Rebuild(*this);
+}
+
 string HardwareState::String() const {
   string ret = StringPrintf("{ %f, %d, %d, %d, {",
                             timestamp,
@@ -361,6 +371,12 @@ void GestureInterpreterPushHardwareState(GestureInterpreter* obj,
   obj->PushHardwareState(hwstate);
 }
 
+void GestureInterpreterPushHardwareStates(GestureInterpreter* obj,
+                                          struct HardwareState* hwstates,
+                                          size_t count) {
+  obj->PushHardwareStates(hwstates, count);
+}
+
 void GestureInterpreterSetHardwareProperties(
     GestureInterpreter* obj,
     const struct HardwareProperties* hwprops) {
@@ -414,6 +430,80 @@ class GestureInterpreterConsumer : public GestureConsumer {
   GestureReadyFunction callback_;
   void* callback_data_;
 };
+
+namespace {
+
+// The interpreter chains, outermost layer first. See chain.h.
+typedef Chain<LoggingFilterInterpreter,
+              TimestampFilterInterpreter,
+              NonLinearityFilterInterpreter,
+              T5R2CorrectingFilterInterpreter,
+              StuckButtonInhibitorFilterInterpreter,
+              FingerMergeFilterInterpreter,
+              ScalingFilterInterpreter,
+              MetricsFilterInterpreter,
+              TrendClassifyingFilterInterpreter,
+              SplitCorrectingFilterInterpreter,
+              AccelFilterInterpreter,
+              SensorJumpFilterInterpreter,
+              StationaryWiggleFilterInterpreter,
+              BoxFilterInterpreter,
+              LookaheadFilterInterpreter,
+              IirFilterInterpreter,
+              PalmClassifyingFilterInterpreter,
+              ClickWiggleFilterInterpreter,
+              FlingStopFilterInterpreter,
+              ImmediateInterpreter> TouchpadChain;
+
+typedef Chain<LoggingFilterInterpreter,
+              TimestampFilterInterpreter,
+              StuckButtonInhibitorFilterInterpreter,
+              FingerMergeFilterInterpreter,
+              ScalingFilterInterpreter,
+              MetricsFilterInterpreter,
+              TrendClassifyingFilterInterpreter,
+              AccelFilterInterpreter,
+              StationaryWiggleFilterInterpreter,
+              BoxFilterInterpreter,
+              LookaheadFilterInterpreter,
+              PalmClassifyingFilterInterpreter,
+              ClickWiggleFilterInterpreter,
+              FlingStopFilterInterpreter,
+              ImmediateInterpreter> Touchpad2Chain;
+
+// TODO(clchiou;chromium-os:36321): Use mouse acceleration algorithm for mice
+typedef Chain<LoggingFilterInterpreter,
+              IntegralGestureFilterInterpreter,
+              MetricsFilterInterpreter,
+              ScalingFilterInterpreter,
+              AccelFilterInterpreter,
+              MouseInterpreter> MouseChain;
+
+typedef Chain<LoggingFilterInterpreter,
+              NonLinearityFilterInterpreter,
+              StuckButtonInhibitorFilterInterpreter,
+              IntegralGestureFilterInterpreter,
+              MetricsFilterInterpreter,
+              ScalingFilterInterpreter,
+              AccelFilterInterpreter,
+              BoxFilterInterpreter,
+              LookaheadFilterInterpreter,
+              ClickWiggleFilterInterpreter,
+              FlingStopFilterInterpreter,
+              MultitouchMouseInterpreter> MultitouchMouseChain;
+
+// Builds |ChainType|, or the same layers as ordinary filters if
+// |static_chain| is off.
+template<typename ChainType>
+LoggingFilterInterpreter* NewChain(PropRegistry* prop_reg, Tracer* tracer,
+                                   GestureInterpreterDeviceClass devclass,
+                                   bool static_chain) {
+  if (static_chain)
+    return new ChainType(prop_reg, tracer, devclass);
+  return ChainType::NewDynamic(prop_reg, tracer, devclass);
+}
+
+}  // namespace {}
 }
 
 GestureInterpreter::GestureInterpreter(int version)
@@ -422,8 +512,11 @@ GestureInterpreter::GestureInterpreter(int version)
       timer_provider_(NULL),
       timer_provider_data_(NULL),
       interpret_timer_(NULL),
+      timer_timeout_(-1.0),
       loggingFilter_(NULL) {
   prop_reg_.reset(new PropRegistry);
+  static_chain_.reset(
+      new BoolProperty(prop_reg_.get(), "Static Interpreter Chain", true));
   tracer_.reset(new Tracer(prop_reg_.get(), TraceMarker::StaticTraceWrite));
   TraceMarker::CreateTraceMarker();
 }
@@ -445,12 +538,38 @@ stime_t InternalTimerCallback(stime_t now, void* callback_data) {
 }
 
 void GestureInterpreter::PushHardwareState(HardwareState* hwstate) {
+  PushHardwareStates(hwstate, 1);
+}
+
+void GestureInterpreter::PushHardwareStates(HardwareState* hwstates,
+                                            size_t count) {
   if (!interpreter_.get()) {
     Err("Filters are not composed yet!");
     return;
   }
   stime_t timeout = -1.0;
-  interpreter_->SyncInterpret(hwstate, &timeout);
+  stime_t prev_timestamp = 0.0;
+  for (size_t i = 0; i < count; i++) {
+    // Filters may rewrite the timestamp, so keep the one the timer runs on.
+    stime_t timestamp = hwstates[i].timestamp;
+    if (i > 0) {
+      stime_t due = prev_timestamp + timeout;
+      while (timeout > 0.0 && due <= timestamp) {
+        timeout = -1.0;
+        interpreter_->HandleTimer(due, &timeout);
+        due += timeout;
+      }
+    }
+    timeout = -1.0;
+    interpreter_->SyncInterpret(&hwstates[i], &timeout);
+    prev_timestamp = timestamp;
+  }
+  if (count)
+    SetTimer(timeout);
+}
+
+void GestureInterpreter::SetTimer(stime_t timeout) {
+  timer_timeout_ = timeout;
   if (timer_provider_ && interpret_timer_) {
     if (timeout <= 0.0) {
       timer_provider_->cancel_fn(timer_provider_data_, interpret_timer_);
@@ -484,6 +603,8 @@ void GestureInterpreter::TimerCallback(stime_t now, stime_t* timeout) {
     return;
   }
   interpreter_->HandleTimer(now, timeout);
+  // The timer provider sets the timer again for this.
+  timer_timeout_ = *timeout;
 }
 
 void GestureInterpreter::SetTimerProvider(GesturesTimerProvider* tp,
@@ -525,104 +646,31 @@ void GestureInterpreter::InitializeTouchpad(void) {
     }
   }
 
-  Interpreter* temp = new ImmediateInterpreter(prop_reg_.get(), tracer_.get());
-  temp = new FlingStopFilterInterpreter(prop_reg_.get(), temp, tracer_.get(),
-                                        GESTURES_DEVCLASS_TOUCHPAD);
-  temp = new ClickWiggleFilterInterpreter(prop_reg_.get(), temp, tracer_.get());
-  temp = new PalmClassifyingFilterInterpreter(prop_reg_.get(), temp,
-                                              tracer_.get());
-  temp = new IirFilterInterpreter(prop_reg_.get(), temp, tracer_.get());
-  temp = new LookaheadFilterInterpreter(prop_reg_.get(), temp, tracer_.get());
-  temp = new BoxFilterInterpreter(prop_reg_.get(), temp, tracer_.get());
-  temp = new StationaryWiggleFilterInterpreter(prop_reg_.get(), temp,
-                                               tracer_.get());
-  temp = new SensorJumpFilterInterpreter(prop_reg_.get(), temp, tracer_.get());
-  temp = new AccelFilterInterpreter(prop_reg_.get(), temp, tracer_.get());
-  temp = new SplitCorrectingFilterInterpreter(prop_reg_.get(), temp,
-                                              tracer_.get());
-  temp = new TrendClassifyingFilterInterpreter(prop_reg_.get(), temp,
-                                               tracer_.get());
-  temp = new MetricsFilterInterpreter(prop_reg_.get(), temp, tracer_.get(),
-                                      GESTURES_DEVCLASS_TOUCHPAD);
-  temp = new ScalingFilterInterpreter(prop_reg_.get(), temp, tracer_.get(),
-                                      GESTURES_DEVCLASS_TOUCHPAD);
-  temp = new FingerMergeFilterInterpreter(prop_reg_.get(), temp, tracer_.get());
-  temp = new StuckButtonInhibitorFilterInterpreter(temp, tracer_.get());
-  temp = new T5R2CorrectingFilterInterpreter(prop_reg_.get(), temp,
-                                             tracer_.get());
-  temp = new NonLinearityFilterInterpreter(prop_reg_.get(), temp,
-                                           tracer_.get());
-  temp = new TimestampFilterInterpreter(prop_reg_.get(), temp, tracer_.get());
-  temp = loggingFilter_ = new LoggingFilterInterpreter(prop_reg_.get(), temp,
-                                                       tracer_.get());
-  interpreter_.reset(temp);
-  temp = NULL;
+  loggingFilter_ = NewChain<TouchpadChain>(prop_reg_.get(), tracer_.get(),
+                                           GESTURES_DEVCLASS_TOUCHPAD,
+                                           static_chain_->val_);
+  interpreter_.reset(loggingFilter_);
 }
 
 void GestureInterpreter::InitializeTouchpad2(void) {
-  Interpreter* temp = new ImmediateInterpreter(prop_reg_.get(), tracer_.get());
-  temp = new FlingStopFilterInterpreter(prop_reg_.get(), temp, tracer_.get(),
-                                        GESTURES_DEVCLASS_TOUCHPAD);
-  temp = new ClickWiggleFilterInterpreter(prop_reg_.get(), temp, tracer_.get());
-  temp = new PalmClassifyingFilterInterpreter(prop_reg_.get(), temp,
-                                              tracer_.get());
-  temp = new LookaheadFilterInterpreter(prop_reg_.get(), temp, tracer_.get());
-  temp = new BoxFilterInterpreter(prop_reg_.get(), temp, tracer_.get());
-  temp = new StationaryWiggleFilterInterpreter(prop_reg_.get(), temp,
-                                               tracer_.get());
-  temp = new AccelFilterInterpreter(prop_reg_.get(), temp, tracer_.get());
-  temp = new TrendClassifyingFilterInterpreter(prop_reg_.get(), temp,
-                                               tracer_.get());
-  temp = new MetricsFilterInterpreter(prop_reg_.get(), temp, tracer_.get(),
-                                      GESTURES_DEVCLASS_TOUCHPAD);
-  temp = new ScalingFilterInterpreter(prop_reg_.get(), temp, tracer_.get(),
-                                      GESTURES_DEVCLASS_TOUCHPAD);
-  temp = new FingerMergeFilterInterpreter(prop_reg_.get(), temp, tracer_.get());
-  temp = new StuckButtonInhibitorFilterInterpreter(temp, tracer_.get());
-  temp = new TimestampFilterInterpreter(prop_reg_.get(), temp, tracer_.get());
-  temp = loggingFilter_ = new LoggingFilterInterpreter(prop_reg_.get(), temp,
-                                                       tracer_.get());
-  interpreter_.reset(temp);
-  temp = NULL;
+  loggingFilter_ = NewChain<Touchpad2Chain>(prop_reg_.get(), tracer_.get(),
+                                            GESTURES_DEVCLASS_TOUCHPAD,
+                                            static_chain_->val_);
+  interpreter_.reset(loggingFilter_);
 }
 
 void GestureInterpreter::InitializeMouse(void) {
-  Interpreter* temp = new MouseInterpreter(prop_reg_.get(), tracer_.get());
-  // TODO(clchiou;chromium-os:36321): Use mouse acceleration algorithm for mice
-  temp = new AccelFilterInterpreter(prop_reg_.get(), temp, tracer_.get());
-  temp = new ScalingFilterInterpreter(prop_reg_.get(), temp, tracer_.get(),
-                                      GESTURES_DEVCLASS_MOUSE);
-  temp = new MetricsFilterInterpreter(prop_reg_.get(), temp, tracer_.get(),
-                                      GESTURES_DEVCLASS_MOUSE);
-  temp = new IntegralGestureFilterInterpreter(temp, tracer_.get());
-  temp = loggingFilter_ = new LoggingFilterInterpreter(prop_reg_.get(), temp,
-                                                       tracer_.get());
-  interpreter_.reset(temp);
-  temp = NULL;
+  loggingFilter_ = NewChain<MouseChain>(prop_reg_.get(), tracer_.get(),
+                                        GESTURES_DEVCLASS_MOUSE,
+                                        static_chain_->val_);
+  interpreter_.reset(loggingFilter_);
 }
 
 void GestureInterpreter::InitializeMultitouchMouse(void) {
-  Interpreter* temp = new MultitouchMouseInterpreter(prop_reg_.get(),
-                                                     tracer_.get());
-  temp = new FlingStopFilterInterpreter(prop_reg_.get(), temp, tracer_.get(),
-                                        GESTURES_DEVCLASS_MULTITOUCH_MOUSE);
-  temp = new ClickWiggleFilterInterpreter(prop_reg_.get(), temp, tracer_.get());
-  temp = new LookaheadFilterInterpreter(prop_reg_.get(), temp, tracer_.get());
-  temp = new BoxFilterInterpreter(prop_reg_.get(), temp, tracer_.get());
-  // TODO(clchiou;chromium-os:36321): Use mouse acceleration algorithm for mice
-  temp = new AccelFilterInterpreter(prop_reg_.get(), temp, tracer_.get());
-  temp = new ScalingFilterInterpreter(prop_reg_.get(), temp, tracer_.get(),
-                                      GESTURES_DEVCLASS_MULTITOUCH_MOUSE);
-  temp = new MetricsFilterInterpreter(prop_reg_.get(), temp, tracer_.get(),
-                                      GESTURES_DEVCLASS_MULTITOUCH_MOUSE);
-  temp = new IntegralGestureFilterInterpreter(temp, tracer_.get());
-  temp = new StuckButtonInhibitorFilterInterpreter(temp, tracer_.get());
-  temp = new NonLinearityFilterInterpreter(prop_reg_.get(), temp,
-                                           tracer_.get());
-  temp = loggingFilter_ = new LoggingFilterInterpreter(prop_reg_.get(), temp,
-                                                       tracer_.get());
-  interpreter_.reset(temp);
-  temp = NULL;
+  loggingFilter_ = NewChain<MultitouchMouseChain>(
+      prop_reg_.get(), tracer_.get(), GESTURES_DEVCLASS_MULTITOUCH_MOUSE,
+      static_chain_->val_);
+  interpreter_.reset(loggingFilter_);
 }
 
 void GestureInterpreter::Initialize(GestureInterpreterDeviceClass cls) {
@@ -645,6 +693,62 @@ std::string GestureInterpreter::EncodeActivityLog() {
   return loggingFilter_->EncodeActivityLog();
 }
 
+void GestureInterpreter::SetLatencyStatsEnabled(bool enabled) {
+  if (interpreter_)
+    interpreter_->SetLatencyStatsEnabled(enabled);
+}
+
+void GestureInterpreter::ClearLatencyStats() {
+  if (interpreter_)
+    interpreter_->ClearLatencyStats();
+}
+
+std::string GestureInterpreter::EncodeLatencyStats() {
+  Json::Value stats(Json::arrayValue);
+  if (interpreter_)
+    interpreter_->EncodeLatencyStats(&stats);
+  return stats.toStyledString();
+}
+
+std::string GestureInterpreter::SaveState() {
+  if (!interpreter_.get()) {
+    Err("Filters are not composed yet!");
+    return "";
+  }
+  StateWriter writer;
+  writer.BeginSection("GestureInterpreter");
+  writer.Write(timer_timeout_);
+  writer.EndSection();
+  interpreter_->SaveState(&writer);
+  return writer.blob();
+}
+
+bool GestureInterpreter::RestoreChainState(const std::string& state,
+                                           stime_t* timeout) {
+  StateReader reader(state.data(), state.size());
+  return reader.BeginSection("GestureInterpreter") && reader.Read(timeout) &&
+      reader.EndSection() && interpreter_->RestoreState(&reader) &&
+      reader.done();
+}
+
+bool GestureInterpreter::RestoreState(const std::string& state) {
+  if (!interpreter_.get()) {
+    Err("Filters are not composed yet!");
+    return false;
+  }
+  // Interpreters are restored in place, so a snapshot that turns out not to
+  // fit partway through is undone with one of the current state.
+  std::string current = SaveState();
+  stime_t timeout = -1.0;
+  if (!RestoreChainState(state, &timeout)) {
+    if (!RestoreChainState(current, &timeout))
+      Err("Can't put back the state of the chain");
+    return false;
+  }
+  SetTimer(timeout);
+  return true;
+}
+
 const GestureMove kGestureMove = { 0, 0, 0, 0 };
 const GestureScroll kGestureScroll = { 0, 0, 0, 0, 0 };
 const GestureButtonsChange kGestureButtonsChange = { 0, 0 };
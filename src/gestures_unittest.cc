@@ -2,9 +2,11 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <algorithm>
 #include <gtest/gtest.h>
 #include <memory>
 #include <stdio.h>
+#include <vector>
 
 #include "gestures/include/macros.h"
 #include "gestures/include/gestures.h"
@@ -340,4 +342,210 @@ TEST(GesturesTest, HardwareStateToStringTest) {
   return;
 }
 
+namespace {
+
+// A timer provider that remembers the one timer that was set, for tests to
+// fire by hand.
+struct FakeTimerProvider {
+  static GesturesTimer* Create(void* data) {
+    return reinterpret_cast<GesturesTimer*>(data);
+  }
+  static void Set(void* data, GesturesTimer* timer, stime_t delay,
+                  GesturesTimerCallback callback, void* callback_data) {
+    FakeTimerProvider* provider = static_cast<FakeTimerProvider*>(data);
+    provider->set_calls++;
+    provider->armed = true;
+    provider->delay = delay;
+    provider->callback = callback;
+    provider->callback_data = callback_data;
+  }
+  static void Cancel(void* data, GesturesTimer* timer) {
+    FakeTimerProvider* provider = static_cast<FakeTimerProvider*>(data);
+    provider->cancel_calls++;
+    provider->armed = false;
+  }
+  static void Free(void* data, GesturesTimer* timer) {}
+
+  // Fires the timer, and any it asks for after, while they're due by |now|.
+  // |set_time| is when the timer was set.
+  void FireUntil(stime_t set_time, stime_t now) {
+    stime_t due = set_time + delay;
+    while (armed && due <= now) {
+      armed = false;
+      stime_t next = callback(due, callback_data);
+      if (next > 0.0) {
+        armed = true;
+        delay = next;
+        due += next;
+      }
+    }
+  }
+
+  int set_calls = 0;
+  int cancel_calls = 0;
+  bool armed = false;
+  stime_t delay = 0.0;
+  GesturesTimerCallback callback = NULL;
+  void* callback_data = NULL;
+};
+
+GesturesTimerProvider kFakeTimerProvider = {
+  FakeTimerProvider::Create,
+  FakeTimerProvider::Set,
+  FakeTimerProvider::Cancel,
+  FakeTimerProvider::Free
+};
+
+void RecordGesture(void* client_data, const Gesture* gesture) {
+  static_cast<std::vector<Gesture>*>(client_data)->push_back(*gesture);
+}
+
+}  // namespace
+
+// Tests that pushing states in a batch gives the same gestures as pushing
+// them one at a time with the timer firing in between, and sets the timer
+// once.
+TEST(GesturesTest, PushHardwareStatesTest) {
+  HardwareProperties hwprops = {
+    0, 0, 100, 60,  // left, top, right, bottom
+    10, 10,  // res_x, res_y
+    133, 133,  // screen dpi x, y
+    -1, 2,  // orientation minimum, maximum
+    2, 5,  // max fingers, max touch
+    0, 0, 1,  // t5r2, semi-mt, is button pad
+    0, 0  // has wheel, wheel is hi res
+  };
+  // Filters modify fingers in place, so each run gets its own copy.
+  const FingerState kFingers[] = {
+    // TM, Tm, WM, Wm, Press, Orientation, X, Y, TrID, flags
+    { 0, 0, 0, 0, 50, 0, 50, 30, 1, 0 },
+    { 0, 0, 0, 0, 50, 0, 40, 20, 2, 0 },
+    { 0, 0, 0, 0, 50, 0, 60, 20, 3, 0 },
+    { 0, 0, 0, 0, 50, 0, 40, 30, 2, 0 },
+    { 0, 0, 0, 0, 50, 0, 60, 30, 3, 0 },
+    { 0, 0, 0, 0, 50, 0, 40, 40, 2, 0 },
+    { 0, 0, 0, 0, 50, 0, 60, 40, 3, 0 },
+  };
+  FingerState fs[arraysize(kFingers)];
+  HardwareState hs[] = {
+    // A tap, left to time out.
+    make_hwstate(100.00, 0, 1, 1, &fs[0]),
+    make_hwstate(100.01, 0, 1, 1, &fs[0]),
+    make_hwstate(100.02, 0, 0, 0, NULL),
+    // A two-finger scroll, then a fling.
+    make_hwstate(101.00, 0, 2, 2, &fs[1]),
+    make_hwstate(101.01, 0, 2, 2, &fs[3]),
+    make_hwstate(101.02, 0, 2, 2, &fs[5]),
+    make_hwstate(101.03, 0, 0, 0, NULL),
+    make_hwstate(101.50, 0, 0, 0, NULL),
+  };
+  const std::vector<HardwareState> kStates(hs, hs + arraysize(hs));
+
+  std::vector<Gesture> expected;
+  FakeTimerProvider single;
+  std::unique_ptr<GestureInterpreter> gi(NewGestureInterpreter());
+  gi->Initialize(GESTURES_DEVCLASS_TOUCHPAD);
+  gi->SetHardwareProperties(hwprops);
+  gi->set_callback(RecordGesture, &expected);
+  gi->SetTimerProvider(&kFakeTimerProvider, &single);
+  std::copy(kFingers, kFingers + arraysize(kFingers), fs);
+  for (size_t i = 0; i < arraysize(hs); i++) {
+    if (i > 0)
+      single.FireUntil(kStates[i - 1].timestamp, kStates[i].timestamp);
+    gi->PushHardwareState(&hs[i]);
+  }
+  EXPECT_EQ(arraysize(hs),
+            static_cast<size_t>(single.set_calls + single.cancel_calls));
+
+  std::vector<Gesture> actual;
+  FakeTimerProvider batch;
+  gi.reset(NewGestureInterpreter());
+  gi->Initialize(GESTURES_DEVCLASS_TOUCHPAD);
+  gi->SetHardwareProperties(hwprops);
+  gi->set_callback(RecordGesture, &actual);
+  gi->SetTimerProvider(&kFakeTimerProvider, &batch);
+  std::copy(kFingers, kFingers + arraysize(kFingers), fs);
+  std::copy(kStates.begin(), kStates.end(), hs);
+  GestureInterpreterPushHardwareStates(gi.get(), hs, arraysize(hs));
+  EXPECT_EQ(1, batch.set_calls + batch.cancel_calls);
+  EXPECT_EQ(single.armed, batch.armed);
+
+  EXPECT_FALSE(expected.empty());
+  ASSERT_EQ(expected.size(), actual.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    EXPECT_TRUE(expected[i] == actual[i])
+        << expected[i].String() << " vs. " << actual[i].String();
+    EXPECT_EQ(expected[i].start_time, actual[i].start_time);
+  }
+}
+
+// Tests that a chain restored while its timer is pending sets the timer
+// again and gives the same gestures as the original when it fires, and that
+// a snapshot that doesn't fit leaves the chain and its timer as they were.
+TEST(GesturesTest, RestoreStateTimerTest) {
+  HardwareProperties hwprops = {
+    0, 0, 100, 60,  // left, top, right, bottom
+    10, 10,  // res_x, res_y
+    133, 133,  // screen dpi x, y
+    -1, 2,  // orientation minimum, maximum
+    2, 5,  // max fingers, max touch
+    0, 0, 1,  // t5r2, semi-mt, is button pad
+    0, 0  // has wheel, wheel is hi res
+  };
+  FingerState fs[] = {
+    // TM, Tm, WM, Wm, Press, Orientation, X, Y, TrID, flags
+    { 0, 0, 0, 0, 50, 0, 50, 30, 1, 0 },
+    { 0, 0, 0, 0, 50, 0, 50, 30, 1, 0 },
+  };
+  HardwareState hs[] = {
+    make_hwstate(100.00, 0, 1, 1, &fs[0]),
+    make_hwstate(100.01, 0, 1, 1, &fs[1]),
+    make_hwstate(100.02, 0, 0, 0, NULL),
+  };
+
+  std::vector<Gesture> expected;
+  FakeTimerProvider original_timer;
+  std::unique_ptr<GestureInterpreter> original(NewGestureInterpreter());
+  original->Initialize(GESTURES_DEVCLASS_TOUCHPAD);
+  original->SetHardwareProperties(hwprops);
+  original->set_callback(RecordGesture, &expected);
+  original->SetTimerProvider(&kFakeTimerProvider, &original_timer);
+  for (size_t i = 0; i < arraysize(hs); i++)
+    original->PushHardwareState(&hs[i]);
+  ASSERT_TRUE(original_timer.armed);
+  std::string state = original->SaveState();
+
+  std::vector<Gesture> actual;
+  FakeTimerProvider restored_timer;
+  std::unique_ptr<GestureInterpreter> restored(NewGestureInterpreter());
+  restored->Initialize(GESTURES_DEVCLASS_TOUCHPAD);
+  restored->SetHardwareProperties(hwprops);
+  restored->set_callback(RecordGesture, &actual);
+  restored->SetTimerProvider(&kFakeTimerProvider, &restored_timer);
+  ASSERT_TRUE(restored->RestoreState(state));
+  EXPECT_TRUE(restored_timer.armed);
+  EXPECT_EQ(original_timer.delay, restored_timer.delay);
+  EXPECT_EQ(state, restored->SaveState());
+
+  // Cut short, so it only fails once the whole chain has been read.
+  int set_calls = restored_timer.set_calls;
+  int cancel_calls = restored_timer.cancel_calls;
+  EXPECT_FALSE(restored->RestoreState(state.substr(0, state.size() - 1)));
+  EXPECT_EQ(state, restored->SaveState());
+  EXPECT_TRUE(restored_timer.armed);
+  EXPECT_EQ(set_calls, restored_timer.set_calls);
+  EXPECT_EQ(cancel_calls, restored_timer.cancel_calls);
+
+  expected.clear();
+  original_timer.FireUntil(100.02, 101.0);
+  restored_timer.FireUntil(100.02, 101.0);
+  ASSERT_FALSE(expected.empty());
+  ASSERT_EQ(expected.size(), actual.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    EXPECT_TRUE(expected[i] == actual[i])
+        << expected[i].String() << " vs. " << actual[i].String();
+    EXPECT_EQ(expected[i].start_time, actual[i].start_time);
+  }
+}
+
 }  // namespace gestures
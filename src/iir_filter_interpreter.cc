@@ -4,26 +4,42 @@
 
 #include "gestures/include/iir_filter_interpreter.h"
 
-#include <utility>
+#include <string.h>
+
+#include <algorithm>
+
+#include "gestures/include/interpreter_state.h"
+#include "gestures/include/macros.h"
 
 namespace gestures {
 
-void IirFilterInterpreter::IoHistory::Increment() {
-  out_head = NextOutHead();
-  in_head = NextInHead();
+size_t IirFilterInterpreter::Histories::Find(short id) const {
+  for (size_t i = 0; i < size; i++)
+    if (tracking_id[i] == id)
+      return i;
+  return size;
+}
+
+void IirFilterInterpreter::Histories::CopyColumn(const Histories& that,
+                                                 size_t from, size_t to) {
+  tracking_id[to] = that.tracking_id[from];
+  for (size_t f = 0; f < kNumFields; f++) {
+    FingerIirHistory* history = &fields[f];
+    const FingerIirHistory& that_history = that.fields[f];
+    for (size_t i = 0; i < arraysize(history->in); i++)
+      history->in[i][to] = that_history.in[i][from];
+    for (size_t i = 0; i < arraysize(history->out); i++)
+      history->out[i][to] = that_history.out[i][from];
+  }
 }
 
-// Uses exact comparisions, rather than approximate float comparisions,
-// for operator==
-bool IirFilterInterpreter::IoHistory::operator==(
-    const IirFilterInterpreter::IoHistory& that) const {
-  for (size_t i = 0; i < kInSize; i++)
-    if (in[i] != that.in[i])
-      return false;
-  for (size_t i = 0; i < kOutSize; i++)
-    if (out[i] != that.out[i])
-      return false;
-  return true;
+void IirFilterInterpreter::Histories::FillColumn(size_t to, Field field,
+                                                 float value) {
+  FingerIirHistory* history = &fields[field];
+  for (size_t i = 0; i < arraysize(history->in); i++)
+    history->in[i][to] = value;
+  for (size_t i = 0; i < arraysize(history->out); i++)
+    history->out[i][to] = value;
 }
 
 // The default filter is a low-pass 2nd order Butterworth IIR filter with a
@@ -40,50 +56,89 @@ IirFilterInterpreter::IirFilterInterpreter(PropRegistry* prop_reg,
       a2_(prop_reg, "IIR a2", 0.412801598096189, this),
       iir_dist_thresh_(prop_reg, "IIR Distance Threshold", 10, this),
       adjust_iir_on_warp_(prop_reg, "Adjust IIR History On Warp", 0),
-      using_iir_(true) {
+      using_iir_(true),
+      last_(0) {
   InitName();
+  // The kernel runs over the padding columns too, so they start out zero.
+  memset(histories_, 0, sizeof(histories_));
 }
 
 void IirFilterInterpreter::SyncInterpretImpl(HardwareState* hwstate,
                                              stime_t* timeout) {
-  // Delete old entries from map
-  short dead_ids[histories_.size()];
-  size_t dead_ids_len = 0;
-  for (map<short, IoHistory, kMaxFingers>::iterator it = histories_.begin(),
-           e = histories_.end(); it != e; ++it)
-    if (!hwstate->GetFingerState((*it).first))
-      dead_ids[dead_ids_len++] = (*it).first;
-  for (size_t i = 0; i < dead_ids_len; ++i)
-    histories_.erase(dead_ids[i]);
-
-  // Modify current hwstate
-  for (size_t i = 0; i < hwstate->finger_cnt; i++) {
-    FingerState* fs = &hwstate->fingers[i];
-    map<short, IoHistory, kMaxFingers>::iterator history =
-        histories_.find(fs->tracking_id);
-    if (history == histories_.end()) {
-      // new finger
-      IoHistory hist(*fs);
-      histories_[fs->tracking_id] = hist;
+  FingerArrays fingers;
+  fingers.Load(hwstate->fingers,
+               std::min<size_t>(hwstate->finger_cnt, FingerArrays::kCapacity));
+  // Fingers usually come in the order they did last time, and their
+  // histories are filtered where they are. Otherwise, the histories are
+  // rearranged into the other buffer.
+  const Histories& last = histories_[last_];
+  size_t prev[FingerArrays::kCapacity];
+  bool in_place = true;
+  for (size_t i = 0; i < fingers.size; i++) {
+    prev[i] = last.Find(fingers.tracking_id[i]);
+    in_place = in_place && (prev[i] == i || prev[i] == last.size);
+  }
+  if (!in_place)
+    last_ = !last_;
+  Histories* histories = &histories_[last_];
+  float* values[kNumFields] = {
+    fingers.position_x, fingers.position_y, fingers.pressure
+  };
+  // Which fingers are filtered, rather than averaged, and which fields of
+  // which fingers are passed through.
+  alignas(16) uint32_t iir[FingerArrays::kCapacity];
+  alignas(16) uint32_t pass[kNumFields][FingerArrays::kCapacity];
+  // Keep the current pressure readings, so we could make sure the pressure
+  // values will be same if there is two fingers on a SemiMT device.
+  uint32_t pass_pressure = hwprops_ && hwprops_->support_semi_mt ? ~0u : 0;
+
+  for (size_t i = 0; i < fingers.padded_size(); i++) {
+    if (i >= fingers.size || prev[i] == last.size) {
+      // New finger, which starts its history, or padding.
+      if (i < fingers.size) {
+        histories->tracking_id[i] = fingers.tracking_id[i];
+        for (size_t f = 0; f < kNumFields; f++)
+          histories->FillColumn(i, static_cast<Field>(f), values[f][i]);
+      }
+      for (size_t f = 0; f < kNumFields; f++)
+        pass[f][i] = ~0u;
+      iir[i] = 0;
       continue;
     }
     // existing finger, apply filter
-    IoHistory* hist = &(*history).second;
-
-    // Finger WARP detected, adjust the IO history
+    if (!in_place)
+      histories->CopyColumn(last, prev[i], i);
+    FingerIirHistory* x = &histories->fields[kFieldX];
+    FingerIirHistory* y = &histories->fields[kFieldY];
+    pass[kFieldX][i] = pass[kFieldY][i] = 0;
+    pass[kFieldPressure][i] = pass_pressure;
+
+    // Finger WARP detected, adjust the IO history, and pass the warped
+    // position through.
     if (adjust_iir_on_warp_.val_) {
       float dx = 0.0, dy = 0.0;
 
-      if (fs->flags & GESTURES_FINGER_WARP_X_MOVE)
-        dx = fs->position_x - hist->PrevIn(0)->position_x;
-      if (fs->flags & GESTURES_FINGER_WARP_Y_MOVE)
-        dy = fs->position_y - hist->PrevIn(0)->position_y;
+      if (fingers.flags[i] & GESTURES_FINGER_WARP_X_MOVE) {
+        dx = values[kFieldX][i] - x->in[0][i];
+        pass[kFieldX][i] = ~0u;
+      }
+      if (fingers.flags[i] & GESTURES_FINGER_WARP_Y_MOVE) {
+        dy = values[kFieldY][i] - y->in[0][i];
+        pass[kFieldY][i] = ~0u;
+      }
 
-      hist->WarpBy(dx, dy);
+      for (size_t j = 0; j < arraysize(x->in); j++) {
+        x->in[j][i] += dx;
+        y->in[j][i] += dy;
+      }
+      for (size_t j = 0; j < arraysize(x->out); j++) {
+        x->out[j][i] += dx;
+        y->out[j][i] += dy;
+      }
     }
 
-    float dx = fs->position_x - hist->PrevOut(0)->position_x;
-    float dy = fs->position_y - hist->PrevOut(0)->position_y;
+    float dx = values[kFieldX][i] - x->out[0][i];
+    float dy = values[kFieldY][i] - y->out[0][i];
 
     // IIR filter is too smooth for a quick finger movement. We do a simple
     // rolling average if the position change between current and previous
@@ -92,76 +147,62 @@ void IirFilterInterpreter::SyncInterpretImpl(HardwareState* hwstate,
       using_iir_ = false;
     else
       using_iir_ = true;
-
-    // TODO(adlr): consider applying filter to other fields
-    float FingerState::*fields[] = { &FingerState::position_x,
-                                     &FingerState::position_y,
-                                     &FingerState::pressure };
-    for (size_t f_idx = 0; f_idx < arraysize(fields); f_idx++) {
-      float FingerState::*field = fields[f_idx];
-      // Keep the current pressure reading, so we could make sure the pressure
-      // values will be same if there is two fingers on a SemiMT device.
-      if (hwprops_ && hwprops_->support_semi_mt &&
-          (field == &FingerState::pressure)) {
-        hist->NextOut()->pressure = fs->pressure;
-        continue;
-      }
-
-      if (adjust_iir_on_warp_.val_) {
-        if (field == &FingerState::position_x &&
-            (fs->flags & GESTURES_FINGER_WARP_X_MOVE)) {
-          hist->NextOut()->position_x = fs->position_x;
-          continue;
-        }
-
-        if (field == &FingerState::position_y &&
-            (fs->flags & GESTURES_FINGER_WARP_Y_MOVE)) {
-          hist->NextOut()->position_y = fs->position_y;
-          continue;
-        }
-      }
-
-      if (using_iir_) {
-        hist->NextOut()->*field =
-            b3_.val_ * hist->PrevIn(2)->*field +
-            b2_.val_ * hist->PrevIn(1)->*field +
-            b1_.val_ * hist->PrevIn(0)->*field +
-            b0_.val_ * fs->*field -
-            a2_.val_ * hist->PrevOut(1)->*field -
-            a1_.val_ * hist->PrevOut(0)->*field;
-      } else {
-        hist->NextOut()->*field = 0.5 * (fs->*field + hist->PrevOut(0)->*field);
-      }
-    }
-    float FingerState::*pass_fields[] = { &FingerState::touch_major,
-                                          &FingerState::touch_minor,
-                                          &FingerState::width_major,
-                                          &FingerState::width_minor,
-                                          &FingerState::orientation };
-    for (size_t f_idx = 0; f_idx < arraysize(pass_fields); f_idx++)
-      hist->NextOut()->*pass_fields[f_idx] = fs->*pass_fields[f_idx];
-    hist->NextOut()->flags = fs->flags;
-    *hist->NextIn() = *fs;
-    *fs = *hist->NextOut();
-    hist->Increment();
+    iir[i] = using_iir_ ? ~0u : 0;
   }
+
+  // TODO(adlr): consider applying filter to other fields
+  FingerIirCoefficients coeffs = {
+    b0_.val_, b1_.val_, b2_.val_, b3_.val_, a1_.val_, a2_.val_
+  };
+  for (size_t f = 0; f < kNumFields; f++)
+    FingerArraysIir(values[f], &histories->fields[f], coeffs, iir, pass[f],
+                    fingers.padded_size());
+  histories->size = fingers.size;
+  fingers.Store(hwstate->fingers);
   next_->SyncInterpret(hwstate, timeout);
 }
 
 void IirFilterInterpreter::DoubleWasWritten(DoubleProperty* prop) {
-  histories_.clear();
+  histories_[last_].size = 0;
 }
 
-void IirFilterInterpreter::IoHistory::WarpBy(float dx, float dy) {
-  for (size_t i = 0; i < kInSize; i++) {
-    PrevIn(i)->position_x += dx;
-    PrevIn(i)->position_y += dy;
+void IirFilterInterpreter::SaveOwnState(StateWriter* writer) const {
+  const Histories& last = histories_[last_];
+  writer->Write(static_cast<uint32_t>(last.size));
+  for (size_t i = 0; i < last.size; i++) {
+    writer->Write(last.tracking_id[i]);
+    for (size_t f = 0; f < kNumFields; f++) {
+      const FingerIirHistory& history = last.fields[f];
+      for (size_t j = 0; j < arraysize(history.in); j++)
+        writer->Write(history.in[j][i]);
+      for (size_t j = 0; j < arraysize(history.out); j++)
+        writer->Write(history.out[j][i]);
+    }
   }
+}
 
-  for (size_t i = 0; i < kOutSize; i++) {
-    PrevOut(i)->position_x += dx;
-    PrevOut(i)->position_y += dy;
+void IirFilterInterpreter::RestoreOwnState(StateReader* reader) {
+  Histories* last = &histories_[last_];
+  uint32_t size = 0;
+  last->size = 0;
+  if (!reader->Read(&size))
+    return;
+  if (size > FingerArrays::kCapacity) {
+    reader->Fail("too many fingers");
+    return;
+  }
+  for (size_t i = 0; i < size; i++) {
+    reader->Read(&last->tracking_id[i]);
+    for (size_t f = 0; f < kNumFields; f++) {
+      FingerIirHistory* history = &last->fields[f];
+      for (size_t j = 0; j < arraysize(history->in); j++)
+        reader->Read(&history->in[j][i]);
+      for (size_t j = 0; j < arraysize(history->out); j++)
+        reader->Read(&history->out[j][i]);
+    }
   }
+  if (reader->ok())
+    last->size = size;
 }
 
 }  // namespace gestures
@@ -2,8 +2,15 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <math.h>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
 #include <gtest/gtest.h>
 
+#include "gestures/include/finger_arrays.h"
 #include "gestures/include/gestures.h"
 #include "gestures/include/iir_filter_interpreter.h"
 #include "gestures/include/unittest_util.h"
@@ -156,4 +163,185 @@ TEST(IirFilterInterpreterTest, SemiMTIIRTest) {
   EXPECT_EQ(fs_semi_mt[n - 1].pressure, kTestPressure);
 }
 
+namespace {
+
+// Keeps the fingers of the last hardware state it's given.
+class IirFilterInterpreterRecorder : public Interpreter {
+ public:
+  IirFilterInterpreterRecorder() : Interpreter(NULL, NULL, false) {}
+
+  virtual void SyncInterpret(HardwareState* hwstate, stime_t* timeout) {
+    fingers_.assign(hwstate->fingers, hwstate->fingers + hwstate->finger_cnt);
+  }
+
+  virtual void HandleTimer(stime_t now, stime_t* timeout) {}
+
+  std::vector<FingerState> fingers_;
+};
+
+// The filter as IirFilterInterpreter first ran it, one finger at a time,
+// with histories of whole FingerStates, to check the interpreter against.
+class ReferenceIirFilter {
+ public:
+  ReferenceIirFilter(const FingerIirCoefficients& coeffs, double dist_thresh,
+                     bool adjust_on_warp, bool semi_mt)
+      : c_(coeffs), dist_thresh_(dist_thresh),
+        adjust_on_warp_(adjust_on_warp), semi_mt_(semi_mt) {}
+
+  void Filter(HardwareState* hwstate) {
+    std::map<short, History> histories;
+    for (size_t i = 0; i < hwstate->finger_cnt; i++) {
+      FingerState* fs = &hwstate->fingers[i];
+      std::map<short, History>::iterator it = histories_.find(fs->tracking_id);
+      if (it == histories_.end()) {
+        History hist;
+        for (size_t j = 0; j < 3; j++)
+          hist.in[j] = *fs;
+        for (size_t j = 0; j < 2; j++)
+          hist.out[j] = *fs;
+        histories[fs->tracking_id] = hist;
+        continue;
+      }
+      History hist = it->second;
+      bool warp_x = false, warp_y = false;
+      if (adjust_on_warp_) {
+        float dx = 0.0, dy = 0.0;
+        warp_x = fs->flags & GESTURES_FINGER_WARP_X_MOVE;
+        warp_y = fs->flags & GESTURES_FINGER_WARP_Y_MOVE;
+        if (warp_x)
+          dx = fs->position_x - hist.in[0].position_x;
+        if (warp_y)
+          dy = fs->position_y - hist.in[0].position_y;
+        for (size_t j = 0; j < 3; j++) {
+          hist.in[j].position_x += dx;
+          hist.in[j].position_y += dy;
+        }
+        for (size_t j = 0; j < 2; j++) {
+          hist.out[j].position_x += dx;
+          hist.out[j].position_y += dy;
+        }
+      }
+      float dx = fs->position_x - hist.out[0].position_x;
+      float dy = fs->position_y - hist.out[0].position_y;
+      bool use_iir = dx * dx + dy * dy <= dist_thresh_ * dist_thresh_;
+      FingerState out = *fs;
+      float FingerState::*fields[] = { &FingerState::position_x,
+                                       &FingerState::position_y,
+                                       &FingerState::pressure };
+      for (size_t f = 0; f < arraysize(fields); f++) {
+        float FingerState::*field = fields[f];
+        if ((f == 0 && warp_x) || (f == 1 && warp_y) || (f == 2 && semi_mt_))
+          continue;
+        if (use_iir)
+          out.*field = c_.b3 * hist.in[2].*field + c_.b2 * hist.in[1].*field +
+              c_.b1 * hist.in[0].*field + c_.b0 * fs->*field -
+              c_.a2 * hist.out[1].*field - c_.a1 * hist.out[0].*field;
+        else
+          out.*field = 0.5 * (fs->*field + hist.out[0].*field);
+      }
+      hist.in[2] = hist.in[1];
+      hist.in[1] = hist.in[0];
+      hist.in[0] = *fs;
+      hist.out[1] = hist.out[0];
+      hist.out[0] = out;
+      histories[fs->tracking_id] = hist;
+      *fs = out;
+    }
+    histories_.swap(histories);
+  }
+
+ private:
+  // Newest first.
+  struct History {
+    FingerState in[3];
+    FingerState out[2];
+  };
+
+  FingerIirCoefficients c_;
+  double dist_thresh_;
+  bool adjust_on_warp_;
+  bool semi_mt_;
+  std::map<short, History> histories_;
+};
+
+}  // namespace
+
+// Fingers come, go and change order, in lane groups of all sizes, and must
+// come out of the interpreter as they would have one at a time.
+TEST(IirFilterInterpreterTest, ManyFingersTest) {
+  HardwareProperties hwprops = {
+    0, 0, 100, 60,  // left, top, right, bottom
+    1.0, 1.0, 25.4, 25.4, // x res, y res, x DPI, y DPI
+    -1,  // orientation minimum
+    2,   // orientation maximum
+    7, 7, 0, 0, 0,  // max_fingers, max_touch, t5r2, semi_mt, is_button_pad
+    0, 0,  // has wheel, vertical wheel is high resolution
+  };
+  const size_t kMaxTestFingers = 7;
+  for (int semi_mt = 0; semi_mt <= 1; semi_mt++) {
+    for (int adjust = 0; adjust <= 1; adjust++) {
+      SCOPED_TRACE(testing::Message() << "semi_mt " << semi_mt << ", adjust "
+                   << adjust);
+      hwprops.support_semi_mt = semi_mt;
+      IirFilterInterpreterRecorder* recorder =
+          new IirFilterInterpreterRecorder;
+      IirFilterInterpreter interpreter(NULL, recorder, NULL);
+      interpreter.adjust_iir_on_warp_.val_ = adjust;
+      interpreter.b3_.val_ = 0.01;
+      TestInterpreterWrapper wrapper(&interpreter, &hwprops);
+      FingerIirCoefficients coeffs = {
+        interpreter.b0_.val_, interpreter.b1_.val_, interpreter.b2_.val_,
+        interpreter.b3_.val_, interpreter.a1_.val_, interpreter.a2_.val_
+      };
+      ReferenceIirFilter reference(coeffs, interpreter.iir_dist_thresh_.val_,
+                                   adjust, semi_mt);
+
+      for (size_t frame = 0; frame < 120; frame++) {
+        // Finger |id| is down from frame 3 * id for 60 frames, in order of
+        // id on even frames, reversed on odd ones.
+        FingerState fs[kMaxTestFingers];
+        unsigned short finger_cnt = 0;
+        for (size_t id = 0; id < kMaxTestFingers; id++) {
+          if (frame < 3 * id || frame >= 3 * id + 60)
+            continue;
+          float t = frame * 0.1f + id;
+          FingerState finger = {
+            10.0f + id, 9.0f + id, 8.0f, 7.0f,  // touch and width
+            30.0f + 5.0f * sinf(t), 0.1f * id,  // pressure, orientation
+            20.0f + 8.0f * t + 3.0f * sinf(3.0f * t),
+            15.0f + 4.0f * cosf(t), static_cast<short>(id + 1), 0
+          };
+          // Now and then, a jump too far for the IIR filter, or a warp.
+          if (frame % 17 == id)
+            finger.position_x += 25.0f;
+          if (frame % 11 == id)
+            finger.flags |= GESTURES_FINGER_WARP_X_MOVE;
+          if (frame % 13 == id)
+            finger.flags |= GESTURES_FINGER_WARP_Y_MOVE;
+          fs[finger_cnt++] = finger;
+        }
+        if (frame % 2)
+          std::reverse(fs, fs + finger_cnt);
+        FingerState expected[kMaxTestFingers];
+        std::copy(fs, fs + finger_cnt, expected);
+        HardwareState hs = make_hwstate(0.01 * frame, 0, finger_cnt,
+                                        finger_cnt, fs);
+        HardwareState expected_hs = make_hwstate(0.01 * frame, 0, finger_cnt,
+                                                 finger_cnt, expected);
+        reference.Filter(&expected_hs);
+        wrapper.SyncInterpret(&hs, NULL);
+        ASSERT_EQ(finger_cnt, recorder->fingers_.size()) << frame;
+        for (size_t i = 0; i < finger_cnt; i++)
+          EXPECT_TRUE(expected[i] == recorder->fingers_[i])
+              << "frame " << frame << ", finger " << i << ": "
+              << expected[i].position_x << " " << expected[i].position_y
+              << " " << expected[i].pressure << " vs. "
+              << recorder->fingers_[i].position_x << " "
+              << recorder->fingers_[i].position_y << " "
+              << recorder->fingers_[i].pressure;
+      }
+    }
+  }
+}
+
 }  // namespace gestures
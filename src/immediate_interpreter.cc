@@ -13,6 +13,7 @@
 #include <tuple>
 
 #include "gestures/include/gestures.h"
+#include "gestures/include/interpreter_state.h"
 #include "gestures/include/logging.h"
 #include "gestures/include/util.h"
 
@@ -165,6 +166,28 @@ void TapRecord::Clear() {
   released_.clear();
 }
 
+void TapRecord::SaveState(StateWriter* writer) const {
+  writer->Write(touched_);
+  writer->Write(released_);
+  writer->Write(min_tap_pressure_met_);
+  writer->Write(min_cotap_pressure_met_);
+  writer->Write(t5r2_);
+  writer->Write(t5r2_touched_size_);
+  writer->Write(t5r2_released_size_);
+  writer->Write(fingers_below_max_age_);
+}
+
+void TapRecord::RestoreState(StateReader* reader) {
+  reader->Read(&touched_);
+  reader->Read(&released_);
+  reader->Read(&min_tap_pressure_met_);
+  reader->Read(&min_cotap_pressure_met_);
+  reader->Read(&t5r2_);
+  reader->Read(&t5r2_touched_size_);
+  reader->Read(&t5r2_released_size_);
+  reader->Read(&fingers_below_max_age_);
+}
+
 bool TapRecord::Moving(const HardwareState& hwstate,
                        const float dist_max) const {
   const float cotap_min_pressure = CotapMinPressure();
@@ -280,6 +303,30 @@ void ScrollEventBuffer::Clear() {
   size_ = 0;
 }
 
+void ScrollEventBuffer::SaveState(StateWriter* writer) const {
+  writer->Write(static_cast<uint32_t>(size_));
+  for (size_t i = size_; i-- > 0;)
+    writer->Write(Get(i));
+}
+
+void ScrollEventBuffer::RestoreState(StateReader* reader) {
+  Clear();
+  uint32_t size = 0;
+  if (!reader->Read(&size))
+    return;
+  if (size > max_size_) {
+    reader->Fail("too many scroll events");
+    return;
+  }
+  // Oldest first, as they were inserted.
+  for (uint32_t i = 0; i < size; i++) {
+    ScrollEvent evt;
+    if (!reader->Read(&evt))
+      return;
+    Insert(evt.dx, evt.dy, evt.dt);
+  }
+}
+
 const ScrollEvent& ScrollEventBuffer::Get(size_t offset) const {
   if (offset >= size_) {
     Err("Out of bounds access!");
@@ -344,6 +391,16 @@ void HardwareStateBuffer::PopState() {
   newest_index_ = (newest_index_ + 1) % size_;
 }
 
+void HardwareStateBuffer::SaveState(StateWriter* writer) const {
+  for (size_t i = 0; i < size_; i++)
+    writer->Write(*Get(i));
+}
+
+void HardwareStateBuffer::RestoreState(StateReader* reader) {
+  for (size_t i = 0; i < size_; i++)
+    reader->Read(Get(i), max_finger_cnt_);
+}
+
 ScrollManager::ScrollManager(PropRegistry* prop_reg)
     : prev_result_suppress_finger_movement_(false),
       did_generate_scroll_(false),
@@ -374,6 +431,18 @@ ScrollManager::ScrollManager(PropRegistry* prop_reg)
                                   10.0) {
 }
 
+void ScrollManager::SaveState(StateWriter* writer) const {
+  writer->Write(prev_result_suppress_finger_movement_);
+  writer->Write(did_generate_scroll_);
+  writer->Write(stationary_start_positions_);
+}
+
+void ScrollManager::RestoreState(StateReader* reader) {
+  reader->Read(&prev_result_suppress_finger_movement_);
+  reader->Read(&did_generate_scroll_);
+  reader->Read(&stationary_start_positions_);
+}
+
 bool ScrollManager::StationaryFingerPressureChangingSignificantly(
     const HardwareStateBuffer& state_buffer,
     const FingerState& current) const {
@@ -981,11 +1050,13 @@ int FingerButtonClick::EvaluateButtonTypeUsingFigureLocation() {
 ImmediateInterpreter::ImmediateInterpreter(PropRegistry* prop_reg,
                                            Tracer* tracer)
     : Interpreter(NULL, tracer, false),
+      tap_dead_fingers_(&finger_slots_),
       button_type_(0),
       finger_button_click_(this),
       sent_button_down_(false),
       button_down_timeout_(0.0),
       started_moving_time_(-1.0),
+      moving_(&finger_slots_),
       gs_changed_time_(-1.0),
       finger_leave_time_(-1.0),
       moving_finger_id_(-1),
@@ -995,6 +1066,9 @@ ImmediateInterpreter::ImmediateInterpreter(PropRegistry* prop_reg,
       last_movement_timestamp_(-1.0),
       swipe_is_vertical_(false),
       current_gesture_type_(kGestureTypeNull),
+      prev_gesture_type_(kGestureTypeNull),
+      gesture_type_hits_(0),
+      gesture_type_misses_(0),
       state_buffer_(8),
       scroll_buffer_(20),
       pinch_guess_start_(-1.0),
@@ -1146,6 +1220,7 @@ void ImmediateInterpreter::SyncInterpretImpl(HardwareState* hwstate,
   }
 
   state_buffer_.PushState(*hwstate);
+  finger_slots_.Update(*hwstate);
 
   FillOriginInfo(*hwstate);
   result_.type = kGestureTypeNull;
@@ -1213,6 +1288,22 @@ void ImmediateInterpreter::SyncInterpretImpl(HardwareState* hwstate,
   }
 }
 
+void ImmediateInterpreter::ClearLatencyStats() {
+  Interpreter::ClearLatencyStats();
+  gesture_type_hits_ = 0;
+  gesture_type_misses_ = 0;
+}
+
+void ImmediateInterpreter::EncodeLatencyStats(Json::Value* out) {
+  Interpreter::EncodeLatencyStats(out);
+  Json::Value memo(Json::objectValue);
+  memo[ActivityLog::kKeyMemoHits] =
+      Json::Value(static_cast<Json::UInt>(gesture_type_hits_));
+  memo[ActivityLog::kKeyMemoMisses] =
+      Json::Value(static_cast<Json::UInt>(gesture_type_misses_));
+  (*out)[out->size() - 1][ActivityLog::kKeyGestureTypeMemo] = memo;
+}
+
 void ImmediateInterpreter::HandleTimerImpl(stime_t now, stime_t* timeout) {
   result_.type = kGestureTypeNull;
   // Tap-to-click always aborts when real button(s) are being used, so we
@@ -1778,10 +1869,18 @@ void ImmediateInterpreter::UpdateCurrentGestureType(
         else
           current_gesture_type_ = kGestureTypeMove;
       } else {
-        if (changed_time_ > started_moving_time_ ||
+        // Once the gesturing fingers have been the same, and moving, for
+        // evaluation_timeout_, the gesture type is settled: keep it rather
+        // than running the classifier again.
+        bool reclassify =
+            changed_time_ > started_moving_time_ ||
             hwstate.timestamp - max(started_moving_time_, gs_changed_time_) <
             evaluation_timeout_.val_ ||
-            current_gesture_type_ == kGestureTypeNull) {
+            current_gesture_type_ == kGestureTypeNull;
+        if (!reclassify) {
+          gesture_type_hits_++;
+        } else {
+          gesture_type_misses_++;
           // Try to recognize gestures, starting from many-finger gestures
           // first. We choose this order b/c 3-finger gestures are very strict
           // in their interpretation.
@@ -1944,14 +2043,23 @@ void ImmediateInterpreter::SortFingersByProximity(
       (finger_ids.size() * (finger_ids.size() - 1)) / 2;
   DistSqElt dist_sq[dist_sq_capacity];
   size_t dist_sq_len = 0;
+  // Look each finger up in |finger_ids| once, rather than once per pair.
+  const FingerState* members[kMaxGesturingFingers];
+  size_t members_len = 0;
   for (size_t i = 0; i < hwstate.finger_cnt; i++) {
-    const FingerState& fs1 = hwstate.fingers[i];
-    if (!SetContainsValue(finger_ids, fs1.tracking_id))
+    const FingerState& fs = hwstate.fingers[i];
+    if (!SetContainsValue(finger_ids, fs.tracking_id))
       continue;
-    for (size_t j = i + 1; j < hwstate.finger_cnt; j++) {
-      const FingerState& fs2 = hwstate.fingers[j];
-      if (!SetContainsValue(finger_ids, fs2.tracking_id))
-        continue;
+    if (members_len == arraysize(members)) {
+      Err("%s: Array overrun", __func__);
+      break;
+    }
+    members[members_len++] = &fs;
+  }
+  for (size_t i = 0; i < members_len; i++) {
+    const FingerState& fs1 = *members[i];
+    for (size_t j = i + 1; j < members_len; j++) {
+      const FingerState& fs2 = *members[j];
       DistSqElt elt = {
         DistSq(fs1, fs2),
         { fs1.tracking_id, fs2.tracking_id }
@@ -2528,6 +2636,178 @@ void ImmediateInterpreter::SetTapToClickState(TapToClickState state,
   }
 }
 
+// Predicates, effects, and transitions correspond to the diagram in
+// UpdateTapState(). Within a state, the first matching transition is taken.
+const ImmediateInterpreter::TapTransition
+ImmediateInterpreter::kTapTransitions[] = {
+  // state, required, forbidden, effects, next, name
+  // Only the frames added to the record count, as its earlier contents are
+  // cleared along with the first of them.
+  { kTtcIdle, kTapHwState | kTapMotionAllowed | kTapBegan, 0, 0,
+    kTtcFirstTapBegan, "Tap began" },
+  { kTtcIdle, 0, 0, 0, kTtcIdle, "No tap" },
+
+  { kTtcFirstTapBegan, kTapTimeout, 0, 0, kTtcIdle, "Tap timed out" },
+  { kTtcFirstTapBegan, 0, kTapHwState, 0, kTtcFirstTapBegan,
+    "No hardware state but no timeout" },
+  { kTtcFirstTapBegan, kTapComplete, kTapPressureMet, 0, kTtcIdle,
+    "Tap too light" },
+  { kTtcFirstTapBegan, kTapComplete, kTapFingersYoung, 0, kTtcIdle,
+    "Tap fingers too old" },
+  { kTtcFirstTapBegan, kTapComplete | kTapLeft | kTapDragEnabled, 0, 0,
+    kTtcTapComplete, "Left tap complete" },
+  { kTtcFirstTapBegan, kTapComplete, 0, kTapClick, kTtcIdle, "Tap complete" },
+  { kTtcFirstTapBegan, kTapMoving, 0, 0, kTtcIdle, "Tap moved" },
+  { kTtcFirstTapBegan, 0, 0, 0, kTtcFirstTapBegan, "Tap in progress" },
+
+  { kTtcTapComplete, kTapFingersAdded, kTapLeft, kTapClickLeft,
+    kTtcFirstTapBegan, "Non-left tap after tap" },
+  { kTtcTapComplete, kTapFingersAdded, 0, kTapResetDragMotion,
+    kTtcSubsequentTapBegan, "Subsequent tap began" },
+  { kTtcTapComplete, kTapTimeout | kTapPressureMet, 0, kTapClick, kTtcIdle,
+    "Tap timed out" },
+  { kTtcTapComplete, kTapTimeout, 0, 0, kTtcIdle, "Light tap timed out" },
+  { kTtcTapComplete, 0, 0, 0, kTtcTapComplete, "Waiting for another tap" },
+
+  { kTtcSubsequentTapBegan, 0, kTapHwState | kTapTimeout, 0,
+    kTtcSubsequentTapBegan, "No hardware state but no timeout" },
+  { kTtcSubsequentTapBegan, kTapTimeout | kTapLeft, 0, kTapPressLeft,
+    kTtcDrag, "Drag began" },
+  { kTtcSubsequentTapBegan,
+    kTapMoving | kTapLeft | kTapDragDelayMet | kTapDragStationary, 0,
+    kTapPressLeft, kTtcDrag, "Moving drag began" },
+  { kTtcSubsequentTapBegan, kTapMoving | kTapLeft, 0, kTapClickLeft,
+    kTtcIdle, "Tap moved before drag delay" },
+  { kTtcSubsequentTapBegan, kTapTimeout, kTapComplete, kTapClickLeft,
+    kTtcIdle, "Multi-finger tap timed out" },
+  { kTtcSubsequentTapBegan, kTapMoving, kTapComplete, kTapClickLeft,
+    kTtcIdle, "Multi-finger tap moved" },
+  { kTtcSubsequentTapBegan, kTapTimeout, 0, 0, kTtcSubsequentTapBegan,
+    "Multi-finger tap complete at timeout" },
+  { kTtcSubsequentTapBegan, kTapMoving, 0, 0, kTtcSubsequentTapBegan,
+    "Multi-finger tap complete but moving" },
+  { kTtcSubsequentTapBegan, kTapComplete, 0, kTapClickLeft, kTtcTapComplete,
+    "Subsequent tap complete" },
+  { kTtcSubsequentTapBegan, 0, kTapLeft, kTapClickLeft, kTtcFirstTapBegan,
+    "Non-left subsequent tap" },
+  { kTtcSubsequentTapBegan, 0, 0, 0, kTtcSubsequentTapBegan,
+    "Subsequent tap in progress" },
+
+  { kTtcDrag, kTapComplete | kTapDragLockEnabled, 0, kTapClearRecord,
+    kTtcDragRelease, "Drag released with drag lock" },
+  { kTtcDrag, kTapComplete, 0, kTapReleaseLeft | kTapClearRecord, kTtcIdle,
+    "Drag released" },
+  { kTtcDrag, kTapDragEvaluating, kTapLeft, kTapReleaseLeft, kTtcIdle,
+    "Drag was a multi-finger gesture" },
+  { kTtcDrag, 0, 0, 0, kTtcDrag, "Dragging" },
+
+  { kTtcDragRelease, kTapFingersAdded, 0, 0, kTtcDragRetouch,
+    "Drag retouched" },
+  { kTtcDragRelease, kTapTimeout, 0, kTapReleaseLeft, kTtcIdle,
+    "Drag lock timed out" },
+  { kTtcDragRelease, 0, 0, 0, kTtcDragRelease, "Drag lock waiting" },
+
+  { kTtcDragRetouch, kTapComplete | kTapLeft, 0, kTapReleaseLeft, kTtcIdle,
+    "Drag ended by tap" },
+  { kTtcDragRetouch, kTapComplete, 0, kTapReleaseLeft, kTtcTapComplete,
+    "Drag ended by multi-finger tap" },
+  { kTtcDragRetouch, kTapTimeout, 0, 0, kTtcDrag, "Drag resumed at timeout" },
+  { kTtcDragRetouch, 0, kTapHwState, 0, kTtcDragRetouch,
+    "No hardware state but no timeout" },
+  { kTtcDragRetouch, kTapMoving, 0, 0, kTtcDrag, "Drag resumed by moving" },
+  { kTtcDragRetouch, 0, 0, 0, kTtcDragRetouch, "Drag retouch in progress" },
+};
+
+const ImmediateInterpreter::TapRecordUpdate
+ImmediateInterpreter::kTapRecordUpdates[] = {
+  // required, forbidden, clear, track_drag_motion
+  { kTapHwState | kTapMotionAllowed, 0, true, false },  // kTtcIdle
+  { kTapHwState, kTapTimeout, false, false },  // kTtcFirstTapBegan
+  { kTapHwState | kTapFingersAdded, 0, true, false },  // kTtcTapComplete
+  { kTapHwState, 0, false, true },  // kTtcSubsequentTapBegan
+  { kTapHwState, 0, false, false },  // kTtcDrag
+  { kTapHwState | kTapFingersAdded, 0, false, false },  // kTtcDragRelease
+  { kTapHwState, 0, false, false },  // kTtcDragRetouch
+};
+
+namespace {
+
+const size_t kNumTapToClickStates = ImmediateInterpreter::kTtcDragRetouch + 1;
+
+// Where each state's transitions start, and the predicates they test.
+struct TapTransitionIndex {
+  TapTransitionIndex(const ImmediateInterpreter::TapTransition* transitions,
+                     size_t count) {
+    for (size_t i = count; i-- > 0;) {
+      first[transitions[i].state] = &transitions[i];
+      used[transitions[i].state] |=
+          transitions[i].required | transitions[i].forbidden;
+    }
+  }
+  const ImmediateInterpreter::TapTransition* first[kNumTapToClickStates] = {};
+  unsigned used[kNumTapToClickStates] = {};
+};
+
+// Indexes |transitions| on first use.
+const TapTransitionIndex& IndexTapTransitions(
+    const ImmediateInterpreter::TapTransition* transitions, size_t count) {
+  static const TapTransitionIndex index(transitions, count);
+  return index;
+}
+
+}  // namespace {}
+
+// static
+const ImmediateInterpreter::TapTransition&
+ImmediateInterpreter::FindTapTransition(TapToClickState state,
+                                        unsigned predicates) {
+  const TapTransition* transition = IndexTapTransitions(
+      kTapTransitions, arraysize(kTapTransitions)).first[state];
+  while ((predicates & transition->required) != transition->required ||
+         (predicates & transition->forbidden))
+    transition++;
+  return *transition;
+}
+
+// static
+unsigned ImmediateInterpreter::TapPredicatesUsed(TapToClickState state) {
+  static_assert(arraysize(kTapRecordUpdates) == kNumTapToClickStates,
+                "Need a TapRecordUpdate per state");
+  return IndexTapTransitions(
+      kTapTransitions, arraysize(kTapTransitions)).used[state];
+}
+
+unsigned ImmediateInterpreter::EvaluateTapPredicates(
+    const HardwareState* hwstate,
+    stime_t now,
+    unsigned used) const {
+  unsigned predicates = 0;
+  if ((used & kTapBegan) && tap_record_.TapBegan())
+    predicates |= kTapBegan;
+  if ((used & kTapComplete) && tap_record_.TapComplete())
+    predicates |= kTapComplete;
+  if ((used & kTapMoving) && hwstate &&
+      tap_record_.Moving(*hwstate, tap_move_dist_.val_))
+    predicates |= kTapMoving;
+  if ((used & kTapLeft) && tap_record_.TapType() == GESTURES_BUTTON_LEFT)
+    predicates |= kTapLeft;
+  if ((used & kTapPressureMet) && tap_record_.MinTapPressureMet())
+    predicates |= kTapPressureMet;
+  if ((used & kTapFingersYoung) && tap_record_.FingersBelowMaxAge())
+    predicates |= kTapFingersYoung;
+  if (tap_drag_enable_.val_)
+    predicates |= kTapDragEnabled;
+  if (drag_lock_enable_.val_)
+    predicates |= kTapDragLockEnabled;
+  if (now - tap_to_click_state_entered_ > tap_drag_delay_.val_)
+    predicates |= kTapDragDelayMet;
+  if (tap_drag_finger_was_stationary_)
+    predicates |= kTapDragStationary;
+  if (now - tap_to_click_state_entered_ <= evaluation_timeout_.val_)
+    predicates |= kTapDragEvaluating;
+  return predicates & used;
+}
+
 void ImmediateInterpreter::UpdateTapGesture(
     const HardwareState* hwstate,
     const FingerMap& gs_fingers,
@@ -2694,186 +2974,56 @@ void ImmediateInterpreter::UpdateTapState(
     return;
   }
 
-  switch (tap_to_click_state_) {
-    case kTtcIdle:
+  const TapToClickState state = tap_to_click_state_;
+  unsigned predicates = 0;
+  if (hwstate)
+    predicates |= kTapHwState;
+  if (is_timeout)
+    predicates |= kTapTimeout;
+  if (!added_fingers.empty())
+    predicates |= kTapFingersAdded;
+  if (hwstate &&
+      hwstate->timestamp - last_movement_timestamp_ >=
+      motion_tap_prevent_timeout_.val_)
+    predicates |= kTapMotionAllowed;
+
+  const TapRecordUpdate& record_update = kTapRecordUpdates[state];
+  if ((predicates & record_update.required) == record_update.required &&
+      !(predicates & record_update.forbidden)) {
+    if (record_update.clear)
       tap_record_.Clear();
-      if (hwstate &&
-          hwstate->timestamp - last_movement_timestamp_ >=
-          motion_tap_prevent_timeout_.val_) {
-        tap_record_.Update(
-            *hwstate, *state_buffer_.Get(1), added_fingers, removed_fingers,
-            dead_fingers);
-        if (tap_record_.TapBegan())
-          SetTapToClickState(kTtcFirstTapBegan, now);
-      }
-      break;
-    case kTtcFirstTapBegan:
-      if (is_timeout) {
-        SetTapToClickState(kTtcIdle, now);
-        break;
-      }
-      if (!hwstate) {
-        Log("hwstate NULL but no timeout?!");
-        break;
-      }
-      tap_record_.Update(
-          *hwstate, *state_buffer_.Get(1), added_fingers,
-          removed_fingers, dead_fingers);
-      Log("TTC: Is tap? %d Is moving? %d",
-          tap_record_.TapComplete(),
-          tap_record_.Moving(*hwstate, tap_move_dist_.val_));
-      if (tap_record_.TapComplete()) {
-        if (!tap_record_.MinTapPressureMet() ||
-            !tap_record_.FingersBelowMaxAge()) {
-          SetTapToClickState(kTtcIdle, now);
-        } else if (tap_record_.TapType() == GESTURES_BUTTON_LEFT &&
-                   tap_drag_enable_.val_) {
-          SetTapToClickState(kTtcTapComplete, now);
-        } else {
-          *buttons_down = *buttons_up = tap_record_.TapType();
-          SetTapToClickState(kTtcIdle, now);
-        }
-      } else if (tap_record_.Moving(*hwstate, tap_move_dist_.val_)) {
-        SetTapToClickState(kTtcIdle, now);
-      }
-      break;
-    case kTtcTapComplete:
-      if (!added_fingers.empty()) {
-
-        tap_record_.Clear();
-        tap_record_.Update(
-            *hwstate, *state_buffer_.Get(1), added_fingers, removed_fingers,
-            dead_fingers);
-
-        // If more than one finger is touching: Send click
-        // and return to FirstTapBegan state.
-        if (tap_record_.TapType() != GESTURES_BUTTON_LEFT) {
-          *buttons_down = *buttons_up = GESTURES_BUTTON_LEFT;
-          SetTapToClickState(kTtcFirstTapBegan, now);
-        } else {
-          tap_drag_last_motion_time_ = now;
-          tap_drag_finger_was_stationary_ = false;
-          SetTapToClickState(kTtcSubsequentTapBegan, now);
-        }
-      } else if (is_timeout) {
-        *buttons_down = *buttons_up =
-            tap_record_.MinTapPressureMet() ? tap_record_.TapType() : 0;
-        SetTapToClickState(kTtcIdle, now);
-      }
-      break;
-    case kTtcSubsequentTapBegan:
-      if (!is_timeout && !hwstate) {
-        Log("hwstate NULL but not a timeout?!");
-        break;
-      }
-      if (hwstate)
-        tap_record_.Update(*hwstate, *state_buffer_.Get(1), added_fingers,
-                           removed_fingers, dead_fingers);
-
-      if (!tap_record_.Motionless(*hwstate, *state_buffer_.Get(1),
-                                  tap_max_movement_.val_)) {
-        tap_drag_last_motion_time_ = now;
-      }
-      if (tap_record_.TapType() == GESTURES_BUTTON_LEFT &&
-          now - tap_drag_last_motion_time_ > tap_drag_stationary_time_.val_) {
-        tap_drag_finger_was_stationary_ = true;
-      }
-
-      if (is_timeout || tap_record_.Moving(*hwstate, tap_move_dist_.val_)) {
-        if (tap_record_.TapType() == GESTURES_BUTTON_LEFT) {
-          if (is_timeout) {
-            // moving with just one finger. Start dragging.
-            *buttons_down = GESTURES_BUTTON_LEFT;
-            SetTapToClickState(kTtcDrag, now);
-          } else {
-            bool drag_delay_met = (now - tap_to_click_state_entered_
-                                   > tap_drag_delay_.val_);
-            if (drag_delay_met && tap_drag_finger_was_stationary_) {
-              *buttons_down = GESTURES_BUTTON_LEFT;
-              SetTapToClickState(kTtcDrag, now);
-            } else {
-              *buttons_down = GESTURES_BUTTON_LEFT;
-              *buttons_up = GESTURES_BUTTON_LEFT;
-              SetTapToClickState(kTtcIdle, now);
-            }
-          }
-        } else if (!tap_record_.TapComplete()) {
-          // not just one finger. Send button click and go to idle.
-          *buttons_down = *buttons_up = GESTURES_BUTTON_LEFT;
-          SetTapToClickState(kTtcIdle, now);
-        }
-        break;
-      }
-      if (tap_record_.TapType() != GESTURES_BUTTON_LEFT) {
-        // We aren't going to drag, so send left click now and handle current
-        // tap afterwards.
-        *buttons_down = *buttons_up = GESTURES_BUTTON_LEFT;
-        SetTapToClickState(kTtcFirstTapBegan, now);
-      }
-      if (tap_record_.TapComplete()) {
-        *buttons_down = *buttons_up = GESTURES_BUTTON_LEFT;
-        SetTapToClickState(kTtcTapComplete, now);
-        Log("TTC: Subsequent left tap complete");
-      }
-      break;
-    case kTtcDrag:
-      if (hwstate)
-        tap_record_.Update(
-            *hwstate, *state_buffer_.Get(1), added_fingers, removed_fingers,
-            dead_fingers);
-      if (tap_record_.TapComplete()) {
-        tap_record_.Clear();
-        if (drag_lock_enable_.val_) {
-          SetTapToClickState(kTtcDragRelease, now);
-        } else {
-          *buttons_up = GESTURES_BUTTON_LEFT;
-          SetTapToClickState(kTtcIdle, now);
-        }
-      }
-      if (tap_record_.TapType() != GESTURES_BUTTON_LEFT &&
-          now - tap_to_click_state_entered_ <= evaluation_timeout_.val_) {
-        // We thought we were dragging, but actually we're doing a
-        // non-tap-to-click multitouch gesture.
-        *buttons_up = GESTURES_BUTTON_LEFT;
-        SetTapToClickState(kTtcIdle, now);
-      }
-      break;
-    case kTtcDragRelease:
-      if (!added_fingers.empty()) {
-        tap_record_.Update(
-            *hwstate, *state_buffer_.Get(1), added_fingers, removed_fingers,
-            dead_fingers);
-        SetTapToClickState(kTtcDragRetouch, now);
-      } else if (is_timeout) {
-        *buttons_up = GESTURES_BUTTON_LEFT;
-        SetTapToClickState(kTtcIdle, now);
-      }
-      break;
-    case kTtcDragRetouch:
-      if (hwstate)
-        tap_record_.Update(
-            *hwstate, *state_buffer_.Get(1), added_fingers, removed_fingers,
-            dead_fingers);
-      if (tap_record_.TapComplete()) {
-        *buttons_up = GESTURES_BUTTON_LEFT;
-        if (tap_record_.TapType() == GESTURES_BUTTON_LEFT)
-          SetTapToClickState(kTtcIdle, now);
-        else
-          SetTapToClickState(kTtcTapComplete, now);
-        break;
-      }
-      if (is_timeout) {
-        SetTapToClickState(kTtcDrag, now);
-        break;
-      }
-      if (!hwstate) {
-        Log("not timeout but hwstate is NULL?!");
-        break;
-      }
-      if (tap_record_.Moving(*hwstate, tap_move_dist_.val_))
-        SetTapToClickState(kTtcDrag, now);
-      break;
+    tap_record_.Update(
+        *hwstate, *state_buffer_.Get(1), added_fingers, removed_fingers,
+        dead_fingers);
+  }
+  if (record_update.track_drag_motion &&
+      (predicates & (kTapHwState | kTapTimeout))) {
+    if (hwstate && !tap_record_.Motionless(*hwstate, *state_buffer_.Get(1),
+                                           tap_max_movement_.val_)) {
+      tap_drag_last_motion_time_ = now;
+    }
+    if (tap_record_.TapType() == GESTURES_BUTTON_LEFT &&
+        now - tap_drag_last_motion_time_ > tap_drag_stationary_time_.val_) {
+      tap_drag_finger_was_stationary_ = true;
+    }
   }
+
+  predicates |= EvaluateTapPredicates(hwstate, now, TapPredicatesUsed(state));
+  const TapTransition& transition = FindTapTransition(state, predicates);
+  Log("TTC: %s", transition.name);
+  if (transition.effects & kTapClick)
+    *buttons_down = *buttons_up = tap_record_.TapType();
+  if (transition.effects & kTapPressLeft)
+    *buttons_down = GESTURES_BUTTON_LEFT;
+  if (transition.effects & kTapReleaseLeft)
+    *buttons_up = GESTURES_BUTTON_LEFT;
+  if (transition.effects & kTapClearRecord)
+    tap_record_.Clear();
+  if (transition.effects & kTapResetDragMotion) {
+    tap_drag_last_motion_time_ = now;
+    tap_drag_finger_was_stationary_ = false;
+  }
+  SetTapToClickState(transition.next, now);
   if (tap_to_click_state_ != kTtcIdle)
     Log("TTC: New state: %s", TapToClickStateName(tap_to_click_state_));
   // Take action based on new state:
@@ -3389,4 +3539,108 @@ bool AnyGesturingFingerLeft(const HardwareState& state,
   return false;
 }
 
+void ImmediateInterpreter::SaveOwnState(StateWriter* writer) const {
+  finger_slots_.SaveState(writer);
+  tap_dead_fingers_.SaveState(writer);
+  moving_.SaveState(writer);
+  writer->Write(prev_active_gs_fingers_);
+  writer->Write(non_gs_fingers_);
+  writer->Write(prev_gs_fingers_);
+  writer->Write(prev_tap_gs_fingers_);
+  writer->Write(result_);
+  writer->Write(prev_result_);
+  writer->Write(origin_timestamps_);
+  writer->Write(distance_walked_);
+  writer->Write(button_type_);
+  writer->Write(sent_button_down_);
+  writer->Write(button_down_timeout_);
+  writer->Write(changed_time_);
+  writer->Write(started_moving_time_);
+  writer->Write(gs_changed_time_);
+  writer->Write(finger_leave_time_);
+  writer->Write(start_positions_);
+  writer->Write(three_finger_swipe_start_positions_);
+  writer->Write(four_finger_swipe_start_positions_);
+  writer->Write(origin_positions_);
+  writer->Write(pointing_);
+  writer->Write(fingers_);
+  writer->Write(thumb_);
+  writer->Write(thumb_eval_timer_);
+  writer->Write(moving_finger_id_);
+  writer->Write(tap_to_click_state_);
+  writer->Write(tap_to_click_state_entered_);
+  tap_record_.SaveState(writer);
+  writer->Write(tap_drag_last_motion_time_);
+  writer->Write(tap_drag_finger_was_stationary_);
+  writer->Write(last_movement_timestamp_);
+  writer->Write(swipe_is_vertical_);
+  writer->Write(current_gesture_type_);
+  writer->Write(prev_gesture_type_);
+  writer->Write(pinch_prev_distance_sq_);
+  state_buffer_.SaveState(writer);
+  scroll_buffer_.SaveState(writer);
+  writer->Write(pinch_guess_);
+  writer->Write(pinch_guess_start_);
+  writer->Write(pinch_locked_);
+  writer->Write(pinch_status_);
+  writer->Write(pinch_prev_direction_);
+  writer->Write(pinch_prev_time_);
+  writer->Write(finger_seen_shortly_after_button_down_);
+  scroll_manager_.SaveState(writer);
+}
+
+void ImmediateInterpreter::RestoreOwnState(StateReader* reader) {
+  finger_slots_.RestoreState(reader);
+  tap_dead_fingers_.RestoreState(reader);
+  moving_.RestoreState(reader);
+  reader->Read(&prev_active_gs_fingers_);
+  reader->Read(&non_gs_fingers_);
+  reader->Read(&prev_gs_fingers_);
+  reader->Read(&prev_tap_gs_fingers_);
+  reader->Read(&result_);
+  reader->Read(&prev_result_);
+  reader->Read(&origin_timestamps_);
+  reader->Read(&distance_walked_);
+  reader->Read(&button_type_);
+  reader->Read(&sent_button_down_);
+  reader->Read(&button_down_timeout_);
+  reader->Read(&changed_time_);
+  reader->Read(&started_moving_time_);
+  reader->Read(&gs_changed_time_);
+  reader->Read(&finger_leave_time_);
+  reader->Read(&start_positions_);
+  reader->Read(&three_finger_swipe_start_positions_);
+  reader->Read(&four_finger_swipe_start_positions_);
+  reader->Read(&origin_positions_);
+  reader->Read(&pointing_);
+  reader->Read(&fingers_);
+  reader->Read(&thumb_);
+  reader->Read(&thumb_eval_timer_);
+  reader->Read(&moving_finger_id_);
+  if (reader->Read(&tap_to_click_state_) &&
+      static_cast<size_t>(tap_to_click_state_) >= kNumTapToClickStates) {
+    tap_to_click_state_ = kTtcIdle;
+    reader->Fail("bad tap-to-click state");
+  }
+  reader->Read(&tap_to_click_state_entered_);
+  tap_record_.RestoreState(reader);
+  reader->Read(&tap_drag_last_motion_time_);
+  reader->Read(&tap_drag_finger_was_stationary_);
+  reader->Read(&last_movement_timestamp_);
+  reader->Read(&swipe_is_vertical_);
+  reader->Read(&current_gesture_type_);
+  reader->Read(&prev_gesture_type_);
+  reader->Read(&pinch_prev_distance_sq_);
+  state_buffer_.RestoreState(reader);
+  scroll_buffer_.RestoreState(reader);
+  reader->Read(&pinch_guess_);
+  reader->Read(&pinch_guess_start_);
+  reader->Read(&pinch_locked_);
+  reader->Read(&pinch_status_);
+  reader->Read(&pinch_prev_direction_);
+  reader->Read(&pinch_prev_time_);
+  reader->Read(&finger_seen_shortly_after_button_down_);
+  scroll_manager_.RestoreState(reader);
+}
+
 }  // namespace gestures
@@ -595,6 +595,66 @@ TEST(ImmediateInterpreterTest, ScrollReevaluateTest) {
 }
 
 
+TEST(ImmediateInterpreterTest, GestureTypeMemoTest) {
+  ImmediateInterpreter ii(NULL, NULL);
+  HardwareProperties hwprops = {
+    0,  // left edge
+    0,  // top edge
+    100,  // right edge
+    100,  // bottom edge
+    1,  // pixels/TP width
+    1,  // pixels/TP height
+    96,  // x screen DPI
+    96,  // y screen DPI
+    -1,  // orientation minimum
+    2,   // orientation maximum
+    2,  // max fingers
+    5,  // max touch
+    0,  // tripletap
+    0,  // semi-mt
+    1,  // is button pad
+    0,  // has_wheel
+    0,  // wheel_is_hi_res
+  };
+  TestInterpreterWrapper wrapper(&ii, &hwprops);
+
+  // Two fingers scroll down steadily for half a second. Once the scroll has
+  // lasted evaluation_timeout_, the classifier stops running.
+  const size_t kFrames = 50;
+  const stime_t kInterval = 0.01;
+  size_t scrolls = 0;
+  for (size_t i = 0; i < kFrames; i++) {
+    FingerState fs[] = {
+      // TM, Tm, WM, Wm, Press, Orientation, X, Y, TrID
+      {0, 0, 0, 0, 20, 0, 40, 20.0f + i, 1, 0},
+      {0, 0, 0, 0, 20, 0, 60, 20.0f + i, 2, 0},
+    };
+    HardwareState hs = make_hwstate(1.0 + i * kInterval, 0, 2, 2, fs);
+    Gesture* gs = wrapper.SyncInterpret(&hs, NULL);
+    if (gs && gs->type == kGestureTypeScroll)
+      scrolls++;
+  }
+  EXPECT_GT(scrolls, 0);
+  EXPECT_EQ(kFrames, ii.gesture_type_hits() + ii.gesture_type_misses());
+  EXPECT_LT(ii.gesture_type_misses(),
+            static_cast<size_t>(2 * ii.evaluation_timeout_.val_ / kInterval));
+  EXPECT_GT(ii.gesture_type_hits(), kFrames / 2);
+
+  Json::Value stats(Json::arrayValue);
+  ii.EncodeLatencyStats(&stats);
+  ASSERT_EQ(1, stats.size());
+  const Json::Value& memo = stats[0][ActivityLog::kKeyGestureTypeMemo];
+  EXPECT_EQ(ii.gesture_type_hits(),
+            memo[ActivityLog::kKeyMemoHits].asUInt());
+  EXPECT_EQ(ii.gesture_type_misses(),
+            memo[ActivityLog::kKeyMemoMisses].asUInt());
+
+  ii.ClearLatencyStats();
+  EXPECT_EQ(0, ii.gesture_type_hits());
+  EXPECT_EQ(0, ii.gesture_type_misses());
+}
+
+
 // This is based on a log from Dave Moore. He put one finger down, which put
 // it into move mode, then put a second finger down a bit later, but it was
 // stuck in move mode. This tests that it does switch to scroll mode.
@@ -2137,6 +2197,137 @@ struct TapToClickLowPressureBeginOrEndInputs {
 
 }  // namespace {}
 
+namespace {
+
+struct TapOutcome {
+  unsigned effects;
+  ImmediateInterpreter::TapToClickState next;
+};
+
+// The tap-to-click state machine as UpdateTapState() spelled it out before
+// it became a table, in terms of the predicates.
+TapOutcome ReferenceTapTransition(ImmediateInterpreter::TapToClickState state,
+                                  unsigned predicates) {
+  typedef ImmediateInterpreter II;
+  bool hwstate = predicates & II::kTapHwState;
+  bool timeout = predicates & II::kTapTimeout;
+  bool complete = predicates & II::kTapComplete;
+  bool moving = predicates & II::kTapMoving;
+  bool left = predicates & II::kTapLeft;
+  bool pressure_met = predicates & II::kTapPressureMet;
+  TapOutcome stay = { 0, state };
+  switch (state) {
+    case II::kTtcIdle:
+      if (hwstate && (predicates & II::kTapMotionAllowed) &&
+          (predicates & II::kTapBegan))
+        return TapOutcome{ 0, II::kTtcFirstTapBegan };
+      return stay;
+    case II::kTtcFirstTapBegan:
+      if (timeout)
+        return TapOutcome{ 0, II::kTtcIdle };
+      if (!hwstate)
+        return stay;
+      if (complete) {
+        if (!pressure_met || !(predicates & II::kTapFingersYoung))
+          return TapOutcome{ 0, II::kTtcIdle };
+        if (left && (predicates & II::kTapDragEnabled))
+          return TapOutcome{ 0, II::kTtcTapComplete };
+        return TapOutcome{ II::kTapClick, II::kTtcIdle };
+      }
+      if (moving)
+        return TapOutcome{ 0, II::kTtcIdle };
+      return stay;
+    case II::kTtcTapComplete:
+      if (predicates & II::kTapFingersAdded) {
+        if (!left)
+          return TapOutcome{ II::kTapClickLeft, II::kTtcFirstTapBegan };
+        return TapOutcome{ II::kTapResetDragMotion,
+                           II::kTtcSubsequentTapBegan };
+      }
+      if (timeout)
+        return TapOutcome{ pressure_met ? II::kTapClick : 0u, II::kTtcIdle };
+      return stay;
+    case II::kTtcSubsequentTapBegan: {
+      if (!timeout && !hwstate)
+        return stay;
+      if (timeout || moving) {
+        if (left) {
+          if (timeout || ((predicates & II::kTapDragDelayMet) &&
+                          (predicates & II::kTapDragStationary)))
+            return TapOutcome{ II::kTapPressLeft, II::kTtcDrag };
+          return TapOutcome{ II::kTapClickLeft, II::kTtcIdle };
+        }
+        if (!complete)
+          return TapOutcome{ II::kTapClickLeft, II::kTtcIdle };
+        return stay;
+      }
+      TapOutcome outcome = stay;
+      if (!left)
+        outcome = TapOutcome{ II::kTapClickLeft, II::kTtcFirstTapBegan };
+      if (complete)
+        outcome = TapOutcome{ II::kTapClickLeft, II::kTtcTapComplete };
+      return outcome;
+    }
+    case II::kTtcDrag:
+      if (complete) {
+        if (predicates & II::kTapDragLockEnabled)
+          return TapOutcome{ II::kTapClearRecord, II::kTtcDragRelease };
+        return TapOutcome{ II::kTapReleaseLeft | II::kTapClearRecord,
+                           II::kTtcIdle };
+      }
+      if (!left && (predicates & II::kTapDragEvaluating))
+        return TapOutcome{ II::kTapReleaseLeft, II::kTtcIdle };
+      return stay;
+    case II::kTtcDragRelease:
+      if (predicates & II::kTapFingersAdded)
+        return TapOutcome{ 0, II::kTtcDragRetouch };
+      if (timeout)
+        return TapOutcome{ II::kTapReleaseLeft, II::kTtcIdle };
+      return stay;
+    case II::kTtcDragRetouch:
+      if (complete)
+        return TapOutcome{ II::kTapReleaseLeft,
+                           left ? II::kTtcIdle : II::kTtcTapComplete };
+      if (timeout)
+        return TapOutcome{ 0, II::kTtcDrag };
+      if (!hwstate)
+        return stay;
+      if (moving)
+        return TapOutcome{ 0, II::kTtcDrag };
+      return stay;
+  }
+  return stay;
+}
+
+}  // namespace {}
+
+// Drives the transition table with every combination of predicates in every
+// state, and checks it against the original state machine.
+TEST(ImmediateInterpreterTest, TapTransitionTableTest) {
+  const unsigned kAllPredicates =
+      (ImmediateInterpreter::kTapDragEvaluating << 1) - 1;
+  for (int s = ImmediateInterpreter::kTtcIdle;
+       s <= ImmediateInterpreter::kTtcDragRetouch; s++) {
+    ImmediateInterpreter::TapToClickState state =
+        static_cast<ImmediateInterpreter::TapToClickState>(s);
+    unsigned used = ImmediateInterpreter::TapPredicatesUsed(state);
+    EXPECT_EQ(0, used & ~kAllPredicates);
+    for (unsigned predicates = 0; predicates <= kAllPredicates; predicates++) {
+      const ImmediateInterpreter::TapTransition& transition =
+          ImmediateInterpreter::FindTapTransition(state, predicates);
+      TapOutcome expected = ReferenceTapTransition(state, predicates);
+      ASSERT_EQ(state, transition.state) << predicates;
+      ASSERT_EQ(expected.next, transition.next)
+          << state << ", " << predicates << ": " << transition.name;
+      ASSERT_EQ(expected.effects, transition.effects)
+          << state << ", " << predicates << ": " << transition.name;
+      // Predicates that no transition of the state tests don't matter.
+      ASSERT_EQ(&transition, &ImmediateInterpreter::FindTapTransition(
+          state, predicates & used)) << state << ", " << predicates;
+    }
+  }
+}
+
 // Test that if a tap contact has some frames before and after that tap, with
 // a finger that's located far from the tap spot, but has low pressure at that
 // location, it's still a tap. We see this happen on some hardware particularly
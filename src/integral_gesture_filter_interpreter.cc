@@ -8,6 +8,7 @@
 
 #include "gestures/include/gestures.h"
 #include "gestures/include/interpreter.h"
+#include "gestures/include/interpreter_state.h"
 #include "gestures/include/tracer.h"
 
 namespace gestures {
@@ -76,4 +77,18 @@ void IntegralGestureFilterInterpreter::ConsumeGesture(const Gesture& gesture) {
   }
 }
 
+void IntegralGestureFilterInterpreter::SaveOwnState(StateWriter* writer) const {
+  writer->Write(hscroll_remainder_);
+  writer->Write(vscroll_remainder_);
+  writer->Write(hscroll_ordinal_remainder_);
+  writer->Write(vscroll_ordinal_remainder_);
+}
+
+void IntegralGestureFilterInterpreter::RestoreOwnState(StateReader* reader) {
+  reader->Read(&hscroll_remainder_);
+  reader->Read(&vscroll_remainder_);
+  reader->Read(&hscroll_ordinal_remainder_);
+  reader->Read(&vscroll_ordinal_remainder_);
+}
+
 }  // namespace gestures
@@ -11,8 +11,11 @@
 #include <json/writer.h>
 
 #include "gestures/include/activity_log.h"
+#include "gestures/include/finger_index.h"
 #include "gestures/include/finger_metrics.h"
 #include "gestures/include/gestures.h"
+#include "gestures/include/interpreter_state.h"
+#include "gestures/include/json_stream_writer.h"
 #include "gestures/include/logging.h"
 #include "gestures/include/tracer.h"
 
@@ -26,7 +29,8 @@ Interpreter::Interpreter(PropRegistry* prop_reg,
     : requires_metrics_(false),
       initialized_(false),
       name_(NULL),
-      tracer_(tracer) {
+      tracer_(tracer),
+      latency_stats_enabled_(false) {
 #ifdef DEEP_LOGS
   bool logging_enabled = true;
 #else
@@ -41,6 +45,38 @@ Interpreter::~Interpreter() {
     free(const_cast<char*>(name_));
 }
 
+namespace {
+
+// Time spent in interpreters nested inside the innermost timed call on this
+// thread, so far.
+thread_local stime_t nested_time = 0.0;
+
+// Records the self time of its scope into |histogram|, if non-NULL.
+class ScopedSelfTimer {
+ public:
+  explicit ScopedSelfTimer(LatencyHistogram* histogram)
+      : histogram_(histogram), outer_nested_time_(nested_time) {
+    if (!histogram_)
+      return;
+    nested_time = 0.0;
+    start_ = MonotonicNow();
+  }
+  ~ScopedSelfTimer() {
+    if (!histogram_)
+      return;
+    stime_t total = MonotonicNow() - start_;
+    histogram_->Add(total - nested_time);
+    nested_time = outer_nested_time_ + total;
+  }
+
+ private:
+  LatencyHistogram* histogram_;
+  stime_t outer_nested_time_;
+  stime_t start_;
+};
+
+}  // namespace {}
+
 void Interpreter::Trace(const char* message, const char* name) {
   if (tracer_)
     tracer_->Trace(message, name);
@@ -48,7 +84,14 @@ void Interpreter::Trace(const char* message, const char* name) {
 
 void Interpreter::SyncInterpret(HardwareState* hwstate,
                                     stime_t* timeout) {
+  // A no-op unless this is the first interpreter to see |hwstate|.
+  ScopedFingerIndex finger_index(hwstate);
+  if (IsPlainHop()) {
+    SyncInterpretImpl(hwstate, timeout);
+    return;
+  }
   AssertWithReturn(initialized_);
+  ScopedSelfTimer timer(latency_stats_enabled_ ? &sync_latency_ : NULL);
   if (log_.get() && hwstate) {
     Trace("log: start: ", "LogHardwareState");
     log_->LogHardwareState(*hwstate);
@@ -64,7 +107,12 @@ void Interpreter::SyncInterpret(HardwareState* hwstate,
 }
 
 void Interpreter::HandleTimer(stime_t now, stime_t* timeout) {
+  if (IsPlainHop()) {
+    HandleTimerImpl(now, timeout);
+    return;
+  }
   AssertWithReturn(initialized_);
+  ScopedSelfTimer timer(latency_stats_enabled_ ? &timer_latency_ : NULL);
   if (log_.get()) {
     Trace("log: start: ", "LogTimerCallback");
     log_->LogTimerCallback(now);
@@ -114,11 +162,71 @@ std::string Interpreter::Encode() {
   Json::Value root = EncodeCommonInfo();
   if (log_.get())
     log_->AddEncodeInfo(&root);
+  if (latency_stats_enabled_) {
+    Json::Value stats(Json::arrayValue);
+    EncodeLatencyStats(&stats);
+    root[ActivityLog::kKeyLatencyStats] = stats;
+  }
 
   std::string out = root.toStyledString();
   return out;
 }
 
+void Interpreter::WriteCommonInfo(JsonStreamWriter* writer,
+                                  ActivityLog* log) {
+  if (log)
+    log->WriteCommonInfo(writer);
+  writer->Key(ActivityLog::kKeyInterpreterName);
+  writer->String(name());
+  WriteNextCommonInfo(writer);
+}
+
+bool Interpreter::WriteEncoded(int fd) {
+  Json::Value stats;
+  if (latency_stats_enabled_) {
+    stats = Json::Value(Json::arrayValue);
+    EncodeLatencyStats(&stats);
+  }
+  return WriteEncoded(fd, log_.get(), stats);
+}
+
+bool Interpreter::WriteEncoded(int fd, ActivityLog* log,
+                               const Json::Value& latency_stats) {
+  JsonStreamWriter writer(fd);
+  writer.BeginObject();
+  WriteCommonInfo(&writer, log);
+  if (log)
+    log->WriteEncodeInfo(&writer);
+  if (!latency_stats.isNull()) {
+    writer.Key(ActivityLog::kKeyLatencyStats);
+    writer.Value(latency_stats);
+  }
+  writer.EndObject();
+  return writer.Flush();
+}
+
+void Interpreter::EncodeLatencyStats(Json::Value* out) {
+  Json::Value entry(Json::objectValue);
+  entry[ActivityLog::kKeyInterpreterName] =
+      Json::Value(string(name_ ? name_ : ""));
+  entry[ActivityLog::kKeyLatencySync] = sync_latency_.Encode();
+  entry[ActivityLog::kKeyLatencyTimer] = timer_latency_.Encode();
+  out->append(entry);
+}
+
+void Interpreter::SaveState(StateWriter* writer) {
+  writer->BeginSection(name_ ? name_ : "");
+  SaveOwnState(writer);
+  writer->EndSection();
+}
+
+bool Interpreter::RestoreState(StateReader* reader) {
+  if (!reader->BeginSection(name_ ? name_ : ""))
+    return false;
+  RestoreOwnState(reader);
+  return reader->EndSection();
+}
+
 void Interpreter::InitName() {
   if (!name_) {
     int status;
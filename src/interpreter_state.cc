@@ -0,0 +1,181 @@
+// Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "gestures/include/interpreter_state.h"
+
+#include <string.h>
+
+#include "gestures/include/logging.h"
+
+namespace gestures {
+
+namespace {
+
+const char kStateMagic[8] = "GESTATE";
+// Bumped whenever an interpreter changes what it writes.
+const uint32_t kStateVersion = 4;
+
+}  // namespace
+
+StateWriter::StateWriter() {
+  WriteBytes(kStateMagic, sizeof(kStateMagic));
+  Write(kStateVersion);
+}
+
+void StateWriter::BeginSection(const char* name) {
+  uint32_t name_len = strlen(name);
+  Write(name_len);
+  WriteBytes(name, name_len);
+  sections_.push_back(blob_.size());
+  Write(static_cast<uint32_t>(0));
+}
+
+void StateWriter::EndSection() {
+  if (sections_.empty()) {
+    Err("No section to end");
+    return;
+  }
+  size_t start = sections_.back();
+  sections_.pop_back();
+  uint32_t len = blob_.size() - start - sizeof(len);
+  blob_.replace(start, sizeof(len), reinterpret_cast<const char*>(&len),
+                sizeof(len));
+}
+
+void StateWriter::WriteBytes(const void* data, size_t size) {
+  blob_.append(static_cast<const char*>(data), size);
+}
+
+void StateWriter::Write(const Vector2& value) {
+  Write(value.x);
+  Write(value.y);
+}
+
+// FingerState has padding, so it's written field by field to keep snapshots
+// of the same state identical.
+void StateWriter::Write(const FingerState& finger) {
+  Write(finger.touch_major);
+  Write(finger.touch_minor);
+  Write(finger.width_major);
+  Write(finger.width_minor);
+  Write(finger.pressure);
+  Write(finger.orientation);
+  Write(finger.position_x);
+  Write(finger.position_y);
+  Write(finger.tracking_id);
+  Write(finger.flags);
+}
+
+void StateWriter::Write(const HardwareState& hwstate) {
+  Write(hwstate.timestamp);
+  Write(hwstate.buttons_down);
+  Write(hwstate.finger_cnt);
+  Write(hwstate.touch_cnt);
+  Write(hwstate.rel_x);
+  Write(hwstate.rel_y);
+  Write(hwstate.rel_wheel);
+  Write(hwstate.rel_wheel_hi_res);
+  Write(hwstate.rel_hwheel);
+  Write(hwstate.msc_timestamp);
+  for (unsigned short i = 0; i < hwstate.finger_cnt; i++)
+    Write(hwstate.fingers[i]);
+}
+
+StateReader::StateReader(const char* data, size_t size)
+    : data_(data), size_(size), pos_(0), ok_(true) {
+  char magic[sizeof(kStateMagic)];
+  uint32_t version = 0;
+  if (!ReadBytes(magic, sizeof(magic)) || !Read(&version))
+    return;
+  if (memcmp(magic, kStateMagic, sizeof(magic)))
+    Fail("not a state snapshot");
+  else if (version != kStateVersion)
+    Fail("unsupported state snapshot version");
+}
+
+bool StateReader::BeginSection(const char* name) {
+  uint32_t name_len = 0;
+  if (!Read(&name_len))
+    return false;
+  if (name_len != strlen(name) || name_len > size_ - pos_ ||
+      memcmp(data_ + pos_, name, name_len))
+    return Fail(name);
+  pos_ += name_len;
+  uint32_t len = 0;
+  if (!Read(&len))
+    return false;
+  if (len > size_ - pos_)
+    return Fail("section too long");
+  section_ends_.push_back(pos_ + len);
+  return true;
+}
+
+bool StateReader::EndSection() {
+  if (!ok_)
+    return false;
+  if (section_ends_.empty())
+    return Fail("no section to end");
+  size_t end = section_ends_.back();
+  section_ends_.pop_back();
+  if (pos_ != end)
+    return Fail("section length mismatch");
+  return true;
+}
+
+bool StateReader::ReadBytes(void* data, size_t size) {
+  if (!ok_)
+    return false;
+  size_t end = section_ends_.empty() ? size_ : section_ends_.back();
+  if (size > end - pos_)
+    return Fail("truncated");
+  memcpy(data, data_ + pos_, size);
+  pos_ += size;
+  return true;
+}
+
+bool StateReader::Read(Vector2* value) {
+  return Read(&value->x) && Read(&value->y);
+}
+
+bool StateReader::Read(FingerState* finger) {
+  return Read(&finger->touch_major) && Read(&finger->touch_minor) &&
+      Read(&finger->width_major) && Read(&finger->width_minor) &&
+      Read(&finger->pressure) && Read(&finger->orientation) &&
+      Read(&finger->position_x) && Read(&finger->position_y) &&
+      Read(&finger->tracking_id) && Read(&finger->flags);
+}
+
+bool StateReader::Read(HardwareState* hwstate, size_t max_finger_cnt) {
+  if (!Read(&hwstate->timestamp) || !Read(&hwstate->buttons_down) ||
+      !Read(&hwstate->finger_cnt) || !Read(&hwstate->touch_cnt) ||
+      !Read(&hwstate->rel_x) || !Read(&hwstate->rel_y) ||
+      !Read(&hwstate->rel_wheel) || !Read(&hwstate->rel_wheel_hi_res) ||
+      !Read(&hwstate->rel_hwheel) || !Read(&hwstate->msc_timestamp))
+    return false;
+  if (hwstate->finger_cnt > max_finger_cnt) {
+    hwstate->finger_cnt = 0;
+    return Fail("too many fingers");
+  }
+  for (unsigned short i = 0; i < hwstate->finger_cnt; i++)
+    if (!Read(&hwstate->fingers[i]))
+      return false;
+  return true;
+}
+
+bool StateReader::ReadSize(uint32_t* size, size_t max_size) {
+  if (!Read(size))
+    return false;
+  if (*size > max_size)
+    return Fail("too many elements");
+  return true;
+}
+
+bool StateReader::Fail(const char* what) {
+  if (ok_)
+    Err("Can't restore interpreter state: %s at offset %zu", what, pos_);
+  ok_ = false;
+  return false;
+}
+
+}  // namespace gestures
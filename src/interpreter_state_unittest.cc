@@ -0,0 +1,274 @@
+// Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "gestures/include/gestures.h"
+#include "gestures/include/interpreter_state.h"
+#include "gestures/include/unittest_util.h"
+
+namespace gestures {
+
+class InterpreterStateTest : public ::testing::Test {};
+
+TEST(InterpreterStateTest, RoundTripTest) {
+  FingerState fs[] = {
+    // TM, Tm, WM, Wm, Press, Orientation, X, Y, TrID, flags
+    { 1, 2, 3, 4, 10, 0.5, 11, 12, 7, 0 },
+    { 5, 6, 7, 8, 20, -0.5, 21, 22, 8, GESTURES_FINGER_WARP_X },
+  };
+  HardwareState hs = make_hwstate(1.5, GESTURES_BUTTON_LEFT, 2, 2, fs);
+  vector<int, 4> ints;
+  ints.push_back(3);
+  ints.push_back(-1);
+  set<short, 4> shorts;
+  shorts.insert(9);
+  map<short, float, 4> floats;
+  floats[4] = 2.5;
+  floats[2] = -1.0;
+
+  StateWriter writer;
+  writer.BeginSection("outer");
+  writer.Write(static_cast<double>(0.25));
+  writer.BeginSection("inner");
+  writer.Write(ints);
+  writer.Write(shorts);
+  writer.EndSection();
+  writer.Write(floats);
+  writer.Write(hs);
+  writer.EndSection();
+  const std::string& blob = writer.blob();
+
+  StateReader reader(blob.data(), blob.size());
+  double value = 0.0;
+  vector<int, 4> read_ints;
+  set<short, 4> read_shorts;
+  map<short, float, 4> read_floats;
+  FingerState read_fs[2];
+  HardwareState read_hs = make_hwstate(0, 0, 0, 0, read_fs);
+  EXPECT_TRUE(reader.BeginSection("outer"));
+  EXPECT_TRUE(reader.Read(&value));
+  EXPECT_TRUE(reader.BeginSection("inner"));
+  EXPECT_TRUE(reader.Read(&read_ints));
+  EXPECT_TRUE(reader.Read(&read_shorts));
+  EXPECT_TRUE(reader.EndSection());
+  EXPECT_TRUE(reader.Read(&read_floats));
+  EXPECT_TRUE(reader.Read(&read_hs, arraysize(read_fs)));
+  EXPECT_TRUE(reader.EndSection());
+  EXPECT_TRUE(reader.done());
+
+  EXPECT_EQ(0.25, value);
+  ASSERT_EQ(2, read_ints.size());
+  EXPECT_EQ(3, read_ints[0]);
+  EXPECT_EQ(-1, read_ints[1]);
+  EXPECT_TRUE(shorts == read_shorts);
+  EXPECT_TRUE(floats == read_floats);
+  EXPECT_TRUE(hs.SameFingersAs(read_hs));
+  EXPECT_EQ(hs.timestamp, read_hs.timestamp);
+  EXPECT_EQ(hs.buttons_down, read_hs.buttons_down);
+  EXPECT_EQ(hs.touch_cnt, read_hs.touch_cnt);
+  EXPECT_TRUE(fs[1] == read_fs[1]);
+}
+
+TEST(InterpreterStateTest, BadBlobTest) {
+  vector<int, 4> ints;
+  ints.push_back(1);
+  ints.push_back(2);
+  StateWriter writer;
+  writer.BeginSection("a");
+  writer.Write(ints);
+  writer.EndSection();
+  const std::string blob = writer.blob();
+
+  // Each of these fails, and fails every read after it.
+  {
+    // Truncated.
+    StateReader reader(blob.data(), blob.size() - 1);
+    vector<int, 4> read_ints;
+    EXPECT_FALSE(reader.BeginSection("a"));
+    EXPECT_FALSE(reader.Read(&read_ints));
+    EXPECT_FALSE(reader.ok());
+  }
+  {
+    // Not a snapshot.
+    std::string bad = blob;
+    bad[0] = 'X';
+    StateReader reader(bad.data(), bad.size());
+    EXPECT_FALSE(reader.ok());
+    EXPECT_FALSE(reader.BeginSection("a"));
+  }
+  {
+    // Written by another interpreter.
+    StateReader reader(blob.data(), blob.size());
+    EXPECT_FALSE(reader.BeginSection("b"));
+    EXPECT_FALSE(reader.EndSection());
+  }
+  {
+    // Too many elements for the container.
+    StateReader reader(blob.data(), blob.size());
+    vector<int, 1> read_ints;
+    EXPECT_TRUE(reader.BeginSection("a"));
+    EXPECT_FALSE(reader.Read(&read_ints));
+    EXPECT_FALSE(reader.EndSection());
+  }
+  {
+    // Section not read up to its end.
+    StateReader reader(blob.data(), blob.size());
+    uint32_t size = 0;
+    EXPECT_TRUE(reader.BeginSection("a"));
+    EXPECT_TRUE(reader.Read(&size));
+    EXPECT_FALSE(reader.EndSection());
+  }
+}
+
+namespace {
+
+struct Frame {
+  HardwareState hs;
+  FingerState fs[2];
+};
+
+// A session of two-finger scrolling, pointing, a tap, a click and wheel
+// motion, 10 ms apart.
+std::vector<Frame> MakeSession() {
+  std::vector<Frame> frames;
+  for (int i = 0; i < 80; i++) {
+    Frame frame = {};
+    stime_t now = 1000.0 + 0.01 * i;
+    unsigned short finger_cnt = 0;
+    int buttons = 0;
+    FingerState* fs = frame.fs;
+    if (i < 25) {
+      // Two-finger scroll down.
+      fs[0] = { 0, 0, 0, 0, 50, 0, 40, 20 + 2.0f * i, 1, 0 };
+      fs[1] = { 0, 0, 0, 0, 50, 0, 60, 20 + 2.0f * i, 2, 0 };
+      finger_cnt = 2;
+    } else if (i >= 30 && i < 50) {
+      // Point diagonally.
+      float delta = 1.5f * (i - 30);
+      fs[0] = { 0, 0, 0, 0, 40, 0, 20 + delta, 30 + delta, 3, 0 };
+      finger_cnt = 1;
+    } else if (i >= 55 && i < 57) {
+      // Tap.
+      fs[0] = { 0, 0, 0, 0, 50, 0, 50, 30, 4, 0 };
+      finger_cnt = 1;
+    } else if (i >= 65 && i < 70) {
+      // Click.
+      fs[0] = { 0, 0, 0, 0, 80, 0, 50, 50, 5, 0 };
+      finger_cnt = 1;
+      buttons = GESTURES_BUTTON_LEFT;
+    }
+    frame.hs = make_hwstate(now, buttons, finger_cnt, finger_cnt, NULL);
+    if (i >= 70) {
+      frame.hs.rel_x = i % 3;
+      frame.hs.rel_y = 1;
+      frame.hs.rel_wheel = i % 2;
+    }
+    frames.push_back(frame);
+  }
+  return frames;
+}
+
+void RecordGesture(void* client_data, const Gesture* gesture) {
+  static_cast<std::vector<Gesture>*>(client_data)->push_back(*gesture);
+}
+
+// Makes an interpreter that appends its gestures to |gestures|.
+GestureInterpreter* NewRecordingInterpreter(
+    GestureInterpreterDeviceClass devclass, std::vector<Gesture>* gestures) {
+  HardwareProperties hwprops = {
+    0, 0, 100, 60,  // left, top, right, bottom
+    10, 10,  // res_x, res_y
+    133, 133,  // screen dpi x, y
+    -1, 2,  // orientation minimum, maximum
+    2, 5,  // max fingers, max touch
+    0, 0, 1,  // t5r2, semi-mt, is button pad
+    0, 1  // has wheel, wheel is hi res
+  };
+  hwprops.has_wheel = 1;
+  GestureInterpreter* gi = NewGestureInterpreter();
+  gi->Initialize(devclass);
+  gi->SetHardwareProperties(hwprops);
+  gi->set_callback(RecordGesture, gestures);
+  return gi;
+}
+
+void Push(GestureInterpreter* gi, Frame frame) {
+  frame.hs.fingers = frame.hs.finger_cnt ? frame.fs : NULL;
+  gi->PushHardwareState(&frame.hs);
+}
+
+void ExpectSameGestures(const std::vector<Gesture>& expected,
+                        const std::vector<Gesture>& actual,
+                        size_t split) {
+  ASSERT_EQ(expected.size(), actual.size()) << "split at " << split;
+  for (size_t i = 0; i < expected.size(); i++) {
+    EXPECT_TRUE(expected[i] == actual[i])
+        << "split at " << split << ": " << expected[i].String() << " vs. "
+        << actual[i].String();
+    EXPECT_EQ(expected[i].start_time, actual[i].start_time);
+    EXPECT_EQ(expected[i].end_time, actual[i].end_time);
+  }
+}
+
+// Checks that a chain restored from a snapshot taken after any frame of the
+// session goes on to produce the same gestures as the chain that took it.
+void CheckSessionRoundTrip(GestureInterpreterDeviceClass devclass) {
+  std::vector<Frame> frames = MakeSession();
+  for (size_t split = 0; split <= frames.size(); split++) {
+    std::vector<Gesture> expected;
+    std::vector<Gesture> actual;
+    std::unique_ptr<GestureInterpreter> original(
+        NewRecordingInterpreter(devclass, &expected));
+    std::unique_ptr<GestureInterpreter> restored(
+        NewRecordingInterpreter(devclass, &actual));
+    for (size_t i = 0; i < split; i++)
+      Push(original.get(), frames[i]);
+    std::string state = original->SaveState();
+    ASSERT_TRUE(restored->RestoreState(state)) << "split at " << split;
+    EXPECT_EQ(state, restored->SaveState()) << "split at " << split;
+
+    expected.clear();
+    for (size_t i = split; i < frames.size(); i++) {
+      Push(original.get(), frames[i]);
+      Push(restored.get(), frames[i]);
+    }
+    ExpectSameGestures(expected, actual, split);
+    EXPECT_EQ(original->SaveState(), restored->SaveState())
+        << "split at " << split;
+  }
+}
+
+}  // namespace
+
+TEST(InterpreterStateTest, TouchpadSessionTest) {
+  CheckSessionRoundTrip(GESTURES_DEVCLASS_TOUCHPAD);
+}
+
+TEST(InterpreterStateTest, MultitouchMouseSessionTest) {
+  CheckSessionRoundTrip(GESTURES_DEVCLASS_MULTITOUCH_MOUSE);
+}
+
+TEST(InterpreterStateTest, MouseSessionTest) {
+  CheckSessionRoundTrip(GESTURES_DEVCLASS_MOUSE);
+}
+
+TEST(InterpreterStateTest, WrongChainTest) {
+  std::vector<Gesture> gestures;
+  std::unique_ptr<GestureInterpreter> touchpad(
+      NewRecordingInterpreter(GESTURES_DEVCLASS_TOUCHPAD, &gestures));
+  std::unique_ptr<GestureInterpreter> mouse(
+      NewRecordingInterpreter(GESTURES_DEVCLASS_MOUSE, &gestures));
+  std::string state = touchpad->SaveState();
+  EXPECT_FALSE(mouse->RestoreState(state));
+  EXPECT_FALSE(touchpad->RestoreState(state.substr(0, state.size() / 2)));
+  EXPECT_FALSE(touchpad->RestoreState(state + "x"));
+  EXPECT_TRUE(touchpad->RestoreState(state));
+}
+
+}  // namespace gestures
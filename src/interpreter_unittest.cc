@@ -7,6 +7,7 @@
 #include <gtest/gtest.h>
 
 #include "gestures/include/activity_replay.h"
+#include "gestures/include/filter_interpreter.h"
 #include "gestures/include/gestures.h"
 #include "gestures/include/interpreter.h"
 #include "gestures/include/prop_registry.h"
@@ -185,4 +186,71 @@ TEST(InterpreterTest, ResetLogTest) {
   wrapper.SyncInterpret(&hardware_state, &timeout);
   EXPECT_EQ(base_interpreter->log_->size(), 1);
 }
+
+class InterpreterLatencyTestInterpreter : public Interpreter {
+ public:
+  InterpreterLatencyTestInterpreter() : Interpreter(NULL, NULL, false) {
+    InitName();
+  }
+ protected:
+  virtual void SyncInterpretImpl(HardwareState* hwstate, stime_t* timeout) {
+    // Busy wait so that this is clearly slower than the filter above.
+    stime_t end = MonotonicNow() + 0.002;
+    while (MonotonicNow() < end) {}
+  }
+};
+
+class InterpreterLatencyTestFilter : public FilterInterpreter {
+ public:
+  explicit InterpreterLatencyTestFilter(Interpreter* next)
+      : FilterInterpreter(NULL, next, NULL, false) {
+    InitName();
+  }
+};
+
+TEST(InterpreterTest, LatencyStatsTest) {
+  InterpreterLatencyTestInterpreter* base_interpreter =
+      new InterpreterLatencyTestInterpreter();
+  InterpreterLatencyTestFilter filter(base_interpreter);
+  TestInterpreterWrapper wrapper(&filter);
+
+  FingerState finger_state = {
+    // TM, Tm, WM, Wm, Press, Orientation, X, Y, TrID
+    0, 0, 0, 0, 10, 0, 50, 50, 1, 0
+  };
+  HardwareState hardware_state = make_hwstate(200000, 0, 1, 1, &finger_state);
+  stime_t timeout = -1.0;
+
+  // Disabled by default
+  wrapper.SyncInterpret(&hardware_state, &timeout);
+  EXPECT_EQ(0, filter.sync_latency().count());
+  EXPECT_EQ(0, base_interpreter->sync_latency().count());
+
+  filter.SetLatencyStatsEnabled(true);
+  EXPECT_TRUE(base_interpreter->latency_stats_enabled());
+  wrapper.SyncInterpret(&hardware_state, &timeout);
+  wrapper.HandleTimer(hardware_state.timestamp + 0.01, &timeout);
+  EXPECT_EQ(1, filter.sync_latency().count());
+  EXPECT_EQ(1, filter.timer_latency().count());
+  EXPECT_EQ(1, base_interpreter->sync_latency().count());
+  EXPECT_EQ(1, base_interpreter->timer_latency().count());
+  // The filter's self time excludes the time spent in the next interpreter.
+  EXPECT_GE(base_interpreter->sync_latency().total(), 0.002);
+  EXPECT_LT(filter.sync_latency().total(),
+            base_interpreter->sync_latency().total());
+
+  Json::Value stats(Json::arrayValue);
+  filter.EncodeLatencyStats(&stats);
+  ASSERT_EQ(2, stats.size());
+  EXPECT_EQ("InterpreterLatencyTestFilter",
+            stats[0][ActivityLog::kKeyInterpreterName].asString());
+  EXPECT_EQ("InterpreterLatencyTestInterpreter",
+            stats[1][ActivityLog::kKeyInterpreterName].asString());
+  EXPECT_EQ(1, stats[1][ActivityLog::kKeyLatencySync]
+            [LatencyHistogram::kKeyCount].asInt());
+
+  filter.ClearLatencyStats();
+  EXPECT_EQ(0, filter.sync_latency().count());
+  EXPECT_EQ(0, base_interpreter->sync_latency().count());
+}
 }  // namespace gestures
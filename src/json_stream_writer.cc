@@ -0,0 +1,234 @@
+// Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "gestures/include/json_stream_writer.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "gestures/include/file_util.h"
+
+namespace gestures {
+
+const size_t JsonStreamWriter::kBufferSize;
+
+JsonStreamWriter::JsonStreamWriter(int fd)
+    : fd_(fd), used_(0), depth_(0), first_(true), after_key_(false),
+      ok_(true) {}
+
+void JsonStreamWriter::StartValue() {
+  if (after_key_) {
+    after_key_ = false;
+    return;
+  }
+  if (!first_) {
+    WriteChar(',');
+    // Keep the top levels, and thus each log entry, on their own lines.
+    if (depth_ <= 2)
+      WriteChar('\n');
+  }
+  first_ = false;
+}
+
+void JsonStreamWriter::BeginObject() {
+  StartValue();
+  WriteChar('{');
+  depth_++;
+  first_ = true;
+}
+
+void JsonStreamWriter::EndObject() {
+  WriteChar('}');
+  depth_--;
+  first_ = false;
+}
+
+void JsonStreamWriter::BeginArray() {
+  StartValue();
+  WriteChar('[');
+  depth_++;
+  first_ = true;
+}
+
+void JsonStreamWriter::EndArray() {
+  WriteChar(']');
+  depth_--;
+  first_ = false;
+}
+
+void JsonStreamWriter::Key(const char* key) {
+  StartValue();
+  WriteString(key, strlen(key));
+  WriteChar(':');
+  after_key_ = true;
+}
+
+void JsonStreamWriter::Bool(bool value) {
+  StartValue();
+  if (value)
+    Write("true", 4);
+  else
+    Write("false", 5);
+}
+
+void JsonStreamWriter::Int(int value) {
+  StartValue();
+  char buf[16];
+  int len = snprintf(buf, sizeof(buf), "%d", value);
+  Write(buf, len);
+}
+
+void JsonStreamWriter::Double(double value) {
+  StartValue();
+  if (!isfinite(value)) {
+    Write("null", 4);
+    return;
+  }
+  char buf[32];
+  int len = snprintf(buf, sizeof(buf), "%.17g", value);
+  Write(buf, len);
+  // Make sure it reads back as a real rather than an integer.
+  if (!strpbrk(buf, ".e"))
+    Write(".0", 2);
+}
+
+void JsonStreamWriter::String(const char* value) {
+  StartValue();
+  WriteString(value, strlen(value));
+}
+
+void JsonStreamWriter::Value(const Json::Value& value) {
+  switch (value.type()) {
+    case Json::nullValue:
+      StartValue();
+      Write("null", 4);
+      break;
+    case Json::intValue:
+      StartValue();
+      {
+        char buf[32];
+        int len = snprintf(buf, sizeof(buf), "%lld",
+                           static_cast<long long>(value.asLargestInt()));
+        Write(buf, len);
+      }
+      break;
+    case Json::uintValue:
+      StartValue();
+      {
+        char buf[32];
+        int len = snprintf(
+            buf, sizeof(buf), "%llu",
+            static_cast<unsigned long long>(value.asLargestUInt()));
+        Write(buf, len);
+      }
+      break;
+    case Json::realValue:
+      Double(value.asDouble());
+      break;
+    case Json::stringValue:
+      StartValue();
+      {
+        std::string str = value.asString();
+        WriteString(str.data(), str.size());
+      }
+      break;
+    case Json::booleanValue:
+      Bool(value.asBool());
+      break;
+    case Json::arrayValue:
+      BeginArray();
+      for (Json::Value::ArrayIndex i = 0; i < value.size(); i++)
+        Value(value[i]);
+      EndArray();
+      break;
+    case Json::objectValue: {
+      BeginObject();
+      std::vector<std::string> keys = value.getMemberNames();
+      for (size_t i = 0; i < keys.size(); i++) {
+        Key(keys[i].c_str());
+        Value(value[keys[i]]);
+      }
+      EndObject();
+      break;
+    }
+  }
+}
+
+bool JsonStreamWriter::Flush() {
+  if (used_ && ok_ &&
+      WriteFileDescriptor(fd_, buffer_, used_) != static_cast<int>(used_))
+    ok_ = false;
+  used_ = 0;
+  return ok_;
+}
+
+void JsonStreamWriter::Write(const char* data, size_t size) {
+  while (size) {
+    if (used_ == kBufferSize)
+      Flush();
+    size_t chunk = kBufferSize - used_;
+    if (chunk > size)
+      chunk = size;
+    memcpy(&buffer_[used_], data, chunk);
+    used_ += chunk;
+    data += chunk;
+    size -= chunk;
+  }
+}
+
+void JsonStreamWriter::WriteString(const char* value, size_t size) {
+  WriteChar('"');
+  for (size_t i = 0; i < size; i++) {
+    unsigned char c = value[i];
+    switch (c) {
+      case '"': Write("\\\"", 2); break;
+      case '\\': Write("\\\\", 2); break;
+      case '\n': Write("\\n", 2); break;
+      case '\r': Write("\\r", 2); break;
+      case '\t': Write("\\t", 2); break;
+      default:
+        if (c < 0x20) {
+          char buf[8];
+          int len = snprintf(buf, sizeof(buf), "\\u%04x", c);
+          Write(buf, len);
+        } else {
+          WriteChar(c);
+        }
+    }
+  }
+  WriteChar('"');
+}
+
+JsonValueWriter::JsonValueWriter(Json::Value* root) : key_(NULL) {
+  open_.push_back(root);
+}
+
+void JsonValueWriter::BeginObject() {
+  open_.push_back(Add(Json::Value(Json::objectValue)));
+}
+
+void JsonValueWriter::EndObject() {
+  open_.pop_back();
+}
+
+void JsonValueWriter::BeginArray() {
+  open_.push_back(Add(Json::Value(Json::arrayValue)));
+}
+
+void JsonValueWriter::EndArray() {
+  open_.pop_back();
+}
+
+Json::Value* JsonValueWriter::Add(const Json::Value& value) {
+  Json::Value* parent = open_.back();
+  if (parent->isArray())
+    return &parent->append(value);
+  return &((*parent)[key_] = value);
+}
+
+}  // namespace gestures
@@ -0,0 +1,161 @@
+// Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <gtest/gtest.h>
+#include <json/reader.h>
+#include <json/value.h>
+
+#include "gestures/include/file_util.h"
+#include "gestures/include/json_stream_writer.h"
+
+using std::string;
+
+namespace gestures {
+
+class JsonStreamWriterTest : public ::testing::Test {};
+
+namespace {
+
+// Runs |write| against a writer on a temporary file and returns what was
+// written.
+string WriteToString(void (*write)(JsonStreamWriter*)) {
+  char filename[] = "/tmp/gestures_json_XXXXXX";
+  int fd = mkstemp(filename);
+  EXPECT_GE(fd, 0);
+  {
+    JsonStreamWriter writer(fd);
+    write(&writer);
+    EXPECT_TRUE(writer.Flush());
+  }
+  close(fd);
+  string contents;
+  EXPECT_TRUE(ReadFileToString(filename, &contents));
+  unlink(filename);
+  return contents;
+}
+
+void WriteSimple(JsonStreamWriter* writer) {
+  writer->BeginObject();
+  writer->Key("a");
+  writer->Int(-3);
+  writer->Key("b");
+  writer->BeginArray();
+  writer->Bool(true);
+  writer->Double(2.0);
+  writer->Double(0.5);
+  writer->String("q\"\\\n\x01");
+  writer->BeginObject();
+  writer->EndObject();
+  writer->BeginArray();
+  writer->EndArray();
+  writer->EndArray();
+  writer->Key("c");
+  writer->Bool(false);
+  writer->EndObject();
+}
+
+void WriteLong(JsonStreamWriter* writer) {
+  writer->BeginArray();
+  for (int i = 0; i < 10000; i++)
+    writer->Int(i);
+  writer->EndArray();
+}
+
+Json::Value MakeValue() {
+  Json::Value value(Json::objectValue);
+  value["x"] = Json::Value(1.5);
+  value["y"] = Json::Value("s");
+  value["z"] = Json::Value(Json::arrayValue);
+  value["z"].append(Json::Value(7));
+  value["z"].append(Json::Value());
+  return value;
+}
+
+void WriteValue(JsonStreamWriter* writer) {
+  writer->Value(MakeValue());
+}
+
+}  // namespace
+
+TEST(JsonStreamWriterTest, SimpleTest) {
+  string out = WriteToString(WriteSimple);
+  Json::Reader reader;
+  Json::Value root;
+  ASSERT_TRUE(reader.parse(out, root, false)) << out;
+  EXPECT_EQ(-3, root["a"].asInt());
+  ASSERT_EQ(6, root["b"].size());
+  EXPECT_TRUE(root["b"][0].asBool());
+  EXPECT_TRUE(root["b"][1].isDouble());
+  EXPECT_EQ(2.0, root["b"][1].asDouble());
+  EXPECT_EQ(0.5, root["b"][2].asDouble());
+  EXPECT_EQ("q\"\\\n\x01", root["b"][3].asString());
+  EXPECT_TRUE(root["b"][4].isObject());
+  EXPECT_TRUE(root["b"][5].isArray());
+  EXPECT_FALSE(root["c"].asBool());
+}
+
+TEST(JsonStreamWriterTest, ValueTest) {
+  string out = WriteToString(WriteValue);
+  Json::Reader reader;
+  Json::Value root;
+  ASSERT_TRUE(reader.parse(out, root, false)) << out;
+  EXPECT_EQ(MakeValue(), root);
+}
+
+TEST(JsonStreamWriterTest, ValueWriterTest) {
+  Json::Value root(Json::objectValue);
+  JsonValueWriter writer(&root);
+  writer.Key("a");
+  writer.Int(-3);
+  writer.Key("b");
+  writer.BeginArray();
+  writer.Bool(true);
+  writer.Double(2.0);
+  writer.BeginObject();
+  writer.Key("c");
+  writer.String("s");
+  writer.EndObject();
+  writer.BeginArray();
+  writer.EndArray();
+  writer.EndArray();
+  writer.Key("d");
+  writer.Value(MakeValue());
+
+  Json::Value expected(Json::objectValue);
+  expected["a"] = Json::Value(-3);
+  expected["b"] = Json::Value(Json::arrayValue);
+  expected["b"].append(Json::Value(true));
+  expected["b"].append(Json::Value(2.0));
+  expected["b"].append(Json::Value(Json::objectValue));
+  expected["b"][2]["c"] = Json::Value("s");
+  expected["b"].append(Json::Value(Json::arrayValue));
+  expected["d"] = MakeValue();
+  EXPECT_EQ(expected, root);
+  EXPECT_TRUE(root["b"][1].isDouble());
+}
+
+TEST(JsonStreamWriterTest, LongOutputTest) {
+  // Much more than fits in the buffer at once
+  string out = WriteToString(WriteLong);
+  EXPECT_GT(out.size(), JsonStreamWriter::kBufferSize);
+  Json::Reader reader;
+  Json::Value root;
+  ASSERT_TRUE(reader.parse(out, root, false));
+  ASSERT_EQ(10000, root.size());
+  EXPECT_EQ(9999, root[9999].asInt());
+}
+
+TEST(JsonStreamWriterTest, WriteErrorTest) {
+  JsonStreamWriter writer(-1);
+  writer.BeginArray();
+  writer.EndArray();
+  EXPECT_FALSE(writer.Flush());
+}
+
+}  // namespace gestures
@@ -0,0 +1,61 @@
+// Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "gestures/include/latency_histogram.h"
+
+#include <string.h>
+#include <time.h>
+
+namespace gestures {
+
+stime_t MonotonicNow() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return StimeFromTimespec(&ts);
+}
+
+void LatencyHistogram::Add(stime_t duration) {
+  if (duration < 0.0)
+    duration = 0.0;
+  buckets_[BucketForDuration(duration)]++;
+  count_++;
+  total_ += duration;
+  if (duration > max_)
+    max_ = duration;
+}
+
+void LatencyHistogram::Clear() {
+  memset(buckets_, 0, sizeof(buckets_));
+  count_ = 0;
+  total_ = 0.0;
+  max_ = 0.0;
+}
+
+size_t LatencyHistogram::BucketForDuration(stime_t duration) {
+  if (duration < 1e-6)
+    return 0;
+  unsigned long long us = static_cast<unsigned long long>(duration * 1e6);
+  size_t bucket = 64 - __builtin_clzll(us);
+  return bucket < kNumBuckets ? bucket : kNumBuckets - 1;
+}
+
+Json::Value LatencyHistogram::Encode() const {
+  Json::Value ret(Json::objectValue);
+  ret[kKeyCount] = Json::Value(static_cast<Json::UInt>(count_));
+  ret[kKeyTotal] = Json::Value(total_);
+  ret[kKeyMax] = Json::Value(max_);
+  Json::Value buckets(Json::arrayValue);
+  for (size_t i = 0; i < kNumBuckets; i++)
+    buckets.append(Json::Value(static_cast<Json::UInt>(buckets_[i])));
+  ret[kKeyBuckets] = buckets;
+  return ret;
+}
+
+const size_t LatencyHistogram::kNumBuckets;
+const char LatencyHistogram::kKeyCount[] = "count";
+const char LatencyHistogram::kKeyTotal[] = "total";
+const char LatencyHistogram::kKeyMax[] = "max";
+const char LatencyHistogram::kKeyBuckets[] = "buckets";
+
+}  // namespace gestures
@@ -0,0 +1,50 @@
+// Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <gtest/gtest.h>
+
+#include "gestures/include/latency_histogram.h"
+
+namespace gestures {
+
+class LatencyHistogramTest : public ::testing::Test {};
+
+TEST(LatencyHistogramTest, BucketTest) {
+  EXPECT_EQ(0, LatencyHistogram::BucketForDuration(0.0));
+  EXPECT_EQ(0, LatencyHistogram::BucketForDuration(0.0000009));
+  EXPECT_EQ(1, LatencyHistogram::BucketForDuration(0.0000011));
+  EXPECT_EQ(2, LatencyHistogram::BucketForDuration(0.000002));
+  EXPECT_EQ(2, LatencyHistogram::BucketForDuration(0.0000039));
+  EXPECT_EQ(7, LatencyHistogram::BucketForDuration(0.0001));
+  EXPECT_EQ(LatencyHistogram::kNumBuckets - 1,
+            LatencyHistogram::BucketForDuration(10.0));
+}
+
+TEST(LatencyHistogramTest, AddClearTest) {
+  LatencyHistogram hist;
+  hist.Add(0.0001);
+  hist.Add(0.0003);
+  hist.Add(-1.0);  // Clamped to 0
+  EXPECT_EQ(3, hist.count());
+  EXPECT_DOUBLE_EQ(0.0004, hist.total());
+  EXPECT_DOUBLE_EQ(0.0003, hist.max());
+  EXPECT_EQ(1, hist.bucket(0));
+  EXPECT_EQ(1, hist.bucket(7));
+  EXPECT_EQ(1, hist.bucket(9));
+
+  Json::Value encoded = hist.Encode();
+  EXPECT_EQ(3, encoded[LatencyHistogram::kKeyCount].asInt());
+  EXPECT_EQ(LatencyHistogram::kNumBuckets,
+            encoded[LatencyHistogram::kKeyBuckets].size());
+  EXPECT_EQ(1, encoded[LatencyHistogram::kKeyBuckets][9].asInt());
+
+  hist.Clear();
+  EXPECT_EQ(0, hist.count());
+  EXPECT_DOUBLE_EQ(0.0, hist.total());
+  EXPECT_DOUBLE_EQ(0.0, hist.max());
+  for (size_t i = 0; i < LatencyHistogram::kNumBuckets; i++)
+    EXPECT_EQ(0, hist.bucket(i));
+}
+
+}  // namespace gestures
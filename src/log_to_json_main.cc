@@ -0,0 +1,62 @@
+// Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Converts an activity log in ActivityLog's binary format to the JSON
+// format, so that tools that only understand JSON logs (e.g., tplog.py) can
+// read it. JSON logs are passed through unchanged.
+//
+// Usage: log_to_json in_log [out_log]
+// If out_log isn't given, the JSON is written to stdout.
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include <string>
+
+#include "gestures/include/activity_replay.h"
+#include "gestures/include/file_util.h"
+#include "gestures/include/gestures.h"
+
+using std::string;
+
+int main(int argc, char** argv) {
+  if (argc < 2 || argc > 3) {
+    fprintf(stderr, "usage: %s in_log [out_log]\n", argv[0]);
+    return 1;
+  }
+  string contents;
+  if (!gestures::ReadFileToString(argv[1], &contents)) {
+    fprintf(stderr, "Unable to read %s\n", argv[1]);
+    return 1;
+  }
+  gestures::ActivityReplay replay(NULL);
+  if (!replay.Parse(contents)) {
+    fprintf(stderr, "Unable to parse %s\n", argv[1]);
+    return 1;
+  }
+  string json = replay.EncodeJson();
+  if (argc == 3) {
+    if (gestures::WriteFile(argv[2], json.c_str(), json.size()) !=
+        static_cast<int>(json.size())) {
+      fprintf(stderr, "Unable to write %s\n", argv[2]);
+      return 1;
+    }
+    return 0;
+  }
+  fwrite(json.data(), 1, json.size(), stdout);
+  return 0;
+}
+
+extern "C" {
+
+void gestures_log(int verb, const char* fmt, ...) {
+  if (verb != GESTURES_LOG_ERROR)
+    return;
+  va_list args;
+  va_start(args, fmt);
+  vfprintf(stderr, fmt, args);
+  va_end(args);
+}
+
+}
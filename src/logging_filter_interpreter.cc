@@ -6,10 +6,15 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
 #include <string>
 
-#include "gestures/include/logging.h"
+#include "gestures/include/eintr_wrapper.h"
 #include "gestures/include/file_util.h"
+#include "gestures/include/json_stream_writer.h"
+#include "gestures/include/logging.h"
 
 namespace gestures {
 
@@ -21,25 +26,151 @@ LoggingFilterInterpreter::LoggingFilterInterpreter(PropRegistry* prop_reg,
       logging_reset_(prop_reg, "Logging Reset", 0, this),
       log_location_(prop_reg, "Log Path",
                     "/var/log/xorg/touchpad_activity_log.txt"),
-      integrated_touchpad_(prop_reg, "Integrated Touchpad", 0) {
+      log_binary_(prop_reg, "Log Binary Format", 0),
+      log_dump_async_(prop_reg, "Async Log Dump", 0),
+      latency_stats_enable_(prop_reg, "Latency Stats Enable", 0, this),
+      integrated_touchpad_(prop_reg, "Integrated Touchpad", 0),
+      dump_running_(false) {
   InitName();
   if (prop_reg && log_.get())
     prop_reg->set_activity_log(log_.get());
+  if (latency_stats_enable_.val_)
+    SetLatencyStatsEnabled(true);
+}
+
+LoggingFilterInterpreter::~LoggingFilterInterpreter() {
+  WaitForDump();
+}
+
+void LoggingFilterInterpreter::BoolWasWritten(BoolProperty* prop) {
+  if (prop == &latency_stats_enable_)
+    SetLatencyStatsEnabled(latency_stats_enable_.val_);
 }
 
 void LoggingFilterInterpreter::IntWasWritten(IntProperty* prop) {
   if (prop == &logging_notify_)
     Dump(log_location_.val_);
-  if (prop == &logging_reset_)
+  if (prop == &logging_reset_) {
     Clear();
+    ClearLatencyStats();
+  }
 };
 
 std::string LoggingFilterInterpreter::EncodeActivityLog() {
   return Encode();
 }
 
+namespace {
+
+int OpenDumpFile(const char* filename) {
+  int fd = HANDLE_EINTR(creat(filename, 0666));
+  if (fd < 0)
+    Err("Unable to open %s for writing: %s", filename, strerror(errno));
+  return fd;
+}
+
+void CloseDumpFile(int fd, const char* filename, bool ok) {
+  if (!ok)
+    Err("Failed to write activity log to %s", filename);
+  if (IGNORE_EINTR(close(fd)) < 0)
+    Err("Failed to close %s: %s", filename, strerror(errno));
+}
+
+bool WriteBinaryLog(int fd, ActivityLog* log) {
+  std::string data = log->EncodeBinary();
+  return WriteFileDescriptor(fd, data.data(), data.size()) ==
+      static_cast<int>(data.size());
+}
+
+}  // namespace {}
+
 void LoggingFilterInterpreter::Dump(const char* filename) {
-  std::string data = Encode();
-  WriteFile(filename, data.c_str(), data.size());
+#ifndef DEEP_LOGS
+  // Deep logs include the logs of the rest of the chain, which aren't
+  // snapshotted, so they are always written synchronously.
+  if (log_dump_async_.val_ && log_.get()) {
+    DumpAsync(filename);
+    return;
+  }
+#endif  // DEEP_LOGS
+  int fd = OpenDumpFile(filename);
+  if (fd < 0)
+    return;
+  bool ok;
+  if (log_binary_.val_ && log_.get()) {
+    ok = WriteBinaryLog(fd, log_.get());
+  } else {
+    // JSON logs are streamed out as they are encoded, so that dumping a full
+    // log doesn't need memory proportional to its size.
+    ok = WriteEncoded(fd);
+  }
+  CloseDumpFile(fd, filename, ok);
+}
+
+void LoggingFilterInterpreter::DumpAsync(const char* filename) {
+  std::unique_ptr<DumpSnapshot> snapshot(new DumpSnapshot);
+  snapshot->filename = filename;
+  snapshot->binary = log_binary_.val_;
+  snapshot->log.CopyFrom(*log_);
+  if (latency_stats_enabled()) {
+    snapshot->latency_stats = Json::Value(Json::arrayValue);
+    EncodeLatencyStats(&snapshot->latency_stats);
+  }
+  {
+    std::lock_guard<std::mutex> lock(dump_lock_);
+    pending_dump_ = std::move(snapshot);
+    // The thread writing dumps picks this one up when it's done.
+    if (dump_running_)
+      return;
+    dump_running_ = true;
+  }
+  pthread_attr_t attr;
+  pthread_t thread;
+  int err = pthread_attr_init(&attr);
+  if (!err) {
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    err = pthread_create(&thread, &attr, DumpThreadMain, this);
+    pthread_attr_destroy(&attr);
+  }
+  if (err) {
+    Err("Can't start a thread to dump the log: %s", strerror(err));
+    WriteDumps();
+  }
+}
+
+void* LoggingFilterInterpreter::DumpThreadMain(void* interpreter) {
+  static_cast<LoggingFilterInterpreter*>(interpreter)->WriteDumps();
+  return NULL;
+}
+
+void LoggingFilterInterpreter::WriteDumps() {
+  std::unique_lock<std::mutex> lock(dump_lock_);
+  while (pending_dump_.get()) {
+    std::unique_ptr<DumpSnapshot> snapshot = std::move(pending_dump_);
+    lock.unlock();
+    WriteSnapshot(snapshot.get());
+    lock.lock();
+  }
+  dump_running_ = false;
+  dump_done_.notify_all();
+}
+
+void LoggingFilterInterpreter::WriteSnapshot(DumpSnapshot* snapshot) {
+  const char* filename = snapshot->filename.c_str();
+  int fd = OpenDumpFile(filename);
+  if (fd < 0)
+    return;
+  bool ok;
+  if (snapshot->binary)
+    ok = WriteBinaryLog(fd, &snapshot->log);
+  else
+    ok = WriteEncoded(fd, &snapshot->log, snapshot->latency_stats);
+  CloseDumpFile(fd, filename, ok);
+}
+
+void LoggingFilterInterpreter::WaitForDump() {
+  std::unique_lock<std::mutex> lock(dump_lock_);
+  while (dump_running_)
+    dump_done_.wait(lock);
 }
 }  // namespace gestures
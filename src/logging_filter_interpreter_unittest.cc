@@ -2,11 +2,16 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <stdlib.h>
 #include <string>
+#include <unistd.h>
 
 #include <gtest/gtest.h>
+#include <json/reader.h>
+#include <json/value.h>
 
 #include "gestures/include/activity_replay.h"
+#include "gestures/include/file_util.h"
 #include "gestures/include/gestures.h"
 #include "gestures/include/interpreter.h"
 #include "gestures/include/logging_filter_interpreter.h"
@@ -68,4 +73,171 @@ TEST(LoggingFilterInterpreterTest, LogResetHandlerTest) {
   wrapper.SyncInterpret(&hardware_state, &timeout);
   EXPECT_EQ(interpreter.log_->size(), 1);
 }
+
+TEST(LoggingFilterInterpreterTest, AsyncDumpTest) {
+  PropRegistry prop_reg;
+  LoggingFilterInterpreter interpreter(
+      &prop_reg, new LoggingFilterInterpreterResetLogTestInterpreter(), NULL);
+  interpreter.SetLatencyStatsEnabled(true);
+  interpreter.log_dump_async_.val_ = 1;
+  HardwareProperties hwprops = {
+    0, 0, 100, 100, 10, 10, 133, 133, -1, 2, 2, 5, 1, 0, 0, 0, 0
+  };
+  TestInterpreterWrapper wrapper(&interpreter, &hwprops);
+  FingerState finger_state = {
+    // TM, Tm, WM, Wm, Press, Orientation, X, Y, TrID
+    0, 0, 0, 0, 10, 0, 50, 50, 1, 0
+  };
+  HardwareState hardware_state = make_hwstate(200000, 0, 1, 1, &finger_state);
+  stime_t timeout = -1.0;
+  wrapper.SyncInterpret(&hardware_state, &timeout);
+  wrapper.SyncInterpret(&hardware_state, &timeout);
+  string expected = interpreter.Encode();
+
+  char filename[] = "/tmp/gestures_log_XXXXXX";
+  int fd = mkstemp(filename);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  interpreter.Dump(filename);
+  // Activity after the dump was requested isn't included.
+  wrapper.SyncInterpret(&hardware_state, &timeout);
+  interpreter.Clear();
+  interpreter.WaitForDump();
+  string contents;
+  EXPECT_TRUE(ReadFileToString(filename, &contents));
+  unlink(filename);
+
+  Json::Reader reader;
+  Json::Value dumped;
+  Json::Value encoded;
+  ASSERT_TRUE(reader.parse(contents, dumped, false));
+  ASSERT_TRUE(reader.parse(expected, encoded, false));
+  EXPECT_EQ(2, dumped[ActivityLog::kKeyRoot].size());
+  EXPECT_EQ(encoded.toStyledString(), dumped.toStyledString());
+}
+
+// Tests that dumps requested while one is being written are coalesced, so
+// that only the latest is written once it's done.
+TEST(LoggingFilterInterpreterTest, CoalescedDumpTest) {
+  PropRegistry prop_reg;
+  LoggingFilterInterpreter interpreter(
+      &prop_reg, new LoggingFilterInterpreterResetLogTestInterpreter(), NULL);
+  interpreter.log_dump_async_.val_ = 1;
+  HardwareProperties hwprops = {
+    0, 0, 100, 100, 10, 10, 133, 133, -1, 2, 2, 5, 1, 0, 0, 0, 0
+  };
+  TestInterpreterWrapper wrapper(&interpreter, &hwprops);
+  FingerState finger_state = {
+    // TM, Tm, WM, Wm, Press, Orientation, X, Y, TrID
+    0, 0, 0, 0, 10, 0, 50, 50, 1, 0
+  };
+  HardwareState hardware_state = make_hwstate(200000, 0, 1, 1, &finger_state);
+  stime_t timeout = -1.0;
+  wrapper.SyncInterpret(&hardware_state, &timeout);
+
+  char first[] = "/tmp/gestures_log_XXXXXX";
+  char second[] = "/tmp/gestures_log_XXXXXX";
+  int fd = mkstemp(first);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  fd = mkstemp(second);
+  ASSERT_GE(fd, 0);
+  close(fd);
+
+  // Pretend a dump is being written, so these only queue their snapshots.
+  interpreter.dump_running_ = true;
+  interpreter.Dump(first);
+  wrapper.SyncInterpret(&hardware_state, &timeout);
+  interpreter.Dump(second);
+  ASSERT_TRUE(interpreter.pending_dump_.get());
+  EXPECT_EQ(second, interpreter.pending_dump_->filename);
+  interpreter.WriteDumps();
+  EXPECT_FALSE(interpreter.dump_running_);
+  EXPECT_FALSE(interpreter.pending_dump_.get());
+
+  string contents;
+  EXPECT_TRUE(ReadFileToString(first, &contents));
+  EXPECT_TRUE(contents.empty());
+  EXPECT_TRUE(ReadFileToString(second, &contents));
+  unlink(first);
+  unlink(second);
+  Json::Reader reader;
+  Json::Value dumped;
+  ASSERT_TRUE(reader.parse(contents, dumped, false));
+  EXPECT_EQ(2, dumped[ActivityLog::kKeyRoot].size());
+}
+
+TEST(LoggingFilterInterpreterTest, BinaryDumpTest) {
+  PropRegistry prop_reg;
+  LoggingFilterInterpreter interpreter(
+      &prop_reg, new LoggingFilterInterpreterResetLogTestInterpreter(), NULL);
+  HardwareProperties hwprops = {
+    0, 0, 100, 100, 10, 10, 133, 133, -1, 2, 2, 5, 1, 0, 0, 0, 0
+  };
+  TestInterpreterWrapper wrapper(&interpreter, &hwprops);
+  FingerState finger_state = {
+    // TM, Tm, WM, Wm, Press, Orientation, X, Y, TrID
+    0, 0, 0, 0, 10, 0, 50, 50, 1, 0
+  };
+  HardwareState hardware_state = make_hwstate(200000, 0, 1, 1, &finger_state);
+  stime_t timeout = -1.0;
+  wrapper.SyncInterpret(&hardware_state, &timeout);
+  wrapper.SyncInterpret(&hardware_state, &timeout);
+
+  char filename[] = "/tmp/gestures_log_XXXXXX";
+  int fd = mkstemp(filename);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  interpreter.log_binary_.val_ = 1;
+  interpreter.Dump(filename);
+  string contents;
+  EXPECT_TRUE(ReadFileToString(filename, &contents));
+  unlink(filename);
+
+  ActivityReplay replay(NULL);
+  ASSERT_TRUE(replay.Parse(contents));
+  EXPECT_EQ(interpreter.log_->size(), replay.log()->size());
+}
+
+TEST(LoggingFilterInterpreterTest, StreamedDumpTest) {
+  PropRegistry prop_reg;
+  LoggingFilterInterpreter interpreter(
+      &prop_reg, new LoggingFilterInterpreterResetLogTestInterpreter(), NULL);
+  interpreter.SetLatencyStatsEnabled(true);
+  HardwareProperties hwprops = {
+    0, 0, 100, 100, 10, 10, 133, 133, -1, 2, 2, 5, 1, 0, 0, 0, 0
+  };
+  TestInterpreterWrapper wrapper(&interpreter, &hwprops);
+  FingerState finger_state = {
+    // TM, Tm, WM, Wm, Press, Orientation, X, Y, TrID
+    0, 0, 0, 0, 10, 0, 50.5, 50, 1, 0
+  };
+  HardwareState hardware_state = make_hwstate(200000, 0, 1, 1, &finger_state);
+  stime_t timeout = -1.0;
+  wrapper.SyncInterpret(&hardware_state, &timeout);
+  wrapper.HandleTimer(200000.25, &timeout);
+  interpreter.log_->LogGesture(
+      Gesture(kGestureMove, 200000, 200000.5, -1.25, 3));
+  interpreter.log_->LogGesture(
+      Gesture(kGestureButtonsChange, 1, 2, GESTURES_BUTTON_LEFT, 0));
+  interpreter.log_->LogCallbackRequest(200001);
+
+  char filename[] = "/tmp/gestures_log_XXXXXX";
+  int fd = mkstemp(filename);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  interpreter.Dump(filename);
+  string contents;
+  EXPECT_TRUE(ReadFileToString(filename, &contents));
+  unlink(filename);
+
+  // The streamed dump should parse to the same thing as Encode().
+  Json::Reader reader;
+  Json::Value streamed;
+  Json::Value encoded;
+  ASSERT_TRUE(reader.parse(contents, streamed, false));
+  ASSERT_TRUE(reader.parse(interpreter.Encode(), encoded, false));
+  EXPECT_EQ(5, streamed[ActivityLog::kKeyRoot].size());
+  EXPECT_EQ(encoded.toStyledString(), streamed.toStyledString());
+}
 }  // namespace gestures
@@ -8,6 +8,9 @@
 #include <math.h>
 #include <values.h>
 
+#include "gestures/include/activity_log.h"
+#include "gestures/include/interpreter_state.h"
+#include "gestures/include/latency_histogram.h"
 #include "gestures/include/tracer.h"
 #include "gestures/include/util.h"
 
@@ -18,13 +21,16 @@ namespace gestures {
 
 namespace {
 static const stime_t kMaxDelay = 0.09;  // 90ms
+// How much each new sample moves the adaptive delay estimates.
+static const stime_t kAdaptiveDelayWeight = 0.1;
 }
 
 LookaheadFilterInterpreter::LookaheadFilterInterpreter(
     PropRegistry* prop_reg, Interpreter* next, Tracer* tracer)
     : FilterInterpreter(NULL, next, tracer, false),
       last_id_(0), max_fingers_per_hwstate_(0), interpreter_due_(-1.0),
-      last_interpreted_time_(-1.0),
+      last_interpreted_time_(-1.0), delay_(0.0), report_interval_(-1.0),
+      downstream_time_(0.0), last_hwstate_time_(-1.0), clock_(MonotonicNow),
       min_nonsuppress_speed_(prop_reg, "Input Queue Min Nonsuppression Speed",
                              200.0),
       min_delay_(prop_reg, "Input Queue Delay", 0.0),
@@ -39,47 +45,54 @@ LookaheadFilterInterpreter::LookaheadFilterInterpreter(
       co_move_ratio_(prop_reg, "Drumroll Co Move Ratio", 1.2),
       suppress_immediate_tapdown_(prop_reg, "Suppress Immediate Tapdown", 1),
       delay_on_possible_liftoff_(prop_reg, "Delay On Possible Liftoff", 0),
-      liftoff_speed_increase_threshold_(prop_reg, "Liftoff Speed Factor", 5.0) {
+      liftoff_speed_increase_threshold_(prop_reg, "Liftoff Speed Factor", 5.0),
+      overflow_policy_(prop_reg, "Input Queue Overflow Policy",
+                       kOverflowFlush),
+      adaptive_delay_(prop_reg, "Adaptive Input Queue Delay", 0),
+      adaptive_delay_factor_(prop_reg, "Adaptive Input Queue Delay Factor",
+                             1.5) {
   InitName();
 }
 
 void LookaheadFilterInterpreter::SyncInterpretImpl(HardwareState* hwstate,
                                                        stime_t* timeout) {
-  // Push back into queue
-  if (free_list_.Empty()) {
-    Err("Can't accept new hwstate b/c we're out of nodes!");
-    Err("Now: %f, interpreter_due_ %f", hwstate->timestamp, interpreter_due_);
-    Err("Dump of queue:");
-    for (QState* it = queue_.Begin(); it != queue_.End(); it = it->next_)
-      Err("Due: %f%s", it->due_, it->completed_ ? " (c)" : "");
+  if (!queue_.Empty() && queue_.Full() && HandleOverflow(*hwstate, timeout)) {
+    HandleTimerImpl(hwstate->timestamp, timeout);
     return;
   }
-  QState* node = free_list_.PopFront();
-  node->set_state(*hwstate);
-  double delay = max(0.0, min<stime_t>(kMaxDelay, min_delay_.val_));
-  node->due_ = hwstate->timestamp + delay;
-  node->completed_ = false;
-  if (queue_.Empty())
-    node->output_ids_.clear();
-  else
-    node->output_ids_ = queue_.Tail()->output_ids_;
+  stime_t prev_delay = delay_;
+  UpdateDelay(hwstate->timestamp);
+  stime_t due = hwstate->timestamp + delay_;
+  map<short, short, kMaxFingers> output_ids;
+  if (!queue_.Empty())
+    output_ids = queue_.Tail()->output_ids_;
   // At this point, if ExtraVariableDelay() > 0, queue_.Tail()->due_ may have
-  // ExtraVariableDelay() applied, but node->due_ does not, yet.
+  // ExtraVariableDelay() applied, but due does not, yet. The tail may also
+  // have been given a longer delay than due.
   if (!queue_.Empty() &&
-      (queue_.Tail()->due_ - node->due_ > ExtraVariableDelay())) {
+      (queue_.Tail()->due_ - due >
+       ExtraVariableDelay() + max(0.0, prev_delay - delay_))) {
     Err("Clock changed backwards. Flushing queue.");
     stime_t next_timeout = -1.0;
-    QState* q_node = queue_.Head();
-    do {
+    for (size_t i = 0; i < queue_.size(); i++) {
+      QState* q_node = queue_.At(i);
       if (!q_node->completed_)
         next_->SyncInterpret(&q_node->state_, &next_timeout);
-      q_node = q_node->next_;
-      free_list_.PushBack(queue_.PopFront());
-    } while (!queue_.Empty());
+    }
+    queue_.Clear();
     interpreter_due_ = -1.0;
     last_interpreted_time_ = -1.0;
   }
-  queue_.PushBack(node);
+  // Push back into queue
+  QState* node = queue_.PushBack();
+  if (!node) {
+    Err("Can't accept new hwstate b/c we're out of nodes!");
+    return;
+  }
+  node->set_state(*hwstate);
+  node->due_ = due;
+  node->completed_ = false;
+  node->output_ids_ = output_ids;
   AssignTrackingIds();
   AttemptInterpolation();
   UpdateInterpreterDue(interpreter_due_ < 0.0 ?
@@ -145,9 +158,9 @@ void LookaheadFilterInterpreter::AssignTrackingIds() {
 
   QState* tail = queue_.Tail();
   HardwareState* hs = &tail->state_;
-  QState* prev_qs = queue_.size() < 2 ? NULL : tail->prev_;
+  QState* prev_qs = queue_.size() < 2 ? NULL : queue_.At(queue_.size() - 2);
   HardwareState* prev_hs = prev_qs ? &prev_qs->state_ : NULL;
-  QState* prev2_qs = queue_.size() < 3 ? NULL : prev_qs->prev_;
+  QState* prev2_qs = queue_.size() < 3 ? NULL : queue_.At(queue_.size() - 3);
   HardwareState* prev2_hs = prev2_qs ? &prev2_qs->state_ : NULL;
 
   RemoveMissingIdsFromMap(&tail->output_ids_, *hs);
@@ -347,7 +360,7 @@ void LookaheadFilterInterpreter::TapDownOccurringGesture(stime_t now) {
   if (queue_.Tail()->state_.timestamp != now)
     return;  // We didn't push a new hardware state now
   // See if latest hwstate has finger that previous doesn't
-  HardwareState& prev_hs = queue_.Tail()->prev_->state_;
+  HardwareState& prev_hs = queue_.At(queue_.size() - 2)->state_;
   if (hs.finger_cnt > prev_hs.finger_cnt) {
     // Finger was added.
     ProduceGesture(Gesture(kGestureFling, prev_hs.timestamp, hs.timestamp,
@@ -383,33 +396,31 @@ short LookaheadFilterInterpreter::NextTrackingId() {
 void LookaheadFilterInterpreter::AttemptInterpolation() {
   if (queue_.size() < 2)
     return;
-  QState* new_node = queue_.Tail();
-  QState* prev = new_node->prev_;
+  const QState* new_node = queue_.Tail();
+  const QState* prev = queue_.At(queue_.size() - 2);
   if (new_node->state_.timestamp - prev->state_.timestamp <
       split_min_period_.val_)
     return;  // Nodes came in too quickly to need interpolation
   if (!prev->state_.SameFingersAs(new_node->state_))
     return;
-  QState* node = free_list_.PopFront();
+  if ((prev->state_.timestamp + new_node->state_.timestamp) / 2.0 <=
+      last_interpreted_time_) {
+    // Time wouldn't seem monotonically increasing w/ this new event, so
+    // don't make it.
+    return;
+  }
+  // Moves the tail, so new_node and prev are looked up again.
+  QState* node = queue_.InsertBeforeTail();
   if (!node) {
     Err("out of nodes?");
     return;
   }
-  node->state_.fingers = node->fs_.get();
+  new_node = queue_.Tail();
+  prev = queue_.At(queue_.size() - 3);
   node->completed_ = false;
+  node->output_ids_ = new_node->output_ids_;
   Interpolate(prev->state_, new_node->state_, &node->state_);
-
-  double delay = max(0.0, min<stime_t>(kMaxDelay, min_delay_.val_));
-  node->due_ = node->state_.timestamp + delay;
-
-  if (node->state_.timestamp <= last_interpreted_time_) {
-    // Time wouldn't seem monotonically increasing w/ this new event, so
-    // discard it.
-    free_list_.PushBack(node);
-    return;
-  }
-
-  queue_.InsertBefore(new_node, node);
+  node->due_ = node->state_.timestamp + delay_;
 }
 
 void LookaheadFilterInterpreter::HandleTimerImpl(stime_t now,
@@ -430,48 +441,119 @@ void LookaheadFilterInterpreter::HandleTimerImpl(stime_t now,
       if (queue_.Empty())
         break;
       // Get next uncompleted and overdue hwstate
-      QState* node = queue_.Head();
-      while (node != queue_.Tail() && node->completed_)
-        node = node->next_;
+      size_t idx = 0;
+      while (idx + 1 < queue_.size() && queue_.At(idx)->completed_)
+        idx++;
+      QState* node = queue_.At(idx);
       if (node->completed_ || node->due_ > now)
         break;
       next_timeout = -1.0;
-      last_interpreted_time_ = node->state_.timestamp;
-      const size_t finger_cnt = node->state_.finger_cnt;
-      FingerState fs_copy[finger_cnt];
-      std::copy(&node->state_.fingers[0],
-                &node->state_.fingers[finger_cnt],
-                &fs_copy[0]);
-      HardwareState hs_copy = {
-        node->state_.timestamp,
-        node->state_.buttons_down,
-        node->state_.finger_cnt,
-        node->state_.touch_cnt,
-        fs_copy,
-        node->state_.rel_x,
-        node->state_.rel_y,
-        node->state_.rel_wheel,
-        node->state_.rel_wheel_hi_res,
-        node->state_.rel_hwheel,
-        node->state_.msc_timestamp,
-      };
-      next_->SyncInterpret(&hs_copy, &next_timeout);
-
-      // Clear previously completed nodes, but keep at least two nodes.
-      while (queue_.size() > 2 && queue_.Head()->completed_)
-        free_list_.PushBack(queue_.PopFront());
-
-      // Mark current node completed. This should be the only completed
-      // node in the queue.
-      node->completed_ = true;
+      InterpretNode(node, &next_timeout);
     }
     UpdateInterpreterDue(next_timeout, now, timeout);
   }
   UpdateInterpreterDue(next_timeout, now, timeout);
 }
 
+void LookaheadFilterInterpreter::InterpretNode(QState* node,
+                                               stime_t* next_timeout) {
+  last_interpreted_time_ = node->state_.timestamp;
+  const size_t finger_cnt = node->state_.finger_cnt;
+  FingerState fs_copy[finger_cnt];
+  std::copy(&node->state_.fingers[0],
+            &node->state_.fingers[finger_cnt],
+            &fs_copy[0]);
+  HardwareState hs_copy = {
+    node->state_.timestamp,
+    node->state_.buttons_down,
+    node->state_.finger_cnt,
+    node->state_.touch_cnt,
+    fs_copy,
+    node->state_.rel_x,
+    node->state_.rel_y,
+    node->state_.rel_wheel,
+    node->state_.rel_wheel_hi_res,
+    node->state_.rel_hwheel,
+    node->state_.msc_timestamp,
+  };
+  if (adaptive_delay_.val_) {
+    stime_t start = clock_();
+    next_->SyncInterpret(&hs_copy, next_timeout);
+    downstream_time_ +=
+        kAdaptiveDelayWeight * (clock_() - start - downstream_time_);
+  } else {
+    next_->SyncInterpret(&hs_copy, next_timeout);
+  }
+
+  // Clear previously completed nodes, but keep at least two nodes.
+  while (queue_.size() > 2 && queue_.Head()->completed_)
+    queue_.PopFront();
+
+  // Mark current node completed. This should be the only completed
+  // node in the queue.
+  node->completed_ = true;
+}
+
+bool LookaheadFilterInterpreter::HandleOverflow(const HardwareState& hwstate,
+                                                stime_t* timeout) {
+  if (overflow_policy_.val_ == kOverflowGrow) {
+    queue_.Grow();
+    Log("Grew input queue to %zu states", queue_.capacity());
+    return false;
+  }
+  if (overflow_policy_.val_ == kOverflowCoalesce && CoalesceIntoTail(hwstate))
+    return true;
+  // Drop the oldest node, sending it on early if it hasn't been yet.
+  QState* head = queue_.Head();
+  if (!head->completed_) {
+    stime_t next_timeout = -1.0;
+    InterpretNode(head, &next_timeout);
+    UpdateInterpreterDue(next_timeout, hwstate.timestamp, timeout);
+  }
+  queue_.PopFront();
+  return false;
+}
+
+bool LookaheadFilterInterpreter::CoalesceIntoTail(
+    const HardwareState& hwstate) {
+  QState* tail = queue_.Tail();
+  HardwareState* hs = &tail->state_;
+  if (tail->completed_ || hwstate.timestamp < hs->timestamp ||
+      hwstate.finger_cnt != hs->finger_cnt ||
+      hwstate.buttons_down != hs->buttons_down)
+    return false;
+  for (size_t i = 0; i < hwstate.finger_cnt; i++) {
+    short input_id = hwstate.fingers[i].tracking_id;
+    if (!MapContainsKey(tail->output_ids_, input_id) ||
+        !hs->GetFingerState(tail->output_ids_[input_id]))
+      return false;
+  }
+  for (size_t i = 0; i < hwstate.finger_cnt; i++) {
+    short output_id = tail->output_ids_[hwstate.fingers[i].tracking_id];
+    FingerState* fs = hs->GetFingerState(output_id);
+    unsigned no_tap = fs->flags & GESTURES_FINGER_NO_TAP;
+    *fs = hwstate.fingers[i];
+    fs->tracking_id = output_id;
+    fs->flags |= no_tap;
+  }
+  tail->due_ += hwstate.timestamp - hs->timestamp;
+  hs->timestamp = hwstate.timestamp;
+  hs->touch_cnt = hwstate.touch_cnt;
+  hs->rel_x += hwstate.rel_x;
+  hs->rel_y += hwstate.rel_y;
+  hs->rel_wheel += hwstate.rel_wheel;
+  hs->rel_wheel_hi_res += hwstate.rel_wheel_hi_res;
+  hs->rel_hwheel += hwstate.rel_hwheel;
+  hs->msc_timestamp = hwstate.msc_timestamp;
+  return true;
+}
+
 void LookaheadFilterInterpreter::ConsumeGesture(const Gesture& gesture) {
-  QState* node = queue_.Head();
+  if (queue_.Empty()) {
+    ProduceGesture(gesture);
+    return;
+  }
+  const QState* node = queue_.Head();
 
   float distance_sq = 0.0;
   // Slow movements should potentially be suppressed
@@ -498,10 +580,12 @@ void LookaheadFilterInterpreter::ConsumeGesture(const Gesture& gesture) {
     return;
   }
   // Speed is slow. Suppress if fingers have changed.
-  for (QState* iter = node->next_; iter != queue_.End(); iter = iter->next_)
+  for (size_t i = 1; i < queue_.size(); i++) {
+    const QState* iter = queue_.At(i);
     if (!node->state_.SameFingersAs(iter->state_) ||
         (node->state_.buttons_down != iter->state_.buttons_down))
       return; // suppress
+  }
 
   ProduceGesture(gesture);
 }
@@ -514,8 +598,8 @@ void LookaheadFilterInterpreter::UpdateInterpreterDue(
   // timeout, so we use -DBL_MAX as the invalid value.
   stime_t next_hwstate_timeout = -DBL_MAX;
   // Scan queue_ to find when next hwstate is due.
-  for (QState* node = queue_.Begin(); node != queue_.End();
-       node = node->next_) {
+  for (size_t i = 0; i < queue_.size(); i++) {
+    const QState* node = queue_.At(i);
     if (node->completed_)
       continue;
     next_hwstate_timeout = node->due_ - now;
@@ -540,28 +624,54 @@ void LookaheadFilterInterpreter::Initialize(
     GestureConsumer* consumer) {
   FilterInterpreter::Initialize(hwprops, NULL, mprops, consumer);
   const size_t kMaxQNodes = 16;
-  queue_.DeleteAll();
-  free_list_.DeleteAll();
-  for (size_t i = 0; i < kMaxQNodes; ++i) {
-    QState* node = new QState(hwprops_->max_finger_cnt);
-    free_list_.PushBack(node);
+  queue_.Reset(kMaxQNodes, hwprops_->max_finger_cnt);
+}
+
+void LookaheadFilterInterpreter::UpdateDelay(stime_t now) {
+  stime_t configured = max(0.0, min<stime_t>(kMaxDelay, min_delay_.val_));
+  if (!adaptive_delay_.val_) {
+    delay_ = configured;
+    return;
+  }
+  stime_t interval = now - last_hwstate_time_;
+  last_hwstate_time_ = now;
+  // Gaps between touches and clock changes don't tell the report rate.
+  if (interval > 0.0 && interval < kMaxDelay) {
+    if (report_interval_ < 0.0)
+      report_interval_ = interval;
+    else
+      report_interval_ += kAdaptiveDelayWeight * (interval - report_interval_);
   }
+  if (report_interval_ < 0.0) {
+    delay_ = configured;
+    return;
+  }
+  delay_ = min(configured, adaptive_delay_factor_.val_ * report_interval_ +
+               downstream_time_);
 }
 
 stime_t LookaheadFilterInterpreter::ExtraVariableDelay() const {
+  if (adaptive_delay_.val_)
+    return std::max<stime_t>(0.0, max_delay_.val_ - delay_);
   return std::max<stime_t>(0.0, max_delay_.val_ - min_delay_.val_);
 }
 
-LookaheadFilterInterpreter::QState::QState()
-    : max_fingers_(0), completed_(false), next_(NULL), prev_(NULL) {
-  fs_.reset();
-  state_.fingers = NULL;
+void LookaheadFilterInterpreter::EncodeLatencyStats(Json::Value* out) {
+  Interpreter::EncodeLatencyStats(out);
+  Json::Value delay(Json::objectValue);
+  delay[ActivityLog::kKeyQueueDelay] = Json::Value(delay_);
+  if (adaptive_delay_.val_) {
+    delay[ActivityLog::kKeyReportInterval] = Json::Value(report_interval_);
+    delay[ActivityLog::kKeyDownstreamTime] = Json::Value(downstream_time_);
+  }
+  (*out)[out->size() - 1][ActivityLog::kKeyInputQueueDelay] = delay;
+  if (next_)
+    next_->EncodeLatencyStats(out);
 }
 
-LookaheadFilterInterpreter::QState::QState(unsigned short max_fingers)
-    : max_fingers_(max_fingers), completed_(false), next_(NULL), prev_(NULL) {
-  fs_.reset(new FingerState[max_fingers]);
-  state_.fingers = fs_.get();
+LookaheadFilterInterpreter::QState::QState()
+    : max_fingers_(0), due_(0.0), completed_(false) {
+  state_.fingers = NULL;
 }
 
 void LookaheadFilterInterpreter::QState::set_state(
@@ -581,8 +691,111 @@ void LookaheadFilterInterpreter::QState::set_state(
   state_.rel_x = new_state.rel_x;
   state_.rel_y = new_state.rel_y;
   state_.rel_wheel = new_state.rel_wheel;
+  state_.rel_wheel_hi_res = new_state.rel_wheel_hi_res;
   state_.rel_hwheel = new_state.rel_hwheel;
   state_.msc_timestamp = new_state.msc_timestamp;
 }
 
+void LookaheadFilterInterpreter::QStateRing::Reset(
+    size_t capacity, unsigned short max_fingers) {
+  nodes_.assign(capacity, QState());
+  fingers_.assign(capacity * max_fingers, FingerState());
+  max_fingers_ = max_fingers;
+  for (size_t i = 0; i < capacity; i++) {
+    nodes_[i].max_fingers_ = max_fingers;
+    nodes_[i].state_.fingers = fingers_.data() + i * max_fingers;
+  }
+  Clear();
+}
+
+void LookaheadFilterInterpreter::QStateRing::Grow() {
+  QStateRing grown;
+  grown.Reset(max<size_t>(1, 2 * capacity()), max_fingers_);
+  for (size_t i = 0; i < size_; i++) {
+    const QState* node = At(i);
+    QState* copy = grown.PushBack();
+    copy->set_state(node->state_);
+    copy->output_ids_ = node->output_ids_;
+    copy->due_ = node->due_;
+    copy->completed_ = node->completed_;
+  }
+  // Swapping keeps the nodes' finger pointers valid.
+  nodes_.swap(grown.nodes_);
+  fingers_.swap(grown.fingers_);
+  head_ = 0;
+}
+
+LookaheadFilterInterpreter::QState*
+LookaheadFilterInterpreter::QStateRing::PushBack() {
+  if (Full())
+    return NULL;
+  size_++;
+  return Tail();
+}
+
+LookaheadFilterInterpreter::QState*
+LookaheadFilterInterpreter::QStateRing::InsertBeforeTail() {
+  if (Empty() || Full())
+    return NULL;
+  QState* tail = Tail();
+  // Each node carries its own fingers, so swapping whole nodes is safe.
+  std::swap(*tail, *PushBack());
+  return tail;
+}
+
+void LookaheadFilterInterpreter::QStateRing::PopFront() {
+  if (Empty()) {
+    Err("Can't pop from empty queue!");
+    return;
+  }
+  head_ = (head_ + 1) % nodes_.size();
+  size_--;
+}
+
+void LookaheadFilterInterpreter::SaveOwnState(StateWriter* writer) const {
+  writer->Write(static_cast<uint32_t>(queue_.size()));
+  for (size_t i = 0; i < queue_.size(); i++) {
+    const QState* node = queue_.At(i);
+    writer->Write(node->state_);
+    writer->Write(node->output_ids_);
+    writer->Write(node->due_);
+    writer->Write(node->completed_);
+  }
+  writer->Write(last_id_);
+  writer->Write(interpreter_due_);
+  writer->Write(last_interpreted_time_);
+  writer->Write(delay_);
+  writer->Write(report_interval_);
+  writer->Write(downstream_time_);
+  writer->Write(last_hwstate_time_);
+}
+
+void LookaheadFilterInterpreter::RestoreOwnState(StateReader* reader) {
+  queue_.Clear();
+  uint32_t queue_size = 0;
+  if (!reader->Read(&queue_size))
+    return;
+  for (uint32_t i = 0; i < queue_size; i++) {
+    // A grown queue is grown again as its states are read.
+    if (queue_.Full() && overflow_policy_.val_ == kOverflowGrow)
+      queue_.Grow();
+    QState* node = queue_.PushBack();
+    if (!node) {
+      reader->Fail("too many queued states");
+      return;
+    }
+    if (!reader->Read(&node->state_, node->max_fingers_) ||
+        !reader->Read(&node->output_ids_) || !reader->Read(&node->due_) ||
+        !reader->Read(&node->completed_))
+      return;
+  }
+  reader->Read(&last_id_);
+  reader->Read(&interpreter_due_);
+  reader->Read(&last_interpreted_time_);
+  reader->Read(&delay_);
+  reader->Read(&report_interval_);
+  reader->Read(&downstream_time_);
+  reader->Read(&last_hwstate_time_);
+}
+
 }  // namespace gestures
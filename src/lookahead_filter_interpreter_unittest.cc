@@ -3,6 +3,7 @@
 // found in the LICENSE file.
 
 #include <deque>
+#include <float.h>
 #include <math.h>
 #include <set>
 #include <stdio.h>
@@ -11,6 +12,7 @@
 
 #include <gtest/gtest.h>
 
+#include "gestures/include/activity_log.h"
 #include "gestures/include/gestures.h"
 #include "gestures/include/lookahead_filter_interpreter.h"
 #include "gestures/include/unittest_util.h"
@@ -30,9 +32,14 @@ class LookaheadFilterInterpreterTestInterpreter : public Interpreter {
         timer_return_(-1.0),
         clear_incoming_hwstates_(false), expected_id_(-1),
         expected_flags_(0), expected_flags_at_(-1),
-        expected_flags_at_occurred_(false) {}
+        expected_flags_at_occurred_(false), interpreted_cnt_(0),
+        last_timestamp_(-1.0), last_x_(0.0) {}
 
   virtual void SyncInterpret(HardwareState* hwstate, stime_t* timeout) {
+    interpreted_cnt_++;
+    last_timestamp_ = hwstate->timestamp;
+    if (hwstate->finger_cnt > 0)
+      last_x_ = hwstate->fingers[0].position_x;
     for (size_t i = 0; i < hwstate->finger_cnt; i++)
       all_ids_.insert(hwstate->fingers[i].tracking_id);
     if (expected_id_ >= 0) {
@@ -86,6 +93,11 @@ class LookaheadFilterInterpreterTestInterpreter : public Interpreter {
   stime_t expected_flags_at_;
   bool expected_flags_at_occurred_;
   std::set<short> all_ids_;
+  // The number of hardware states given to SyncInterpret(), and the time and
+  // first finger's x of the last one.
+  size_t interpreted_cnt_;
+  stime_t last_timestamp_;
+  float last_x_;
 };
 
 TEST(LookaheadFilterInterpreterTest, SimpleTest) {
@@ -779,22 +791,22 @@ TEST(LookaheadFilterInterpreterTest, QuickMoveTest) {
   wrapper.Reset(interpreter.get());
 
   stime_t timeout = -1.0;
-  List<LookaheadFilterInterpreter::QState>* queue = &interpreter->queue_;
+  LookaheadFilterInterpreter::QStateRing* queue = &interpreter->queue_;
 
   // Pushing the first event
   wrapper.SyncInterpret(&hs[0], &timeout);
   EXPECT_EQ(queue->size(), 1);
-  EXPECT_EQ(queue->Tail()->fs_[0].tracking_id, 1);
+  EXPECT_EQ(queue->Tail()->state_.fingers[0].tracking_id, 1);
 
   // Expecting Drumroll detected and ID reassigned 1 -> 2.
   wrapper.SyncInterpret(&hs[1], &timeout);
   EXPECT_EQ(queue->size(), 2);
-  EXPECT_EQ(queue->Tail()->fs_[0].tracking_id, 2);
+  EXPECT_EQ(queue->Tail()->state_.fingers[0].tracking_id, 2);
 
   // Expecting Drumroll detected and ID reassigned 1 -> 3.
   wrapper.SyncInterpret(&hs[2], &timeout);
   EXPECT_EQ(queue->size(), 3);
-  EXPECT_EQ(queue->Tail()->fs_[0].tracking_id, 3);
+  EXPECT_EQ(queue->Tail()->state_.fingers[0].tracking_id, 3);
 
   // Removing the touch.
   wrapper.SyncInterpret(&hs[3], &timeout);
@@ -804,17 +816,17 @@ TEST(LookaheadFilterInterpreterTest, QuickMoveTest) {
   // New finger tracking ID assigned 2 - > 4.
   wrapper.SyncInterpret(&hs[4], &timeout);
   EXPECT_EQ(queue->size(), 2);
-  EXPECT_EQ(queue->Tail()->fs_[0].tracking_id, 4);
+  EXPECT_EQ(queue->Tail()->state_.fingers[0].tracking_id, 4);
 
   // Expecting Drumroll detected and ID reassigned 2 -> 5.
   wrapper.SyncInterpret(&hs[5], &timeout);
-  EXPECT_EQ(queue->Tail()->fs_[0].tracking_id, 5);
+  EXPECT_EQ(queue->Tail()->state_.fingers[0].tracking_id, 5);
 
   // Expecting Quick movement detected and ID correction 5 -> 4.
   wrapper.SyncInterpret(&hs[6], &timeout);
-  EXPECT_EQ(queue->Tail()->fs_[0].tracking_id, 4);
-  EXPECT_EQ(queue->Tail()->prev_->fs_[0].tracking_id, 4);
-  EXPECT_EQ(queue->Tail()->prev_->prev_->fs_[0].tracking_id, 4);
+  EXPECT_EQ(queue->Tail()->state_.fingers[0].tracking_id, 4);
+  EXPECT_EQ(queue->At(queue->size() - 2)->state_.fingers[0].tracking_id, 4);
+  EXPECT_EQ(queue->At(queue->size() - 3)->state_.fingers[0].tracking_id, 4);
 }
 
 struct QuickSwipeTestInputs {
@@ -1250,16 +1262,178 @@ TEST(LookaheadFilterInterpreterTest, SemiMtNoTrackingIdAssignmentTest) {
   wrapper.Reset(interpreter.get());
 
   stime_t timeout = -1.0;
-  List<LookaheadFilterInterpreter::QState>* queue = &interpreter->queue_;
+  LookaheadFilterInterpreter::QStateRing* queue = &interpreter->queue_;
 
   wrapper.SyncInterpret(&hs[0], &timeout);
-  EXPECT_EQ(queue->Tail()->fs_[0].tracking_id, 20);
+  EXPECT_EQ(queue->Tail()->state_.fingers[0].tracking_id, 20);
 
   // Test if the fingers in queue have the same tracking ids from input.
   for (size_t i = 1; i < arraysize(hs); i++) {
     wrapper.SyncInterpret(&hs[i], &timeout);
-    EXPECT_EQ(queue->Tail()->fs_[0].tracking_id, 20);  // the same input id
-    EXPECT_EQ(queue->Tail()->fs_[1].tracking_id, 21);
+    // The same input ids.
+    EXPECT_EQ(queue->Tail()->state_.fingers[0].tracking_id, 20);
+    EXPECT_EQ(queue->Tail()->state_.fingers[1].tracking_id, 21);
+  }
+}
+
+namespace {
+
+// Pushes |count| states of one finger moving slowly to the right, 1 ms
+// apart, firing timers as they come due, then fires timers until the queue
+// drains. Returns the x of the last state.
+float PushQuickStates(TestInterpreterWrapper* wrapper,
+                      LookaheadFilterInterpreterTestInterpreter* base,
+                      size_t count) {
+  stime_t due = -1.0;
+  float x = 0.0;
+  for (size_t i = 0; i <= count; i++) {
+    stime_t now = i < count ? 1.0 + 0.001 * i : DBL_MAX;
+    while (due >= 0.0 && due <= now) {
+      stime_t timeout = -1.0;
+      wrapper->HandleTimer(due, &timeout);
+      due = timeout >= 0.0 ? due + timeout : -1.0;
+    }
+    if (i == count)
+      break;
+    x = 10.0 + 0.1 * i;
+    FingerState fs = { 0, 0, 0, 0, 1, 0, x, 10, 1, 0 };
+    HardwareState hs = make_hwstate(now, 0, 1, 1, &fs);
+    stime_t last_timestamp = base->last_timestamp_;
+    stime_t timeout = -1.0;
+    wrapper->SyncInterpret(&hs, &timeout);
+    EXPECT_GE(base->last_timestamp_, last_timestamp);
+    due = timeout >= 0.0 ? now + timeout : -1.0;
   }
+  return x;
 }
+
+HardwareProperties overflow_hwprops = {
+  0, 0, 100, 100,  // left, top, right, bottom
+  1, 1,  // x res, y res (pixels/mm)
+  133, 133,  // scrn DPI X, Y
+  -1, 2,  // orientation minimum, maximum
+  2, 5,  // max fingers, max_touch
+  0, 0, 1,  // t5r2, semi, button pad
+  0, 0,  // has wheel, vertical wheel is high resolution
+};
+
+}  // namespace
+
+// States coming in faster than the queue drains are sent on early, oldest
+// first, so none is lost.
+TEST(LookaheadFilterInterpreterTest, OverflowFlushTest) {
+  LookaheadFilterInterpreterTestInterpreter* base_interpreter =
+      new LookaheadFilterInterpreterTestInterpreter;
+  LookaheadFilterInterpreter interpreter(NULL, base_interpreter, NULL);
+  TestInterpreterWrapper wrapper(&interpreter, &overflow_hwprops);
+  interpreter.min_delay_.val_ = 0.09;
+  size_t capacity = interpreter.queue_.capacity();
+
+  float last_x = PushQuickStates(&wrapper, base_interpreter, 40);
+  EXPECT_EQ(40, base_interpreter->interpreted_cnt_);
+  EXPECT_FLOAT_EQ(last_x, base_interpreter->last_x_);
+  EXPECT_EQ(capacity, interpreter.queue_.capacity());
+}
+
+TEST(LookaheadFilterInterpreterTest, OverflowCoalesceTest) {
+  LookaheadFilterInterpreterTestInterpreter* base_interpreter =
+      new LookaheadFilterInterpreterTestInterpreter;
+  LookaheadFilterInterpreter interpreter(NULL, base_interpreter, NULL);
+  TestInterpreterWrapper wrapper(&interpreter, &overflow_hwprops);
+  interpreter.min_delay_.val_ = 0.09;
+  interpreter.overflow_policy_.val_ =
+      LookaheadFilterInterpreter::kOverflowCoalesce;
+  size_t capacity = interpreter.queue_.capacity();
+
+  float last_x = PushQuickStates(&wrapper, base_interpreter, 40);
+  EXPECT_EQ(capacity, base_interpreter->interpreted_cnt_);
+  EXPECT_FLOAT_EQ(last_x, base_interpreter->last_x_);
+  EXPECT_EQ(capacity, interpreter.queue_.capacity());
+}
+
+TEST(LookaheadFilterInterpreterTest, OverflowGrowTest) {
+  LookaheadFilterInterpreterTestInterpreter* base_interpreter =
+      new LookaheadFilterInterpreterTestInterpreter;
+  LookaheadFilterInterpreter interpreter(NULL, base_interpreter, NULL);
+  TestInterpreterWrapper wrapper(&interpreter, &overflow_hwprops);
+  interpreter.min_delay_.val_ = 0.09;
+  interpreter.overflow_policy_.val_ = LookaheadFilterInterpreter::kOverflowGrow;
+  size_t capacity = interpreter.queue_.capacity();
+
+  float last_x = PushQuickStates(&wrapper, base_interpreter, 40);
+  EXPECT_EQ(40, base_interpreter->interpreted_cnt_);
+  EXPECT_FLOAT_EQ(last_x, base_interpreter->last_x_);
+  EXPECT_LT(capacity, interpreter.queue_.capacity());
+}
+
+namespace {
+
+// A clock that moves 1 ms each time it's read, so that the interpreter below
+// the queue always seems to take 1 ms.
+stime_t fake_clock_now = 0.0;
+stime_t FakeClock() {
+  return fake_clock_now += 0.001;
+}
+
+}  // namespace
+
+// With adaptive delay, states 5 ms apart are held for 1.5 reports plus the
+// time to handle one instead of the configured 50 ms, but each is still
+// queued when the next one arrives.
+TEST(LookaheadFilterInterpreterTest, AdaptiveDelayTest) {
+  LookaheadFilterInterpreterTestInterpreter* base_interpreter =
+      new LookaheadFilterInterpreterTestInterpreter;
+  LookaheadFilterInterpreter interpreter(NULL, base_interpreter, NULL);
+  TestInterpreterWrapper wrapper(&interpreter, &overflow_hwprops);
+  interpreter.clock_ = FakeClock;
+  interpreter.min_delay_.val_ = 0.05;
+  interpreter.max_delay_.val_ = 0.05;
+  interpreter.adaptive_delay_.val_ = 1;
+
+  const stime_t kInterval = 0.005;
+  stime_t due = -1.0;
+  for (size_t i = 0; i < 40; i++) {
+    stime_t now = 1.0 + kInterval * i;
+    while (due >= 0.0 && due <= now) {
+      stime_t timeout = -1.0;
+      wrapper.HandleTimer(due, &timeout);
+      // The first state waits out the configured delay, as the report
+      // interval isn't known yet, and holds up the ones behind it.
+      if (now > 1.0 + interpreter.min_delay_.val_ + kInterval) {
+        EXPECT_LT(due - base_interpreter->last_timestamp_, 2 * kInterval);
+      }
+      due = timeout >= 0.0 ? due + timeout : -1.0;
+    }
+    if (i > 0) {
+      EXPECT_LT(base_interpreter->last_timestamp_, now - kInterval / 2);
+    }
+    FingerState fs = { 0, 0, 0, 0, 1, 0, 10.0f + 0.1f * i, 10, 1, 0 };
+    HardwareState hs = make_hwstate(now, 0, 1, 1, &fs);
+    stime_t timeout = -1.0;
+    wrapper.SyncInterpret(&hs, &timeout);
+    due = timeout >= 0.0 ? now + timeout : -1.0;
+  }
+  EXPECT_NEAR(kInterval, interpreter.report_interval_, 1e-6);
+  // The handling time estimate has nearly settled at 1 ms.
+  EXPECT_GT(interpreter.downstream_time_, 0.0009);
+  EXPECT_LT(interpreter.downstream_time_, 0.001);
+  EXPECT_GT(interpreter.delay_, 1.5 * kInterval + 0.0009 - 1e-6);
+  EXPECT_LT(interpreter.delay_, 1.5 * kInterval + 0.001 + 1e-6);
+  // Possibly ambiguous states are still held for max_delay_.
+  EXPECT_DOUBLE_EQ(0.05, interpreter.delay_ + interpreter.ExtraVariableDelay());
+
+  Json::Value stats(Json::arrayValue);
+  interpreter.EncodeLatencyStats(&stats);
+  EXPECT_DOUBLE_EQ(interpreter.delay_,
+                   stats[0][ActivityLog::kKeyInputQueueDelay]
+                   [ActivityLog::kKeyQueueDelay].asDouble());
+
+  interpreter.adaptive_delay_.val_ = 0;
+  FingerState fs = { 0, 0, 0, 0, 1, 0, 20, 10, 1, 0 };
+  HardwareState hs = make_hwstate(2.0, 0, 1, 1, &fs);
+  stime_t timeout = -1.0;
+  wrapper.SyncInterpret(&hs, &timeout);
+  EXPECT_DOUBLE_EQ(0.05, interpreter.delay_);
+}
+
 }  // namespace gestures
@@ -9,6 +9,7 @@
 #include "gestures/include/filter_interpreter.h"
 #include "gestures/include/finger_metrics.h"
 #include "gestures/include/gestures.h"
+#include "gestures/include/interpreter_state.h"
 #include "gestures/include/logging.h"
 #include "gestures/include/prop_registry.h"
 #include "gestures/include/tracer.h"
@@ -204,4 +205,66 @@ bool MetricsFilterInterpreter::DetectNoisyGround(
   return false;
 }
 
+void MetricsFilterInterpreter::SaveOwnState(StateWriter* writer) const {
+  writer->Write(static_cast<uint32_t>(histories_.size()));
+  for (FingerHistoryMap::const_iterator it = histories_.begin();
+       it != histories_.end(); ++it) {
+    const FingerHistory* history = it->second;
+    writer->Write(it->first);
+    writer->Write(static_cast<uint32_t>(history->size()));
+    for (const MState* state = history->Begin(); state != history->End();
+         state = state->next_) {
+      writer->Write(state->timestamp);
+      writer->Write(state->data);
+    }
+  }
+  writer->Write(mouse_movement_session_index_);
+  writer->Write(mouse_movement_current_session_length);
+  writer->Write(mouse_movement_current_session_start);
+  writer->Write(mouse_movement_current_session_last);
+  writer->Write(mouse_movement_current_session_distance);
+}
+
+void MetricsFilterInterpreter::RestoreOwnState(StateReader* reader) {
+  for (FingerHistoryMap::const_iterator it = histories_.begin();
+       it != histories_.end(); ++it) {
+    it->second->DeleteAll();
+    history_mm_.Free(it->second);
+  }
+  histories_.clear();
+
+  uint32_t num_histories = 0;
+  if (!reader->Read(&num_histories))
+    return;
+  if (num_histories > history_mm_.MaxSize()) {
+    reader->Fail("too many finger histories");
+    return;
+  }
+  for (uint32_t i = 0; i < num_histories; i++) {
+    short tracking_id = 0;
+    uint32_t size = 0;
+    if (!reader->Read(&tracking_id) || !reader->Read(&size))
+      return;
+    if (size > MState::MaxHistorySize() ||
+        MapContainsKey(histories_, tracking_id)) {
+      reader->Fail("bad finger history");
+      return;
+    }
+    FingerHistory* history = history_mm_.Allocate();
+    history->Init(&mstate_mm_);
+    histories_[tracking_id] = history;
+    for (uint32_t j = 0; j < size; j++) {
+      MState* state = history->PushNewEltBack();
+      if (!state || !reader->Read(&state->timestamp) ||
+          !reader->Read(&state->data))
+        return;
+    }
+  }
+  reader->Read(&mouse_movement_session_index_);
+  reader->Read(&mouse_movement_current_session_length);
+  reader->Read(&mouse_movement_current_session_start);
+  reader->Read(&mouse_movement_current_session_last);
+  reader->Read(&mouse_movement_current_session_distance);
+}
+
 }  // namespace gestures
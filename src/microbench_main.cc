@@ -0,0 +1,903 @@
+// Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Times small building blocks of the interpreters in isolation, each next to
+// the implementation it replaces or competes with. Unlike bench, the inputs
+// are synthetic, so the numbers only compare the variants of a benchmark.
+//
+// Usage: microbench [--iterations=N] [--list] [benchmark ...]
+// Runs all benchmarks if none are named.
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "gestures/include/accel_filter_interpreter.h"
+#include "gestures/include/command_line.h"
+#include "gestures/include/file_util.h"
+#include "gestures/include/finger_arrays.h"
+#include "gestures/include/finger_index.h"
+#include "gestures/include/finger_metrics.h"
+#include "gestures/include/finger_slots.h"
+#include "gestures/include/gestures.h"
+#include "gestures/include/immediate_interpreter.h"
+#include "gestures/include/macros.h"
+#include "gestures/include/map.h"
+#include "gestures/include/non_linearity_filter_interpreter.h"
+#include "gestures/include/prop_registry.h"
+#include "gestures/include/set.h"
+#include "gestures/include/util.h"
+#include "gestures/include/vector.h"
+
+using std::string;
+
+namespace gestures {
+
+namespace {
+
+// Set from --iterations: how many times each benchmark runs its workload.
+size_t iterations = 20000;
+
+// Results are accumulated here so that the compiler can't drop the work.
+volatile double sink = 0.0;
+
+double NowSec() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return StimeFromTimespec(&ts);
+}
+
+void Report(const char* benchmark, const char* variant, double seconds,
+            size_t ops) {
+  printf("%-20s %-28s %10.2f ns/op\n", benchmark, variant,
+         ops ? seconds / ops * 1e9 : 0.0);
+}
+
+// A synthetic session of kFingers fingers. Every kFramesPerChange frames, the
+// oldest finger lifts and a new one, with the next tracking id, lands.
+class FingerSession {
+ public:
+  static const size_t kFingers = 5;
+  static const size_t kFrames = 256;
+  static const size_t kFramesPerChange = 8;
+
+  FingerSession() {
+    memset(fingers_, 0, sizeof(fingers_));
+    for (size_t frame = 0; frame < kFrames; frame++) {
+      short first_id = 100 + frame / kFramesPerChange;
+      for (size_t i = 0; i < kFingers; i++) {
+        FingerState* fs = &fingers_[frame][i];
+        fs->tracking_id = first_id + i;
+        fs->position_x = 10.0 * i + frame % 7;
+        fs->position_y = 20.0 + frame % 5;
+        fs->pressure = 30.0 + i;
+      }
+      HardwareState* hs = &states_[frame];
+      memset(hs, 0, sizeof(*hs));
+      hs->timestamp = frame * 0.01;
+      hs->finger_cnt = hs->touch_cnt = kFingers;
+      hs->fingers = fingers_[frame];
+    }
+  }
+
+  const HardwareState& frame(size_t i) const { return states_[i]; }
+
+ private:
+  FingerState fingers_[kFrames][kFingers];
+  HardwareState states_[kFrames];
+};
+
+const size_t kNumContainers = 4;
+
+// The per-frame set traffic of PalmClassifyingFilterInterpreter: drop the
+// ids that left, then query and grow each set for every finger.
+struct StdSetFixture {
+  void BeginFrame(const HardwareState& hs) {
+    for (size_t i = 0; i < kNumContainers; i++)
+      RemoveMissingIdsFromSet(&sets[i], hs);
+  }
+  set<short, kMaxFingers> sets[kNumContainers];
+};
+
+struct SlotSetFixture {
+  SlotSetFixture()
+      : sets{{&slots}, {&slots}, {&slots}, {&slots}} {}
+  void BeginFrame(const HardwareState& hs) {
+    slots.Update(hs);
+    for (size_t i = 0; i < kNumContainers; i++)
+      RemoveMissingIdsFromSet(&sets[i], hs);
+  }
+  TrackingIdSlots slots;
+  TrackingIdSet sets[kNumContainers];
+};
+
+template<typename Fixture>
+void RunSetFrames(const FingerSession& session, const char* variant) {
+  Fixture fixture;
+  size_t hits = 0;
+  double start = NowSec();
+  for (size_t iter = 0; iter < iterations; iter++) {
+    for (size_t frame = 0; frame < FingerSession::kFrames; frame++) {
+      const HardwareState& hs = session.frame(frame);
+      fixture.BeginFrame(hs);
+      for (size_t i = 0; i < hs.finger_cnt; i++) {
+        short id = hs.fingers[i].tracking_id;
+        for (size_t j = 0; j < kNumContainers; j++) {
+          if (SetContainsValue(fixture.sets[j], id))
+            hits++;
+          else if ((id + frame + j) % 3 == 0)
+            fixture.sets[j].insert(id);
+        }
+      }
+    }
+  }
+  double elapsed = NowSec() - start;
+  sink += hits;
+  Report("finger_sets", variant, elapsed,
+         iterations * FingerSession::kFrames);
+}
+
+void BenchFingerSets() {
+  FingerSession session;
+  RunSetFrames<StdSetFixture>(session, "set<short> (per frame)");
+  RunSetFrames<SlotSetFixture>(session, "TrackingIdSet (per frame)");
+}
+
+// The per-frame map traffic of PalmClassifyingFilterInterpreter's distance
+// and max pressure bookkeeping.
+struct StdMapFixture {
+  void BeginFrame(const HardwareState& hs) {
+    for (size_t i = 0; i < kNumContainers; i++)
+      RemoveMissingIdsFromMap(&maps[i], hs);
+  }
+  map<short, float, kMaxFingers> maps[kNumContainers];
+};
+
+struct SlotMapFixture {
+  SlotMapFixture()
+      : maps{{&slots}, {&slots}, {&slots}, {&slots}} {}
+  void BeginFrame(const HardwareState& hs) {
+    slots.Update(hs);
+    for (size_t i = 0; i < kNumContainers; i++)
+      RemoveMissingIdsFromMap(&maps[i], hs);
+  }
+  TrackingIdSlots slots;
+  TrackingIdMap<float> maps[kNumContainers];
+};
+
+template<typename Fixture>
+void RunMapFrames(const FingerSession& session, const char* variant) {
+  Fixture fixture;
+  float total = 0.0;
+  double start = NowSec();
+  for (size_t iter = 0; iter < iterations; iter++) {
+    for (size_t frame = 0; frame < FingerSession::kFrames; frame++) {
+      const HardwareState& hs = session.frame(frame);
+      fixture.BeginFrame(hs);
+      for (size_t i = 0; i < hs.finger_cnt; i++) {
+        const FingerState& fs = hs.fingers[i];
+        for (size_t j = 0; j < kNumContainers; j++) {
+          if (MapContainsKey(fixture.maps[j], fs.tracking_id))
+            fixture.maps[j][fs.tracking_id] += fs.position_x;
+          else
+            fixture.maps[j][fs.tracking_id] = 0.0;
+          total += fixture.maps[j][fs.tracking_id];
+        }
+      }
+    }
+  }
+  double elapsed = NowSec() - start;
+  sink += total;
+  Report("finger_maps", variant, elapsed,
+         iterations * FingerSession::kFrames);
+}
+
+void BenchFingerMaps() {
+  FingerSession session;
+  RunMapFrames<StdMapFixture>(session, "map<short> (per frame)");
+  RunMapFrames<SlotMapFixture>(session, "TrackingIdMap (per frame)");
+}
+
+// GetFingerState() for every finger of a frame and one missing id, as in
+// the loops over finger pairs of the palm classifier and ImmediateInterpreter.
+template<bool kIndexed>
+void RunFingerLookup(const FingerSession& session, const char* variant) {
+  size_t hits = 0;
+  double start = NowSec();
+  for (size_t iter = 0; iter < iterations; iter++) {
+    for (size_t frame = 0; frame < FingerSession::kFrames; frame++) {
+      const HardwareState& hs = session.frame(frame);
+      ScopedFingerIndex index(kIndexed ? &hs : NULL);
+      for (size_t i = 0; i < hs.finger_cnt; i++)
+        for (size_t j = 0; j <= hs.finger_cnt; j++)
+          hits += hs.GetFingerState(hs.fingers[i].tracking_id + j) != NULL;
+    }
+  }
+  double elapsed = NowSec() - start;
+  sink += hits;
+  Report("finger_lookup", variant, elapsed,
+         iterations * FingerSession::kFrames);
+}
+
+void BenchFingerLookup() {
+  FingerSession session;
+  RunFingerLookup<false>(session, "scan (per frame)");
+  RunFingerLookup<true>(session, "ScopedFingerIndex (per frame)");
+}
+
+// Kernels over |count| values of a FingerArrays column, which must be a
+// multiple of kFingerLanes, that match the scalar float math in the
+// comments.
+
+// values[i] = values[i] * scale
+void FingerArraysScale(float* values, size_t count, float scale) {
+#if defined(__SSE2__)
+  __m128 scale_v = _mm_set1_ps(scale);
+  for (size_t i = 0; i < count; i += kFingerLanes)
+    _mm_store_ps(&values[i], _mm_mul_ps(_mm_load_ps(&values[i]), scale_v));
+#elif defined(__ARM_NEON)
+  for (size_t i = 0; i < count; i += kFingerLanes)
+    vst1q_f32(&values[i], vmulq_n_f32(vld1q_f32(&values[i]), scale));
+#else
+  for (size_t i = 0; i < count; i++)
+    values[i] *= scale;
+#endif
+}
+
+// values[i] = values[i] * scale + translate
+void FingerArraysScaleAndTranslate(float* values, size_t count, float scale,
+                                   float translate) {
+#if defined(__SSE2__)
+  __m128 scale_v = _mm_set1_ps(scale);
+  __m128 translate_v = _mm_set1_ps(translate);
+  for (size_t i = 0; i < count; i += kFingerLanes) {
+    __m128 v = _mm_mul_ps(_mm_load_ps(&values[i]), scale_v);
+    _mm_store_ps(&values[i], _mm_add_ps(v, translate_v));
+  }
+#elif defined(__ARM_NEON)
+  // Not vmlaq, which may fuse the multiply and add.
+  float32x4_t translate_v = vdupq_n_f32(translate);
+  for (size_t i = 0; i < count; i += kFingerLanes) {
+    float32x4_t v = vmulq_n_f32(vld1q_f32(&values[i]), scale);
+    vst1q_f32(&values[i], vaddq_f32(v, translate_v));
+  }
+#else
+  for (size_t i = 0; i < count; i++) {
+    values[i] *= scale;
+    values[i] += translate;
+  }
+#endif
+}
+
+// The affine part of ScalingFilterInterpreter on each frame's fingers,
+// field by field on the FingerStates, or on a FingerArrays.
+template<bool kArrays>
+void RunFingerScaling(const FingerSession& session, const char* variant) {
+  FingerState fingers[FingerSession::kFingers];
+  float total = 0.0;
+  double start = NowSec();
+  for (size_t iter = 0; iter < iterations; iter++) {
+    for (size_t frame = 0; frame < FingerSession::kFrames; frame++) {
+      const HardwareState& hs = session.frame(frame);
+      memcpy(fingers, hs.fingers, sizeof(fingers));
+      if (kArrays) {
+        FingerArrays arrays;
+        arrays.Load(fingers, hs.finger_cnt);
+        size_t padded_size = arrays.padded_size();
+        FingerArraysScaleAndTranslate(arrays.position_x, padded_size,
+                                      0.0306f, -1.5f);
+        FingerArraysScaleAndTranslate(arrays.position_y, padded_size,
+                                      0.0306f, -2.5f);
+        FingerArraysScale(arrays.orientation, padded_size, 0.7f);
+        FingerArraysScaleAndTranslate(arrays.pressure, padded_size,
+                                      1.1f, 3.0f);
+        arrays.Store(fingers);
+      } else {
+        for (size_t i = 0; i < hs.finger_cnt; i++) {
+          fingers[i].position_x *= 0.0306f;
+          fingers[i].position_x += -1.5f;
+          fingers[i].position_y *= 0.0306f;
+          fingers[i].position_y += -2.5f;
+          fingers[i].orientation *= 0.7f;
+          fingers[i].pressure *= 1.1f;
+          fingers[i].pressure += 3.0f;
+        }
+      }
+      total += fingers[hs.finger_cnt - 1].position_x;
+    }
+  }
+  double elapsed = NowSec() - start;
+  sink += total;
+  Report("finger_scaling", variant, elapsed,
+         iterations * FingerSession::kFrames);
+}
+
+void BenchFingerScaling() {
+  FingerSession session;
+  RunFingerScaling<false>(session, "FingerState (per frame)");
+  RunFingerScaling<true>(session, "FingerArrays (per frame)");
+}
+
+// The IIR filter of IirFilterInterpreter on each frame's position and
+// pressure: one finger at a time, with a map from tracking id to histories
+// of FingerStates, as it first ran, or with FingerArraysIir() on a
+// FingerArrays, with histories in columns that are filtered in place while
+// the fingers keep their order, and rearranged when it changes.
+struct IirFingerHistory {
+  // For map.
+  bool operator==(const IirFingerHistory& that) const {
+    return std::equal(in, in + 3, that.in) &&
+        std::equal(out, out + 2, that.out);
+  }
+  FingerState in[3];
+  FingerState out[2];
+};
+
+struct IirColumns {
+  size_t size;
+  short tracking_id[FingerArrays::kCapacity];
+  FingerIirHistory fields[3];
+};
+
+template<bool kArrays>
+void RunIirFilter(const FingerSession& session, const char* variant) {
+  const FingerIirCoefficients kCoeffs = {
+    0.0674552738890719, 0.134910547778144, 0.0674552738890719, 0.0,
+    -1.1429805025399, 0.412801598096189
+  };
+  map<short, IirFingerHistory, kMaxFingers> histories;
+  IirColumns columns[2];
+  memset(columns, 0, sizeof(columns));
+  size_t last = 0;
+  alignas(16) uint32_t iir[FingerArrays::kCapacity];
+  alignas(16) uint32_t pass[FingerArrays::kCapacity];
+  float FingerState::*fields[] = { &FingerState::position_x,
+                                   &FingerState::position_y,
+                                   &FingerState::pressure };
+  FingerState fingers[FingerSession::kFingers];
+  float total = 0.0;
+  double start = NowSec();
+  for (size_t iter = 0; iter < iterations; iter++) {
+    for (size_t frame = 0; frame < FingerSession::kFrames; frame++) {
+      const HardwareState& hs = session.frame(frame);
+      memcpy(fingers, hs.fingers, sizeof(fingers));
+      if (kArrays) {
+        FingerArrays arrays;
+        arrays.Load(fingers, hs.finger_cnt);
+        float* values[] = {
+          arrays.position_x, arrays.position_y, arrays.pressure
+        };
+        const IirColumns& prev = columns[last];
+        size_t found[FingerArrays::kCapacity];
+        bool in_place = true;
+        for (size_t i = 0; i < arrays.size; i++) {
+          size_t j = 0;
+          while (j < prev.size && prev.tracking_id[j] != arrays.tracking_id[i])
+            j++;
+          found[i] = j;
+          in_place = in_place && (j == i || j == prev.size);
+        }
+        if (!in_place)
+          last = !last;
+        IirColumns* next = &columns[last];
+        for (size_t i = 0; i < arrays.padded_size(); i++) {
+          bool old = i < arrays.size && found[i] < prev.size;
+          iir[i] = old ? ~0u : 0;
+          pass[i] = old ? 0 : ~0u;
+          if (i >= arrays.size || (old && in_place))
+            continue;
+          next->tracking_id[i] = arrays.tracking_id[i];
+          for (size_t f = 0; f < arraysize(next->fields); f++) {
+            FingerIirHistory* column = &next->fields[f];
+            for (size_t k = 0; k < 3; k++)
+              column->in[k][i] = old ? prev.fields[f].in[k][found[i]] :
+                  values[f][i];
+            for (size_t k = 0; k < 2; k++)
+              column->out[k][i] = old ? prev.fields[f].out[k][found[i]] :
+                  values[f][i];
+          }
+        }
+        for (size_t f = 0; f < arraysize(values); f++)
+          FingerArraysIir(values[f], &next->fields[f], kCoeffs, iir, pass,
+                          arrays.padded_size());
+        next->size = arrays.size;
+        arrays.Store(fingers);
+      } else {
+        RemoveMissingIdsFromMap(&histories, hs);
+        for (size_t i = 0; i < hs.finger_cnt; i++) {
+          FingerState* fs = &fingers[i];
+          if (!MapContainsKey(histories, fs->tracking_id)) {
+            IirFingerHistory hist;
+            for (size_t k = 0; k < 3; k++)
+              hist.in[k] = *fs;
+            for (size_t k = 0; k < 2; k++)
+              hist.out[k] = *fs;
+            histories[fs->tracking_id] = hist;
+            continue;
+          }
+          IirFingerHistory* hist = &histories[fs->tracking_id];
+          FingerState out = *fs;
+          for (size_t f = 0; f < arraysize(fields); f++) {
+            float FingerState::*field = fields[f];
+            out.*field =
+                kCoeffs.b3 * hist->in[2].*field +
+                kCoeffs.b2 * hist->in[1].*field +
+                kCoeffs.b1 * hist->in[0].*field +
+                kCoeffs.b0 * fs->*field -
+                kCoeffs.a2 * hist->out[1].*field -
+                kCoeffs.a1 * hist->out[0].*field;
+          }
+          hist->in[2] = hist->in[1];
+          hist->in[1] = hist->in[0];
+          hist->in[0] = *fs;
+          hist->out[1] = hist->out[0];
+          hist->out[0] = out;
+          *fs = out;
+        }
+      }
+      total += fingers[hs.finger_cnt - 1].position_x;
+    }
+  }
+  double elapsed = NowSec() - start;
+  sink += total;
+  Report("iir_filter", variant, elapsed, iterations * FingerSession::kFrames);
+}
+
+void BenchIirFilter() {
+  FingerSession session;
+  RunIirFilter<false>(session, "map of FingerStates");
+  RunIirFilter<true>(session, "FingerArraysIir columns");
+}
+
+// A matrix of the squared distances between all fingers of a frame, filled
+// once per frame, which the interpreters' checks over finger pairs could read
+// instead of calling DistSq(). Indexed by position in the frame, which is the
+// best case: the checks hold FingerStates, not positions.
+struct DistanceMatrix {
+  void Fill(const HardwareState& hs) {
+    for (size_t i = 0; i < hs.finger_cnt; i++) {
+      dist_sq[i][i] = 0.0;
+      for (size_t j = i + 1; j < hs.finger_cnt; j++)
+        dist_sq[i][j] = dist_sq[j][i] = DistSq(hs.fingers[i], hs.fingers[j]);
+    }
+  }
+  float dist_sq[FingerSession::kFingers][FingerSession::kFingers];
+};
+
+// The matrix as the interpreters would use it: filled kFingerLanes pairs at
+// a time from a FingerArrays, and looked up by the FingerStates the checks
+// hold. Fingers outside the frame it was filled from, e.g. copies from an
+// earlier frame, fall back to DistSq().
+class BoundDistanceMatrix {
+ public:
+  void Fill(const HardwareState& hs) {
+    fingers_ = hs.fingers;
+    count_ = std::min<size_t>(hs.finger_cnt, FingerArrays::kCapacity);
+    FingerArrays arrays;
+    arrays.Load(hs.fingers, count_);
+    const float* x = arrays.position_x;
+    const float* y = arrays.position_y;
+    for (size_t i = 0; i < count_; i++) {
+      float* row = dist_sq_[i];
+      for (size_t j = 0; j < arrays.padded_size(); j += kFingerLanes) {
+#if defined(__SSE2__)
+        __m128 dx = _mm_sub_ps(_mm_set1_ps(x[i]), _mm_load_ps(x + j));
+        __m128 dy = _mm_sub_ps(_mm_set1_ps(y[i]), _mm_load_ps(y + j));
+        _mm_store_ps(row + j, _mm_add_ps(_mm_mul_ps(dx, dx),
+                                         _mm_mul_ps(dy, dy)));
+#else
+        for (size_t k = j; k < j + kFingerLanes; k++) {
+          float dx = x[i] - x[k];
+          float dy = y[i] - y[k];
+          row[k] = dx * dx + dy * dy;
+        }
+#endif
+      }
+    }
+  }
+
+  float DistSq(const FingerState& a, const FingerState& b) const {
+    if (&a >= fingers_ && &a < fingers_ + count_ &&
+        &b >= fingers_ && &b < fingers_ + count_)
+      return dist_sq_[&a - fingers_][&b - fingers_];
+    return gestures::DistSq(a, b);
+  }
+
+ private:
+  const FingerState* fingers_;
+  size_t count_;
+  alignas(16) float dist_sq_[FingerArrays::kCapacity][FingerArrays::kCapacity];
+};
+
+// The pairwise distance checks that ImmediateInterpreter and the palm
+// classifier could make on one frame: all pairs for SortFingersByProximity(),
+// and each finger against all others for FingerNearOtherFinger() and
+// FingerTooCloseToTap().
+enum DistanceVariant { kDistSq, kPositionMatrix, kBoundMatrix };
+
+template<DistanceVariant kVariant>
+float FrameDistSq(const DistanceMatrix& matrix,
+                  const BoundDistanceMatrix& bound, const HardwareState& hs,
+                  size_t i, size_t j) {
+  switch (kVariant) {
+    case kDistSq: return DistSq(hs.fingers[i], hs.fingers[j]);
+    case kPositionMatrix: return matrix.dist_sq[i][j];
+    case kBoundMatrix: return bound.DistSq(hs.fingers[i], hs.fingers[j]);
+  }
+  return 0.0;
+}
+
+template<DistanceVariant kVariant>
+void RunFingerDistances(const FingerSession& session, const char* variant) {
+  DistanceMatrix matrix;
+  BoundDistanceMatrix bound;
+  float total = 0.0;
+  double start = NowSec();
+  for (size_t iter = 0; iter < iterations; iter++) {
+    for (size_t frame = 0; frame < FingerSession::kFrames; frame++) {
+      const HardwareState& hs = session.frame(frame);
+      if (kVariant == kPositionMatrix)
+        matrix.Fill(hs);
+      else if (kVariant == kBoundMatrix)
+        bound.Fill(hs);
+      for (size_t i = 0; i < hs.finger_cnt; i++)
+        for (size_t j = i + 1; j < hs.finger_cnt; j++)
+          total += FrameDistSq<kVariant>(matrix, bound, hs, i, j);
+      for (size_t pass = 0; pass < 2; pass++)
+        for (size_t i = 0; i < hs.finger_cnt; i++)
+          for (size_t j = 0; j < hs.finger_cnt; j++)
+            if (i != j)
+              total += FrameDistSq<kVariant>(matrix, bound, hs, i, j);
+    }
+  }
+  double elapsed = NowSec() - start;
+  sink += total;
+  Report("finger_distances", variant, elapsed,
+         iterations * FingerSession::kFrames);
+}
+
+void BenchFingerDistances() {
+  FingerSession session;
+  RunFingerDistances<kDistSq>(session, "DistSq (per frame)");
+  RunFingerDistances<kPositionMatrix>(session, "DistanceMatrix (per frame)");
+  RunFingerDistances<kBoundMatrix>(session, "SIMD matrix by FingerState");
+}
+
+// set<short>::insert() and SetContainsValue() on a full set of tracking
+// ids, with and without the chunked compare of FindValueIndex(). Sets
+// smaller than a chunk are compared one at a time either way.
+template<bool kChunked>
+void RunShortFind(const char* variant) {
+  const size_t kSetSize = 10;
+  vector<short, kSetSize> ids;
+  for (size_t i = 0; i < kSetSize; i++)
+    ids.push_back(100 + 3 * i);
+  const size_t kQueries = 16;
+  size_t hits = 0;
+  double start = NowSec();
+  for (size_t iter = 0; iter < iterations; iter++) {
+    for (size_t i = 0; i < kQueries; i++) {
+      short id = 100 + i + iter % 3;
+      size_t index = kChunked ?
+          FindValueIndex(ids.begin(), ids.size(), id) :
+          FindValueIndex<short>(ids.begin(), ids.size(), id);
+      hits += index != ids.size();
+    }
+  }
+  double elapsed = NowSec() - start;
+  sink += hits;
+  Report("short_find", variant, elapsed, iterations * kQueries);
+}
+
+void BenchShortFind() {
+  RunShortFind<false>("scalar");
+  RunShortFind<true>("chunked");
+}
+
+// ImmediateInterpreter's tap-to-click transition table, driven with the
+// predicates of synthetic tap sequences, or with random predicates.
+typedef ImmediateInterpreter II;
+
+const unsigned kTapFrame = II::kTapHwState | II::kTapMotionAllowed |
+    II::kTapPressureMet | II::kTapFingersYoung | II::kTapDragEnabled;
+
+// A one-finger tap, a tap-and-drag, and a two-finger tap, frame by frame.
+const unsigned kTapSequence[] = {
+  kTapFrame,
+  kTapFrame | II::kTapBegan | II::kTapLeft,
+  kTapFrame | II::kTapLeft,
+  kTapFrame | II::kTapComplete | II::kTapLeft,
+  II::kTapTimeout | II::kTapPressureMet | II::kTapLeft,
+  kTapFrame | II::kTapBegan | II::kTapLeft,
+  kTapFrame | II::kTapComplete | II::kTapLeft,
+  kTapFrame | II::kTapFingersAdded | II::kTapLeft,
+  kTapFrame | II::kTapLeft | II::kTapDragEvaluating,
+  kTapFrame | II::kTapTimeout | II::kTapLeft,
+  kTapFrame | II::kTapMoving | II::kTapLeft,
+  kTapFrame | II::kTapMoving | II::kTapLeft,
+  kTapFrame | II::kTapComplete | II::kTapLeft,
+  kTapFrame | II::kTapBegan,
+  kTapFrame,
+  kTapFrame | II::kTapComplete,
+};
+
+template<bool kRandom>
+void RunTapTransitions(const char* variant) {
+  const size_t kSteps = 64;
+  II::TapToClickState state = II::kTtcIdle;
+  uint32_t random = 1;
+  size_t effects = 0;
+  double start = NowSec();
+  for (size_t iter = 0; iter < iterations; iter++) {
+    for (size_t i = 0; i < kSteps; i++) {
+      unsigned predicates;
+      if (kRandom) {
+        random = random * 1103515245 + 12345;
+        predicates = random >> 8;
+      } else {
+        predicates = kTapSequence[i % arraysize(kTapSequence)];
+      }
+      predicates &= II::TapPredicatesUsed(state);
+      const II::TapTransition& transition =
+          II::FindTapTransition(state, predicates);
+      effects += transition.effects;
+      state = transition.next;
+    }
+  }
+  double elapsed = NowSec() - start;
+  sink += effects;
+  Report("tap_transitions", variant, elapsed, iterations * kSteps);
+}
+
+void BenchTapTransitions() {
+  RunTapTransitions<false>("tap sequences");
+  RunTapTransitions<true>("random predicates");
+}
+
+// The errors of a non-linearity table as the interpreter first found them:
+// with linear searches for the samples around a point in the table read into
+// vectors, and blending one error at a time.
+class LinearNonLinearityTable {
+ public:
+  typedef NonLinearityTable::Error Error;
+
+  // |data| must be a well-formed table.
+  explicit LinearNonLinearityTable(const string& data) {
+    size_t pos = 0;
+    for (size_t axis = 0; axis < 3; axis++) {
+      int32_t len;
+      memcpy(&len, &data[pos], sizeof(len));
+      pos += sizeof(len);
+      ranges_[axis].resize(len);
+      memcpy(&ranges_[axis][0], &data[pos], len * sizeof(double));
+      pos += len * sizeof(double);
+    }
+    errors_.resize(ranges_[0].size() * ranges_[1].size() *
+                   ranges_[2].size());
+    memcpy(&errors_[0], &data[pos], errors_.size() * sizeof(Error));
+  }
+
+  Error GetError(float x, float y, float p) const {
+    Error error = { 0, 0 };
+    size_t x_lo, y_lo, p_lo;
+    float x_hi_perc, y_hi_perc, p_hi_perc;
+    if (!FindCell(ranges_[0], x, &x_lo, &x_hi_perc) ||
+        !FindCell(ranges_[1], y, &y_lo, &y_hi_perc) ||
+        !FindCell(ranges_[2], p, &p_lo, &p_hi_perc))
+      return error;
+    size_t x_hi = x_lo + 1, y_hi = y_lo + 1, p_hi = p_lo + 1;
+    Error e_yhi_phi = Interpolate(At(x_hi, y_hi, p_hi), At(x_lo, y_hi, p_hi),
+                                  x_hi_perc);
+    Error e_yhi_plo = Interpolate(At(x_hi, y_hi, p_lo), At(x_lo, y_hi, p_lo),
+                                  x_hi_perc);
+    Error e_ylo_phi = Interpolate(At(x_hi, y_lo, p_hi), At(x_lo, y_lo, p_hi),
+                                  x_hi_perc);
+    Error e_ylo_plo = Interpolate(At(x_hi, y_lo, p_lo), At(x_lo, y_lo, p_lo),
+                                  x_hi_perc);
+    Error e_plo = Interpolate(e_yhi_plo, e_ylo_plo, y_hi_perc);
+    Error e_phi = Interpolate(e_yhi_phi, e_ylo_phi, y_hi_perc);
+    return Interpolate(e_phi, e_plo, p_hi_perc);
+  }
+
+ private:
+  static bool FindCell(const std::vector<double>& range, float value,
+                       size_t* lo, float* frac) {
+    for (size_t i = 1; i < range.size(); i++) {
+      if (range[i - 1] <= value && value < range[i]) {
+        *lo = i - 1;
+        *frac = (value - range[i - 1]) / (range[i] - range[i - 1]);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static Error Interpolate(const Error& p1, const Error& p2,
+                           float percent_p1) {
+    Error ret;
+    ret.x_error = percent_p1 * p1.x_error + (1.0 - percent_p1) * p2.x_error;
+    ret.y_error = percent_p1 * p1.y_error + (1.0 - percent_p1) * p2.y_error;
+    return ret;
+  }
+
+  const Error& At(size_t x, size_t y, size_t p) const {
+    return errors_[(x * ranges_[1].size() + y) * ranges_[2].size() + p];
+  }
+
+  std::vector<double> ranges_[3];  // x, y and p
+  std::vector<Error> errors_;
+};
+
+// GetError() of a table of the test data, at points spread over the unit
+// cube it samples and a little past it.
+template<typename Table>
+void RunNonLinearity(const Table& table, const char* variant) {
+  const size_t kPoints = 256;
+  float points[kPoints][3];
+  uint32_t random = 1;
+  for (size_t i = 0; i < kPoints; i++) {
+    for (size_t axis = 0; axis < 3; axis++) {
+      random = random * 1103515245 + 12345;
+      points[i][axis] = (random >> 8) / 16777216.0f * 1.1f - 0.05f;
+    }
+  }
+  double total = 0.0;
+  double start = NowSec();
+  for (size_t iter = 0; iter < iterations; iter++) {
+    for (size_t i = 0; i < kPoints; i++) {
+      const float* point = points[i];
+      NonLinearityTable::Error error =
+          table.GetError(point[0], point[1], point[2]);
+      total += error.x_error + error.y_error;
+    }
+  }
+  double elapsed = NowSec() - start;
+  sink += total;
+  Report("non_linearity", variant, elapsed, iterations * kPoints);
+}
+
+void BenchNonLinearity() {
+  const char kData[] =
+      "data/non_linearity_data/testing_non_linearity_data.dat";
+  std::shared_ptr<const NonLinearityTable> table =
+      NonLinearityTable::Open(kData);
+  string data;
+  if (!table || !ReadFileToString(kData, &data)) {
+    fprintf(stderr, "Can't open %s; run from the source directory\n", kData);
+    return;
+  }
+  RunNonLinearity(LinearNonLinearityTable(data), "linear search, scalar");
+  RunNonLinearity(*table, "cell index, vector blend");
+}
+
+// Adds up the motion of the gestures it's given.
+class SummingConsumer : public GestureConsumer {
+ public:
+  SummingConsumer() : total(0.0) {}
+  virtual void ConsumeGesture(const Gesture& gesture) {
+    total += gesture.details.move.dx + gesture.details.move.dy;
+  }
+  double total;
+};
+
+// AccelFilterInterpreter::ConsumeGesture() on moves at speeds spread over
+// the touchpad pointer curve, with the curve evaluated segment by segment or
+// baked into a table.
+void RunAccelCurve(bool baked, const char* variant) {
+  const size_t kMoves = 256;
+  const stime_t kDt = 0.01;
+  Gesture moves[kMoves];
+  uint32_t random = 1;
+  for (size_t i = 0; i < kMoves; i++) {
+    random = random * 1103515245 + 12345;
+    float speed = (random >> 8) / 16777216.0f * 300.0f;
+    moves[i] = Gesture(kGestureMove, 1.0, 1.0 + kDt, speed * kDt * 0.6f,
+                       speed * kDt * 0.8f);
+  }
+  PropRegistry prop_reg;
+  AccelFilterInterpreter accel(&prop_reg, NULL, NULL);
+  SummingConsumer consumer;
+  accel.Initialize(NULL, NULL, NULL, &consumer);
+  for (Property* prop : prop_reg.props()) {
+    if (strcmp(prop->name(), "Baked Accel Curves") == 0) {
+      prop->SetValue(Json::Value(baked));
+      prop->HandleGesturesPropWritten();
+    }
+  }
+  double start = NowSec();
+  for (size_t iter = 0; iter < iterations; iter++)
+    for (size_t i = 0; i < kMoves; i++)
+      accel.ConsumeGesture(moves[i]);
+  double elapsed = NowSec() - start;
+  sink += consumer.total;
+  Report("accel_curve", variant, elapsed, iterations * kMoves);
+}
+
+void BenchAccelCurve() {
+  RunAccelCurve(false, "segment walk");
+  RunAccelCurve(true, "baked table");
+}
+
+struct Benchmark {
+  const char* name;
+  void (*run)();
+};
+
+const Benchmark kBenchmarks[] = {
+  { "finger_sets", BenchFingerSets },
+  { "finger_maps", BenchFingerMaps },
+  { "short_find", BenchShortFind },
+  { "finger_lookup", BenchFingerLookup },
+  { "finger_scaling", BenchFingerScaling },
+  { "iir_filter", BenchIirFilter },
+  { "finger_distances", BenchFingerDistances },
+  { "tap_transitions", BenchTapTransitions },
+  { "non_linearity", BenchNonLinearity },
+  { "accel_curve", BenchAccelCurve },
+};
+
+}  // namespace
+
+int MicrobenchMain() {
+  CommandLine* cl = CommandLine::ForCurrentProcess();
+  if (cl->HasSwitch("list")) {
+    for (size_t i = 0; i < arraysize(kBenchmarks); i++)
+      printf("%s\n", kBenchmarks[i].name);
+    return 0;
+  }
+  if (cl->HasSwitch("iterations"))
+    iterations = std::max(1, atoi(
+        cl->GetSwitchValueASCII("iterations").c_str()));
+  CommandLine::StringVector names = cl->GetArgs();
+  for (size_t i = 0; i < names.size(); i++) {
+    bool found = false;
+    for (size_t j = 0; j < arraysize(kBenchmarks); j++)
+      found = found || names[i] == kBenchmarks[j].name;
+    if (!found) {
+      fprintf(stderr, "Unknown benchmark: %s\n", names[i].c_str());
+      return 1;
+    }
+  }
+  for (size_t i = 0; i < arraysize(kBenchmarks); i++) {
+    bool run = names.empty();
+    for (size_t j = 0; j < names.size(); j++)
+      run = run || names[j] == kBenchmarks[i].name;
+    if (run)
+      kBenchmarks[i].run();
+  }
+  return 0;
+}
+
+}  // namespace gestures
+
+int main(int argc, char** argv) {
+  gestures::CommandLine::Init(argc, argv);
+  return gestures::MicrobenchMain();
+}
+
+extern "C" {
+
+void gestures_log(int verb, const char* fmt, ...) {
+  if (verb != GESTURES_LOG_ERROR)
+    return;
+  va_list args;
+  va_start(args, fmt);
+  vfprintf(stderr, fmt, args);
+  va_end(args);
+}
+
+}
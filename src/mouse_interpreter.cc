@@ -6,6 +6,7 @@
 
 #include <math.h>
 
+#include "gestures/include/interpreter_state.h"
 #include "gestures/include/macros.h"
 #include "gestures/include/logging.h"
 #include "gestures/include/tracer.h"
@@ -230,4 +231,23 @@ void MouseInterpreter::InterpretMouseMotionEvent(
   }
 }
 
+void MouseInterpreter::SaveOwnState(StateWriter* writer) const {
+  writer->Write(prev_state_);
+  writer->Write(last_wheel_);
+  writer->Write(last_hwheel_);
+  writer->Write(wheel_emulation_accu_x_);
+  writer->Write(wheel_emulation_accu_y_);
+  writer->Write(wheel_emulation_active_);
+}
+
+void MouseInterpreter::RestoreOwnState(StateReader* reader) {
+  // prev_state_ keeps no fingers.
+  reader->Read(&prev_state_, 0);
+  reader->Read(&last_wheel_);
+  reader->Read(&last_hwheel_);
+  reader->Read(&wheel_emulation_accu_x_);
+  reader->Read(&wheel_emulation_accu_y_);
+  reader->Read(&wheel_emulation_active_);
+}
+
 }  // namespace gestures
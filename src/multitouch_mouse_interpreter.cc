@@ -6,6 +6,7 @@
 
 #include <algorithm>
 
+#include "gestures/include/interpreter_state.h"
 #include "gestures/include/tracer.h"
 
 namespace gestures {
@@ -240,4 +241,39 @@ void MultitouchMouseInterpreter::InterpretMultitouchEvent() {
   prev_result_ = result;
 }
 
+void MultitouchMouseInterpreter::SaveOwnState(StateWriter* writer) const {
+  MouseInterpreter::SaveOwnState(writer);
+  state_buffer_.SaveState(writer);
+  writer->Write(prev_state_);
+  scroll_buffer_.SaveState(writer);
+  writer->Write(prev_gs_fingers_);
+  writer->Write(gs_fingers_);
+  writer->Write(prev_gesture_type_);
+  writer->Write(current_gesture_type_);
+  writer->Write(should_fling_);
+  scroll_manager_.SaveState(writer);
+  writer->Write(prev_result_);
+  writer->Write(origin_);
+  writer->Write(start_position_);
+  writer->Write(moving_);
+}
+
+void MultitouchMouseInterpreter::RestoreOwnState(StateReader* reader) {
+  MouseInterpreter::RestoreOwnState(reader);
+  state_buffer_.RestoreState(reader);
+  // prev_state_ keeps no fingers.
+  reader->Read(&prev_state_, 0);
+  scroll_buffer_.RestoreState(reader);
+  reader->Read(&prev_gs_fingers_);
+  reader->Read(&gs_fingers_);
+  reader->Read(&prev_gesture_type_);
+  reader->Read(&current_gesture_type_);
+  reader->Read(&should_fling_);
+  scroll_manager_.RestoreState(reader);
+  reader->Read(&prev_result_);
+  reader->Read(&origin_);
+  reader->Read(&start_position_);
+  reader->Read(&moving_);
+}
+
 }  // namespace gestures
@@ -4,202 +4,294 @@
 
 #include "gestures/include/non_linearity_filter_interpreter.h"
 
-#include <linux/in.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "gestures/include/file_util.h"
+#include "gestures/include/logging.h"
 
 namespace {
 const size_t kIntPackedSize = 4;
 const size_t kDoublePackedSize = 8;
+const size_t kErrorPackedSize = 2 * kDoublePackedSize;
 }
 
 namespace gestures {
 
-NonLinearityFilterInterpreter::NonLinearityFilterInterpreter(
-                                                        PropRegistry* prop_reg,
-                                                        Interpreter* next,
-                                                        Tracer* tracer)
-    : FilterInterpreter(NULL, next, tracer, false),
-      enabled_(prop_reg, "Enable non-linearity correction", false),
-      data_location_(prop_reg, "Non-linearity correction data file", "None"),
-      x_range_len_(0), y_range_len_(0), p_range_len_(0) {
-  InitName();
-  LoadData();
-}
+namespace {
+
+// The tables that are loaded, by path. An entry expires when the last
+// interpreter using its table lets go of it.
+std::mutex open_tables_lock;
+std::map<std::string, std::weak_ptr<const NonLinearityTable> > open_tables;
 
-unsigned int NonLinearityFilterInterpreter::ErrorIndex(size_t x_index,
-                                                       size_t y_index,
-                                                       size_t p_index) const {
-  unsigned int index = x_index * y_range_len_ * p_range_len_ +
-                       y_index * p_range_len_ + p_index;
+typedef NonLinearityTable::Error Error;
 
-  if (index >= x_range_len_ * y_range_len_ * p_range_len_)
-    index = 0;
-  return index;
+// Interpolate linearly between p1 and p2, according to percent_p1
+Error LinearInterpolate(const Error& p1, const Error& p2, float percent_p1) {
+  Error ret;
+  ret.x_error = percent_p1 * p1.x_error + (1.0 - percent_p1) * p2.x_error;
+  ret.y_error = percent_p1 * p1.y_error + (1.0 - percent_p1) * p2.y_error;
+  return ret;
 }
 
-int NonLinearityFilterInterpreter::ReadObject(void* buf, size_t object_size,
-                                            FILE* fd) {
-  int objs_read = fread(buf, object_size, 1, fd);
-  /* If this machine is big endian, reverse the bytes in the object */
-  if (object_size == kDoublePackedSize)
-    __le64_to_cpu(*static_cast<double*>(buf));
-  if (object_size == kIntPackedSize)
-    __le32_to_cpu(*static_cast<int32_t*>(buf));
+Error LoadError(const char* data) {
+  Error error;
+  memcpy(&error.x_error, data, kDoublePackedSize);
+  memcpy(&error.y_error, data + kDoublePackedSize, kDoublePackedSize);
+  return error;
+}
 
-  return objs_read;
+#if defined(__SSE2__)
+// The weights of the samples on either side of a point along an axis, for
+// both the x and y errors.
+struct Weights {
+  explicit Weights(float percent_hi)
+      : hi(_mm_set1_pd(percent_hi)), lo(_mm_set1_pd(1.0 - percent_hi)) {}
+  __m128d hi;
+  __m128d lo;
+};
+
+// LinearInterpolate(), for the x and y errors at once. Rounds the same.
+__m128d LinearInterpolate(__m128d p1, __m128d p2, const Weights& weights) {
+  return _mm_add_pd(_mm_mul_pd(weights.hi, p1), _mm_mul_pd(weights.lo, p2));
 }
 
-bool NonLinearityFilterInterpreter::LoadRange(std::unique_ptr<double[]>& arr,
-                                              size_t& len, FILE* fd) {
-  int tmp;
-  if (!ReadObject(&tmp, kIntPackedSize, fd))
-    return false;
-  len = tmp;
+__m128d LoadError(const char* data, size_t offset) {
+  return _mm_loadu_pd(reinterpret_cast<const double*>(data + offset));
+}
+#endif  // __SSE2__
 
-  arr.reset(new double[len]);
-  for (size_t i = 0; i < len; i++) {
-    double tmp;
-    if (!ReadObject(&tmp, kDoublePackedSize, fd))
-      return false;
-    else
-      arr[i] = tmp;
+}  // namespace
+
+std::shared_ptr<const NonLinearityTable> NonLinearityTable::Open(
+    const char* path) {
+  std::lock_guard<std::mutex> lock(open_tables_lock);
+  std::shared_ptr<const NonLinearityTable> shared = open_tables[path].lock();
+  if (shared)
+    return shared;
+  open_tables.erase(path);
+
+  // The table is read rather than mapped, so that changes to the file can't
+  // alter it, or fault, under interpreters already using it.
+  std::unique_ptr<NonLinearityTable> table(new NonLinearityTable);
+  if (!ReadFileToString(path, &table->data_))
+    return shared;
+  if (!table->Parse()) {
+    Err("Malformed non-linearity filter data '%s'", path);
+    return shared;
   }
-  return true;
+  shared.reset(table.release());
+  open_tables[path] = shared;
+  return shared;
 }
 
-void NonLinearityFilterInterpreter::LoadData() {
-  FILE* data_fd = fopen(data_location_.val_, "rb");
-  if (!data_fd) {
-    Log("Unable to open non-linearity filter data '%s'", data_location_.val_);
-    return;
-  }
+bool NonLinearityTable::Parse() {
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+  Err("Non-linearity filter data is only read on little-endian hosts");
+  return false;
+#endif
+  size_t pos = 0;
+  if (!ParseAxis(&pos, &x_) || !ParseAxis(&pos, &y_) || !ParseAxis(&pos, &p_))
+    return false;
+  // There's an error for every sample, and maybe more data after them.
+  size_t available = (data_.size() - pos) / kErrorPackedSize;
+  size_t count = x_.len;
+  if (y_.len && count > available / y_.len)
+    return false;
+  count *= y_.len;
+  if (p_.len && count > available / p_.len)
+    return false;
+  errors_ = data_.data() + pos;
+  return true;
+}
 
-  // Load the ranges
-  if (!LoadRange(x_range_, x_range_len_, data_fd))
-    goto abort_load;
-  if (!LoadRange(y_range_, y_range_len_, data_fd))
-    goto abort_load;
-  if (!LoadRange(p_range_, p_range_len_, data_fd))
-    goto abort_load;
-
-  // Load the error readings themselves
-  err_.reset(new Error[x_range_len_ * y_range_len_ * p_range_len_]);
-  Error tmp;
-  for(unsigned int x = 0; x < x_range_len_; x++) {
-    for(unsigned int y = 0; y < y_range_len_; y++) {
-      for(unsigned int p = 0; p < p_range_len_; p++) {
-        if (!ReadObject(&tmp.x_error, kDoublePackedSize, data_fd) ||
-            !ReadObject(&tmp.y_error, kDoublePackedSize, data_fd)) {
-          goto abort_load;
-        }
-        err_[ErrorIndex(x, y, p)] = tmp;
-      }
-    }
-  }
+bool NonLinearityTable::ParseAxis(size_t* pos, Axis* axis) {
+  const char* data = data_.data();
+  size_t size = data_.size();
+  int32_t len = 0;
+  if (size - *pos < kIntPackedSize)
+    return false;
+  memcpy(&len, data + *pos, kIntPackedSize);
+  *pos += kIntPackedSize;
+  if (len < 0 ||
+      static_cast<size_t>(len) > (size - *pos) / kDoublePackedSize)
+    return false;
+  axis->values = data + *pos;
+  axis->len = len;
+  *pos += len * kDoublePackedSize;
 
-  fclose(data_fd);
-  return;
+  // Binary searches need the samples in order.
+  for (size_t i = 1; i < axis->len; i++)
+    if (!(axis->Value(i - 1) <= axis->Value(i)))
+      return false;
+  axis->uniform = false;
+  if (axis->len < 2)
+    return true;
+  axis->first = axis->Value(0);
+  double step = (axis->Value(len - 1) - axis->first) / (len - 1);
+  if (!(step > 0.0))
+    return true;
+  axis->inv_step = 1.0 / step;
+  // FindCell() corrects the cell it computes, so this only needs to be
+  // roughly right.
+  axis->uniform = true;
+  for (size_t i = 1; i < axis->len && axis->uniform; i++)
+    axis->uniform =
+        fabs(axis->Value(i) - axis->first - i * step) < 0.01 * step;
+  return true;
+}
 
-abort_load:
-  x_range_.reset();
-  x_range_len_ = 0;
-  y_range_.reset();
-  y_range_len_ = 0;
-  p_range_.reset();
-  p_range_len_ = 0;
-  err_.reset();
-  fclose(data_fd);
+double NonLinearityTable::Axis::Value(size_t i) const {
+  double value;
+  memcpy(&value, values + i * kDoublePackedSize, sizeof(value));
+  return value;
 }
 
-void NonLinearityFilterInterpreter::SyncInterpretImpl(HardwareState* hwstate,
-                                                      stime_t* timeout) {
-  if (enabled_.val_ && err_.get() && hwstate->finger_cnt == 1) {
-    FingerState* finger = &(hwstate->fingers[0]);
-    if (finger) {
-      Error error = GetError(finger->position_x, finger->position_y,
-                             finger->pressure);
-      finger->position_x -= error.x_error;
-      finger->position_y -= error.y_error;
+bool NonLinearityTable::Axis::FindCell(float value, size_t* lo,
+                                       float* frac) const {
+  if (len < 2 || !(value >= Value(0)) || !(value < Value(len - 1)))
+    return false;
+  // Value(hi - 1) <= value < Value(hi).
+  size_t hi;
+  if (uniform) {
+    hi = std::min(len - 1,
+                  static_cast<size_t>((value - first) * inv_step) + 1);
+    while (hi > 1 && Value(hi - 1) > value)
+      hi--;
+    while (Value(hi) <= value)
+      hi++;
+  } else {
+    size_t below = 0;
+    hi = len - 1;
+    while (hi - below > 1) {
+      size_t mid = below + (hi - below) / 2;
+      if (Value(mid) <= value)
+        below = mid;
+      else
+        hi = mid;
     }
   }
-  next_->SyncInterpret(hwstate, timeout);
+  *lo = hi - 1;
+  *frac = (value - Value(*lo)) / (Value(hi) - Value(*lo));
+  return true;
 }
 
-NonLinearityFilterInterpreter::Error
-NonLinearityFilterInterpreter::LinearInterpolate(const Error& p1,
-                                                 const Error& p2,
-                                                 float percent_p1) const {
-  Error ret;
-  ret.x_error = percent_p1 * p1.x_error + (1.0 - percent_p1) * p2.x_error;
-  ret.y_error = percent_p1 * p1.y_error + (1.0 - percent_p1) * p2.y_error;
-  return ret;
+const char* NonLinearityTable::ErrorAt(size_t x_index, size_t y_index,
+                                       size_t p_index) const {
+  return errors_ +
+      ((x_index * y_.len + y_index) * p_.len + p_index) * kErrorPackedSize;
 }
 
-NonLinearityFilterInterpreter::Error
-NonLinearityFilterInterpreter::GetError(float finger_x, float finger_y,
-                                        float finger_p) const {
-  // First, find the 6 values surrounding the point to interpolate over
-  Bounds x_bounds = FindBounds(finger_x, x_range_, x_range_len_);
-  Bounds y_bounds = FindBounds(finger_y, y_range_, y_range_len_);
-  Bounds p_bounds = FindBounds(finger_p, p_range_, p_range_len_);
-
-  if (x_bounds.lo == -1 || x_bounds.hi == -1 || y_bounds.lo == -1 ||
-    y_bounds.hi == -1 || p_bounds.lo == -1 || p_bounds.hi == -1) {
-    Error error = { 0, 0 };
+NonLinearityTable::Error NonLinearityTable::GetError(float x, float y,
+                                                     float p) const {
+  Error error = { 0, 0 };
+  size_t x_lo, y_lo, p_lo;
+  float x_hi_perc, y_hi_perc, p_hi_perc;
+  if (!x_.FindCell(x, &x_lo, &x_hi_perc) ||
+      !y_.FindCell(y, &y_lo, &y_hi_perc) ||
+      !p_.FindCell(p, &p_lo, &p_hi_perc))
     return error;
-  }
 
+#if defined(__SSE2__)
+  // Offsets of the samples after the low ones along each axis.
+  const size_t p_hi = kErrorPackedSize;
+  const size_t y_hi = p_.len * kErrorPackedSize;
+  const size_t x_hi = y_.len * y_hi;
+  const char* lo = ErrorAt(x_lo, y_lo, p_lo);
+
+  // Interpolate along the x-axis
+  Weights x_weights(x_hi_perc);
+  __m128d e_yhi_phi = LinearInterpolate(LoadError(lo, x_hi + y_hi + p_hi),
+                                        LoadError(lo, y_hi + p_hi), x_weights);
+  __m128d e_yhi_plo = LinearInterpolate(LoadError(lo, x_hi + y_hi),
+                                        LoadError(lo, y_hi), x_weights);
+  __m128d e_ylo_phi = LinearInterpolate(LoadError(lo, x_hi + p_hi),
+                                        LoadError(lo, p_hi), x_weights);
+  __m128d e_ylo_plo = LinearInterpolate(LoadError(lo, x_hi),
+                                        LoadError(lo, 0), x_weights);
+
+  // Interpolate along the y-axis
+  Weights y_weights(y_hi_perc);
+  __m128d e_plo = LinearInterpolate(e_yhi_plo, e_ylo_plo, y_weights);
+  __m128d e_phi = LinearInterpolate(e_yhi_phi, e_ylo_phi, y_weights);
+
+  // Finally, interpolate along the p-axis
+  double out[2];
+  _mm_storeu_pd(out, LinearInterpolate(e_phi, e_plo, Weights(p_hi_perc)));
+  error.x_error = out[0];
+  error.y_error = out[1];
+  return error;
+#else
+  return Blend(x_lo, y_lo, p_lo, x_hi_perc, y_hi_perc, p_hi_perc);
+#endif  // __SSE2__
+}
+
+NonLinearityTable::Error NonLinearityTable::Blend(
+    size_t x_lo, size_t y_lo, size_t p_lo,
+    float x_hi_perc, float y_hi_perc, float p_hi_perc) const {
+  size_t x_hi = x_lo + 1, y_hi = y_lo + 1, p_hi = p_lo + 1;
   // Interpolate along the x-axis
-  float x_hi_perc = (finger_x - x_range_[x_bounds.lo]) /
-                    (x_range_[x_bounds.hi] - x_range_[x_bounds.lo]);
-  Error e_yhi_phi = LinearInterpolate(
-                        err_[ErrorIndex(x_bounds.hi, y_bounds.hi, p_bounds.hi)],
-                        err_[ErrorIndex(x_bounds.lo, y_bounds.hi, p_bounds.hi)],
-                        x_hi_perc);
-  Error e_yhi_plo = LinearInterpolate(
-                        err_[ErrorIndex(x_bounds.hi, y_bounds.hi, p_bounds.lo)],
-                        err_[ErrorIndex(x_bounds.lo, y_bounds.hi, p_bounds.lo)],
-                        x_hi_perc);
-  Error e_ylo_phi = LinearInterpolate(
-                        err_[ErrorIndex(x_bounds.hi, y_bounds.lo, p_bounds.hi)],
-                        err_[ErrorIndex(x_bounds.lo, y_bounds.lo, p_bounds.hi)],
-                        x_hi_perc);
-  Error e_ylo_plo = LinearInterpolate(
-                        err_[ErrorIndex(x_bounds.hi, y_bounds.lo, p_bounds.lo)],
-                        err_[ErrorIndex(x_bounds.lo, y_bounds.lo, p_bounds.lo)],
-                        x_hi_perc);
+  Error e_yhi_phi = LinearInterpolate(LoadError(ErrorAt(x_hi, y_hi, p_hi)),
+                                      LoadError(ErrorAt(x_lo, y_hi, p_hi)),
+                                      x_hi_perc);
+  Error e_yhi_plo = LinearInterpolate(LoadError(ErrorAt(x_hi, y_hi, p_lo)),
+                                      LoadError(ErrorAt(x_lo, y_hi, p_lo)),
+                                      x_hi_perc);
+  Error e_ylo_phi = LinearInterpolate(LoadError(ErrorAt(x_hi, y_lo, p_hi)),
+                                      LoadError(ErrorAt(x_lo, y_lo, p_hi)),
+                                      x_hi_perc);
+  Error e_ylo_plo = LinearInterpolate(LoadError(ErrorAt(x_hi, y_lo, p_lo)),
+                                      LoadError(ErrorAt(x_lo, y_lo, p_lo)),
+                                      x_hi_perc);
 
   // Interpolate along the y-axis
-  float y_hi_perc = (finger_y - y_range_[y_bounds.lo]) /
-                    (y_range_[y_bounds.hi] - y_range_[y_bounds.lo]);
   Error e_plo = LinearInterpolate(e_yhi_plo, e_ylo_plo, y_hi_perc);
   Error e_phi = LinearInterpolate(e_yhi_phi, e_ylo_phi, y_hi_perc);
 
   // Finally, interpolate along the p-axis
-  float p_hi_perc = (finger_p - p_range_[p_bounds.lo]) /
-                    (p_range_[p_bounds.hi] - p_range_[p_bounds.lo]);
-  Error error = LinearInterpolate(e_phi, e_plo, p_hi_perc);
+  return LinearInterpolate(e_phi, e_plo, p_hi_perc);
+}
 
-  return error;
+NonLinearityFilterInterpreter::NonLinearityFilterInterpreter(
+                                                        PropRegistry* prop_reg,
+                                                        Interpreter* next,
+                                                        Tracer* tracer)
+    : FilterInterpreter(NULL, next, tracer, false),
+      enabled_(prop_reg, "Enable non-linearity correction", false),
+      data_location_(prop_reg, "Non-linearity correction data file", "None") {
+  InitName();
+  LoadData();
+}
+
+void NonLinearityFilterInterpreter::LoadData() {
+  table_ = NonLinearityTable::Open(data_location_.val_);
+  if (!table_)
+    Log("Unable to open non-linearity filter data '%s'", data_location_.val_);
 }
 
-NonLinearityFilterInterpreter::Bounds
-NonLinearityFilterInterpreter::FindBounds(
-    float value,
-    const std::unique_ptr<double[]>& range,
-    size_t len) const {
-  Bounds bounds;
-  bounds.lo = bounds.hi = -1;
-
-  for (size_t i = 0; i < len; i++) {
-    if (range[i] <= value) {
-      bounds.lo = i;
-    } else {
-      bounds.hi = i;
-      break;
+void NonLinearityFilterInterpreter::SyncInterpretImpl(HardwareState* hwstate,
+                                                      stime_t* timeout) {
+  if (enabled_.val_ && table_ && hwstate->finger_cnt == 1) {
+    FingerState* finger = &(hwstate->fingers[0]);
+    if (finger) {
+      NonLinearityTable::Error error = table_->GetError(
+          finger->position_x, finger->position_y, finger->pressure);
+      finger->position_x -= error.x_error;
+      finger->position_y -= error.y_error;
     }
   }
-
-  return bounds;
+  next_->SyncInterpret(hwstate, timeout);
 }
 
 }  // namespace gestures
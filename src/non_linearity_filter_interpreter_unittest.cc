@@ -2,8 +2,17 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
 #include <gtest/gtest.h>
 
+#include "gestures/include/file_util.h"
 #include "gestures/include/gestures.h"
 #include "gestures/include/non_linearity_filter_interpreter.h"
 #include "gestures/include/unittest_util.h"
@@ -104,4 +113,200 @@ TEST(NonLinearityFilterInterpreterTest, HWstateNoChangesNeededTest) {
   EXPECT_FLOAT_EQ(hwstates[1].fingers[0].position_y, 0.5);
 }
 
+namespace {
+
+template<typename T>
+void AppendValue(T value, std::string* table) {
+  table->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void AppendRange(const std::vector<double>& range, std::string* table) {
+  AppendValue(static_cast<int32_t>(range.size()), table);
+  for (size_t i = 0; i < range.size(); i++)
+    AppendValue(range[i], table);
+}
+
+// Writes |table| to a temporary file and opens it.
+std::shared_ptr<const NonLinearityTable> OpenTable(const std::string& table) {
+  char filename[] = "/tmp/gestures_non_linearity_XXXXXX";
+  int fd = mkstemp(filename);
+  if (fd < 0)
+    return std::shared_ptr<const NonLinearityTable>();
+  close(fd);
+  WriteFile(filename, table.data(), table.size());
+  std::shared_ptr<const NonLinearityTable> opened =
+      NonLinearityTable::Open(filename);
+  unlink(filename);
+  return opened;
+}
+
+// Finds the errors of a table the simplest way, as the interpreter first
+// did: with linear searches for the samples around a point, and blending one
+// error at a time.
+class ReferenceTable {
+ public:
+  typedef NonLinearityTable::Error Error;
+
+  // |data| must be a well-formed table.
+  explicit ReferenceTable(const std::string& data) {
+    size_t pos = 0;
+    for (size_t axis = 0; axis < 3; axis++) {
+      int32_t len;
+      memcpy(&len, &data[pos], sizeof(len));
+      pos += sizeof(len);
+      ranges_[axis].resize(len);
+      memcpy(&ranges_[axis][0], &data[pos], len * sizeof(double));
+      pos += len * sizeof(double);
+    }
+    errors_.resize(ranges_[0].size() * ranges_[1].size() *
+                   ranges_[2].size());
+    memcpy(&errors_[0], &data[pos], errors_.size() * sizeof(Error));
+  }
+
+  Error GetError(float x, float y, float p) const {
+    Error error = { 0, 0 };
+    size_t x_lo, y_lo, p_lo;
+    float x_hi_perc, y_hi_perc, p_hi_perc;
+    if (!FindCell(ranges_[0], x, &x_lo, &x_hi_perc) ||
+        !FindCell(ranges_[1], y, &y_lo, &y_hi_perc) ||
+        !FindCell(ranges_[2], p, &p_lo, &p_hi_perc))
+      return error;
+    size_t x_hi = x_lo + 1, y_hi = y_lo + 1, p_hi = p_lo + 1;
+    Error e_yhi_phi = Interpolate(At(x_hi, y_hi, p_hi), At(x_lo, y_hi, p_hi),
+                                  x_hi_perc);
+    Error e_yhi_plo = Interpolate(At(x_hi, y_hi, p_lo), At(x_lo, y_hi, p_lo),
+                                  x_hi_perc);
+    Error e_ylo_phi = Interpolate(At(x_hi, y_lo, p_hi), At(x_lo, y_lo, p_hi),
+                                  x_hi_perc);
+    Error e_ylo_plo = Interpolate(At(x_hi, y_lo, p_lo), At(x_lo, y_lo, p_lo),
+                                  x_hi_perc);
+    Error e_plo = Interpolate(e_yhi_plo, e_ylo_plo, y_hi_perc);
+    Error e_phi = Interpolate(e_yhi_phi, e_ylo_phi, y_hi_perc);
+    return Interpolate(e_phi, e_plo, p_hi_perc);
+  }
+
+ private:
+  static bool FindCell(const std::vector<double>& range, float value,
+                       size_t* lo, float* frac) {
+    for (size_t i = 1; i < range.size(); i++) {
+      if (range[i - 1] <= value && value < range[i]) {
+        *lo = i - 1;
+        *frac = (value - range[i - 1]) / (range[i] - range[i - 1]);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static Error Interpolate(const Error& p1, const Error& p2,
+                           float percent_p1) {
+    Error ret;
+    ret.x_error = percent_p1 * p1.x_error + (1.0 - percent_p1) * p2.x_error;
+    ret.y_error = percent_p1 * p1.y_error + (1.0 - percent_p1) * p2.y_error;
+    return ret;
+  }
+
+  const Error& At(size_t x, size_t y, size_t p) const {
+    return errors_[(x * ranges_[1].size() + y) * ranges_[2].size() + p];
+  }
+
+  std::vector<double> ranges_[3];  // x, y and p
+  std::vector<Error> errors_;
+};
+
+// Checks GetError() against ReferenceTable on |data|, the table's contents,
+// on a grid of points that covers the sampled range and goes past it.
+void ExpectSameErrors(const NonLinearityTable& table,
+                      const std::string& data) {
+  ReferenceTable reference(data);
+  for (float x = -0.125; x <= 1.125; x += 0.0625)
+    for (float y = -0.125; y <= 1.125; y += 0.0625)
+      for (float p = -0.125; p <= 1.125; p += 0.03125) {
+        NonLinearityTable::Error error = table.GetError(x, y, p);
+        NonLinearityTable::Error expected = reference.GetError(x, y, p);
+        EXPECT_EQ(expected.x_error, error.x_error) << x << ", " << y << ", "
+                                                   << p;
+        EXPECT_EQ(expected.y_error, error.y_error) << x << ", " << y << ", "
+                                                   << p;
+      }
+}
+
+}  // namespace
+
+TEST(NonLinearityFilterInterpreterTest, UniformTableTest) {
+  std::shared_ptr<const NonLinearityTable> table =
+      NonLinearityTable::Open(kTestNonlinearData);
+  ASSERT_TRUE(table.get());
+  std::string data;
+  ASSERT_TRUE(ReadFileToString(kTestNonlinearData, &data));
+  ExpectSameErrors(*table, data);
+  NonLinearityTable::Error error = table->GetError(0.1, 0.3, 0.2);
+  EXPECT_FLOAT_EQ(0.325, error.x_error);
+  EXPECT_FLOAT_EQ(-0.325, error.y_error);
+}
+
+TEST(NonLinearityFilterInterpreterTest, NonUniformTableTest) {
+  std::vector<double> x_range = { 0.0, 0.1, 0.5, 0.55, 1.0 };
+  std::vector<double> y_range = { 0.0, 1.0 };
+  // Repeated samples are allowed.
+  std::vector<double> p_range = { 0.0, 0.3, 0.3, 0.9 };
+  std::string table;
+  AppendRange(x_range, &table);
+  AppendRange(y_range, &table);
+  AppendRange(p_range, &table);
+  size_t count = x_range.size() * y_range.size() * p_range.size();
+  for (size_t i = 0; i < count; i++) {
+    AppendValue(0.01 * i, &table);
+    AppendValue(-0.02 * (i % 7), &table);
+  }
+  std::shared_ptr<const NonLinearityTable> opened = OpenTable(table);
+  ASSERT_TRUE(opened.get());
+  ExpectSameErrors(*opened, table);
+
+  // Too few errors.
+  EXPECT_FALSE(OpenTable(table.substr(0, table.size() - 1)).get());
+  // Out of order.
+  std::swap(x_range[1], x_range[2]);
+  table.clear();
+  AppendRange(x_range, &table);
+  AppendRange(y_range, &table);
+  AppendRange(p_range, &table);
+  table.append(count * 2 * sizeof(double), '\0');
+  EXPECT_FALSE(OpenTable(table).get());
+}
+
+// A table is read in, so changing its file doesn't affect it.
+TEST(NonLinearityFilterInterpreterTest, ChangedFileTest) {
+  std::string table;
+  ASSERT_TRUE(ReadFileToString(kTestNonlinearData, &table));
+  char filename[] = "/tmp/gestures_non_linearity_XXXXXX";
+  int fd = mkstemp(filename);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  WriteFile(filename, table.data(), table.size());
+  std::shared_ptr<const NonLinearityTable> opened =
+      NonLinearityTable::Open(filename);
+  ASSERT_TRUE(opened.get());
+  NonLinearityTable::Error before = opened->GetError(0.9, 0.9, 0.9);
+  ASSERT_EQ(0, truncate(filename, 0));
+  NonLinearityTable::Error after = opened->GetError(0.9, 0.9, 0.9);
+  unlink(filename);
+  EXPECT_EQ(before.x_error, after.x_error);
+  EXPECT_EQ(before.y_error, after.y_error);
+}
+
+TEST(NonLinearityFilterInterpreterTest, SharedTableTest) {
+  NonLinearityFilterInterpreter first(
+      NULL, new NonLinearityFilterInterpreterTestInterpreter, NULL);
+  NonLinearityFilterInterpreter second(
+      NULL, new NonLinearityFilterInterpreterTestInterpreter, NULL);
+  first.data_location_.val_ = kTestNonlinearData;
+  first.LoadData();
+  second.data_location_.val_ = kTestNonlinearData;
+  second.LoadData();
+  ASSERT_TRUE(first.table_.get());
+  EXPECT_EQ(first.table_.get(), second.table_.get());
+  EXPECT_FALSE(NonLinearityTable::Open("/nonexistent/table").get());
+}
+
 }  // namespace gestures
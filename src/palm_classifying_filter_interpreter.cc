@@ -6,6 +6,7 @@
 
 #include "gestures/include/gestures.h"
 #include "gestures/include/interpreter.h"
+#include "gestures/include/interpreter_state.h"
 #include "gestures/include/tracer.h"
 #include "gestures/include/util.h"
 
@@ -15,6 +16,15 @@ PalmClassifyingFilterInterpreter::PalmClassifyingFilterInterpreter(
     PropRegistry* prop_reg, Interpreter* next,
     Tracer* tracer)
     : FilterInterpreter(NULL, next, tracer, false),
+      max_pressure_(&finger_slots_),
+      max_width_(&finger_slots_),
+      distance_positive_{{&finger_slots_}, {&finger_slots_}},
+      distance_negative_{{&finger_slots_}, {&finger_slots_}},
+      palm_(&finger_slots_),
+      non_stationary_palm_(&finger_slots_),
+      pointing_(&finger_slots_),
+      was_near_other_fingers_(&finger_slots_),
+      fingers_not_in_edge_(&finger_slots_),
       palm_pressure_(prop_reg, "Palm Pressure", 200.0),
       palm_width_(prop_reg, "Palm Width", 21.2),
       multi_palm_width_(prop_reg, "Multiple Palm Width", 75.0),
@@ -45,6 +55,7 @@ PalmClassifyingFilterInterpreter::PalmClassifyingFilterInterpreter(
 void PalmClassifyingFilterInterpreter::SyncInterpretImpl(
     HardwareState* hwstate,
     stime_t* timeout) {
+  finger_slots_.Update(*hwstate);
   FillOriginInfo(*hwstate);
   FillMaxPressureWidthInfo(*hwstate);
   UpdateDistanceInfo(*hwstate);
@@ -321,4 +332,43 @@ stime_t PalmClassifyingFilterInterpreter::FingerAge(short finger_id,
   return now - origin_timestamps_[finger_id];
 }
 
+void PalmClassifyingFilterInterpreter::SaveOwnState(
+    StateWriter* writer) const {
+  writer->Write(origin_timestamps_);
+  writer->Write(origin_fingerstates_);
+  writer->Write(prev_fingerstates_);
+  finger_slots_.SaveState(writer);
+  max_pressure_.SaveState(writer);
+  max_width_.SaveState(writer);
+  for (size_t i = 0; i < arraysize(distance_positive_); i++) {
+    distance_positive_[i].SaveState(writer);
+    distance_negative_[i].SaveState(writer);
+  }
+  palm_.SaveState(writer);
+  non_stationary_palm_.SaveState(writer);
+  pointing_.SaveState(writer);
+  was_near_other_fingers_.SaveState(writer);
+  fingers_not_in_edge_.SaveState(writer);
+  writer->Write(prev_time_);
+}
+
+void PalmClassifyingFilterInterpreter::RestoreOwnState(StateReader* reader) {
+  reader->Read(&origin_timestamps_);
+  reader->Read(&origin_fingerstates_);
+  reader->Read(&prev_fingerstates_);
+  finger_slots_.RestoreState(reader);
+  max_pressure_.RestoreState(reader);
+  max_width_.RestoreState(reader);
+  for (size_t i = 0; i < arraysize(distance_positive_); i++) {
+    distance_positive_[i].RestoreState(reader);
+    distance_negative_[i].RestoreState(reader);
+  }
+  palm_.RestoreState(reader);
+  non_stationary_palm_.RestoreState(reader);
+  pointing_.RestoreState(reader);
+  was_near_other_fingers_.RestoreState(reader);
+  fingers_not_in_edge_.RestoreState(reader);
+  reader->Read(&prev_time_);
+}
+
 }  // namespace gestures
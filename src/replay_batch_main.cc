@@ -0,0 +1,311 @@
+// Copyright (c) 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Replays a corpus of activity logs in parallel and reports, for each log,
+// whether replaying it produces the gestures it recorded. Like
+// tools/replay_log, but for directories of logs and with a summary of the
+// gesture differences rather than a gtest failure.
+//
+// Each worker thread builds its own GestureInterpreter, and so its own
+// PropRegistry, Tracer and interpreter chain, for every log it replays.
+// Workers start with an even share of the logs and steal from each other
+// once they run out, so a few long logs don't leave cores idle.
+//
+// Usage: replay_batch [--device=touchpad|mouse|multitouch_mouse]
+//                     [--jobs=N] [--only_honor=Props] [--max_diff_lines=N]
+//                     [--verbose] dir|log [dir|log ...]
+// Directories are searched recursively. Exits with 1 if any log fails.
+
+#include <dirent.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gestures/include/activity_replay.h"
+#include "gestures/include/binary_log_reader.h"
+#include "gestures/include/command_line.h"
+#include "gestures/include/file_util.h"
+#include "gestures/include/finger_metrics.h"
+#include "gestures/include/gestures.h"
+#include "gestures/include/interpreter.h"
+#include "gestures/include/prop_registry.h"
+#include "gestures/include/string_util.h"
+
+using std::string;
+
+namespace gestures {
+
+namespace {
+
+// Set from --verbose. Otherwise errors logged by the library are only
+// counted, per log.
+bool verbose = false;
+std::mutex output_lock;
+
+struct LogResult {
+  LogResult() : parsed(false), errors(0) {}
+  bool passed() const {
+    return parsed && !diff.missing && !diff.unexpected;
+  }
+  string path;
+  bool parsed;
+  size_t errors;  // Errors logged by the library during the replay
+  ActivityReplay::GestureDiff diff;
+};
+
+// The result that errors logged on this thread are counted against.
+thread_local LogResult* current_result = NULL;
+
+// Runs jobs 0 to |num_jobs| - 1 on |num_workers| threads. Each worker takes
+// jobs from the front of its own queue, then steals from the back of the
+// others' queues, which holds their largest remaining share.
+class WorkStealingPool {
+ public:
+  WorkStealingPool(size_t num_workers, size_t num_jobs)
+      : queues_(num_workers) {
+    for (size_t i = 0; i < num_workers; i++) {
+      queues_[i].reset(new Queue);
+      for (size_t job = num_jobs * i / num_workers;
+           job < num_jobs * (i + 1) / num_workers; job++)
+        queues_[i]->jobs.push_back(job);
+    }
+  }
+
+  // Calls |runner|->RunJob(job) for every job and returns once all are done.
+  template<typename Runner>
+  void Run(Runner* runner) {
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < queues_.size(); i++)
+      threads.push_back(std::thread(&WorkStealingPool::Work<Runner>, this,
+                                    runner, i));
+    for (size_t i = 0; i < threads.size(); i++)
+      threads[i].join();
+  }
+
+ private:
+  struct Queue {
+    std::mutex lock;
+    std::deque<size_t> jobs;
+  };
+
+  template<typename Runner>
+  void Work(Runner* runner, size_t worker) {
+    size_t job;
+    while (Take(worker, &job))
+      runner->RunJob(job);
+  }
+
+  bool Take(size_t worker, size_t* out) {
+    {
+      Queue* own = queues_[worker].get();
+      std::lock_guard<std::mutex> lock(own->lock);
+      if (!own->jobs.empty()) {
+        *out = own->jobs.front();
+        own->jobs.pop_front();
+        return true;
+      }
+    }
+    for (size_t i = 1; i < queues_.size(); i++) {
+      Queue* victim = queues_[(worker + i) % queues_.size()].get();
+      std::lock_guard<std::mutex> lock(victim->lock);
+      if (!victim->jobs.empty()) {
+        *out = victim->jobs.back();
+        victim->jobs.pop_back();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::vector<std::unique_ptr<Queue> > queues_;
+};
+
+class LogReplayer {
+ public:
+  LogReplayer(GestureInterpreterDeviceClass device,
+              const std::set<string>& honor_props,
+              std::vector<LogResult>* results)
+      : device_(device), honor_props_(honor_props), results_(results) {}
+
+  void RunJob(size_t idx) {
+    LogResult* result = &(*results_)[idx];
+    current_result = result;
+    GestureInterpreter* gi = NewGestureInterpreter();
+    gi->Initialize(device_);
+    Interpreter* interpreter = gi->interpreter();
+    if (interpreter) {
+      MetricsProperties mprops(gi->prop_reg());
+      ActivityReplay replay(gi->prop_reg());
+      replay.set_report_failures(false);
+      // Binary logs are replayed straight from the mapped file.
+      BinaryLogReader reader;
+      string contents;
+      if (reader.Open(result->path.c_str())) {
+        result->parsed = replay.ParseBinaryInfo(reader, honor_props_) &&
+            replay.ReplayBinary(&reader, interpreter, &mprops);
+      } else if (ReadFileToString(result->path.c_str(), &contents) &&
+                 replay.Parse(contents, honor_props_)) {
+        replay.Replay(interpreter, &mprops);
+        result->parsed = true;
+      }
+      result->diff = replay.gesture_diff();
+    }
+    DeleteGestureInterpreter(gi);
+    current_result = NULL;
+  }
+
+ private:
+  GestureInterpreterDeviceClass device_;
+  const std::set<string>& honor_props_;
+  std::vector<LogResult>* results_;
+};
+
+// Appends the regular files under |path|, or |path| itself if it's a file,
+// to |out|. Hidden files and directories are skipped.
+void FindLogs(const string& path, std::vector<string>* out) {
+  struct stat st;
+  if (stat(path.c_str(), &st) < 0) {
+    fprintf(stderr, "Unable to stat %s\n", path.c_str());
+    return;
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    out->push_back(path);
+    return;
+  }
+  DIR* dir = opendir(path.c_str());
+  if (!dir) {
+    fprintf(stderr, "Unable to open %s\n", path.c_str());
+    return;
+  }
+  std::vector<string> children;
+  while (struct dirent* ent = readdir(dir)) {
+    if (ent->d_name[0] != '.')
+      children.push_back(path + "/" + ent->d_name);
+  }
+  closedir(dir);
+  std::sort(children.begin(), children.end());
+  for (size_t i = 0; i < children.size(); i++)
+    FindLogs(children[i], out);
+}
+
+GestureInterpreterDeviceClass ParseDevice(const string& name) {
+  if (name.empty() || name == "touchpad")
+    return GESTURES_DEVCLASS_TOUCHPAD;
+  if (name == "mouse")
+    return GESTURES_DEVCLASS_MOUSE;
+  if (name == "multitouch_mouse")
+    return GESTURES_DEVCLASS_MULTITOUCH_MOUSE;
+  return GESTURES_DEVCLASS_UNKNOWN;
+}
+
+}  // namespace
+
+int ReplayBatchMain() {
+  CommandLine* cl = CommandLine::ForCurrentProcess();
+  GestureInterpreterDeviceClass device =
+      ParseDevice(cl->GetSwitchValueASCII("device"));
+  if (device == GESTURES_DEVCLASS_UNKNOWN) {
+    fprintf(stderr, "Unknown --device: %s\n",
+            cl->GetSwitchValueASCII("device").c_str());
+    return 1;
+  }
+  verbose = cl->HasSwitch("verbose");
+  // Same default as tools/replay_log.
+  string only_honor = "Tap Enable,Sensitivity";
+  if (cl->HasSwitch("only_honor"))
+    only_honor = cl->GetSwitchValueASCII("only_honor");
+  std::vector<string> honor_props;
+  if (!only_honor.empty())
+    SplitString(only_honor, ',', &honor_props);
+  std::set<string> honor_props_set(honor_props.begin(), honor_props.end());
+  size_t jobs = std::thread::hardware_concurrency();
+  if (cl->HasSwitch("jobs"))
+    jobs = atoi(cl->GetSwitchValueASCII("jobs").c_str());
+  if (!jobs)
+    jobs = 1;
+  size_t max_diff_lines = 10;
+  if (cl->HasSwitch("max_diff_lines"))
+    max_diff_lines = atoi(cl->GetSwitchValueASCII("max_diff_lines").c_str());
+
+  CommandLine::StringVector args = cl->GetArgs();
+  if (args.empty()) {
+    fprintf(stderr, "usage: %s [--device=touchpad|mouse|multitouch_mouse] "
+            "[--jobs=N] [--only_honor=Props] [--max_diff_lines=N] "
+            "[--verbose] dir|log [dir|log ...]\n",
+            cl->GetProgram().c_str());
+    return 1;
+  }
+  std::vector<string> paths;
+  for (size_t i = 0; i < args.size(); i++)
+    FindLogs(args[i], &paths);
+
+  std::vector<LogResult> results(paths.size());
+  for (size_t i = 0; i < paths.size(); i++)
+    results[i].path = paths[i];
+  LogReplayer replayer(device, honor_props_set, &results);
+  WorkStealingPool pool(std::min(jobs, std::max<size_t>(paths.size(), 1)),
+                        paths.size());
+  pool.Run(&replayer);
+
+  size_t passed = 0;
+  for (size_t i = 0; i < results.size(); i++) {
+    const LogResult& result = results[i];
+    if (!result.parsed) {
+      printf("FAIL %s: unable to parse\n", result.path.c_str());
+      continue;
+    }
+    const ActivityReplay::GestureDiff& diff = result.diff;
+    printf("%s %s: %zu matched, %zu missing, %zu unexpected gestures",
+           result.passed() ? "PASS" : "FAIL", result.path.c_str(),
+           diff.matched, diff.missing, diff.unexpected);
+    if (result.errors)
+      printf(", %zu errors logged", result.errors);
+    printf("\n");
+    if (result.passed()) {
+      passed++;
+      continue;
+    }
+    for (size_t j = 0; j < diff.lines.size() && j < max_diff_lines; j++)
+      printf("  %s\n", diff.lines[j].c_str());
+    if (diff.lines.size() > max_diff_lines)
+      printf("  ... %zu more\n", diff.lines.size() - max_diff_lines);
+  }
+  printf("%zu of %zu logs passed\n", passed, results.size());
+  return passed == results.size() ? 0 : 1;
+}
+
+}  // namespace gestures
+
+int main(int argc, char** argv) {
+  gestures::CommandLine::Init(argc, argv);
+  return gestures::ReplayBatchMain();
+}
+
+extern "C" {
+
+void gestures_log(int verb, const char* fmt, ...) {
+  if (verb != GESTURES_LOG_ERROR)
+    return;
+  if (gestures::current_result)
+    gestures::current_result->errors++;
+  if (!gestures::verbose)
+    return;
+  std::lock_guard<std::mutex> lock(gestures::output_lock);
+  va_list args;
+  va_start(args, fmt);
+  vfprintf(stderr, fmt, args);
+  va_end(args);
+}
+
+}
@@ -75,7 +75,10 @@ void ScalingFilterInterpreter::FilterLowPressure(HardwareState* hwstate) {
         touch_cnt--;
     }
   }
-  hwstate->finger_cnt = finger_cnt;
+  if (finger_cnt != hwstate->finger_cnt) {
+    hwstate->finger_cnt = finger_cnt;
+    hwstate->FingersChanged();
+  }
   hwstate->touch_cnt = touch_cnt;
 }
 
@@ -91,7 +94,10 @@ void ScalingFilterInterpreter::FilterZeroArea(HardwareState* hwstate) {
         touch_cnt--;
     }
   }
-  hwstate->finger_cnt = finger_cnt;
+  if (finger_cnt != hwstate->finger_cnt) {
+    hwstate->finger_cnt = finger_cnt;
+    hwstate->FingersChanged();
+  }
   hwstate->touch_cnt = touch_cnt;
 }
 
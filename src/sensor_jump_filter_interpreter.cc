@@ -4,6 +4,7 @@
 
 #include "gestures/include/sensor_jump_filter_interpreter.h"
 
+#include "gestures/include/interpreter_state.h"
 #include "gestures/include/tracer.h"
 #include "gestures/include/util.h"
 
@@ -133,4 +134,18 @@ void SensorJumpFilterInterpreter::SyncInterpretImpl(HardwareState* hwstate,
   next_->SyncInterpret(hwstate, timeout);
 }
 
+void SensorJumpFilterInterpreter::SaveOwnState(StateWriter* writer) const {
+  for (size_t i = 0; i < arraysize(previous_input_); i++)
+    writer->Write(previous_input_[i]);
+  for (size_t i = 0; i < arraysize(first_flag_); i++)
+    writer->Write(first_flag_[i]);
+}
+
+void SensorJumpFilterInterpreter::RestoreOwnState(StateReader* reader) {
+  for (size_t i = 0; i < arraysize(previous_input_); i++)
+    reader->Read(&previous_input_[i]);
+  for (size_t i = 0; i < arraysize(first_flag_); i++)
+    reader->Read(&first_flag_[i]);
+}
+
 }  // namespace gestures
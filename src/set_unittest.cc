@@ -2,9 +2,12 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <string.h>
+
 #include <gtest/gtest.h>
 
 #include "gestures/include/set.h"
+#include "gestures/include/unittest_util.h"
 
 namespace gestures {
 
@@ -174,4 +177,34 @@ TEST(SetTest, SetSubtractTest) {
   DoSetSubtractTest<set<short, 4>, set<short, 2>>();
 }
 
+TEST(SetTest, RemoveMissingIdsFromSetTest) {
+  // More fingers than fit in one chunk of FindValueIndex().
+  const size_t kFingers = 2 * kFindShortChunk + 1;
+  FingerState fs[kFingers];
+  memset(fs, 0, sizeof(fs));
+  for (size_t i = 0; i < kFingers; i++)
+    fs[i].tracking_id = 100 + i;
+  HardwareState hs = make_hwstate(0.0, 0, kFingers, kFingers, fs);
+
+  set<short, kFingers + 2> the_set;
+  the_set.insert(99);
+  for (size_t i = 0; i < kFingers; i++)
+    the_set.insert(100 + i);
+  the_set.insert(100 + kFingers);
+  RemoveMissingIdsFromSet(&the_set, hs);
+  EXPECT_EQ(kFingers, the_set.size());
+  EXPECT_FALSE(SetContainsValue(the_set, 99));
+  EXPECT_TRUE(SetContainsValue(the_set, 100 + kFingers - 1));
+  EXPECT_FALSE(SetContainsValue(the_set, 100 + kFingers));
+
+  hs.finger_cnt = hs.touch_cnt = 1;
+  RemoveMissingIdsFromSet(&the_set, hs);
+  EXPECT_EQ(1, the_set.size());
+  EXPECT_TRUE(SetContainsValue(the_set, 100));
+
+  hs.finger_cnt = hs.touch_cnt = 0;
+  RemoveMissingIdsFromSet(&the_set, hs);
+  EXPECT_TRUE(the_set.empty());
+}
+
 }  // namespace gestures
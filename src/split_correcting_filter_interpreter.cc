@@ -6,6 +6,7 @@
 
 #include <math.h>
 
+#include "gestures/include/interpreter_state.h"
 #include "gestures/include/tracer.h"
 #include "gestures/include/util.h"
 
@@ -260,6 +261,7 @@ void SplitCorrectingFilterInterpreter::UpdateHwState(
     if (unmerged && unmerged->Valid()) {
       // Easier case. Just update tracking id
       fs->tracking_id = unmerged->output_id;
+      hwstate->FingersChanged();
       continue;
     }
     const MergedContact* merged = FindMerged(fs->tracking_id);
@@ -275,6 +277,7 @@ void SplitCorrectingFilterInterpreter::UpdateHwState(
       JoinFingerState(fs, *other_fs);
       fs->tracking_id = merged->output_id;
       RemoveFingerStateFromHardwareState(hwstate, other_fs);
+      hwstate->FingersChanged();
       continue;
     }
     Err("Neither unmerged nor merged?");
@@ -374,4 +377,16 @@ void SplitCorrectingFilterInterpreter::Dump(
     Log("  %d", hwstate.fingers[i].tracking_id);
 }
 
+void SplitCorrectingFilterInterpreter::SaveOwnState(StateWriter* writer) const {
+  writer->Write(last_tracking_ids_);
+  writer->Write(unmerged_);
+  writer->Write(merged_);
+}
+
+void SplitCorrectingFilterInterpreter::RestoreOwnState(StateReader* reader) {
+  reader->Read(&last_tracking_ids_);
+  reader->Read(&unmerged_);
+  reader->Read(&merged_);
+}
+
 };  // namespace gestures
@@ -6,6 +6,7 @@
 
 #include "gestures/include/gestures.h"
 #include "gestures/include/interpreter.h"
+#include "gestures/include/interpreter_state.h"
 #include "gestures/include/map.h"
 #include "gestures/include/tracer.h"
 #include "gestures/include/util.h"
@@ -142,4 +143,13 @@ void StationaryWiggleFilterInterpreter::UpdateStationaryFlags(
   }
 }
 
+void StationaryWiggleFilterInterpreter::SaveOwnState(
+    StateWriter* writer) const {
+  writer->Write(histories_);
+}
+
+void StationaryWiggleFilterInterpreter::RestoreOwnState(StateReader* reader) {
+  reader->Read(&histories_);
+}
+
 }  // namespace gestures
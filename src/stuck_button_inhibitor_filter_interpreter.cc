@@ -4,6 +4,7 @@
 
 #include "gestures/include/stuck_button_inhibitor_filter_interpreter.h"
 
+#include "gestures/include/interpreter_state.h"
 #include "gestures/include/logging.h"
 #include "gestures/include/tracer.h"
 
@@ -93,4 +94,20 @@ void StuckButtonInhibitorFilterInterpreter::HandleTimeouts(
   }
 }
 
+void StuckButtonInhibitorFilterInterpreter::SaveOwnState(
+    StateWriter* writer) const {
+  writer->Write(incoming_button_must_be_up_);
+  writer->Write(sent_buttons_down_);
+  writer->Write(next_expects_timer_);
+  writer->Write(result_);
+}
+
+void StuckButtonInhibitorFilterInterpreter::RestoreOwnState(
+    StateReader* reader) {
+  reader->Read(&incoming_button_must_be_up_);
+  reader->Read(&sent_buttons_down_);
+  reader->Read(&next_expects_timer_);
+  reader->Read(&result_);
+}
+
 }  // namespace gestures
@@ -4,6 +4,8 @@
 
 #include "gestures/include/t5r2_correcting_filter_interpreter.h"
 
+#include "gestures/include/interpreter_state.h"
+
 namespace gestures {
 
 // Takes ownership of |next|:
@@ -30,4 +32,14 @@ void T5R2CorrectingFilterInterpreter::SyncInterpretImpl(
   next_->SyncInterpret(hwstate, timeout);
 }
 
+void T5R2CorrectingFilterInterpreter::SaveOwnState(StateWriter* writer) const {
+  writer->Write(last_finger_cnt_);
+  writer->Write(last_touch_cnt_);
+}
+
+void T5R2CorrectingFilterInterpreter::RestoreOwnState(StateReader* reader) {
+  reader->Read(&last_finger_cnt_);
+  reader->Read(&last_touch_cnt_);
+}
+
 };  // namespace gestures
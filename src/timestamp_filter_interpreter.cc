@@ -6,6 +6,7 @@
 
 #include <math.h>
 
+#include "gestures/include/interpreter_state.h"
 #include "gestures/include/logging.h"
 #include "gestures/include/tracer.h"
 
@@ -68,4 +69,18 @@ void TimestampFilterInterpreter::ConsumeGesture(const Gesture& gs) {
   ProduceGesture(copy);
 }
 
+void TimestampFilterInterpreter::SaveOwnState(StateWriter* writer) const {
+  writer->Write(prev_msc_timestamp_);
+  writer->Write(msc_timestamp_offset_);
+  writer->Write(fake_timestamp_);
+  writer->Write(skew_);
+}
+
+void TimestampFilterInterpreter::RestoreOwnState(StateReader* reader) {
+  reader->Read(&prev_msc_timestamp_);
+  reader->Read(&msc_timestamp_offset_);
+  reader->Read(&fake_timestamp_);
+  reader->Read(&skew_);
+}
+
 }  // namespace gestures
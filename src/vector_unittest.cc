@@ -77,4 +77,33 @@ TEST(VectorTest, FilterEditTest) {
   ExpectGrowingVectorOfSize(vector, 7);
 }
 
+// Short vectors are searched in chunks; check every position around the
+// chunk boundaries, with and without stale values past the end.
+TEST(VectorTest, FindShortTest) {
+  const size_t kMax = 2 * kFindShortChunk + 3;
+  vector<short, kMax> vector;
+  for (size_t size = 0; size <= kMax; size++) {
+    vector.clear();
+    for (size_t i = 0; i < kMax; i++)
+      vector.push_back(-1 - i);  // Left behind past the end below
+    vector.clear();
+    for (size_t i = 0; i < size; i++)
+      vector.push_back(3 * i);
+    for (size_t i = 0; i < size; i++)
+      EXPECT_EQ(&vector[i], vector.find(3 * i)) << size << " " << i;
+    EXPECT_EQ(vector.end(), vector.find(1));
+    EXPECT_EQ(vector.end(), vector.find(-1 - size));
+  }
+  // The first match wins.
+  vector.clear();
+  for (size_t i = 0; i < kMax; i++)
+    vector.push_back(i % 4);
+  EXPECT_EQ(&vector[2], vector.find(2));
+
+  // Fewer values than a chunk, with nothing readable past them.
+  short values[] = { 4, 5, 6 };
+  EXPECT_EQ(1, FindValueIndex(values, 3, static_cast<short>(5)));
+  EXPECT_EQ(2, FindValueIndex(values, 2, static_cast<short>(6)));
+}
+
 }  // namespace gestures